@@ -2,9 +2,12 @@
 #include "dxdiag.hpp"
 #include "Yolo.hpp"
 #include "Utils.hpp"
+#include "FramePool.hpp"
+#include "cpu_topology.hpp"
+#include "DetectionJournal.hpp"
+#include "FrameGovernor.hpp"
+#include "Renderer.hpp"
 #include <future>
-#include <mutex>
-#include <condition_variable>
 
 int main()
 {
@@ -15,20 +18,27 @@ int main()
     if (!setUpEnv())
         return -1;
 
-    constexpr int targetFps = 30;
-    constexpr int frameDelayMs = 1000 / targetFps;
+    const CT::CpuTopology topology = CT::DiscoverTopology();
+    const CT::ThreadLayout layout = CT::PlanLayout(topology);
+    CT::StartupReport(topology, layout);
+    CT::ApplyLayout(layout);
+
+    // Full rate while the picture moves, backing off to the minimum once it has been still for a while
+    FrameGovernor::Options governor_options;
+    governor_options.min_fps = 2.0;
+    governor_options.max_fps = 30.0;
+    FrameGovernor governor(governor_options.FromEnvironment());
     long long frameCount = 0;
     bool quit = false;
 
     std::future<void> yolo_future;
-    std::mutex frame_mutex;
-    std::condition_variable c_var;
-    std::atomic<bool> frame_processed;
+
+    FramePool &frame_pool = FramePool::Instance();
 
     YOLO model = YOLO();
-    model.HardwareSummary();
     try {
         model.Init();
+        model.Warmup();
     }
     catch (const cv::Exception& e) {
         errorHandler(std::format("Failed to load model: {}", e.msg));
@@ -37,6 +47,12 @@ int main()
         errorHandler(std::format("Failed to Load model: {}", e.what()));
         return -1;
     }
+    model.HardwareSummary();
+
+    // Every frame's detections go to the journal, journal_query answers what was on screen when
+    DetectionJournal journal(std::filesystem::current_path() / "journal", model.ClassNames());
+    // Preview windows live on the renderer's thread, one per monitor
+    Renderer renderer(model.ClassNames());
 
     while (!quit)
     {
@@ -49,29 +65,52 @@ int main()
         }
         LOG("DXGI Initialized successfully.");
 
-        int width = 0, height = 0;
-        std::vector<BYTE> pixelBuffer;
+        // One buffer per monitor; an output whose screen did not change keeps no frame this round
+        std::vector<cv::Mat> frames(ctx.outputs.size());
         bool duplication_active = true;
         int consecutive_failures = 0;
         constexpr int MAX_CONSECUTIVE_FAILURES = 5;
 
         while (!quit)
         {
-            auto startTime = std::chrono::high_resolution_clock::now();
-            if (!DG::GetScreenPixelsDXGI(ctx.pDesktopDupl, ctx.pDevice, ctx.pImmediateContext, width, height, pixelBuffer))
+            auto startTime = std::chrono::steady_clock::now();
+            if (renderer.QuitRequested())
             {
+                quit = true;
+                break;
+            }
+            std::vector<cv::Mat> batch;
+            std::vector<uint32_t> batch_ids;
+            bool access_lost = false;
+            for (size_t i = 0; i < ctx.outputs.size(); ++i)
+            {
+                const DG::OutputDuplication &output = ctx.outputs[i];
+                if (DG::GetScreenPixelsDXGI(output.pDupl, ctx.pDevice, ctx.pImmediateContext, frames[i]) && !frames[i].empty())
+                {
+                    // Each grab lands in its own recycled buffer, so the worker takes the BGRA frame as is;
+                    // YOLO drops the alpha channel while building the blob and imshow accepts BGRA
+                    batch.push_back(std::move(frames[i]));
+                    batch_ids.push_back(output.id);
+                    continue;
+                }
                 DXGI_OUTDUPL_FRAME_INFO frameInfoCheck;
                 IDXGIResource *resourceCheck = nullptr;
-                HRESULT checkHr = ctx.pDesktopDupl->AcquireNextFrame(0, &frameInfoCheck, &resourceCheck);
+                HRESULT checkHr = output.pDupl->AcquireNextFrame(0, &frameInfoCheck, &resourceCheck);
+                if (SUCCEEDED(checkHr))
+                    output.pDupl->ReleaseFrame();
                 DG::SafeRelease(&resourceCheck);
+                access_lost = access_lost || checkHr == DXGI_ERROR_ACCESS_LOST;
+            }
 
-                if (checkHr == DXGI_ERROR_ACCESS_LOST)
-                {
-                    LOG_ERR("Desktop Duplication access lost. Re-initializing DXGI and YOLO setup...");
-                    duplication_active = false;
-                    break;
-                }
+            if (access_lost)
+            {
+                LOG_ERR("Desktop Duplication access lost. Re-initializing DXGI and YOLO setup...");
+                duplication_active = false;
+                break;
+            }
 
+            if (batch.empty())
+            {
                 consecutive_failures++;
                 if (consecutive_failures >= MAX_CONSECUTIVE_FAILURES)
                 {
@@ -85,65 +124,49 @@ int main()
             }
 
             consecutive_failures = 0;
+            governor.Record(FrameGovernor::Stage::Capture, std::chrono::steady_clock::now() - startTime);
+            for (size_t i = 0; i < batch.size(); ++i)
+                governor.Observe(batch[i], batch_ids[i]);
 
-            if (!pixelBuffer.empty())
-            {
-                frameCount++;
-                cv::Mat frame(height, width, CV_8UC4, pixelBuffer.data());
-                cv::Mat frame_bgr;
-                cv::cvtColor(frame, frame_bgr, cv::COLOR_BGRA2BGR);
+            frameCount++;
 
-                try
-                {
-                    cv::Mat display_frame;
-                    frame_processed.store(false);
-                    yolo_future = std::async(std::launch::async, [&model, &frame_processed, &frame_mutex, &c_var, &display_frame, frame_to_process = frame_bgr.clone()]() mutable {
-                        LOG("Processing frame...");
-                        model.ProcessFrame(frame_to_process);
-                        {
-                            std::lock_guard lock(frame_mutex);
-                            display_frame = frame_to_process.clone();
-                        }
-                        frame_processed = true;
-                        frame_processed.store(true);
-                        c_var.notify_one();
-                    });
-
-                    while (!quit) {
-                        {
-                            std::unique_lock lock(frame_mutex);
-                            if (display_frame.empty()) {
-                                c_var.wait(lock,[&frame_processed] {return frame_processed.load();});
-                            };
-                        }
-                        handleWindow("DXGI Feed", display_frame, quit);
-                        if (frame_processed)
-                            break;
+            try
+            {
+                yolo_future = std::async(std::launch::async, [&model, &layout, &journal, &governor, &renderer, frameCount, batch_ids, frames_to_process = std::move(batch)]() {
+                    CT::PinCurrentThread(layout.inference_cpus);
+                    LOG_EVERY_MS(1000, "Processing " << frames_to_process.size() << " output(s)...");
+                    // Monitors that changed go through the network together, tagged with their output id
+                    const auto inference_start = std::chrono::steady_clock::now();
+                    const std::vector<std::vector<Detection>> detections = model.DetectBatch(frames_to_process);
+                    governor.Record(FrameGovernor::Stage::Inference, std::chrono::steady_clock::now() - inference_start);
+                    for (size_t i = 0; i < frames_to_process.size(); ++i)
+                    {
+                        journal.Append(frameCount, detections[i], static_cast<uint8_t>(batch_ids[i]));
+                        renderer.Submit(std::format("DXGI Feed {}", batch_ids[i]), frames_to_process[i], detections[i]);
                     }
-                }
-                catch (const cv::Exception &e)
-                {
-                    LOG_ERR("OpenCV error during YOLO processing: " << e.msg);
-                    LOG_ERR("Attempting to re-initialize DXGI and YOLO due to OpenCV error during processing.");
-                    break;
-                }
-                catch (const std::exception&)
-                {
-                    LOG_ERR("Error during YOLO processing");
-                    break;
-                }
-                
-                // Maintain target frame rate
-                auto endTime = std::chrono::high_resolution_clock::now();
-                if (auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count(); elapsedTime < frameDelayMs)
-                {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(frameDelayMs - elapsedTime));
-                }
+                });
+                yolo_future.get();
+            }
+            catch (const cv::Exception &e)
+            {
+                LOG_ERR("OpenCV error during YOLO processing: " << e.msg);
+                LOG_ERR("Attempting to re-initialize DXGI and YOLO due to OpenCV error during processing.");
+                break;
+            }
+            catch (const std::exception&)
+            {
+                LOG_ERR("Error during YOLO processing");
+                break;
+            }
+            
+            // Cadence follows screen activity and the measured stage latencies
+            governor.Pace(startTime);
 
-                if (frameCount % 100 == 0)
-                {
-                    LOG("Processed " << frameCount << " frames via DXGI.");
-                }
+            if (frameCount % 100 == 0)
+            {
+                LOG("Processed " << frameCount << " frames via DXGI.");
+                LOG(frame_pool.Summary());
+                LOG("Capture rate: " << governor.Summary());
             }
         }
         LOG("Cleaning up DXGI context for this session.");
@@ -157,7 +180,6 @@ int main()
     LOG("Screen capture stopped.");
     if (yolo_future.valid())
         yolo_future.wait();
-    cv::destroyAllWindows(); // Ensure OpenCV windows are closed
     return 0;
 }
 
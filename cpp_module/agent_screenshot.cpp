@@ -1,12 +1,27 @@
 #include "Yolo.hpp"
 #include "Utils.hpp"
 #include "Screenshot.hpp"
+#include "cpu_topology.hpp"
+#include "FrameRing.hpp"
+#include "DetectionJournal.hpp"
+#include "FrameGovernor.hpp"
+#include "Renderer.hpp"
+#include "FrameArchive.hpp"
+#include "AnalysisCache.hpp"
+#include "TopologyDiff.hpp"
+#include "StartupTimeline.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
 #include <future>
+#include <memory>
 
 int main()
 {
     cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_WARNING);
+    StartupTimeline timeline;
 
     if (!setUpEnv())
     {
@@ -19,18 +34,105 @@ int main()
         return -1;
 #endif
 
-    constexpr std::chrono::milliseconds INTERVAL(10000);
+    const auto topology_start = StartupTimeline::Clock::now();
+    const CT::CpuTopology topology = CT::DiscoverTopology();
+    const CT::ThreadLayout layout = CT::PlanLayout(topology);
+    CT::StartupReport(topology, layout);
+    CT::ApplyLayout(layout);
+    timeline.Record("cpu topology", topology_start, StartupTimeline::Clock::now());
 
+    // Probing, model load and warm-up run on their own thread while the capture is set up
     YOLO model = YOLO();
-    model.HardwareSummary();
     LOG("Loading Model...");
-    model.Init();
-    LOG("Model Loaded Successfully...")
-    
+    std::future<void> model_ready = std::async(std::launch::async, [&model, &timeline] {
+        model.Init(false, &timeline);
+        auto phase = timeline.Begin("warm-up");
+        model.Warmup();
+    });
+
+    // Every capture goes to the archive and the journal, so an active screen keeps the old 10 s cadence
+    // and a static one backs off to a minute; POF_MAX_FPS raises the ceiling
+    FrameGovernor::Options governor_options;
+    governor_options.min_fps = 1.0 / 60.0;
+    governor_options.max_fps = 0.1;
+    governor_options.idle_after = std::chrono::seconds(5);
+    FrameGovernor governor(governor_options.FromEnvironment());
+
+    // Successive captures of a monitor are diffed against its previous topology graph; what changed
+    // (recolored, moved, appeared or vanished nodes and links) goes to topology_changes.jsonl, which
+    // rolls over to topology_changes.jsonl.1 once it reaches CHANGE_LOG_BYTES
+    std::map<uint32_t, TopologyDiff> topology_diffs;
+    const std::filesystem::path change_log_path = std::filesystem::current_path() / "topology_changes.jsonl";
+    constexpr std::streamoff CHANGE_LOG_BYTES = 16ll * 1024 * 1024;
+    std::ofstream change_log;
+    uint64_t capture_count{0};
+
     // Initialize Screenshot
     std::string storagePath = "Screenshots";
+    const auto capture_start = StartupTimeline::Clock::now();
     Screenshot screenshot(storagePath);
-    cv::Mat image;
+    timeline.Record("capture open", capture_start, StartupTimeline::Clock::now());
+    std::vector<cv::Mat> images;
+
+    // Captures go into deduplicated pack files under Screenshots/archive (see archive_extract);
+    // POF_SCREENSHOT_FILES=1 keeps writing one PNG per capture and monitor instead
+    const char *loose_files = std::getenv("POF_SCREENSHOT_FILES");
+    std::unique_ptr<FrameArchive> archive;
+    if (loose_files && std::string(loose_files) == "1")
+    {
+        LOG("Saving screenshots as individual files in " << storagePath);
+    }
+    else
+    {
+        screenshot.setSaveFiles(false);
+        archive = std::make_unique<FrameArchive>(std::filesystem::path(storagePath) / "archive");
+        LOG("Archiving screenshots to " << archive->Directory().generic_string());
+    }
+
+    // With POF_SHM_RING set, every capture and its detections are published to that shared memory
+    // ring for the POF service (POST /pof/frame) instead of travelling as base64 PNG
+    const char *ring_name = std::getenv("POF_SHM_RING");
+    std::unique_ptr<FrameRing> ring;
+    constexpr uint32_t RING_SLOTS = 4;
+
+    try
+    {
+        model_ready.get();
+    }
+    catch (const cv::Exception &e)
+    {
+        errorHandler(std::format("Failed to load model: {}", e.msg));
+        return -1;
+    }
+    catch (const std::exception &e)
+    {
+        errorHandler(std::format("Failed to load model: {}", e.what()));
+        return -1;
+    }
+    LOG("Model Loaded Successfully...")
+    model.HardwareSummary();
+    LOG(timeline.Summary());
+    LOG(model.LoadSummary());
+
+    // Only a topology model's detections make a graph to diff
+    const bool diff_topology = TopologyDiff::IsTopologyClassList(model.ClassNames());
+    if (diff_topology)
+        change_log.open(change_log_path, std::ios::app);
+    else
+        LOG("Class list is not a topology model's, topology changes are not tracked");
+
+    // A retrained model copied over models/yolo/<model>.onnx is swapped in without a restart
+    if (const char *watch = std::getenv("POF_MODEL_WATCH"); !watch || std::string(watch) != "0")
+        model.WatchModel();
+
+    DetectionJournal journal(std::filesystem::current_path() / "journal", model.ClassNames());
+    // A screen that has not changed since an earlier capture reuses that capture's detections
+    AnalysisCache<std::vector<Detection>> detection_cache(16ull * 1024 * 1024, [](const std::vector<Detection> &d) {
+        return sizeof(d) + d.size() * sizeof(Detection);
+    });
+    // Detections of a model that has since been swapped out are dropped
+    uint64_t cache_generation = model.GetSwapStats().generation;
+    Renderer renderer(model.ClassNames());
 
     bool quit{false};
     uint16_t retry_count{0};
@@ -42,10 +144,14 @@ int main()
         {
 
             LOG("Capturing screenshot...");
+            // The frames are views into the capture buffers, which the next capture replaces
+            images.clear();
             screenshot.capture();
-            image = screenshot.getImage();
+            images = screenshot.getImages();
+            const std::vector<ScreenOutput> &outputs = screenshot.getOutputs();
+            governor.Record(FrameGovernor::Stage::Capture, std::chrono::steady_clock::now() - start_time);
 
-            if (image.empty())
+            if (images.empty() || std::any_of(images.begin(), images.end(), [](const cv::Mat &m) { return m.empty(); }))
             {
                 LOG_ERR("Image is empty, Retrying...");
                 retry_count++;
@@ -58,14 +164,96 @@ int main()
                 continue;
             }
             retry_count = 0;
+            ++capture_count;
+            const int64_t capture_ns = FrameArchive::NowNs();
+            for (size_t i = 0; i < images.size(); ++i)
+            {
+                governor.Observe(images[i], outputs[i].id);
+                if (archive)
+                    archive->Append(images[i], static_cast<uint8_t>(outputs[i].id), capture_ns);
+            }
 
-            std::future<void> process_frame = std::async(std::launch::async, [&]{model.ProcessFrame(image);});
-            std::future_status status = process_frame.wait_for(std::chrono::milliseconds(10));
-            do 
+            // Created on the first frame, and again if a monitor grows beyond the slot size
+            size_t frame_bytes = 0;
+            for (const cv::Mat &m : images)
+                frame_bytes = std::max(frame_bytes, m.total() * m.elemSize());
+            if (ring_name && (!ring || ring->FrameCapacity() < frame_bytes))
             {
-                handleWindow("Screenshot", image, quit);
-                status = process_frame.wait_for(std::chrono::milliseconds(10));
-            }while(!quit && status != std::future_status::ready);
+                ring.reset();
+                ring = std::make_unique<FrameRing>(ring_name, RING_SLOTS, frame_bytes);
+                LOG("Publishing frames to shared memory ring " << ring_name);
+            }
+
+            // Every monitor goes through the network in one batch; results carry the output id as source
+            std::future<void> process_frame = std::async(std::launch::async, [&]{
+                CT::PinCurrentThread(layout.inference_cpus);
+                const auto inference_start = std::chrono::steady_clock::now();
+                const uint64_t generation = model.GetSwapStats().generation;
+                if (generation != cache_generation)
+                {
+                    detection_cache.Clear();
+                    cache_generation = generation;
+                }
+                std::vector<std::vector<Detection>> detections(images.size());
+                std::vector<uint64_t> keys(images.size());
+                std::vector<cv::Mat> misses;
+                std::vector<size_t> miss_index;
+                for (size_t i = 0; i < images.size(); ++i)
+                {
+                    keys[i] = detection_cache.KeyOf(images[i]);
+                    if (const auto cached = detection_cache.Find(keys[i]))
+                        detections[i] = *cached;
+                    else
+                    {
+                        misses.push_back(images[i]);
+                        miss_index.push_back(i);
+                    }
+                }
+                if (!misses.empty())
+                {
+                    std::vector<std::vector<Detection>> fresh = model.DetectBatch(misses);
+                    // A swap during the batch may have produced these with either network
+                    const bool same_model = model.GetSwapStats().generation == generation;
+                    for (size_t m = 0; m < misses.size(); ++m)
+                    {
+                        detections[miss_index[m]] = fresh[m];
+                        if (same_model)
+                            detection_cache.Insert(keys[miss_index[m]], std::move(fresh[m]));
+                    }
+                }
+                governor.Record(FrameGovernor::Stage::Inference, std::chrono::steady_clock::now() - inference_start);
+                for (size_t i = 0; i < images.size(); ++i)
+                {
+                    const uint32_t output_id = outputs[i].id;
+                    journal.Append(capture_count, detections[i], static_cast<uint8_t>(output_id));
+                    if (diff_topology)
+                    {
+                        TopologyDiff &diff = topology_diffs.try_emplace(output_id, model.ClassNames()).first->second;
+                        if (const TD::ChangeEvent event = diff.Update(images[i], detections[i], capture_count, capture_ns, static_cast<uint8_t>(output_id)); !event.Empty())
+                        {
+                            if (change_log.tellp() >= CHANGE_LOG_BYTES)
+                            {
+                                change_log.close();
+                                std::error_code ec;
+                                std::filesystem::rename(change_log_path, change_log_path.string() + ".1", ec);
+                                if (ec)
+                                    LOG_ERR("Failed to rotate " << change_log_path.generic_string() << ": " << ec.message());
+                                change_log.open(change_log_path, std::ios::app);
+                            }
+                            change_log << event.ToJson() << std::endl;
+                            LOG("Topology of output " << outputs[i].name << (event.new_view ? ": new view, " : ": ") << event.changes.size() << " changes, " << event.unchanged << " unchanged");
+                        }
+                    }
+                    if (ring)
+                    {
+                        const uint64_t seq = ring->Publish(images[i], detections[i], output_id);
+                        DEV_LOG("Published frame " << seq << " of output " << outputs[i].name << " to " << ring->Name());
+                    }
+                    // The preview is downscaled here, the capture buffers are free again once this returns
+                    renderer.Submit(images.size() == 1 ? "Screenshot" : "Screenshot " + outputs[i].name, images[i], detections[i]);
+                }
+            });
+            process_frame.get();
         }
         catch (const std::exception &e)
         {
@@ -80,13 +268,16 @@ int main()
             continue;
         }
 
-        auto end_time = std::chrono::steady_clock::now();
-        if (auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count(); elapsed_time < INTERVAL.count())
+        governor.Pace(start_time);
+        quit = quit || renderer.QuitRequested();
+        LOG_EVERY_MS(60000, "Capture rate: " << governor.Summary());
+        LOG_EVERY_MS(60000, "Detection cache: " << detection_cache.Summary());
+        LOG_EVERY_MS(60000, "Memory: " << CurrentProcessMemory().Summary());
+        if (archive)
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(INTERVAL.count() - elapsed_time));
+            LOG_EVERY_MS(60000, "Archive: " << archive->DuplicateFrames() << " duplicate and " << archive->DroppedFrames() << " dropped frames");
         }
     }
 
-    cv::destroyAllWindows();
     return 0;
 }
\ No newline at end of file
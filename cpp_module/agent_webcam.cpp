@@ -1,26 +1,344 @@
 #include "Yolo.hpp"
+#include "FramePool.hpp"
+#include "cpu_topology.hpp"
+#include "DetectionJournal.hpp"
+#include "FrameGovernor.hpp"
+#include "Renderer.hpp"
+#include "StartupTimeline.hpp"
+#include "InferenceScheduler.hpp"
+#include <algorithm>
+#include <cctype>
 #include <string>
 #include <future>
-#include <mutex>
-#include <condition_variable>
+#include <memory>
+#include <optional>
+#include <thread>
 #ifdef  _WIN32
 #include "dxdiag.hpp"
 #endif
+#if defined(__linux__)
+#include "V4l2Capture.hpp"
+#endif
+
+// agent_webcam                              webcam 0, mirrored, paced by the frame governor
+// agent_webcam <source> [<source> ...]      several cameras or files sharing one model
+//              [--batch N] [--unpaced]
+//
+// A source is a camera index or a video file / stream URL. Every source is read on its own capture
+// thread and the frames of all of them are batched into one network by the inference scheduler.
+// Files are played at their own frame rate unless --unpaced, which reads them as fast as detection
+// keeps up and shows the throughput the machine reaches. Cameras drop their oldest queued frame
+// when detection falls behind, files wait for it.
+//
+// On Linux cameras (an index or /dev/videoN) and recorded .mjpeg streams are read through
+// V4l2Capture, configured with the POF_V4L2_* variables; POF_V4L2=0 uses cv::VideoCapture instead.
+
+namespace
+{
+    bool WaitForModel(std::future<void> &model_ready)
+    {
+        try {
+            model_ready.get();
+        }
+        catch (const cv::Exception& e) {
+            errorHandler(std::format("Failed to load model: {}", e.msg));
+            return false;
+        }catch (const std::exception& e) {
+            errorHandler(std::format("Failed to Load model: {}", e.what()));
+            return false;
+        }
+        return true;
+    }
+
+    // A retrained model copied over models/yolo/<model>.onnx is swapped in without a restart; POF_MODEL_WATCH=0 turns that off
+    void WatchModel(YOLO &model)
+    {
+        if (const char *watch = std::getenv("POF_MODEL_WATCH"); !watch || std::string(watch) != "0")
+            model.WatchModel();
+    }
+
+#if defined(__linux__)
+    // Null when POF_V4L2=0 or the device cannot be negotiated, the caller falls back to cv::VideoCapture
+    std::unique_ptr<V4l2Capture> OpenV4l2(const std::string &device, std::optional<double> fps = std::nullopt)
+    {
+        if (const char *enabled = std::getenv("POF_V4L2"); enabled && std::string(enabled) == "0")
+            return nullptr;
+        try
+        {
+            V4l2Capture::Options options;
+            options.device = device;
+            options = options.FromEnvironment();
+            options.fps = fps.value_or(options.fps);
+            return std::make_unique<V4l2Capture>(options);
+        }
+        catch (const std::exception &e)
+        {
+            LOG("V4L2 capture unavailable, falling back to OpenCV: " << e.what());
+            return nullptr;
+        }
+    }
+#endif
+
+    struct Source
+    {
+        std::string name;
+        bool camera = false;
+        cv::VideoCapture capture;
+#if defined(__linux__)
+        std::unique_ptr<V4l2Capture> v4l2;
+#endif
+
+        cv::Size FrameSize() const
+        {
+#if defined(__linux__)
+            if (this->v4l2)
+                return this->v4l2->FrameSize();
+#endif
+            return {static_cast<int>(this->capture.get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(this->capture.get(cv::CAP_PROP_FRAME_HEIGHT))};
+        }
+    };
+
+    bool OpenSource(Source &source, const std::string &spec, bool paced)
+    {
+        const bool camera = !spec.empty() && std::all_of(spec.begin(), spec.end(), [](unsigned char c) { return std::isdigit(c); });
+        source.camera = camera;
+#if defined(__linux__)
+        const std::string extension = std::filesystem::path(spec).extension().string();
+        if (camera || spec.starts_with("/dev/video") || extension == ".mjpeg" || extension == ".mjpg")
+        {
+            const bool device = camera || spec.starts_with("/dev/video");
+            source.name = camera ? "Webcam " + spec : std::filesystem::path(spec).filename().string();
+            // Recordings carry no frame rate, they play at POF_V4L2_FPS
+            source.v4l2 = OpenV4l2(camera ? "/dev/video" + spec : spec, device || paced ? std::nullopt : std::optional<double>(0.0));
+            source.camera = device;
+            if (source.v4l2)
+                return true;
+        }
+#else
+        (void)paced;
+#endif
+        if (camera)
+        {
+            source.name = "Webcam " + spec;
+#if defined(_WIN32)
+            source.capture.open(std::stoi(spec), cv::CAP_DSHOW);
+#elif defined(__linux__)
+            source.capture.open(std::stoi(spec), cv::CAP_V4L2);
+#else
+            source.capture.open(std::stoi(spec));
+#endif
+        }
+        else
+        {
+            source.name = std::filesystem::path(spec).filename().string();
+            source.capture.open(spec);
+        }
+        return source.capture.isOpened();
+    }
+
+    int RunMultiSource(const std::vector<std::string> &args, YOLO &model, std::future<void> &model_ready, const CT::ThreadLayout &layout,
+                       StartupTimeline &timeline)
+    {
+        size_t batch = 0;
+        bool paced = true;
+        std::vector<std::string> specs;
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            if (args[i] == "--unpaced")
+                paced = false;
+            else if (args[i] == "--batch" && i + 1 < args.size())
+                batch = std::stoul(args[++i]);
+            else
+                specs.push_back(args[i]);
+        }
+        if (specs.empty() || specs.size() > UINT8_MAX + 1)
+        {
+            errorHandler(std::format("Expected between 1 and {} sources", UINT8_MAX + 1));
+            return -1;
+        }
+
+        std::vector<Source> sources(specs.size());
+        {
+            auto phase = timeline.Begin("sources open");
+            for (size_t i = 0; i < specs.size(); ++i)
+            {
+                if (!OpenSource(sources[i], specs[i], paced))
+                {
+                    errorHandler(std::format("Failed to open source {}", specs[i]));
+                    return -1;
+                }
+                const cv::Size size = sources[i].FrameSize();
+                LOG("Opened " << sources[i].name << " at " << size.width << "x" << size.height);
+            }
+        }
+
+        if (!WaitForModel(model_ready))
+            return -1;
+        model.HardwareSummary();
+        LOG(timeline.Summary());
+        LOG(model.LoadSummary());
+        WatchModel(model);
+
+        DetectionJournal journal(std::filesystem::current_path() / "journal", model.ClassNames());
+        Renderer renderer(model.ClassNames());
+
+        InferenceScheduler::Options scheduler_options;
+        // One frame of every source per batch unless told otherwise or yolo_tune measured a better size
+        if (batch == 0 && model.Profile())
+            batch = static_cast<size_t>(model.Profile()->batch);
+        scheduler_options.max_batch = batch > 0 ? batch : std::min<size_t>(sources.size(), 8);
+        scheduler_options.thread_init = [&layout] { CT::PinCurrentThread(layout.inference_cpus); };
+        InferenceScheduler scheduler(model, scheduler_options);
+
+        std::vector<uint8_t> ids;
+        for (Source &source : sources)
+        {
+            InferenceScheduler::SourceOptions source_options;
+            source_options.drop = source.camera ? InferenceScheduler::DropPolicy::DropOldest : InferenceScheduler::DropPolicy::Block;
+            source_options.mirror = source.camera;
+            // The journal's source id is the scheduler's
+            const uint8_t id = static_cast<uint8_t>(ids.size());
+            ids.push_back(scheduler.AddSource(
+                source.name,
+                [&journal, &renderer, &source, id](const cv::Mat &frame, uint64_t frame_id, const std::vector<Detection> &detections) {
+                    journal.Append(frame_id, detections, id);
+                    renderer.Submit(source.name, frame, detections, source.camera);
+                },
+                source_options));
+        }
+
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> capture_threads;
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            capture_threads.emplace_back([&scheduler, &layout, &stop, &source = sources[i], id = ids[i], paced] {
+                CT::PinCurrentThread(layout.capture_cpus);
+#if defined(__linux__)
+                // Decodes into pooled frames of its own and paces recordings itself
+                if (source.v4l2)
+                {
+                    V4l2Capture::Frame frame;
+                    uint64_t frame_id = 0;
+                    while (!stop.load(std::memory_order_relaxed) && source.v4l2->Read(frame))
+                        scheduler.Submit(id, frame.image, ++frame_id);
+                    if (const std::string error = source.v4l2->Error(); !error.empty())
+                    {
+                        LOG_ERR(error);
+                    }
+                    scheduler.CloseSource(id);
+                    LOG(source.v4l2->Summary());
+                    return;
+                }
+#endif
+                FramePool &frame_pool = FramePool::Instance();
+                const cv::Size size = source.FrameSize();
+                // Enough buffers for the queue, the batch in flight and the one being read
+                frame_pool.Preallocate(size, CV_8UC3, 4);
+
+                const double fps = source.capture.get(cv::CAP_PROP_FPS);
+                const bool pace = paced && !source.camera && fps > 0;
+                const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(pace ? 1.0 / fps : 0.0));
+                auto next = std::chrono::steady_clock::now();
 
-int main()
+                uint64_t frame_id = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    // The scheduler keeps the previous frame until its result is out, so every read gets a fresh buffer
+                    cv::Mat frame = frame_pool.Acquire(size, CV_8UC3);
+                    if (!source.capture.read(frame) || frame.empty())
+                    {
+                        if (source.camera)
+                        {
+                            LOG_ERR(source.name << " disconnected or failed to deliver frames");
+                        }
+                        break;
+                    }
+                    scheduler.Submit(id, frame, ++frame_id);
+                    if (pace)
+                    {
+                        next += period;
+                        std::this_thread::sleep_until(next);
+                    }
+                }
+                scheduler.CloseSource(id);
+                LOG(source.name << " ended after " << frame_id << " frames");
+            });
+        }
+
+        auto last_report = std::chrono::steady_clock::now();
+        while (!renderer.QuitRequested() && !scheduler.Failed() && !scheduler.Idle())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (const auto now = std::chrono::steady_clock::now(); now - last_report >= std::chrono::seconds(5))
+            {
+                LOG(scheduler.Summary());
+                last_report = now;
+            }
+        }
+
+        // Block sources may be waiting on the scheduler, it has to stop before they can be joined
+        stop = true;
+        scheduler.Stop();
+#if defined(__linux__)
+        // Wakes the capture threads blocked in Read()
+        for (Source &source : sources)
+        {
+            if (source.v4l2)
+                source.v4l2->Stop();
+        }
+#endif
+        for (std::thread &thread : capture_threads)
+            thread.join();
+        for (Source &source : sources)
+            source.capture.release();
+
+        if (scheduler.Failed())
+        {
+            LOG_ERR("Inference stopped: " << scheduler.Error());
+        }
+        LOG(scheduler.Summary());
+        LOG(FramePool::Instance().Summary());
+        LOG("Webcam Feed Ended");
+        return scheduler.Failed() ? -1 : 0;
+    }
+}
+
+int main(int argc, char **argv)
 {
 #ifdef _WIN32
     DG::enableANSIColors();
 #endif
     cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_WARNING);
+    StartupTimeline timeline;
 
     if (!setUpEnv()) {
         std::cin.get();
         return -1;
     }
 
-    constexpr int targetFps = 30;
-    constexpr int frameDelayMs = 1000 / targetFps;
+    const auto topology_start = StartupTimeline::Clock::now();
+    const CT::CpuTopology topology = CT::DiscoverTopology();
+    const CT::ThreadLayout layout = CT::PlanLayout(topology);
+    CT::StartupReport(topology, layout);
+    CT::ApplyLayout(layout);
+    timeline.Record("cpu topology", topology_start, StartupTimeline::Clock::now());
+
+    // Probing, model load and warm-up run on their own thread while the camera opens
+    YOLO model = YOLO();
+    std::future<void> model_ready = std::async(std::launch::async, [&model, &timeline] {
+        model.Init(false, &timeline);
+        auto phase = timeline.Begin("warm-up");
+        model.Warmup();
+    });
+
+    if (argc > 1)
+        return RunMultiSource(std::vector<std::string>(argv + 1, argv + argc), model, model_ready, layout, timeline);
+
+    // Full rate while the picture moves, backing off to the minimum once it has been still for a while
+    FrameGovernor::Options governor_options;
+    governor_options.min_fps = 5.0;
+    governor_options.max_fps = 30.0;
+    FrameGovernor governor(governor_options.FromEnvironment());
     long long frameCount = 0;
     bool quit = false;
 
@@ -28,30 +346,41 @@ int main()
     cv::VideoCapture webcam;
     constexpr int16_t MAX_INIT_ATTEMPTS = 3;
     bool webcam_initialized = false;
+#if defined(__linux__)
+    // Negotiates 1280x720 up front, the OpenCV path below switches after the first frame
+    std::unique_ptr<V4l2Capture> v4l2;
+#endif
 
-    for (int attempt = 0; attempt < MAX_INIT_ATTEMPTS && !webcam_initialized; attempt++)
     {
-        if (attempt > 0)
+        auto phase = timeline.Begin("camera open");
+#if defined(__linux__)
+        v4l2 = OpenV4l2("/dev/video0");
+        webcam_initialized = v4l2 != nullptr;
+#endif
+        for (int attempt = 0; attempt < MAX_INIT_ATTEMPTS && !webcam_initialized; attempt++)
         {
-            LOG("Retrying webcam initialization...");
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        }
+            if (attempt > 0)
+            {
+                LOG("Retrying webcam initialization...");
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            }
 
-// cv::CAP_DSHOW
+            // cv::CAP_DSHOW
 #if defined(_WIN32)
-        webcam = cv::VideoCapture(0, cv::CAP_DSHOW);
+            webcam = cv::VideoCapture(0, cv::CAP_DSHOW);
 #elif defined(__linux__)
-        webcam = cv::VideoCapture(0 + cv::CAP_V4L2);
+            webcam = cv::VideoCapture(0 + cv::CAP_V4L2);
 #endif
-        if (webcam.isOpened())
-        {
-            // Quick check if we can get a frame
-            if (cv::Mat test_frame; webcam.read(test_frame))
+            if (webcam.isOpened())
             {
-                webcam_initialized = true;
-                int actual_width = webcam.get(cv::CAP_PROP_FRAME_WIDTH);
-                int actual_height = webcam.get(cv::CAP_PROP_FRAME_HEIGHT);
-                LOG("Webcam initialized at default resolution: " << actual_width << "x" << actual_height);
+                // Quick check if we can get a frame
+                if (cv::Mat test_frame; webcam.read(test_frame))
+                {
+                    webcam_initialized = true;
+                    int actual_width = webcam.get(cv::CAP_PROP_FRAME_WIDTH);
+                    int actual_height = webcam.get(cv::CAP_PROP_FRAME_HEIGHT);
+                    LOG("Webcam initialized at default resolution: " << actual_width << "x" << actual_height);
+                }
             }
         }
     }
@@ -64,45 +393,63 @@ int main()
 
     LOG("Webcam Initialized successfully at default resolution");
 
-    YOLO model = YOLO();
-    model.HardwareSummary();
-    try {
-        model.Init();
-    }
-    catch (const cv::Exception& e) {
-        errorHandler(std::format("Failed to load model: {}", e.msg));
-        return -1;
-    }catch (const std::exception& e) {
-        errorHandler(std::format("Failed to Load model", e.what()));
+    if (!WaitForModel(model_ready))
         return -1;
-    }
+    model.HardwareSummary();
+    LOG(timeline.Summary());
+    LOG(model.LoadSummary());
+    WatchModel(model);
 
-    // Create window after webcam is initialized
+    DetectionJournal journal(std::filesystem::current_path() / "journal", model.ClassNames());
+
+    // Preview windows live on the renderer's thread
     static const std::string windowName = "Webcam Live Feed";
-    cv::namedWindow(windowName, cv::WINDOW_NORMAL);
+    Renderer renderer(model.ClassNames());
 
-    // For thread-safe frame handling between YOLO processing and display
-    std::mutex frame_mutex;
     std::future<void> yolo_future;
-    std::condition_variable c_var;
-    std::atomic<bool> frame_processed;
-    cv::Mat display_frame;
 
-    // Phase 2: Switch to high resolution after first frame
+    // Capture lands in a reused buffer that inference reads directly, mirroring while it builds the blob.
+    // Only the downscaled preview is flipped.
+    FramePool &frame_pool = FramePool::Instance();
+    cv::Mat captured;
     bool high_res_initialized = false;
+#if defined(__linux__)
+    high_res_initialized = v4l2 != nullptr;
+    if (!v4l2)
+#endif
+        frame_pool.Preallocate(cv::Size(static_cast<int>(webcam.get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(webcam.get(cv::CAP_PROP_FRAME_HEIGHT))), CV_8UC3, 3);
+
+    // Phase 2: Switch to high resolution after first frame
     int high_res_attempts = 0;
 
     while (!quit)
     {
-        auto startTime = std::chrono::high_resolution_clock::now();
+        auto startTime = std::chrono::steady_clock::now();
+        // When the frame was taken, for the latency from sensor to detections
+        auto captured_at = startTime;
 
-        cv::Mat frame_bgr;
-        webcam >> frame_bgr;
-        cv::flip(frame_bgr, frame_bgr, 1);
+#if defined(__linux__)
+        if (v4l2)
+        {
+            if (V4l2Capture::Frame frame; v4l2->Read(frame))
+            {
+                captured = std::move(frame.image);
+                captured_at = frame.captured;
+            }
+            else
+            {
+                captured.release();
+            }
+        }
+        else
+#endif
+            webcam >> captured;
 
-        if (!frame_bgr.empty())
+        if (!captured.empty())
         {
             frameCount++;
+            governor.Record(FrameGovernor::Stage::Capture, std::chrono::steady_clock::now() - startTime);
+            governor.Observe(captured);
             // Try to switch to high resolution after first successful frame
             if (constexpr int MAX_HIGH_RES_ATTEMPTS = 3; !high_res_initialized && high_res_attempts < MAX_HIGH_RES_ATTEMPTS)
             {
@@ -119,7 +466,6 @@ int main()
                     if (new_width >= 1280 && new_height >= 720)
                     {
                         high_res_initialized = true;
-                        cv::resizeWindow(windowName, webcam.get(cv::CAP_PROP_FRAME_WIDTH), webcam.get(cv::CAP_PROP_FRAME_HEIGHT));
                         LOG("Successfully switched to high resolution: " << new_width << "x" << new_height);
                     }
                     else
@@ -136,31 +482,20 @@ int main()
 
             try
             {
-                frame_processed.store(false);
-                yolo_future = std::async(std::launch::async, [&model, &frame_processed, &frame_mutex, &c_var, &display_frame, frame_to_process = frame_bgr.clone()]() mutable {
-                    LOG("Processing frame...");
-                    model.ProcessFrame(frame_to_process);
-                    {
-                        std::lock_guard lock(frame_mutex);
-                        display_frame = frame_to_process.clone();
-                    }
-                    frame_processed = true;
-                    frame_processed.store(true);
-                    c_var.notify_one();
+                // The capture loop waits for this task before reading into captured again
+                yolo_future = std::async(std::launch::async, [&model, &layout, &journal, &governor, &renderer, frameCount, captured_at, frame_to_process = captured]() {
+                    CT::PinCurrentThread(layout.inference_cpus);
+                    LOG_EVERY_MS(1000, "Processing frame...");
+                    const auto inference_start = std::chrono::steady_clock::now();
+                    const std::vector<Detection> detections = model.Detect(frame_to_process, true);
+                    governor.Record(FrameGovernor::Stage::Inference, std::chrono::steady_clock::now() - inference_start);
+                    LOG_EVERY_MS(5000, "Capture to detections: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - captured_at).count() << " ms");
+                    journal.Append(frameCount, detections);
+                    // Flipped after downscaling, the boxes are in mirrored coordinates already
+                    renderer.Submit(windowName, frame_to_process, detections, true);
                 });
-
-                while (!quit) {
-                    {
-                        std::unique_lock lock(frame_mutex);
-                        if (display_frame.empty()) {
-                            c_var.wait(lock,[&frame_processed] {return frame_processed.load();});
-                        };
-                    }
-                    handleWindow(windowName, display_frame, quit);
-                    if (frame_processed)
-                        break;
-                }
-
+                yolo_future.get();
+                quit = renderer.QuitRequested();
             }
             catch (const cv::Exception &e)
             {
@@ -173,11 +508,7 @@ int main()
                 quit = true;
             }
 
-            auto endTime = std::chrono::high_resolution_clock::now();
-            if (auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count(); elapsedTime < frameDelayMs)
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(frameDelayMs - elapsedTime));
-            }
+            governor.Pace(startTime);
         }
         else
         {
@@ -193,7 +524,15 @@ int main()
     }
 
     webcam.release();
-    cv::destroyAllWindows();
+#if defined(__linux__)
+    if (v4l2)
+    {
+        v4l2->Stop();
+        LOG(v4l2->Summary());
+    }
+#endif
+    LOG(frame_pool.Summary());
+    LOG("Capture rate: " << governor.Summary());
     LOG("Webcam Feed Ended");
     return 0;
 }
@@ -0,0 +1,156 @@
+#include "FrameArchive.hpp"
+#include "Utils.hpp"
+#include <format>
+#include <fstream>
+#include <limits>
+
+// Lists or extracts frames from a screenshot archive written by agent_screenshot.
+//
+// usage: archive_extract <archive_dir> [--from <time>] [--to <time>] [--source <n>] [--limit <n>]
+//                        [--out <dir> | --list | --segments]
+//
+// <time> is local time as "YYYY-MM-DD HH:MM[:SS]" or "HH:MM[:SS]" for today. Frames are written to
+// --out (default "extracted") as <yyyymmdd_hhmmss_mmm>_<source><ext> with the bytes exactly as
+// stored, so nothing is re-encoded. --list prints the matching frames, --segments the pack files.
+
+namespace
+{
+    enum class Mode
+    {
+        Extract,
+        List,
+        Segments
+    };
+
+    struct Options
+    {
+        std::filesystem::path archive_dir;
+        std::filesystem::path out_dir = "extracted";
+        std::string from;
+        std::string to;
+        std::optional<int> source_id;
+        size_t limit = 0;
+        Mode mode = Mode::Extract;
+    };
+
+    bool ParseArgs(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--from" && has_value)
+                options.from = argv[++i];
+            else if (arg == "--to" && has_value)
+                options.to = argv[++i];
+            else if (arg == "--source" && has_value)
+                options.source_id = std::stoi(argv[++i]);
+            else if (arg == "--limit" && has_value)
+                options.limit = std::stoul(argv[++i]);
+            else if (arg == "--out" && has_value)
+                options.out_dir = argv[++i];
+            else if (arg == "--list")
+                options.mode = Mode::List;
+            else if (arg == "--segments")
+                options.mode = Mode::Segments;
+            else if (options.archive_dir.empty() && !arg.starts_with("--"))
+                options.archive_dir = arg;
+            else
+                return false;
+        }
+        return !options.archive_dir.empty();
+    }
+
+    std::string FileStamp(int64_t timestamp_ns)
+    {
+        // "YYYY-MM-DD HH:MM:SS.mmm" to something every filesystem accepts
+        std::string stamp = FormatLocalTime(timestamp_ns);
+        for (char &c : stamp)
+        {
+            if (c == ' ' || c == '.')
+                c = '_';
+        }
+        std::erase_if(stamp, [](char c) { return c == '-' || c == ':'; });
+        return stamp;
+    }
+
+    void ListSegments(const ArchiveReader &reader)
+    {
+        uint64_t total_bytes = 0;
+        size_t total_frames = 0;
+        for (const FA::SegmentInfo &segment : reader.Segments())
+        {
+            total_bytes += segment.pack_bytes;
+            total_frames += segment.frame_count;
+            if (segment.frame_count == 0)
+            {
+                std::cout << std::format("{}  (empty)\n", segment.pack.filename().string());
+                continue;
+            }
+            std::cout << std::format("{}  {} .. {}  {} frames  {} bytes  {}\n", segment.pack.filename().string(), FormatLocalTime(segment.min_ts_ns),
+                                     FormatLocalTime(segment.max_ts_ns), segment.frame_count, segment.pack_bytes, segment.encoding);
+        }
+        if (total_frames > 0)
+            std::cout << std::format("{} segments, {} frames, {:.1f} KB per frame\n", reader.Segments().size(), total_frames,
+                                     static_cast<double>(total_bytes) / static_cast<double>(total_frames) / 1024.0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!ParseArgs(argc, argv, options))
+    {
+        std::cerr << "usage: archive_extract <archive_dir> [--from <time>] [--to <time>] [--source <n>] [--limit <n>]\n"
+                  << "                       [--out <dir> | --list | --segments]\n"
+                  << "  <time>: \"YYYY-MM-DD HH:MM[:SS]\" or \"HH:MM[:SS]\" (today), local time\n";
+        return 2;
+    }
+
+    try
+    {
+        const ArchiveReader reader(options.archive_dir);
+        if (options.mode == Mode::Segments)
+        {
+            ListSegments(reader);
+            return 0;
+        }
+
+        const int64_t from_ns = options.from.empty() ? std::numeric_limits<int64_t>::min() : ParseLocalTime(options.from);
+        const int64_t to_ns = options.to.empty() ? std::numeric_limits<int64_t>::max() : ParseLocalTime(options.to);
+        std::optional<uint8_t> source_id;
+        if (options.source_id)
+            source_id = static_cast<uint8_t>(*options.source_id);
+        if (options.mode == Mode::Extract)
+            std::filesystem::create_directories(options.out_dir);
+
+        size_t count = 0;
+        reader.ForEachFrame(from_ns, to_ns, source_id, [&](const FA::Frame &frame) {
+            const FA::IndexEntry &e = frame.entry;
+            if (options.mode == Mode::List)
+            {
+                std::cout << std::format("{}  source {}  {}x{}  {} bytes{}\n", FormatLocalTime(e.timestamp_ns), static_cast<int>(e.source_id), e.width, e.height,
+                                         e.bytes, (e.flags & FA::FLAG_DUPLICATE) ? "  (duplicate)" : "");
+            }
+            else
+            {
+                const std::filesystem::path path = options.out_dir / std::format("{}_{}{}", FileStamp(e.timestamp_ns), static_cast<int>(e.source_id), frame.encoding);
+                const std::vector<uchar> bytes = reader.ReadEncoded(frame);
+                std::ofstream ofs(path, std::ios::binary);
+                if (!ofs.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size())))
+                    throw std::runtime_error(std::format("Unable to write {}", path.generic_string()));
+            }
+            ++count;
+            return options.limit == 0 || count < options.limit;
+        });
+
+        if (options.mode == Mode::Extract)
+            LOG("Extracted " << count << " frames to " << options.out_dir.generic_string());
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERR(e.what());
+        return 1;
+    }
+    return 0;
+}
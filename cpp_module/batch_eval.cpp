@@ -0,0 +1,368 @@
+#include "Yolo.hpp"
+#include "Utils.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+
+// Offline re-annotation of a topology image corpus.
+//
+// usage: batch_eval <image_dir> [--out <dir>] [--workers <n>] [--decoders <n>] [--model <name>] [--cpu]
+//
+// Images are decoded on a thread pool and handed to a pool of inference workers, each owning its
+// own YOLO instance. For every image a YOLO-format label file is written to <out>/labels and all
+// detections are collected into <out>/detections.json (COCO results layout).
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        std::filesystem::path image_dir;
+        std::filesystem::path out_dir = "batch_eval";
+        std::string model_name = "yolov8l";
+        size_t workers = 0;
+        size_t decoders = 0;
+        bool cpu_only = false;
+    };
+
+    struct DecodedImage
+    {
+        int64_t image_id = 0;
+        std::filesystem::path path;
+        cv::Mat image;
+    };
+
+    struct ImageResult
+    {
+        int64_t image_id = 0;
+        std::filesystem::path path;
+        cv::Size size;
+        std::vector<Detection> detections;
+    };
+
+    // Stage timings are accumulated in microseconds across all threads
+    struct StageTimes
+    {
+        std::atomic<int64_t> decode_us{0};
+        std::atomic<int64_t> infer_us{0};
+        std::atomic<int64_t> write_us{0};
+    };
+
+    int64_t ElapsedUs(const Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    }
+
+    bool IsImage(const std::filesystem::path &path)
+    {
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp";
+    }
+
+    std::string JsonEscape(const std::string &value)
+    {
+        std::string escaped;
+        escaped.reserve(value.size());
+        for (const char c : value)
+        {
+            switch (c)
+            {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    escaped += std::format("\\u{:04x}", static_cast<int>(c));
+                else
+                    escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    bool ParseCount(const char *text, size_t &count)
+    {
+        try
+        {
+            size_t used = 0;
+            const unsigned long value = std::stoul(text, &used);
+            if (text[used] != '\0')
+                return false;
+            count = value;
+            return true;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+    bool ParseArgs(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--out" && has_value)
+                options.out_dir = argv[++i];
+            else if (arg == "--workers" && has_value)
+            {
+                if (!ParseCount(argv[++i], options.workers))
+                    return false;
+            }
+            else if (arg == "--decoders" && has_value)
+            {
+                if (!ParseCount(argv[++i], options.decoders))
+                    return false;
+            }
+            else if (arg == "--model" && has_value)
+                options.model_name = argv[++i];
+            else if (arg == "--cpu")
+                options.cpu_only = true;
+            else if (options.image_dir.empty() && !arg.starts_with("--"))
+                options.image_dir = arg;
+            else
+                return false;
+        }
+        return !options.image_dir.empty();
+    }
+
+    // YOLO label format: <class> <cx> <cy> <w> <h>, all normalised to the image size
+    void WriteLabelFile(const std::filesystem::path &label_path, const ImageResult &result)
+    {
+        std::ofstream ofs(label_path, std::ios::trunc);
+        if (!ofs.is_open())
+            throw std::runtime_error(std::format("Unable to write label file: {}", label_path.generic_string()));
+
+        const cv::Rect bounds(0, 0, result.size.width, result.size.height);
+        for (const Detection &detection : result.detections)
+        {
+            const cv::Rect box = detection.box & bounds;
+            if (box.empty())
+                continue;
+            const double cx = (box.x + box.width / 2.0) / result.size.width;
+            const double cy = (box.y + box.height / 2.0) / result.size.height;
+            const double w = box.width / static_cast<double>(result.size.width);
+            const double h = box.height / static_cast<double>(result.size.height);
+            ofs << std::format("{} {:.6f} {:.6f} {:.6f} {:.6f}\n", detection.class_id, cx, cy, w, h);
+        }
+    }
+
+    void WriteCocoJson(const std::filesystem::path &json_path, const std::vector<ImageResult> &results, const std::vector<std::string> &class_names)
+    {
+        std::ofstream ofs(json_path, std::ios::trunc);
+        if (!ofs.is_open())
+            throw std::runtime_error(std::format("Unable to write detections file: {}", json_path.generic_string()));
+
+        ofs << "{\n  \"images\": [";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const ImageResult &result = results[i];
+            ofs << (i ? ",\n    " : "\n    ")
+                << std::format(R"({{"id": {}, "file_name": "{}", "width": {}, "height": {}}})",
+                               result.image_id, JsonEscape(result.path.filename().string()), result.size.width, result.size.height);
+        }
+
+        ofs << "\n  ],\n  \"categories\": [";
+        for (size_t i = 0; i < class_names.size(); ++i)
+            ofs << (i ? ",\n    " : "\n    ") << std::format(R"({{"id": {}, "name": "{}"}})", i, JsonEscape(class_names[i]));
+
+        ofs << "\n  ],\n  \"annotations\": [";
+        int64_t annotation_id = 1;
+        bool first = true;
+        for (const ImageResult &result : results)
+        {
+            for (const Detection &detection : result.detections)
+            {
+                const cv::Rect &box = detection.box;
+                ofs << (first ? "\n    " : ",\n    ")
+                    << std::format(R"({{"id": {}, "image_id": {}, "category_id": {}, "bbox": [{}, {}, {}, {}], "area": {}, "score": {:.4f}, "iscrowd": 0}})",
+                                   annotation_id++, result.image_id, detection.class_id, box.x, box.y, box.width, box.height, box.area(), detection.confidence);
+                first = false;
+            }
+        }
+        ofs << "\n  ]\n}\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_WARNING);
+
+    Options options;
+    if (!ParseArgs(argc, argv, options))
+    {
+        LOG_ERR("usage: batch_eval <image_dir> [--out <dir>] [--workers <n>] [--decoders <n>] [--model <name>] [--cpu]");
+        return -1;
+    }
+
+    if (!std::filesystem::is_directory(options.image_dir))
+    {
+        LOG_ERR("Image directory does not exist: " << options.image_dir.generic_string());
+        return -1;
+    }
+
+    if (!setUpEnv())
+        return -1;
+
+    std::vector<std::filesystem::path> image_paths;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(options.image_dir))
+    {
+        if (entry.is_regular_file() && IsImage(entry.path()))
+            image_paths.push_back(entry.path());
+    }
+    std::sort(image_paths.begin(), image_paths.end());
+
+    if (image_paths.empty())
+    {
+        LOG("No images found in " << options.image_dir.generic_string());
+        return 0;
+    }
+
+    const size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+    if (options.workers == 0)
+        options.workers = std::max<size_t>(1, cores / 4);
+    if (options.decoders == 0)
+        options.decoders = std::max<size_t>(1, cores / 4);
+
+    // Each worker runs its own network, so split the cores between them instead of letting
+    // every network spin up a full-width OpenCV pool
+    cv::setNumThreads(static_cast<int>(std::max<size_t>(1, cores / options.workers)));
+
+    const std::filesystem::path labels_dir = options.out_dir / "labels";
+    std::filesystem::create_directories(labels_dir);
+
+    LOG(std::format("Evaluating {} images with {} inference workers and {} decoders", image_paths.size(), options.workers, options.decoders));
+
+    std::vector<std::unique_ptr<YOLO>> models;
+    for (size_t i = 0; i < options.workers; ++i)
+    {
+        auto model = std::make_unique<YOLO>(options.model_name);
+        try
+        {
+            model->Init(options.cpu_only);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERR("Failed to load model: " << e.what());
+            return -1;
+        }
+        models.push_back(std::move(model));
+    }
+    models.front()->HardwareSummary();
+
+    StageTimes times;
+    std::atomic<size_t> failed{0};
+    BoundedQueue<DecodedImage> decoded(options.workers * 4);
+    std::vector<ImageResult> results;
+    std::mutex results_mutex;
+
+    const auto start = Clock::now();
+
+    std::vector<std::thread> inference_workers;
+    for (size_t w = 0; w < options.workers; ++w)
+    {
+        inference_workers.emplace_back([&, model = models[w].get()] {
+            while (std::optional<DecodedImage> item = decoded.Pop())
+            {
+                ImageResult result{item->image_id, item->path, item->image.size(), {}};
+                try
+                {
+                    auto stage_start = Clock::now();
+                    result.detections = model->Detect(item->image);
+                    times.infer_us += ElapsedUs(stage_start);
+
+                    stage_start = Clock::now();
+                    // Mirror the corpus layout so images with the same name in different folders do not collide
+                    std::filesystem::path label_path = labels_dir / std::filesystem::relative(item->path, options.image_dir);
+                    label_path.replace_extension(".txt");
+                    std::filesystem::create_directories(label_path.parent_path());
+                    WriteLabelFile(label_path, result);
+                    times.write_us += ElapsedUs(stage_start);
+                }
+                catch (const std::exception &e)
+                {
+                    LOG_ERR("Failed to process " << item->path.generic_string() << ": " << e.what());
+                    ++failed;
+                    continue;
+                }
+
+                std::lock_guard lock(results_mutex);
+                results.push_back(std::move(result));
+            }
+        });
+    }
+
+    // The workers have to be joined on every way out, a joinable std::thread terminates the process
+    std::string pipeline_error;
+    try
+    {
+        ThreadPool decode_pool(options.decoders);
+        std::vector<std::future<void>> pending;
+        pending.reserve(image_paths.size());
+        for (size_t i = 0; i < image_paths.size(); ++i)
+        {
+            pending.push_back(decode_pool.Submit([&, i] {
+                const auto stage_start = Clock::now();
+                cv::Mat image = cv::imread(image_paths[i].string(), cv::IMREAD_COLOR);
+                times.decode_us += ElapsedUs(stage_start);
+                if (image.empty())
+                {
+                    LOG_ERR("Could not read image: " << image_paths[i].generic_string());
+                    ++failed;
+                    return;
+                }
+                decoded.Push({static_cast<int64_t>(i + 1), image_paths[i], std::move(image)});
+            }));
+        }
+        for (std::future<void> &task : pending)
+            task.get();
+    }
+    catch (const std::exception &e)
+    {
+        pipeline_error = e.what();
+    }
+
+    decoded.Close();
+    for (std::thread &worker : inference_workers)
+        worker.join();
+
+    if (!pipeline_error.empty())
+    {
+        LOG_ERR("Decoding failed: " << pipeline_error);
+        return -1;
+    }
+
+    const double wall_seconds = ElapsedUs(start) / 1e6;
+
+    std::sort(results.begin(), results.end(), [](const ImageResult &a, const ImageResult &b) { return a.image_id < b.image_id; });
+    try
+    {
+        WriteCocoJson(options.out_dir / "detections.json", results, models.front()->ClassNames());
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERR(e.what());
+        return -1;
+    }
+
+    size_t detection_count = 0;
+    for (const ImageResult &result : results)
+        detection_count += result.detections.size();
+
+    // Every image is decoded, failed ones included; only the processed ones reach inference and the writer
+    const double attempted = static_cast<double>(image_paths.size());
+    const double processed = static_cast<double>(std::max<size_t>(1, results.size()));
+    LOG(std::format("Processed {} images ({} failed), {} detections in {:.2f}s", results.size(), failed.load(), detection_count, wall_seconds));
+    LOG(std::format("Throughput: {:.2f} images/sec", results.size() / wall_seconds));
+    LOG(std::format("Mean per image: decode {:.2f} ms, inference {:.2f} ms, write {:.2f} ms",
+                    times.decode_us / attempted / 1000.0, times.infer_us / processed / 1000.0, times.write_us / processed / 1000.0));
+    LOG("Labels written to: " << labels_dir.generic_string());
+    return failed.load() == 0 ? 0 : 1;
+}
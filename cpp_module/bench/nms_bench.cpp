@@ -0,0 +1,199 @@
+#include "Nms.hpp"
+#include "opencv2/dnn.hpp"
+#include <algorithm>
+#include <format>
+#include <random>
+#include <benchmark/benchmark.h>
+
+// Scaling of the grid accelerated NMS against cv::dnn::NMSBoxes from 100 to 20,000 candidates.
+// Candidates come in tight clusters like the ones a dense topology screenshot produces.
+// BM_BruteForceNMS also checks the grid against the plain O(n^2) greedy pass.
+
+namespace
+{
+    constexpr int NUM_CLASSES = 24;
+
+    std::vector<Detection> Candidates(int count)
+    {
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<int> centre_x(0, 3840 - 80);
+        std::uniform_int_distribution<int> centre_y(0, 2160 - 80);
+        std::uniform_int_distribution<int> jitter(-8, 8);
+        std::uniform_real_distribution<float> score(0.5f, 1.0f);
+        std::uniform_int_distribution<int> klass(0, NUM_CLASSES - 1);
+
+        std::vector<Detection> candidates;
+        candidates.reserve(count);
+        while (static_cast<int>(candidates.size()) < count)
+        {
+            const int x = centre_x(rng);
+            const int y = centre_y(rng);
+            const int class_id = klass(rng);
+            for (int j = 0; j < 8 && static_cast<int>(candidates.size()) < count; ++j)
+                candidates.push_back({class_id, score(rng), cv::Rect(x + jitter(rng), y + jitter(rng), 40 + jitter(rng), 40 + jitter(rng))});
+        }
+        return candidates;
+    }
+
+    // The O(n^2) greedy pass the grid must reproduce exactly: descending score, ties by index
+    std::vector<int> BruteForce(const std::vector<Detection> &candidates, const NmsConfig &config)
+    {
+        std::vector<int> order;
+        for (int i = 0; i < static_cast<int>(candidates.size()); ++i)
+        {
+            if (candidates[i].confidence > config.score_threshold)
+                order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [&candidates](int a, int b) {
+            return candidates[a].confidence != candidates[b].confidence ? candidates[a].confidence > candidates[b].confidence : a < b;
+        });
+
+        std::vector<int> kept;
+        for (const int i : order)
+        {
+            const bool suppressed = std::any_of(kept.begin(), kept.end(), [&](int k) {
+                return (!config.class_aware || candidates[k].class_id == candidates[i].class_id) &&
+                       NMS::IoU(candidates[i].box, candidates[k].box) > config.iou_threshold;
+            });
+            if (!suppressed)
+                kept.push_back(i);
+        }
+        return kept;
+    }
+
+    void Scaling(benchmark::internal::Benchmark *bench)
+    {
+        for (const int count : {100, 500, 1000, 2000, 5000, 10000, 20000})
+            bench->Arg(count);
+        bench->Complexity()->Unit(benchmark::kMicrosecond);
+    }
+}
+
+static void BM_NMSBoxes(benchmark::State &state)
+{
+    const std::vector<Detection> candidates = Candidates(static_cast<int>(state.range(0)));
+    std::vector<cv::Rect> boxes;
+    std::vector<float> scores;
+    for (const Detection &candidate : candidates)
+    {
+        boxes.push_back(candidate.box);
+        scores.push_back(candidate.confidence);
+    }
+
+    std::vector<int> kept;
+    for (auto _ : state)
+    {
+        cv::dnn::NMSBoxes(boxes, scores, 0.5f, 0.4f, kept);
+        benchmark::DoNotOptimize(kept.data());
+    }
+    state.counters["kept"] = static_cast<double>(kept.size());
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_NMSBoxes)->Apply(Scaling);
+
+static void BM_NMSBoxesBatched(benchmark::State &state)
+{
+    const std::vector<Detection> candidates = Candidates(static_cast<int>(state.range(0)));
+    std::vector<cv::Rect> boxes;
+    std::vector<float> scores;
+    std::vector<int> class_ids;
+    for (const Detection &candidate : candidates)
+    {
+        boxes.push_back(candidate.box);
+        scores.push_back(candidate.confidence);
+        class_ids.push_back(candidate.class_id);
+    }
+
+    std::vector<int> kept;
+    for (auto _ : state)
+    {
+        cv::dnn::NMSBoxesBatched(boxes, scores, class_ids, 0.5f, 0.4f, kept);
+        benchmark::DoNotOptimize(kept.data());
+    }
+    state.counters["kept"] = static_cast<double>(kept.size());
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_NMSBoxesBatched)->Apply(Scaling);
+
+static void BM_GridNMS(benchmark::State &state)
+{
+    const std::vector<Detection> candidates = Candidates(static_cast<int>(state.range(0)));
+    NmsConfig config;
+    config.class_aware = state.range(1) != 0;
+    NMS nms(config);
+
+    std::vector<int> kept;
+    for (auto _ : state)
+    {
+        kept = nms.Run(candidates);
+        benchmark::DoNotOptimize(kept.data());
+    }
+    state.counters["kept"] = static_cast<double>(kept.size());
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_GridNMS)->ArgNames({"boxes", "class_aware"})->ArgsProduct({{100, 500, 1000, 2000, 5000, 10000, 20000}, {0, 1}})->Complexity()->Unit(benchmark::kMicrosecond);
+
+// Times the brute force pass after checking that the grid keeps exactly the same boxes; a
+// mismatch fails the run
+static void BM_BruteForceNMS(benchmark::State &state)
+{
+    const std::vector<Detection> candidates = Candidates(static_cast<int>(state.range(0)));
+    NmsConfig config;
+    config.class_aware = state.range(1) != 0;
+
+    std::vector<int> grid = NMS(config).Run(candidates);
+    std::vector<int> reference = BruteForce(candidates, config);
+    std::sort(grid.begin(), grid.end());
+    std::sort(reference.begin(), reference.end());
+    if (grid != reference)
+    {
+        state.SkipWithError(std::format("grid kept {} boxes, brute force {}", grid.size(), reference.size()).c_str());
+        return;
+    }
+
+    std::vector<int> kept;
+    for (auto _ : state)
+    {
+        kept = BruteForce(candidates, config);
+        benchmark::DoNotOptimize(kept.data());
+    }
+    state.counters["kept"] = static_cast<double>(kept.size());
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_BruteForceNMS)->ArgNames({"boxes", "class_aware"})->ArgsProduct({{100, 1000, 5000, 20000}, {0, 1}})->Complexity()->Unit(benchmark::kMicrosecond);
+
+static void BM_SoftNMS(benchmark::State &state)
+{
+    const std::vector<Detection> candidates = Candidates(static_cast<int>(state.range(0)));
+    NmsConfig config;
+    config.soft = true;
+    NMS nms(config);
+
+    std::vector<int> kept;
+    for (auto _ : state)
+    {
+        kept = nms.Run(candidates);
+        benchmark::DoNotOptimize(kept.data());
+    }
+    state.counters["kept"] = static_cast<double>(kept.size());
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_SoftNMS)->Apply(Scaling);
+
+static void BM_GridNMSBatch(benchmark::State &state)
+{
+    // The same total candidate count split over 8 images or tiles
+    const int per_image = static_cast<int>(state.range(0)) / 8;
+    std::vector<std::vector<Detection>> images(8, Candidates(per_image));
+    const NMS nms;
+
+    for (auto _ : state)
+    {
+        auto results = nms.ApplyBatch(images);
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_GridNMSBatch)->Apply(Scaling)->UseRealTime();
+
+BENCHMARK_MAIN();
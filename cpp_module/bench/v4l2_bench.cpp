@@ -0,0 +1,82 @@
+#include "V4l2Capture.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <benchmark/benchmark.h>
+
+// Replays an MJPEG recording through V4l2Capture's decode pipeline, unpaced, with 1 to 4 decode threads.
+// POF_BENCH_MJPEG names a recording (see V4l2Capture.hpp for capturing one from a camera); without it a
+// synthetic 1280x720 one is written to the temp directory. The size change case ends the synthetic stream
+// with frames of another size, which never decode into the negotiated frame: the reader must still see
+// the stream end instead of hanging.
+
+namespace
+{
+    constexpr int SYNTHETIC_FRAMES = 120;
+
+    std::filesystem::path WriteRecording(const std::string &name, int frames, int resized_frames)
+    {
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / name;
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        std::vector<uchar> jpeg;
+        for (int i = 0; i < frames + resized_frames; ++i)
+        {
+            cv::Mat frame = i < frames ? cv::Mat(720, 1280, CV_8UC3) : cv::Mat(360, 640, CV_8UC3);
+            cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+            cv::imencode(".jpg", frame, jpeg, {cv::IMWRITE_JPEG_QUALITY, 85});
+            out.write(reinterpret_cast<const char *>(jpeg.data()), static_cast<std::streamsize>(jpeg.size()));
+        }
+        return path;
+    }
+
+    void Replay(benchmark::State &state, const std::filesystem::path &recording, std::optional<uint64_t> expected_frames)
+    {
+        uint64_t total = 0;
+        for (auto _ : state)
+        {
+            V4l2Capture::Options options;
+            options.device = recording.string();
+            options.fps = 0.0;
+            options.decode_threads = static_cast<uint32_t>(state.range(0));
+            options.buffers = options.decode_threads + 2;
+            V4l2Capture capture(options);
+
+            V4l2Capture::Frame frame;
+            uint64_t frames = 0;
+            while (capture.Read(frame))
+                ++frames;
+            total += frames;
+            if (expected_frames && frames != *expected_frames)
+            {
+                state.SkipWithError(std::format("read {} frames, expected {}", frames, *expected_frames).c_str());
+                break;
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(total));
+    }
+}
+
+static void BM_ReplayRecording(benchmark::State &state)
+{
+    if (const char *recording = std::getenv("POF_BENCH_MJPEG"))
+    {
+        Replay(state, recording, std::nullopt);
+        return;
+    }
+    static const std::filesystem::path synthetic = WriteRecording("v4l2_bench.mjpeg", SYNTHETIC_FRAMES, 0);
+    Replay(state, synthetic, SYNTHETIC_FRAMES);
+}
+BENCHMARK(BM_ReplayRecording)->DenseRange(1, 4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_ReplaySizeChange(benchmark::State &state)
+{
+    // More undecodable frames than buffers, which used to leave the recording waiting for room forever
+    static const std::filesystem::path synthetic = WriteRecording("v4l2_bench_resized.mjpeg", SYNTHETIC_FRAMES / 2, SYNTHETIC_FRAMES / 2);
+    Replay(state, synthetic, SYNTHETIC_FRAMES / 2);
+}
+BENCHMARK(BM_ReplaySizeChange)->DenseRange(1, 4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
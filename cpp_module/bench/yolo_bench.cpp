@@ -0,0 +1,242 @@
+#include "Yolo.hpp"
+#include "InferenceScheduler.hpp"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <benchmark/benchmark.h>
+
+// Run from the directory that contains models/yolo. The end-to-end case looks for a small
+// model (models/yolo/yolov8n.onnx, exported with pt_to_onnx.py) and is skipped when it is missing,
+// as are the scheduler cases that run it.
+// For machine readable output use --benchmark_out=<file> --benchmark_out_format=json
+// or the yolo_bench_json target.
+
+namespace
+{
+    constexpr int NUM_CHANNELS = 84;
+    constexpr int NUM_PROPOSALS = 8400;
+    const cv::Size INPUT_SIZE(640, 640);
+    const cv::Size FRAME_SIZE(1920, 1080);
+
+    cv::Mat SyntheticFrame(int width, int height, int type = CV_8UC3)
+    {
+        cv::Mat frame(height, width, type);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+        return frame;
+    }
+
+    // Builds a [1, 84, 8400] tensor where roughly `density` percent of the proposals score above 0.5
+    cv::Mat SyntheticOutput(int density)
+    {
+        const int sizes[] = {1, NUM_CHANNELS, NUM_PROPOSALS};
+        cv::Mat output(3, sizes, CV_32F, cv::Scalar(0));
+        float *data = output.ptr<float>();
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> coord(0.0f, 640.0f);
+        std::uniform_real_distribution<float> extent(8.0f, 120.0f);
+        std::uniform_real_distribution<float> low_score(0.0f, 0.3f);
+        std::uniform_real_distribution<float> high_score(0.55f, 0.99f);
+        std::uniform_int_distribution<int> klass(0, NUM_CHANNELS - 5);
+        std::uniform_int_distribution<int> percent(0, 99);
+
+        for (int i = 0; i < NUM_PROPOSALS; ++i)
+        {
+            data[0 * NUM_PROPOSALS + i] = coord(rng);
+            data[1 * NUM_PROPOSALS + i] = coord(rng);
+            data[2 * NUM_PROPOSALS + i] = extent(rng);
+            data[3 * NUM_PROPOSALS + i] = extent(rng);
+            for (int c = 4; c < NUM_CHANNELS; ++c)
+                data[c * NUM_PROPOSALS + i] = low_score(rng);
+            if (percent(rng) < density)
+                data[(4 + klass(rng)) * NUM_PROPOSALS + i] = high_score(rng);
+        }
+        return output;
+    }
+
+    // Clusters of heavily overlapping boxes, which is what a dense topology screenshot produces
+    std::vector<Detection> SyntheticCandidates(int count)
+    {
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> centre_x(0, FRAME_SIZE.width - 64);
+        std::uniform_int_distribution<int> centre_y(0, FRAME_SIZE.height - 64);
+        std::uniform_int_distribution<int> jitter(-6, 6);
+        std::uniform_real_distribution<float> score(0.5f, 1.0f);
+        std::uniform_int_distribution<int> klass(0, 79);
+
+        std::vector<Detection> candidates;
+        candidates.reserve(count);
+        constexpr int PER_CLUSTER = 10;
+        while (static_cast<int>(candidates.size()) < count)
+        {
+            const int x = centre_x(rng);
+            const int y = centre_y(rng);
+            const int class_id = klass(rng);
+            for (int j = 0; j < PER_CLUSTER && static_cast<int>(candidates.size()) < count; ++j)
+                candidates.push_back({class_id, score(rng), cv::Rect(x + jitter(rng), y + jitter(rng), 48 + jitter(rng), 48 + jitter(rng))});
+        }
+        return candidates;
+    }
+
+    // Loaded once for every case that runs the network, null when the model is missing
+    YOLO *SmallModel()
+    {
+        static std::unique_ptr<YOLO> model;
+        if (!model && std::filesystem::exists(std::filesystem::current_path() / "models/yolo/yolov8n.onnx"))
+        {
+            model = std::make_unique<YOLO>("yolov8n");
+            model->Init(true);
+        }
+        return model.get();
+    }
+}
+
+static void BM_CreateBlob(benchmark::State &state)
+{
+    const cv::Mat frame = SyntheticFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    cv::Mat blob;
+    for (auto _ : state)
+    {
+        YOLO::CreateBlob(frame, blob, INPUT_SIZE);
+        benchmark::DoNotOptimize(blob.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(frame.total() * frame.elemSize()));
+}
+BENCHMARK(BM_CreateBlob)->Args({640, 480})->Args({1280, 720})->Args({1920, 1080})->Args({3840, 2160})->Unit(benchmark::kMicrosecond);
+
+// What a mirrored BGRA capture used to cost: full-resolution conversion and flip before the blob
+static void BM_IngestConvertFlip(benchmark::State &state)
+{
+    const cv::Mat frame = SyntheticFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)), CV_8UC4);
+    cv::Mat bgr, flipped, blob;
+    for (auto _ : state)
+    {
+        cv::cvtColor(frame, bgr, cv::COLOR_BGRA2BGR);
+        cv::flip(bgr, flipped, 1);
+        cv::dnn::blobFromImage(flipped, blob, 1.0 / 255.0, INPUT_SIZE, cv::Scalar(), true, false, CV_32F);
+        benchmark::DoNotOptimize(blob.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IngestConvertFlip)->Args({1280, 720})->Args({1920, 1080})->Args({3840, 2160})->Unit(benchmark::kMicrosecond);
+
+// The same frame handed to CreateBlob as is
+static void BM_IngestFused(benchmark::State &state)
+{
+    const cv::Mat frame = SyntheticFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)), CV_8UC4);
+    cv::Mat blob;
+    for (auto _ : state)
+    {
+        YOLO::CreateBlob(frame, blob, INPUT_SIZE, true);
+        benchmark::DoNotOptimize(blob.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IngestFused)->Args({1280, 720})->Args({1920, 1080})->Args({3840, 2160})->Unit(benchmark::kMicrosecond);
+
+static void BM_DecodeOutput(benchmark::State &state)
+{
+    const cv::Mat output = SyntheticOutput(static_cast<int>(state.range(0)));
+    std::vector<Detection> candidates;
+    for (auto _ : state)
+    {
+        candidates.clear();
+        YOLO::DecodeOutput(output, FRAME_SIZE, INPUT_SIZE, 0.5f, candidates);
+        benchmark::DoNotOptimize(candidates.data());
+    }
+    state.counters["candidates"] = static_cast<double>(candidates.size());
+    state.SetItemsProcessed(state.iterations() * NUM_PROPOSALS);
+}
+BENCHMARK(BM_DecodeOutput)->Arg(0)->Arg(1)->Arg(10)->Arg(50)->Unit(benchmark::kMicrosecond);
+
+static void BM_Suppress(benchmark::State &state)
+{
+    const std::vector<Detection> candidates = SyntheticCandidates(static_cast<int>(state.range(0)));
+    std::vector<Detection> kept;
+    for (auto _ : state)
+    {
+        kept = YOLO::Suppress(candidates, 0.5f, 0.4f);
+        benchmark::DoNotOptimize(kept.data());
+    }
+    state.counters["kept"] = static_cast<double>(kept.size());
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Suppress)->RangeMultiplier(4)->Range(100, 6400)->Complexity()->Unit(benchmark::kMicrosecond);
+
+static void BM_ProcessFrame(benchmark::State &state)
+{
+    YOLO *model = SmallModel();
+    if (!model)
+    {
+        state.SkipWithError("models/yolo/yolov8n.onnx not found");
+        return;
+    }
+
+    const cv::Mat source = SyntheticFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    cv::Mat frame;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        source.copyTo(frame);
+        state.ResumeTiming();
+        model->ProcessFrame(frame);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProcessFrame)->Args({1280, 720})->Args({1920, 1080})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// N sources sharing one model through the scheduler, each submitting a 720p frame per iteration.
+// items_per_second is the aggregate frame rate; against Arg(1) it shows what batching buys.
+static void BM_SchedulerSources(benchmark::State &state)
+{
+    YOLO *model = SmallModel();
+    if (!model)
+    {
+        state.SkipWithError("models/yolo/yolov8n.onnx not found");
+        return;
+    }
+
+    const int source_count = static_cast<int>(state.range(0));
+    std::mutex mutex;
+    std::condition_variable done;
+    int pending = 0;
+
+    InferenceScheduler::Options options;
+    options.max_batch = source_count;
+    InferenceScheduler scheduler(*model, options);
+    std::vector<uint8_t> ids;
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < source_count; ++i)
+    {
+        InferenceScheduler::SourceOptions source_options;
+        source_options.drop = InferenceScheduler::DropPolicy::Block;
+        ids.push_back(scheduler.AddSource(std::format("source {}", i), [&](const cv::Mat &, uint64_t, const std::vector<Detection> &) {
+            std::lock_guard lock(mutex);
+            if (--pending == 0)
+                done.notify_one();
+        }, source_options));
+        frames.push_back(SyntheticFrame(1280, 720));
+    }
+
+    uint64_t frame_id = 0;
+    for (auto _ : state)
+    {
+        {
+            std::lock_guard lock(mutex);
+            pending = source_count;
+        }
+        ++frame_id;
+        for (int i = 0; i < source_count; ++i)
+            scheduler.Submit(ids[i], frames[i], frame_id);
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&] { return pending == 0; });
+    }
+    state.SetItemsProcessed(state.iterations() * source_count);
+    const InferenceScheduler::Stats stats = scheduler.GetStats();
+    state.counters["per_batch"] = static_cast<double>(stats.frames) / std::max<uint64_t>(stats.batches, 1);
+}
+BENCHMARK(BM_SchedulerSources)->DenseRange(1, 4)->Arg(6)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,262 @@
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <mutex>
+
+#include "AnalysisCache.hpp"
+#include "ImageHash.hpp"
+#include "TopologyGraph.hpp"
+#include "Yolo.hpp"
+
+// pof_native: the C++ detector for the Python service.
+//
+//   import pof_native
+//   detector = pof_native.Detector("best", "models/YOLO", "models/YOLO/classes.txt")
+//   detections = detector.detect(image)   # structured array, same dtype as shm_ring.DETECTION_DTYPE
+//   detector.watch_model()                 # swaps in a re-exported .onnx without a restart
+//
+// Images are uint8 NumPy arrays (H, W) or (H, W, 1|3|4) in BGR(A) order. They are wrapped as
+// cv::Mat without copying as long as each row is contiguous, which holds for cv2 results and any
+// slice along the first axis. The GIL is released while the network runs.
+//
+// confidence and input_size stand in for ultralytics' conf and imgsz; the ONNX file has to be exported
+// at input_size. What still differs from ultralytics' predict: the frame is stretched to the square
+// input instead of letterboxed, and NMS runs per class at IoU 0.4 instead of 0.7.
+//
+//   cache = pof_native.AnalysisCache(256 * 1024 * 1024)   # the agents' AnalysisCache, for any Python value
+//   cache.put(pof_native.hash_pixels(image), analysis, nbytes)
+//
+//   graph = pof_native.TopologyGraph(["HubSite", "ATN"], ["Green", "Red"], [(0, 1)], ["Green"])
+//   prior = graph.rank_pof_candidates(down=1)   # structural POF prior, see TopologyGraph.hpp
+
+namespace py = pybind11;
+
+namespace
+{
+    struct DetectionRecord
+    {
+        int32_t class_id;
+        float confidence;
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    // A view of the array's memory; the caller keeps the array alive while the Mat is in use
+    cv::Mat AsMat(const py::array &image)
+    {
+        if (!py::isinstance<py::array_t<uint8_t>>(image))
+            throw py::type_error("image must be a uint8 array");
+        if (image.ndim() != 2 && image.ndim() != 3)
+            throw py::value_error("image must have shape (H, W) or (H, W, C)");
+
+        const int channels = image.ndim() == 3 ? static_cast<int>(image.shape(2)) : 1;
+        if (channels != 1 && channels != 3 && channels != 4)
+            throw py::value_error(std::format("image must have 1, 3 or 4 channels, got {}", channels));
+        // Rows may be strided, pixels within a row must be packed
+        if (image.strides(1) != channels || (image.ndim() == 3 && image.strides(2) != 1) || image.strides(0) < image.shape(1) * channels)
+            throw py::value_error("image rows must be contiguous, pass np.ascontiguousarray(image)");
+
+        return cv::Mat(static_cast<int>(image.shape(0)), static_cast<int>(image.shape(1)), CV_8UC(channels), const_cast<void *>(image.data()),
+                       static_cast<size_t>(image.strides(0)));
+    }
+
+    py::array_t<DetectionRecord> ToArray(const std::vector<Detection> &detections)
+    {
+        py::array_t<DetectionRecord> out(static_cast<py::ssize_t>(detections.size()));
+        DetectionRecord *records = out.mutable_data();
+        for (size_t i = 0; i < detections.size(); ++i)
+        {
+            const Detection &d = detections[i];
+            records[i] = {d.class_id, d.confidence, d.box.x, d.box.y, d.box.width, d.box.height};
+        }
+        return out;
+    }
+
+    TopologyGraph MakeGraph(const std::vector<std::string> &node_types, const std::vector<std::string> &node_statuses,
+                            const std::vector<std::pair<uint32_t, uint32_t>> &links, const std::vector<std::string> &link_statuses)
+    {
+        if (node_types.size() != node_statuses.size())
+            throw py::value_error("node_types and node_statuses must have the same length");
+        if (links.size() != link_statuses.size())
+            throw py::value_error("links and link_statuses must have the same length");
+
+        std::vector<TG::Node> nodes;
+        nodes.reserve(node_types.size());
+        for (size_t i = 0; i < node_types.size(); ++i)
+            nodes.push_back({node_types[i], node_statuses[i]});
+        std::vector<TG::Link> graph_links;
+        graph_links.reserve(links.size());
+        for (size_t i = 0; i < links.size(); ++i)
+            graph_links.push_back({links[i].first, links[i].second, link_statuses[i]});
+        return TopologyGraph(nodes, graph_links);
+    }
+
+    struct CachedObject
+    {
+        py::object value;
+        size_t bytes; // as reported by the caller
+    };
+
+    // Every method runs with the GIL held, which the reference counts of the stored objects need,
+    // evictions included
+    class ObjectCache
+    {
+    public:
+        explicit ObjectCache(size_t max_bytes) : max_bytes(max_bytes), cache(max_bytes, [](const CachedObject &c) { return c.bytes; }) {}
+
+        py::object Get(uint64_t key)
+        {
+            const std::shared_ptr<const CachedObject> hit = this->cache.Find(key);
+            return hit ? hit->value : py::none();
+        }
+        void Put(uint64_t key, py::object value, size_t bytes) { this->cache.Insert(key, {std::move(value), bytes}); }
+        void Clear() { this->cache.Clear(); }
+
+        py::dict Stats() const
+        {
+            const AnalysisCache<CachedObject>::Stats s = this->cache.GetStats();
+            py::dict stats;
+            stats["entries"] = s.entries;
+            stats["bytes"] = s.bytes;
+            stats["max_bytes"] = this->max_bytes;
+            stats["hits"] = s.hits;
+            stats["misses"] = s.misses;
+            stats["evictions"] = s.evictions;
+            return stats;
+        }
+
+    private:
+        const size_t max_bytes;
+        AnalysisCache<CachedObject> cache;
+    };
+
+    class Detector
+    {
+    public:
+        Detector(const std::string &model_name, const std::string &model_dir, const std::string &class_names_path, bool cpu_only, float confidence,
+                 int input_size)
+            : model(model_name, model_dir, class_names_path)
+        {
+            py::gil_scoped_release release;
+            this->model.Init(cpu_only);
+            // After Init, so they win over a tuned profile
+            this->model.SetConfidenceThreshold(confidence);
+            this->model.SetInputSize(input_size);
+        }
+
+        py::array_t<DetectionRecord> Detect(const py::array &image, bool mirror)
+        {
+            const cv::Mat frame = AsMat(image);
+            std::vector<Detection> detections;
+            {
+                py::gil_scoped_release release;
+                std::lock_guard lock(this->mutex);
+                detections = this->model.Detect(frame, mirror);
+            }
+            return ToArray(detections);
+        }
+
+        std::vector<py::array_t<DetectionRecord>> DetectBatch(const std::vector<py::array> &images, bool mirror)
+        {
+            std::vector<cv::Mat> frames;
+            frames.reserve(images.size());
+            for (const py::array &image : images)
+                frames.push_back(AsMat(image));
+
+            std::vector<std::vector<Detection>> detections;
+            {
+                py::gil_scoped_release release;
+                std::lock_guard lock(this->mutex);
+                detections = this->model.DetectBatch(frames, mirror);
+            }
+
+            std::vector<py::array_t<DetectionRecord>> out;
+            out.reserve(detections.size());
+            for (const std::vector<Detection> &d : detections)
+                out.push_back(ToArray(d));
+            return out;
+        }
+
+        const std::vector<std::string> &ClassNames() const { return this->model.ClassNames(); }
+        bool Reload() { return this->model.Reload(); }
+        void WatchModel(int interval_ms) { this->model.WatchModel(std::chrono::milliseconds(interval_ms)); }
+        uint64_t Generation() const { return this->model.GetSwapStats().generation; }
+        std::string LoadSummary() const { return this->model.LoadSummary(); }
+
+    private:
+        YOLO model;
+        // cv::dnn::Net is not safe to run from several threads at once
+        std::mutex mutex;
+    };
+}
+
+PYBIND11_MODULE(pof_native, m)
+{
+    m.doc() = "C++ detection pipeline of the POF agents";
+
+    PYBIND11_NUMPY_DTYPE(DetectionRecord, class_id, confidence, x, y, width, height);
+
+    py::class_<Detector>(m, "Detector")
+        .def(py::init<const std::string &, const std::string &, const std::string &, bool, float, int>(), py::arg("model_name"), py::arg("model_dir"),
+             py::arg("class_names_path"), py::arg("cpu_only") = false, py::arg("confidence") = 0.5f, py::arg("input_size") = 640,
+             "Loads <model_dir>/<model_name>.onnx (or .xml/.bin for OpenVINO) and one class name per line from class_names_path")
+        .def("detect", &Detector::Detect, py::arg("image"), py::arg("mirror") = false,
+             "Detections of one image as a structured array of (class_id, confidence, x, y, width, height)")
+        .def("detect_batch", &Detector::DetectBatch, py::arg("images"), py::arg("mirror") = false,
+             "Detections of each image, run as one batch when the model has a dynamic batch axis")
+        .def("reload", &Detector::Reload, "Loads the model files again in the background and swaps the new network in once it passed a smoke inference; False while a reload runs")
+        .def("watch_model", &Detector::WatchModel, py::arg("interval_ms") = 2000, "Reloads whenever <model_dir>/<model_name>.onnx changes")
+        .def_property_readonly("model_generation", &Detector::Generation)
+        .def_property_readonly("load_summary", &Detector::LoadSummary, "Model size, read time and the process RSS, shared and private memory")
+        .def_property_readonly("class_names", &Detector::ClassNames);
+
+    py::class_<ObjectCache>(m, "AnalysisCache")
+        .def(py::init<size_t>(), py::arg("max_bytes"), "LRU over hash_pixels keys, evicting once the reported sizes exceed max_bytes")
+        .def("get", &ObjectCache::Get, py::arg("key"), "The value stored under key, None on a miss")
+        .def("put", &ObjectCache::Put, py::arg("key"), py::arg("value"), py::arg("nbytes"), "Replaces an existing entry; a value above max_bytes is not kept")
+        .def("clear", &ObjectCache::Clear)
+        .def("stats", &ObjectCache::Stats, "entries, bytes, max_bytes, hits, misses and evictions");
+
+    py::class_<TG::Candidate>(m, "PofCandidate")
+        .def_readonly("node", &TG::Candidate::node)
+        .def_readonly("score", &TG::Candidate::score)
+        .def_readonly("failed", &TG::Candidate::failed)
+        .def_readonly("separating", &TG::Candidate::separating)
+        .def_readonly("distance", &TG::Candidate::distance)
+        .def("__repr__", [](const TG::Candidate &c) {
+            return std::format("PofCandidate(node={}, score={:.2f}, failed={}, separating={}, distance={})", c.node, c.score, c.failed, c.separating, c.distance);
+        });
+
+    py::class_<TG::Prior>(m, "PofPrior")
+        .def_readonly("reachable", &TG::Prior::reachable)
+        .def_readonly("decisive", &TG::Prior::decisive)
+        .def_readonly("candidates", &TG::Prior::candidates);
+
+    py::class_<TopologyGraph>(m, "TopologyGraph")
+        .def(py::init(&MakeGraph), py::arg("node_types"), py::arg("node_statuses"), py::arg("links"), py::arg("link_statuses"),
+             "Undirected graph of detected nodes (type, status color) and links (node index pairs, status color)")
+        .def_property_readonly("articulation_points", &TopologyGraph::ArticulationPoints)
+        .def_property_readonly("bridges",
+                               [](const TopologyGraph &g) {
+                                   std::vector<std::pair<uint32_t, uint32_t>> ends;
+                                   for (const uint32_t link : g.Bridges())
+                                       ends.push_back(g.LinkEnds(link));
+                                   return ends;
+                               })
+        .def("root_distances", &TopologyGraph::RootDistances, py::arg("healthy_only") = false,
+             "Hops from the nearest HubSite or Router per node, 2**32 - 1 where none leads")
+        .def("rank_pof_candidates", &TopologyGraph::RankPofCandidates, py::arg("down"),
+             "Point of failure candidates for the down node, best first");
+
+    m.def(
+        "hash_pixels",
+        [](const py::array &image) {
+            const cv::Mat frame = AsMat(image);
+            py::gil_scoped_release release;
+            return HashPixels(frame);
+        },
+        py::arg("image"), "The 64-bit pixel hash the C++ AnalysisCache and FrameArchive key frames by");
+}
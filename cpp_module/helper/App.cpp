@@ -5,7 +5,6 @@
 #endif
 
 bool initYolo(YOLO& model) {
-	model.HardwareSummary();
 	try
 	{
 		model.Init();
@@ -20,5 +19,6 @@ bool initYolo(YOLO& model) {
 		errorHandler(std::format("Failed to load model: {}", e.what()));
 		return false;
 	}
+	model.HardwareSummary();
 	return true;
 }
\ No newline at end of file
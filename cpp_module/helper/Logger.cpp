@@ -0,0 +1,209 @@
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <string>
+
+struct LogRecord
+{
+    LogLevel level = LogLevel::Info;
+    std::chrono::steady_clock::time_point time;
+    std::string message;
+};
+
+// Single producer (the owning thread), single consumer (whoever holds Logger::drain_mutex)
+class LogRing
+{
+public:
+    static constexpr size_t CAPACITY = 1024;
+    std::atomic<bool> retired{false};
+
+    bool TryPush(LogRecord &record)
+    {
+        const size_t head = this->head.load(std::memory_order_relaxed);
+        if (head - this->tail.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+        this->slots[head % CAPACITY] = std::move(record);
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void DrainInto(std::vector<LogRecord> &out)
+    {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        const size_t head = this->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail)
+            out.push_back(std::move(this->slots[tail % CAPACITY]));
+        this->tail.store(tail, std::memory_order_release);
+    }
+
+private:
+    std::array<LogRecord, CAPACITY> slots;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+namespace
+{
+    // Marks the ring as retired when its thread exits so the flusher can drop it once drained
+    struct RingHandle
+    {
+        std::shared_ptr<LogRing> ring;
+        ~RingHandle()
+        {
+            if (this->ring)
+                this->ring->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    void AppendFormatted(std::string &out, const LogRecord &record)
+    {
+        switch (record.level)
+        {
+        case LogLevel::Dev:
+            out += YELLOW "[DEV INFO] ";
+            break;
+        case LogLevel::Info:
+            out += "[INFO] ";
+            break;
+        case LogLevel::Error:
+            out += RED "[ERROR] ";
+            break;
+        }
+        out += record.message;
+        out += RESET "\n";
+    }
+}
+
+Logger::Logger()
+{
+    this->flusher = std::thread([this] { this->FlushLoop(); });
+}
+
+Logger::~Logger()
+{
+    {
+        std::lock_guard lock(this->wake_mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    if (this->flusher.joinable())
+        this->flusher.join();
+    this->Drain();
+}
+
+Logger &Logger::Instance()
+{
+    static Logger instance;
+    return instance;
+}
+
+std::ostringstream &Logger::ThreadStream()
+{
+    thread_local std::ostringstream stream;
+    return stream;
+}
+
+LogRing &Logger::ThreadRing()
+{
+    thread_local RingHandle handle;
+    if (!handle.ring)
+    {
+        handle.ring = std::make_shared<LogRing>();
+        std::lock_guard lock(this->rings_mutex);
+        this->rings.push_back(handle.ring);
+    }
+    return *handle.ring;
+}
+
+void Logger::Submit(LogLevel msg_level, std::ostringstream &stream)
+{
+    LogRecord record{msg_level, std::chrono::steady_clock::now(), stream.str()};
+    stream.str({});
+    stream.clear();
+
+    LogRing &ring = this->ThreadRing();
+    if (ring.TryPush(record))
+    {
+        if (msg_level == LogLevel::Error)
+            this->wake.notify_one();
+        return;
+    }
+
+    // Give the flusher a short window to make room; after that informational messages are
+    // dropped rather than stalling the worker, while errors keep waiting
+    const auto give_up = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+    do
+    {
+        this->wake.notify_one();
+        std::this_thread::yield();
+        if (msg_level != LogLevel::Error && std::chrono::steady_clock::now() > give_up)
+        {
+            this->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!ring.TryPush(record));
+}
+
+void Logger::Flush()
+{
+    this->Drain();
+}
+
+void Logger::FlushLoop()
+{
+    std::unique_lock lock(this->wake_mutex);
+    while (!this->stopping)
+    {
+        this->wake.wait_for(lock, FLUSH_INTERVAL);
+        lock.unlock();
+        this->Drain();
+        lock.lock();
+    }
+}
+
+void Logger::Drain()
+{
+    std::lock_guard drain_lock(this->drain_mutex);
+
+    std::vector<LogRecord> batch;
+    {
+        std::lock_guard lock(this->rings_mutex);
+        std::erase_if(this->rings, [&batch](const std::shared_ptr<LogRing> &ring) {
+            // Read the flag before draining so a retired ring is only dropped once it is empty
+            const bool retired = ring->retired.load(std::memory_order_acquire);
+            ring->DrainInto(batch);
+            return retired;
+        });
+    }
+
+    static uint64_t reported_drops = 0;
+    const uint64_t drops = this->dropped.load(std::memory_order_relaxed);
+    if (batch.empty() && drops == reported_drops)
+        return;
+
+    std::stable_sort(batch.begin(), batch.end(), [](const LogRecord &a, const LogRecord &b) { return a.time < b.time; });
+
+    std::string out;
+    std::string err;
+    for (const LogRecord &record : batch)
+        AppendFormatted(record.level == LogLevel::Info ? out : err, record);
+
+    if (drops != reported_drops)
+    {
+        AppendFormatted(err, {LogLevel::Dev, {}, "Logger dropped " + std::to_string(drops - reported_drops) + " messages under load"});
+        reported_drops = drops;
+    }
+
+    if (!out.empty())
+    {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
+    if (!err.empty())
+    {
+        std::fwrite(err.data(), 1, err.size(), stderr);
+        std::fflush(stderr);
+    }
+}
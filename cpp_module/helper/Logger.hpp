@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#define RED     "\033[31m"
+#define YELLOW  "\033[33m"
+#define RESET   "\033[0m"
+
+// Messages below this level are removed at compile time: 0 = DEV, 1 = INFO, 2 = ERROR
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 0
+#endif
+
+enum class LogLevel : int
+{
+    Dev = 0,
+    Info = 1,
+    Error = 2
+};
+
+class LogRing;
+
+// Asynchronous logger. Every producing thread owns a lock-free single-producer ring, so worker
+// threads never contend on a stream lock or pay for a flush. A background thread drains all rings
+// in timestamp order and writes them in batches.
+class Logger
+{
+private:
+    std::mutex rings_mutex;
+    std::vector<std::shared_ptr<LogRing>> rings;
+    std::mutex drain_mutex;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::atomic<int> level{static_cast<int>(LogLevel::Dev)};
+    std::atomic<uint64_t> dropped{0};
+    std::thread flusher;
+
+    Logger();
+    LogRing &ThreadRing();
+    void FlushLoop();
+    void Drain();
+
+public:
+    static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(20);
+
+    static Logger &Instance();
+    static std::ostringstream &ThreadStream();
+
+    ~Logger();
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    bool IsEnabled(LogLevel msg_level) const { return static_cast<int>(msg_level) >= this->level.load(std::memory_order_relaxed); }
+    void SetLevel(LogLevel min_level) { this->level.store(static_cast<int>(min_level), std::memory_order_relaxed); }
+    uint64_t Dropped() const { return this->dropped.load(std::memory_order_relaxed); }
+
+    // Takes the formatted message out of the stream and resets it for reuse
+    void Submit(LogLevel msg_level, std::ostringstream &stream);
+    // Blocks until everything queued so far has been written
+    void Flush();
+};
+
+#define LOG_AT_LEVEL(lvl, ...)                                           \
+    do                                                                   \
+    {                                                                    \
+        if (Logger::Instance().IsEnabled(lvl))                           \
+        {                                                                \
+            std::ostringstream &log_stream_ = Logger::ThreadStream();    \
+            log_stream_ << __VA_ARGS__;                                  \
+            Logger::Instance().Submit(lvl, log_stream_);                 \
+        }                                                                \
+    } while (0)
+
+// Emits at most one message per `ms` milliseconds from this call site, for per-frame messages
+#define LOG_AT_LEVEL_EVERY_MS(lvl, ms, ...)                                                                                  \
+    do                                                                                                                       \
+    {                                                                                                                        \
+        static std::atomic<int64_t> log_last_ms_{INT64_MIN / 2};                                                              \
+        const int64_t log_now_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(                                    \
+                                        std::chrono::steady_clock::now().time_since_epoch()).count();                       \
+        int64_t log_prev_ms_ = log_last_ms_.load(std::memory_order_relaxed);                                                  \
+        if (log_now_ms_ - log_prev_ms_ >= (ms) && log_last_ms_.compare_exchange_strong(log_prev_ms_, log_now_ms_))            \
+            LOG_AT_LEVEL(lvl, __VA_ARGS__);                                                                                   \
+    } while (0)
+
+#if LOG_COMPILED_LEVEL <= 0
+#define DEV_LOG(...) LOG_AT_LEVEL(LogLevel::Dev, __VA_ARGS__);
+#else
+#define DEV_LOG(...) do {} while (0);
+#endif
+
+#if LOG_COMPILED_LEVEL <= 1
+#define LOG(...) LOG_AT_LEVEL(LogLevel::Info, __VA_ARGS__);
+#define LOG_EVERY_MS(ms, ...) LOG_AT_LEVEL_EVERY_MS(LogLevel::Info, ms, __VA_ARGS__);
+#else
+#define LOG(...) do {} while (0);
+#define LOG_EVERY_MS(ms, ...) do {} while (0);
+#endif
+
+#define LOG_ERR(...) LOG_AT_LEVEL(LogLevel::Error, __VA_ARGS__);
@@ -1,12 +1,22 @@
 #include "Utils.hpp"
+#include <algorithm>
+#include <ctime>
+#include <format>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <set>
+#include <sstream>
 #include <stdexcept>
 
 #include "classes/Yolo.hpp"
-#ifdef  _WIN32
-#include <ctime>
-#endif
 #ifdef __linux__
 #include <stdlib.h>
+#include <unistd.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
 #endif
 
 void errorHandler(const std::string& msg) {
@@ -14,6 +24,7 @@ void errorHandler(const std::string& msg) {
         LOG_ERR("Unknown Error occurred");
     LOG_ERR(msg);
     LOG("Press Enter to exit...");
+    Logger::Instance().Flush();
     std::cin.get();
 }
 
@@ -88,7 +99,11 @@ std::string GetTimestampString()
     std::stringstream ss;
     const std::time_t t = std::time(nullptr);
     std::tm tm{};
+#ifdef _WIN32
     if (localtime_s(&tm,&t) == 0)
+#else
+    if (localtime_r(&t, &tm) != nullptr)
+#endif
         ss << std::put_time(&tm, "%Y%m%d_%H%M%S");
     return ss.str();
 }
@@ -102,15 +117,20 @@ void handleWindow(std::string winName, const cv::Mat &frame, bool &quit)
     if(winName.empty())
         winName = "Screenshot";
 
-    cv::namedWindow(winName, cv::WINDOW_NORMAL);
-    cv::resizeWindow(winName, 1280, 720);
-     
+    // Created once per name, recreating and resizing on every frame costs a round trip to the window system
+    static std::set<std::string> created;
+    if (created.insert(winName).second)
+    {
+        cv::namedWindow(winName, cv::WINDOW_NORMAL);
+        cv::resizeWindow(winName, 1280, 720);
+    }
+
     if (cv::getWindowProperty(winName, cv::WND_PROP_VISIBLE) >= 1)
     {
         cv::imshow(winName, frame);
     }
 
-    if (const int key = cv::waitKey(20); key == 27)
+    if (const int key = cv::waitKey(1); key == 27)
     {
         quit = true;
     }
@@ -120,4 +140,115 @@ void handleWindow(std::string winName, const cv::Mat &frame, bool &quit)
         quit = true;
     }
     
-}
\ No newline at end of file
+}
+
+int64_t ParseLocalTime(const std::string &text)
+{
+    std::tm tm{};
+    std::istringstream iss(text);
+    iss >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+    if (iss.fail())
+    {
+        tm = {};
+        iss.clear();
+        iss.str(text);
+        iss >> std::get_time(&tm, "%Y-%m-%d %H:%M");
+    }
+    if (iss.fail())
+    {
+        // Time of day only, on today's date
+        const std::time_t now = std::time(nullptr);
+#ifdef _WIN32
+        localtime_s(&tm, &now);
+#else
+        localtime_r(&now, &tm);
+#endif
+        tm.tm_sec = 0;
+        iss.clear();
+        iss.str(text);
+        iss >> std::get_time(&tm, "%H:%M:%S");
+        if (iss.fail())
+        {
+            iss.clear();
+            iss.str(text);
+            iss >> std::get_time(&tm, "%H:%M");
+        }
+    }
+    if (iss.fail())
+        throw std::runtime_error(std::format("Unrecognised time '{}', expected \"YYYY-MM-DD HH:MM[:SS]\" or \"HH:MM[:SS]\"", text));
+    tm.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&tm)) * 1'000'000'000;
+}
+
+std::string FormatLocalTime(int64_t timestamp_ns)
+{
+    const std::time_t seconds = static_cast<std::time_t>(timestamp_ns / 1'000'000'000);
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &seconds);
+#else
+    localtime_r(&seconds, &tm);
+#endif
+    std::ostringstream oss;
+    oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << std::format(".{:03}", (timestamp_ns / 1'000'000) % 1000);
+    return oss.str();
+}
+
+ProcessMemory CurrentProcessMemory()
+{
+    ProcessMemory memory;
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS_EX counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS *>(&counters), sizeof(counters)))
+    {
+        memory.resident = counters.WorkingSetSize;
+        memory.private_bytes = counters.PrivateUsage;
+    }
+#elif defined(__linux__)
+    // Totals over every mapping, in kB; the first line is the address range
+    std::ifstream rollup("/proc/self/smaps_rollup");
+    std::string key;
+    uint64_t kb = 0;
+    while (rollup >> key)
+    {
+        if (!(rollup >> kb))
+        {
+            rollup.clear();
+            rollup.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            continue;
+        }
+        rollup.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        if (key == "Rss:")
+            memory.resident = kb * 1024;
+        else if (key == "Pss:")
+            memory.proportional = kb * 1024;
+        else if (key == "Shared_Clean:" || key == "Shared_Dirty:")
+            memory.shared += kb * 1024;
+        else if (key == "Private_Clean:" || key == "Private_Dirty:")
+            memory.private_bytes += kb * 1024;
+    }
+    if (memory.resident == 0)
+    {
+        // Kernels before 4.14 have no rollup; statm counts resident file pages as shared
+        std::ifstream statm("/proc/self/statm");
+        uint64_t size = 0, resident = 0, shared = 0;
+        if (statm >> size >> resident >> shared)
+        {
+            const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            memory.resident = resident * page;
+            memory.shared = shared * page;
+            memory.private_bytes = memory.resident - std::min(memory.resident, memory.shared);
+        }
+    }
+#endif
+    return memory;
+}
+
+std::string ProcessMemory::Summary() const
+{
+    constexpr double MB = 1024.0 * 1024.0;
+    std::string summary = std::format("RSS {:.0f} MB ({:.0f} MB private, {:.0f} MB shared)", this->resident / MB, this->private_bytes / MB, this->shared / MB);
+    if (this->proportional > 0)
+        summary += std::format(", PSS {:.0f} MB", this->proportional / MB);
+    return summary;
+}
@@ -1,22 +1,35 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
 
 #include "opencv2/opencv.hpp"
 // ReSharper disable once CppUnusedIncludeDirective
 #include "opencv2/core/ocl.hpp"
-
-#define RED     "\033[31m"
-#define YELLOW  "\033[33m"
-#define RESET   "\033[0m"
-
-#define LOG(...) std::cout << "[INFO] " << __VA_ARGS__ << RESET << std::endl;
-#define LOG_ERR(...) std::cerr << RED << "[ERROR] " << __VA_ARGS__ << RESET << std::endl;
-#define DEV_LOG(...) std::cerr << YELLOW << "[DEV INFO] " << __VA_ARGS__ << RESET << std::endl;
+#include "Logger.hpp"
 
 bool setUpEnv();
 void errorHandler(const std::string&);
 bool supportedWindowingSystem();
 std::string GetTimestampString();
-void handleWindow(std::string winName, const cv::Mat &frame, bool& quit);
\ No newline at end of file
+// Local time as "YYYY-MM-DD HH:MM[:SS]" or "HH:MM[:SS]" for today, to unix epoch nanoseconds
+int64_t ParseLocalTime(const std::string &text);
+// "YYYY-MM-DD HH:MM:SS.mmm" in local time
+std::string FormatLocalTime(int64_t timestamp_ns);
+// Shows a frame and pumps the GUI on the calling thread; the agents render through Renderer instead
+void handleWindow(std::string winName, const cv::Mat &frame, bool& quit);
+// Memory of this process. shared is resident memory other processes may map as well (file mappings,
+// the page cache); proportional (PSS) splits it between the processes mapping it, so the PSS of all
+// agents on a box adds up to what they cost together. On Windows private is the commit charge and
+// shared and proportional stay 0.
+struct ProcessMemory
+{
+    uint64_t resident = 0;
+    uint64_t shared = 0;
+    uint64_t private_bytes = 0;
+    uint64_t proportional = 0;
+
+    std::string Summary() const;
+};
+ProcessMemory CurrentProcessMemory();
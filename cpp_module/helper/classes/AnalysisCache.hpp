@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "ImageHash.hpp"
+
+// Content addressed cache of whatever was computed from an image (detections, OCR'd ids, graphs),
+// keyed by HashPixels() of the decoded frame. Least recently used entries are evicted once the
+// entries' reported cost exceeds the byte budget. Values are shared, a hit never copies them.
+//
+//   AnalysisCache<std::vector<Detection>> cache(64ull * 1024 * 1024, [](const auto &d) { return d.size() * sizeof(Detection); });
+//   if (auto cached = cache.Find(key)) ... else cache.Insert(key, detect(frame));
+template <typename Value>
+class AnalysisCache
+{
+public:
+    using Key = uint64_t;
+    using CostFn = std::function<size_t(const Value &)>;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0; // sum of the entries' cost
+    };
+
+    explicit AnalysisCache(size_t max_bytes, CostFn cost = [](const Value &) { return sizeof(Value); })
+        : max_bytes(max_bytes), cost(std::move(cost))
+    {
+    }
+
+    AnalysisCache(const AnalysisCache &) = delete;
+    AnalysisCache &operator=(const AnalysisCache &) = delete;
+
+    static Key KeyOf(const cv::Mat &frame) { return HashPixels(frame); }
+
+    // Null on a miss; a hit makes the entry the most recently used
+    std::shared_ptr<const Value> Find(Key key)
+    {
+        std::lock_guard lock(this->mutex);
+        const auto it = this->index.find(key);
+        if (it == this->index.end())
+        {
+            ++this->stats.misses;
+            return nullptr;
+        }
+        ++this->stats.hits;
+        this->lru.splice(this->lru.begin(), this->lru, it->second);
+        return it->second->value;
+    }
+
+    // Replaces an existing entry with the same key. A value larger than the whole budget is not kept.
+    std::shared_ptr<const Value> Insert(Key key, Value value)
+    {
+        const size_t bytes = this->cost(value);
+        auto shared = std::make_shared<const Value>(std::move(value));
+        if (bytes > this->max_bytes)
+            return shared;
+
+        std::lock_guard lock(this->mutex);
+        if (const auto it = this->index.find(key); it != this->index.end())
+            this->Erase(it->second);
+        this->lru.push_front({key, bytes, shared});
+        this->index[key] = this->lru.begin();
+        this->stats.bytes += bytes;
+        while (this->stats.bytes > this->max_bytes)
+        {
+            this->Erase(std::prev(this->lru.end()));
+            ++this->stats.evictions;
+        }
+        this->stats.entries = this->lru.size();
+        return shared;
+    }
+
+    // Find, or compute and insert on a miss. compute runs outside the lock, so two threads missing on
+    // the same key both compute and the later insert wins.
+    std::shared_ptr<const Value> GetOrCompute(Key key, const std::function<Value()> &compute)
+    {
+        if (auto cached = this->Find(key))
+            return cached;
+        return this->Insert(key, compute());
+    }
+
+    void Clear()
+    {
+        std::lock_guard lock(this->mutex);
+        this->lru.clear();
+        this->index.clear();
+        this->stats.bytes = 0;
+        this->stats.entries = 0;
+    }
+
+    Stats GetStats() const
+    {
+        std::lock_guard lock(this->mutex);
+        return this->stats;
+    }
+
+    std::string Summary() const
+    {
+        const Stats s = this->GetStats();
+        const uint64_t lookups = s.hits + s.misses;
+        return std::format("{} entries, {:.1f} MB, hit rate {:.1f}% ({} hits, {} misses, {} evictions)", s.entries, s.bytes / (1024.0 * 1024.0),
+                           lookups ? 100.0 * static_cast<double>(s.hits) / static_cast<double>(lookups) : 0.0, s.hits, s.misses, s.evictions);
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        size_t bytes;
+        std::shared_ptr<const Value> value;
+    };
+    using Iterator = typename std::list<Entry>::iterator;
+
+    const size_t max_bytes;
+    const CostFn cost;
+    mutable std::mutex mutex;
+    // Front is the most recently used
+    std::list<Entry> lru;
+    std::unordered_map<Key, Iterator> index;
+    Stats stats;
+
+    void Erase(Iterator it)
+    {
+        this->stats.bytes -= it->bytes;
+        this->index.erase(it->key);
+        this->lru.erase(it);
+        this->stats.entries = this->lru.size();
+    }
+};
@@ -0,0 +1,339 @@
+#include "Autotuner.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int REFERENCE_INPUT = 640;
+    constexpr size_t WARMUP_RUNS = 2;
+    constexpr size_t MAX_RUNS = 1000;
+
+    std::string BackendName(int backend)
+    {
+        switch (backend)
+        {
+        case cv::dnn::DNN_BACKEND_OPENCV:
+            return "OpenCV";
+        case cv::dnn::DNN_BACKEND_CUDA:
+            return "CUDA";
+        case cv::dnn::DNN_BACKEND_INFERENCE_ENGINE:
+            return "OpenVINO";
+        default:
+            return std::format("backend {}", backend);
+        }
+    }
+
+    std::string TargetName(int target)
+    {
+        switch (target)
+        {
+        case cv::dnn::DNN_TARGET_CPU:
+            return "CPU";
+        case cv::dnn::DNN_TARGET_OPENCL:
+            return "OpenCL";
+        case cv::dnn::DNN_TARGET_OPENCL_FP16:
+            return "OpenCL FP16";
+        case cv::dnn::DNN_TARGET_CUDA:
+            return "CUDA";
+        case cv::dnn::DNN_TARGET_CUDA_FP16:
+            return "CUDA FP16";
+        default:
+            return std::format("target {}", target);
+        }
+    }
+
+    double Percentile(std::vector<double> values, double q)
+    {
+        if (values.empty())
+            return 0.0;
+        const size_t index = std::min(values.size() - 1, static_cast<size_t>(q / 100.0 * static_cast<double>(values.size() - 1) + 0.5));
+        std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+        return values[index];
+    }
+
+    double Iou(const cv::Rect &a, const cv::Rect &b)
+    {
+        const double intersection = (a & b).area();
+        const double united = a.area() + b.area() - intersection;
+        return united > 0 ? intersection / united : 0.0;
+    }
+
+    // Targets that compute in FP32 on the reference's kernels or CUDA's, trusted without an agreement check
+    bool IsFullPrecision(int target)
+    {
+        return target == cv::dnn::DNN_TARGET_CPU || target == cv::dnn::DNN_TARGET_CUDA;
+    }
+
+    bool IsReference(const TuneProfile &config)
+    {
+        return config.backend == cv::dnn::DNN_BACKEND_OPENCV && config.target == cv::dnn::DNN_TARGET_CPU && config.input_size == REFERENCE_INPUT;
+    }
+}
+
+Autotuner::Autotuner(const YOLO &model, Options options) : model(model), options(std::move(options))
+{
+    if (this->options.samples.empty())
+    {
+        this->synthetic = true;
+        for (int i = 0; i < 4; ++i)
+        {
+            cv::Mat frame(720, 1280, CV_8UC3);
+            cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+            this->options.samples.push_back(frame);
+        }
+    }
+    // ApplyProfile never goes above the pool size, so neither does the search
+    const int pool = std::max(1, cv::getNumThreads());
+    std::erase_if(this->options.thread_counts, [pool](int threads) { return threads > pool; });
+    if (this->options.thread_counts.empty())
+    {
+        for (int threads = 1; threads < pool; threads *= 2)
+            this->options.thread_counts.push_back(threads);
+        this->options.thread_counts.push_back(pool);
+    }
+    std::sort(this->options.input_sizes.begin(), this->options.input_sizes.end(), std::greater<>());
+    std::sort(this->options.batch_sizes.begin(), this->options.batch_sizes.end());
+}
+
+std::unique_ptr<YOLO> Autotuner::Load() const
+{
+    // Init takes the pool size as the ceiling for the trials' thread counts
+    cv::setNumThreads(this->default_threads);
+    auto trial_model = std::make_unique<YOLO>(this->model.ModelName(), this->model.ModelDir(), this->model.ClassNamesPath());
+    // cpu_only keeps a stored profile out of the way, every trial applies its own
+    trial_model->Init(true);
+    return trial_model;
+}
+
+Autotuner::Trial Autotuner::Measure(YOLO &trial_model, const TuneProfile &config) const
+{
+    Trial trial;
+    trial.config = config;
+    trial.config.budget_ms = this->options.budget_ms;
+    try
+    {
+        trial_model.ApplyProfile(trial.config);
+        if (config.threads <= 0)
+            cv::setNumThreads(this->default_threads);
+        std::vector<cv::Mat> batch;
+        for (int i = 0; i < config.batch; ++i)
+            batch.push_back(this->options.samples[static_cast<size_t>(i) % this->options.samples.size()]);
+
+        // Backend setup and kernel compilation
+        for (size_t i = 0; i < WARMUP_RUNS; ++i)
+            trial_model.DetectBatch(batch);
+        if (config.batch > 1 && trial_model.BatchSupported() == false)
+        {
+            trial.rejected = "model has a fixed batch of 1";
+            return trial;
+        }
+
+        std::vector<double> latencies;
+        const Clock::time_point start = Clock::now();
+        while (latencies.size() < this->options.min_runs || (Clock::now() - start < this->options.measure_time && latencies.size() < MAX_RUNS))
+        {
+            const Clock::time_point run_start = Clock::now();
+            trial_model.DetectBatch(batch);
+            latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - run_start).count());
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        trial.config.latency_ms = Percentile(latencies, 90);
+        trial.config.fps = seconds > 0 ? config.batch * static_cast<double>(latencies.size()) / seconds : 0.0;
+        trial.config.meets_budget = trial.config.latency_ms <= this->options.budget_ms;
+        if (!trial.config.meets_budget)
+            trial.rejected = std::format("over the {:.1f} ms budget", this->options.budget_ms);
+    }
+    catch (const std::exception &e)
+    {
+        trial.rejected = e.what();
+    }
+    return trial;
+}
+
+double Autotuner::Agreement(YOLO &trial_model) const
+{
+    size_t expected = 0;
+    size_t matched = 0;
+    for (size_t i = 0; i < this->options.samples.size(); ++i)
+    {
+        const std::vector<Detection> detections = trial_model.Detect(this->options.samples[i]);
+        std::vector<bool> used(detections.size(), false);
+        for (const Detection &wanted : this->reference[i])
+        {
+            ++expected;
+            for (size_t j = 0; j < detections.size(); ++j)
+            {
+                if (!used[j] && detections[j].class_id == wanted.class_id && Iou(detections[j].box, wanted.box) >= 0.5)
+                {
+                    used[j] = true;
+                    ++matched;
+                    break;
+                }
+            }
+        }
+    }
+    return expected > 0 ? static_cast<double>(matched) / expected : 1.0;
+}
+
+TuneProfile Autotuner::Run()
+{
+    this->trials.clear();
+    this->reference.clear();
+    this->default_threads = cv::getNumThreads();
+
+    // What the other configurations are held against
+    {
+        std::unique_ptr<YOLO> cpu = this->Load();
+        cpu->ApplyProfile(TuneProfile{});
+        for (const cv::Mat &sample : this->options.samples)
+            this->reference.push_back(cpu->Detect(sample));
+    }
+
+    std::vector<std::pair<int, int>> pairs{{cv::dnn::DNN_BACKEND_OPENCV, cv::dnn::DNN_TARGET_CPU}};
+    for (const auto &[backend, target] : cv::dnn::getAvailableBackends())
+    {
+        const std::pair<int, int> pair(backend, target);
+        if (std::find(pairs.begin(), pairs.end(), pair) == pairs.end())
+            pairs.push_back(pair);
+    }
+
+    const std::vector<int> input_sizes = this->synthetic ? std::vector<int>{REFERENCE_INPUT} : this->options.input_sizes;
+    for (const auto &[backend, target] : pairs)
+    {
+        TuneProfile config;
+        config.backend = backend;
+        config.target = target;
+
+        if (this->synthetic && !IsFullPrecision(target))
+        {
+            Trial skipped;
+            skipped.config = config;
+            skipped.rejected = "needs --samples to check its accuracy";
+            this->trials.push_back(skipped);
+            continue;
+        }
+
+        std::unique_ptr<YOLO> trial_model;
+        try
+        {
+            trial_model = this->Load();
+        }
+        catch (const std::exception &e)
+        {
+            Trial failed;
+            failed.config = config;
+            failed.rejected = e.what();
+            this->trials.push_back(failed);
+            continue;
+        }
+
+        // cv::setNumThreads steers OpenCV's own CPU kernels only
+        const bool cpu_target = backend == cv::dnn::DNN_BACKEND_OPENCV && target == cv::dnn::DNN_TARGET_CPU;
+        for (const int input_size : input_sizes)
+        {
+            config.input_size = input_size;
+            config.batch = 1;
+
+            // Thread count at batch 1 first, the batches then run with the best one
+            std::optional<Trial> best;
+            for (const int threads : cpu_target ? this->options.thread_counts : std::vector<int>{0})
+            {
+                config.threads = threads;
+                Trial trial = this->Measure(*trial_model, config);
+                const bool ran = trial.config.latency_ms > 0.0;
+                this->trials.push_back(trial);
+                if (ran && (!best || trial.config.fps > best->config.fps))
+                    best = trial;
+            }
+            if (!best)
+                continue;
+
+            double agreement = 1.0;
+            if (!this->synthetic && !IsReference(best->config))
+            {
+                try
+                {
+                    trial_model->ApplyProfile(best->config);
+                    agreement = this->Agreement(*trial_model);
+                }
+                catch (const std::exception &e)
+                {
+                    agreement = 0.0;
+                    LOG_ERR("Agreement check failed for " << BackendName(backend) << "/" << TargetName(target) << ": " << e.what());
+                }
+            }
+            for (Trial &trial : this->trials)
+            {
+                const TuneProfile &c = trial.config;
+                if (c.backend == backend && c.target == target && c.input_size == input_size)
+                {
+                    trial.agreement = agreement;
+                    if (agreement < this->options.min_agreement)
+                        trial.rejected = std::format("reproduces {:.0f}% of the reference detections", agreement * 100.0);
+                }
+            }
+            // Larger batches only take longer
+            if (agreement < this->options.min_agreement || !best->config.meets_budget)
+                continue;
+
+            for (const int batch : this->options.batch_sizes)
+            {
+                if (batch <= 1)
+                    continue;
+                config = best->config;
+                config.batch = batch;
+                Trial trial = this->Measure(*trial_model, config);
+                trial.agreement = agreement;
+                this->trials.push_back(trial);
+                if (!trial.rejected.empty())
+                    break;
+            }
+        }
+    }
+    cv::setNumThreads(this->default_threads);
+
+    const Trial *picked = nullptr;
+    for (const Trial &trial : this->trials)
+    {
+        // Highest throughput, the larger input on a tie
+        if (trial.rejected.empty() && (!picked || trial.config.fps > picked->config.fps ||
+                                (trial.config.fps == picked->config.fps && trial.config.input_size > picked->config.input_size)))
+            picked = &trial;
+    }
+    if (!picked)
+    {
+        for (const Trial &trial : this->trials)
+        {
+            // Ran and was accurate enough, only too slow
+            const bool only_slow = trial.config.latency_ms > 0.0 && !trial.config.meets_budget && trial.agreement >= this->options.min_agreement;
+            if (only_slow && (!picked || trial.config.latency_ms < picked->config.latency_ms))
+                picked = &trial;
+        }
+        if (picked)
+        {
+            LOG_ERR(std::format("No configuration meets the {:.1f} ms budget, the fastest takes {:.1f} ms", this->options.budget_ms, picked->config.latency_ms));
+        }
+    }
+    if (!picked)
+        throw std::runtime_error("No configuration could be run, see the trial report");
+    return picked->config;
+}
+
+std::string Autotuner::Report() const
+{
+    std::string report = std::format("{:<24} {:>7} {:>5} {:>5} {:>9} {:>8} {:>6}  {}", "backend/target", "threads", "input", "batch", "p90 ms", "fps", "agree",
+                                     this->synthetic ? "(synthetic frames, input and agreement not checked)" : "");
+    for (const Trial &trial : this->trials)
+    {
+        const TuneProfile &c = trial.config;
+        report += std::format("\n{:<24} {:>7} {:>5} {:>5} {:>9.1f} {:>8.1f} {:>6}  {}", BackendName(c.backend) + "/" + TargetName(c.target),
+                              c.threads > 0 ? std::to_string(c.threads) : "auto", c.input_size, c.batch, c.latency_ms, c.fps,
+                              this->synthetic ? "-" : std::format("{:.0f}%", trial.agreement * 100.0), trial.rejected);
+    }
+    return report;
+}
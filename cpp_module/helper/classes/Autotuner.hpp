@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Yolo.hpp"
+
+// Measures how a model runs on this host and picks the configuration with the highest throughput
+// whose per-frame latency stays within a budget. A frame in a batch waits for the whole batch, so the
+// budget applies to the 90th percentile of a DetectBatch call, preprocessing and NMS included.
+//
+// Every backend/target pair OpenCV reports is tried. The CPU target is also tried with a range of
+// thread counts. Larger batches are tried while the model takes them and the batch still fits the
+// budget. Smaller inputs are only tried on real sample frames. A configuration other than the
+// reference (OpenCV CPU, 640) must reproduce min_agreement of the reference detections on them,
+// which also catches FP16 targets that lose detections. Synthetic frames give no detections to
+// compare, so without samples agreement goes unchecked and only the FP32 CPU and CUDA targets are
+// tried. When nothing fits the budget the fastest configuration is picked, with meets_budget unset.
+//
+//   Autotuner tuner(model, options);
+//   model.StoreTuneProfile(tuner.Run());
+class Autotuner
+{
+public:
+    struct Options
+    {
+        double budget_ms = 33.0;
+        // Descending, multiples of 32
+        std::vector<int> input_sizes{640, 512, 416, 320};
+        std::vector<int> batch_sizes{1, 2, 4, 8};
+        // Empty: 1, 2, 4 ... and OpenCV's pool size, which CT::ApplyLayout sets to the inference cores;
+        // counts above the pool size are dropped
+        std::vector<int> thread_counts;
+        // The workload; without samples synthetic frames are used and the input stays at 640, as
+        // there is nothing to check a smaller one against
+        std::vector<cv::Mat> samples;
+        // Share of the reference detections (same class, IoU 0.5) a configuration has to reproduce
+        double min_agreement = 0.9;
+        // Per configuration, after two warm-up runs
+        std::chrono::milliseconds measure_time{1500};
+        size_t min_runs = 5;
+    };
+
+    struct Trial
+    {
+        // latency_ms, fps and meets_budget as measured
+        TuneProfile config;
+        // 1 when unchecked, see Autotuner::Report
+        double agreement = 1.0;
+        // Why the configuration cannot be picked, empty when it can
+        std::string rejected;
+    };
+
+    // model only names the files to load, trials run on instances of their own
+    Autotuner(const YOLO &model, Options options);
+
+    // Throws std::runtime_error when no configuration runs at all
+    TuneProfile Run();
+    const std::vector<Trial> &Trials() const { return this->trials; }
+    std::string Report() const;
+
+private:
+    const YOLO &model;
+    Options options;
+    bool synthetic = false;
+    // Restored for trials that leave the thread count alone
+    int default_threads = 0;
+    std::vector<std::vector<Detection>> reference;
+    std::vector<Trial> trials;
+
+    std::unique_ptr<YOLO> Load() const;
+    Trial Measure(YOLO &trial_model, const TuneProfile &config) const;
+    double Agreement(YOLO &trial_model) const;
+};
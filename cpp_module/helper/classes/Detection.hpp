@@ -0,0 +1,10 @@
+#pragma once
+
+#include "opencv2/core.hpp"
+
+struct Detection
+{
+    int class_id = -1;
+    float confidence = 0.0f;
+    cv::Rect box;
+};
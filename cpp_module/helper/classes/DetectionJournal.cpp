@@ -0,0 +1,460 @@
+#include "DetectionJournal.hpp"
+#include "MappedFile.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(DJ::SegmentHeader) == 64);
+static_assert(sizeof(DJ::BlockHeader) == 32);
+
+namespace
+{
+    // Frame timestamps are stored as u32 microsecond offsets, so a block may span at most ~71 minutes
+    constexpr int64_t MAX_BLOCK_SPAN_NS = static_cast<int64_t>(UINT32_MAX) * 1000;
+    constexpr size_t MAX_BLOCK_FRAMES = 4096;
+
+    size_t Pad8(size_t bytes)
+    {
+        return (bytes + 7) & ~static_cast<size_t>(7);
+    }
+
+    // Column offsets inside a block, relative to the block header
+    struct BlockLayout
+    {
+        size_t ts_offset, frame_id, detection_count, source_id;
+        size_t class_id, score, x, y, width, height;
+        size_t total;
+
+        BlockLayout(size_t frames, size_t detections)
+        {
+            size_t at = sizeof(DJ::BlockHeader);
+            auto take = [&at](size_t bytes) { const size_t start = at; at = Pad8(at + bytes); return start; };
+            ts_offset = take(sizeof(uint32_t) * frames);
+            frame_id = take(sizeof(uint64_t) * frames);
+            detection_count = take(sizeof(uint16_t) * frames);
+            source_id = take(frames);
+            class_id = take(detections);
+            score = take(detections);
+            x = take(sizeof(int16_t) * detections);
+            y = take(sizeof(int16_t) * detections);
+            width = take(sizeof(int16_t) * detections);
+            height = take(sizeof(int16_t) * detections);
+            total = at;
+        }
+    };
+
+    int16_t ToInt16(int value)
+    {
+        return static_cast<int16_t>(std::clamp(value, static_cast<int>(INT16_MIN), static_cast<int>(INT16_MAX)));
+    }
+
+    template <typename T>
+    T *Column(uint8_t *block, size_t offset)
+    {
+        return reinterpret_cast<T *>(block + offset);
+    }
+
+    template <typename T>
+    const T *Column(const uint8_t *block, size_t offset)
+    {
+        return reinterpret_cast<const T *>(block + offset);
+    }
+}
+
+namespace DJ
+{
+    int64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::vector<std::string> LoadClassNames(const std::filesystem::path &directory)
+    {
+        std::vector<std::string> names;
+        std::ifstream ifs(directory / "classes.txt");
+        for (std::string line; std::getline(ifs, line);)
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            names.push_back(line);
+        }
+        return names;
+    }
+}
+
+DetectionJournal::DetectionJournal(std::filesystem::path directory, const std::vector<std::string> &class_names)
+    : DetectionJournal(std::move(directory), class_names, Options{})
+{
+}
+
+DetectionJournal::DetectionJournal(std::filesystem::path directory, const std::vector<std::string> &class_names, Options options)
+    : directory(std::move(directory)), options(options)
+{
+    std::filesystem::create_directories(this->directory);
+    if (!class_names.empty())
+    {
+        std::ofstream ofs(this->directory / "classes.txt", std::ios::trunc);
+        for (const std::string &name : class_names)
+            ofs << name << '\n';
+    }
+    this->writer = std::thread(&DetectionJournal::Run, this);
+}
+
+DetectionJournal::~DetectionJournal()
+{
+    {
+        std::lock_guard lock(this->mutex);
+        this->stop = true;
+    }
+    this->wake.notify_one();
+    this->writer.join();
+    if (this->dropped > 0)
+        LOG_ERR("Detection journal dropped " << this->dropped << " frames because the writer fell behind");
+}
+
+void DetectionJournal::Append(uint64_t frame_id, const std::vector<Detection> &detections, uint8_t source_id, int64_t timestamp_ns)
+{
+    std::lock_guard lock(this->mutex);
+    if (this->pending_frames.size() >= this->options.max_pending_frames)
+    {
+        ++this->dropped;
+        return;
+    }
+    const uint16_t count = static_cast<uint16_t>(std::min<size_t>(detections.size(), UINT16_MAX));
+    this->pending_frames.push_back({timestamp_ns, frame_id, source_id, count});
+    this->pending_detections.insert(this->pending_detections.end(), detections.begin(), detections.begin() + count);
+    ++this->appended;
+}
+
+void DetectionJournal::Flush()
+{
+    std::unique_lock lock(this->mutex);
+    const uint64_t target = this->appended;
+    this->flush_requested = true;
+    this->wake.notify_one();
+    this->flushed.wait(lock, [this, target] { return this->written >= target; });
+}
+
+uint64_t DetectionJournal::DroppedFrames() const
+{
+    std::lock_guard lock(this->mutex);
+    return this->dropped;
+}
+
+void DetectionJournal::Run()
+{
+    std::vector<PendingFrame> frames;
+    std::vector<Detection> detections;
+
+    std::unique_lock lock(this->mutex);
+    while (true)
+    {
+        this->wake.wait_for(lock, this->options.flush_interval, [this] { return this->stop || this->flush_requested; });
+        frames.swap(this->pending_frames);
+        detections.swap(this->pending_detections);
+        const bool sync_now = this->flush_requested || this->stop;
+        const bool stopping = this->stop;
+        const uint64_t target = this->appended;
+        this->flush_requested = false;
+        lock.unlock();
+
+        try
+        {
+            if (!frames.empty())
+                this->WriteBlock(frames, detections);
+
+            const auto now = std::chrono::steady_clock::now();
+            if (this->segment && (sync_now || now - this->last_sync >= this->options.fsync_interval))
+                this->Sync();
+            if (this->segment && (stopping || now - this->segment_opened >= this->options.segment_age))
+                this->CloseSegment();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERR("Detection journal write failed: " << e.what());
+        }
+        frames.clear();
+        detections.clear();
+
+        lock.lock();
+        this->written = target;
+        this->flushed.notify_all();
+        if (stopping)
+            break;
+    }
+}
+
+void DetectionJournal::WriteBlock(const std::vector<PendingFrame> &frames, const std::vector<Detection> &detections)
+{
+    size_t first_frame = 0;
+    size_t first_detection = 0;
+    while (first_frame < frames.size())
+    {
+        // Cut the batch into blocks whose timestamps fit the u32 microsecond offsets
+        size_t end = first_frame;
+        size_t detection_count = 0;
+        int64_t min_ts = std::numeric_limits<int64_t>::max();
+        int64_t max_ts = std::numeric_limits<int64_t>::min();
+        while (end < frames.size() && end - first_frame < MAX_BLOCK_FRAMES)
+        {
+            const int64_t lo = std::min(min_ts, frames[end].timestamp_ns);
+            const int64_t hi = std::max(max_ts, frames[end].timestamp_ns);
+            if (end > first_frame && hi - lo > MAX_BLOCK_SPAN_NS)
+                break;
+            min_ts = lo;
+            max_ts = hi;
+            detection_count += frames[end].detection_count;
+            ++end;
+        }
+
+        const size_t frame_count = end - first_frame;
+        const BlockLayout layout(frame_count, detection_count);
+        this->block.assign(layout.total, 0);
+        uint8_t *out = this->block.data();
+
+        auto *header = reinterpret_cast<DJ::BlockHeader *>(out);
+        *header = {DJ::BLOCK_MAGIC, static_cast<uint32_t>(frame_count), static_cast<uint32_t>(detection_count), static_cast<uint32_t>(layout.total), min_ts, max_ts};
+
+        for (size_t i = 0; i < frame_count; ++i)
+        {
+            const PendingFrame &frame = frames[first_frame + i];
+            Column<uint32_t>(out, layout.ts_offset)[i] = static_cast<uint32_t>((frame.timestamp_ns - min_ts) / 1000);
+            Column<uint64_t>(out, layout.frame_id)[i] = frame.frame_id;
+            Column<uint16_t>(out, layout.detection_count)[i] = frame.detection_count;
+            Column<uint8_t>(out, layout.source_id)[i] = frame.source_id;
+        }
+        for (size_t i = 0; i < detection_count; ++i)
+        {
+            const Detection &d = detections[first_detection + i];
+            Column<uint8_t>(out, layout.class_id)[i] = static_cast<uint8_t>(std::clamp(d.class_id, 0, 255));
+            Column<uint8_t>(out, layout.score)[i] = static_cast<uint8_t>(std::lround(std::clamp(d.confidence, 0.0f, 1.0f) * 255.0f));
+            Column<int16_t>(out, layout.x)[i] = ToInt16(d.box.x);
+            Column<int16_t>(out, layout.y)[i] = ToInt16(d.box.y);
+            Column<int16_t>(out, layout.width)[i] = ToInt16(d.box.width);
+            Column<int16_t>(out, layout.height)[i] = ToInt16(d.box.height);
+        }
+
+        if (!this->segment)
+            this->OpenSegment();
+        if (std::fwrite(this->block.data(), 1, this->block.size(), this->segment) != this->block.size())
+        {
+            // What did get written lies past data_bytes and stays invisible; later blocks go to a new segment
+            this->AbandonSegment();
+            throw std::runtime_error("Unable to append block to journal segment");
+        }
+
+        // The header is rewritten only after the block is fully written, a torn block stays invisible
+        DJ::SegmentHeader &segment_header = this->segment_header;
+        segment_header.block_count += 1;
+        segment_header.data_bytes += this->block.size();
+        segment_header.min_ts_ns = std::min(segment_header.min_ts_ns, min_ts);
+        segment_header.max_ts_ns = std::max(segment_header.max_ts_ns, max_ts);
+        segment_header.frame_count += frame_count;
+        segment_header.detection_count += detection_count;
+        const bool header_written = std::fflush(this->segment) == 0 && std::fseek(this->segment, 0, SEEK_SET) == 0 &&
+                                    std::fwrite(&segment_header, sizeof(segment_header), 1, this->segment) == 1 &&
+                                    std::fflush(this->segment) == 0 && std::fseek(this->segment, 0, SEEK_END) == 0;
+        if (!header_written)
+        {
+            this->AbandonSegment();
+            throw std::runtime_error("Unable to update journal segment header");
+        }
+
+        if (segment_header.data_bytes >= this->options.segment_bytes)
+            this->CloseSegment();
+
+        first_frame = end;
+        first_detection += detection_count;
+    }
+}
+
+void DetectionJournal::OpenSegment()
+{
+    // Names only have second resolution and the index restarts with the process, so a name may be
+    // taken by a segment of an earlier run; the file is created exclusively and the next index tried
+    std::filesystem::path path;
+    while (!this->segment)
+    {
+        path = this->directory / std::format("{}_{}{}", GetTimestampString(), this->segment_index++, DJ::SEGMENT_EXTENSION);
+#if defined(_WIN32)
+        this->segment = _wfopen(path.c_str(), L"wbx");
+#else
+        this->segment = std::fopen(path.c_str(), "wbx");
+#endif
+        if (!this->segment && errno != EEXIST)
+            throw std::runtime_error(std::format("Unable to create journal segment {}", path.generic_string()));
+    }
+
+    this->segment_header = {};
+    this->segment_header.magic = DJ::SEGMENT_MAGIC;
+    this->segment_header.version = DJ::VERSION;
+    this->segment_header.min_ts_ns = std::numeric_limits<int64_t>::max();
+    this->segment_header.max_ts_ns = std::numeric_limits<int64_t>::min();
+    std::fwrite(&this->segment_header, sizeof(this->segment_header), 1, this->segment);
+    std::fflush(this->segment);
+
+    this->segment_opened = std::chrono::steady_clock::now();
+    this->last_sync = this->segment_opened;
+    DEV_LOG("Journal segment opened: " << path.generic_string());
+}
+
+void DetectionJournal::CloseSegment()
+{
+    if (!this->segment)
+        return;
+    this->Sync();
+    std::fclose(this->segment);
+    this->segment = nullptr;
+}
+
+void DetectionJournal::AbandonSegment()
+{
+    std::fclose(this->segment);
+    this->segment = nullptr;
+}
+
+void DetectionJournal::Sync()
+{
+    std::fflush(this->segment);
+#if defined(_WIN32)
+    _commit(_fileno(this->segment));
+#else
+    fsync(fileno(this->segment));
+#endif
+    this->last_sync = std::chrono::steady_clock::now();
+}
+
+JournalReader::JournalReader(std::filesystem::path directory) : directory(std::move(directory))
+{
+    if (!std::filesystem::is_directory(this->directory))
+        throw std::runtime_error(std::format("Journal directory not found: {}", this->directory.generic_string()));
+
+    for (const auto &entry : std::filesystem::directory_iterator(this->directory))
+    {
+        if (!entry.is_regular_file() || entry.path().extension() != DJ::SEGMENT_EXTENSION)
+            continue;
+        DJ::SegmentInfo info{entry.path()};
+        std::ifstream ifs(entry.path(), std::ios::binary);
+        if (!ifs.read(reinterpret_cast<char *>(&info.header), sizeof(info.header)) || info.header.magic != DJ::SEGMENT_MAGIC)
+        {
+            LOG_ERR("Skipping unreadable journal segment " << entry.path().generic_string());
+            continue;
+        }
+        if (info.header.version != DJ::VERSION)
+        {
+            LOG_ERR("Skipping journal segment " << entry.path().generic_string() << " with version " << info.header.version);
+            continue;
+        }
+        this->segments.push_back(std::move(info));
+    }
+    std::sort(this->segments.begin(), this->segments.end(), [](const DJ::SegmentInfo &a, const DJ::SegmentInfo &b) {
+        return a.header.min_ts_ns != b.header.min_ts_ns ? a.header.min_ts_ns < b.header.min_ts_ns : a.path < b.path;
+    });
+    this->class_names = DJ::LoadClassNames(this->directory);
+}
+
+void JournalReader::ForEachFrame(const DJ::Query &query, const std::function<bool(const DJ::Frame &)> &fn) const
+{
+    DJ::Frame frame;
+    for (const DJ::SegmentInfo &info : this->segments)
+    {
+        // Only the newest segment can still be growing, the others are skipped on the listed header alone
+        const bool newest = &info == &this->segments.back();
+        if (!newest && (info.header.block_count == 0 || info.header.max_ts_ns < query.from_ns || info.header.min_ts_ns > query.to_ns))
+            continue;
+
+        const MappedFile file(info.path);
+        if (file.Size() < sizeof(DJ::SegmentHeader))
+            continue;
+        DJ::SegmentHeader header;
+        std::memcpy(&header, file.Data(), sizeof(header));
+        if (header.block_count == 0 || header.max_ts_ns < query.from_ns || header.min_ts_ns > query.to_ns)
+            continue;
+
+        const size_t end = std::min(file.Size(), sizeof(header) + static_cast<size_t>(header.data_bytes));
+        size_t at = sizeof(header);
+        while (at + sizeof(DJ::BlockHeader) <= end)
+        {
+            const uint8_t *block = file.Data() + at;
+            const auto *block_header = reinterpret_cast<const DJ::BlockHeader *>(block);
+            if (block_header->magic != DJ::BLOCK_MAGIC || block_header->block_bytes < sizeof(DJ::BlockHeader) || at + block_header->block_bytes > end)
+            {
+                LOG_ERR("Corrupt block in journal segment " << info.path.generic_string() << " at offset " << at);
+                break;
+            }
+            at += block_header->block_bytes;
+            if (block_header->max_ts_ns < query.from_ns || block_header->min_ts_ns > query.to_ns)
+                continue;
+
+            const BlockLayout layout(block_header->frame_count, block_header->detection_count);
+            if (layout.total != block_header->block_bytes)
+            {
+                LOG_ERR("Block size mismatch in journal segment " << info.path.generic_string());
+                break;
+            }
+
+            const uint32_t *ts_offset = Column<uint32_t>(block, layout.ts_offset);
+            const uint64_t *frame_id = Column<uint64_t>(block, layout.frame_id);
+            const uint16_t *detection_count = Column<uint16_t>(block, layout.detection_count);
+            const uint8_t *source_id = Column<uint8_t>(block, layout.source_id);
+            const uint8_t *class_id = Column<uint8_t>(block, layout.class_id);
+            const uint8_t *score = Column<uint8_t>(block, layout.score);
+            const int16_t *x = Column<int16_t>(block, layout.x);
+            const int16_t *y = Column<int16_t>(block, layout.y);
+            const int16_t *width = Column<int16_t>(block, layout.width);
+            const int16_t *height = Column<int16_t>(block, layout.height);
+
+            // The per frame counts index the detection columns, which only hold detection_count entries
+            uint64_t counted = 0;
+            for (uint32_t i = 0; i < block_header->frame_count; ++i)
+                counted += detection_count[i];
+            if (counted != block_header->detection_count)
+            {
+                LOG_ERR("Detection count mismatch in journal segment " << info.path.generic_string() << " at offset " << at - block_header->block_bytes
+                                                                        << ", block skipped");
+                continue;
+            }
+
+            size_t first_detection = 0;
+            for (uint32_t i = 0; i < block_header->frame_count; ++i)
+            {
+                const size_t first = first_detection;
+                first_detection += detection_count[i];
+
+                const int64_t timestamp = block_header->min_ts_ns + static_cast<int64_t>(ts_offset[i]) * 1000;
+                if (timestamp < query.from_ns || timestamp > query.to_ns)
+                    continue;
+                if (query.source_id && *query.source_id != source_id[i])
+                    continue;
+
+                frame.timestamp_ns = timestamp;
+                frame.frame_id = frame_id[i];
+                frame.source_id = source_id[i];
+                frame.detections.clear();
+                for (size_t d = first; d < first_detection; ++d)
+                {
+                    const float confidence = score[d] / 255.0f;
+                    if (confidence < query.min_score || (!query.class_ids.empty() && !query.class_ids.contains(class_id[d])))
+                        continue;
+                    frame.detections.push_back({class_id[d], confidence, cv::Rect(x[d], y[d], width[d], height[d])});
+                }
+                if (frame.detections.empty() && !query.include_empty)
+                    continue;
+                if (!fn(frame))
+                    return;
+            }
+        }
+    }
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Detection.hpp"
+
+// Append-only journal of every detection the agents make, so what was on screen at a given time can
+// be answered later without keeping screenshots. Agents call Append(); a background thread packs
+// pending frames into columnar blocks, appends them to the current segment file, fsyncs periodically
+// and rolls over to a new segment by size or age. A detection costs 10 bytes plus 15 per frame.
+//
+// Segment file (<directory>/<yyyymmdd_hhmmss>_<n>.djl), little endian:
+//   SegmentHeader, rewritten after each block so readers only trust data_bytes worth of blocks
+//   blocks: BlockHeader, then the columns below, each padded to 8 bytes
+//     frames:     ts_offset_us u32 (from min_ts_ns), frame_id u64, detection_count u16, source_id u8
+//     detections: class_id u8, score u8 (x/255), x i16, y i16, width i16, height i16
+// Class names are kept in <directory>/classes.txt, one per line in class id order.
+namespace DJ
+{
+    struct SegmentHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t block_count;
+        uint32_t reserved0;
+        uint64_t data_bytes; // bytes of complete blocks after the header
+        int64_t min_ts_ns;
+        int64_t max_ts_ns;
+        uint64_t frame_count;
+        uint64_t detection_count;
+        uint64_t reserved1;
+    };
+
+    struct BlockHeader
+    {
+        uint32_t magic;
+        uint32_t frame_count;
+        uint32_t detection_count;
+        uint32_t block_bytes; // including this header
+        int64_t min_ts_ns;
+        int64_t max_ts_ns;
+    };
+
+    constexpr uint32_t SEGMENT_MAGIC = 0x47534A44; // "DJSG"
+    constexpr uint32_t BLOCK_MAGIC = 0x4B424A44;   // "DJBK"
+    constexpr uint32_t VERSION = 1;
+    constexpr const char *SEGMENT_EXTENSION = ".djl";
+
+    // One journaled frame, with the detections that passed the query's filters
+    struct Frame
+    {
+        int64_t timestamp_ns = 0; // unix epoch
+        uint64_t frame_id = 0;
+        uint8_t source_id = 0;
+        std::vector<Detection> detections;
+    };
+
+    struct Query
+    {
+        int64_t from_ns = std::numeric_limits<int64_t>::min();
+        int64_t to_ns = std::numeric_limits<int64_t>::max(); // inclusive
+        std::set<int> class_ids;                              // empty matches every class
+        std::optional<uint8_t> source_id;
+        float min_score = 0.0f;
+        bool include_empty = false; // report frames without (matching) detections
+    };
+
+    struct SegmentInfo
+    {
+        std::filesystem::path path;
+        SegmentHeader header{};
+    };
+
+    int64_t NowNs();
+    std::vector<std::string> LoadClassNames(const std::filesystem::path &directory);
+}
+
+class DetectionJournal
+{
+public:
+    struct Options
+    {
+        std::chrono::milliseconds flush_interval{1000};
+        std::chrono::milliseconds fsync_interval{5000};
+        size_t segment_bytes = 64ull * 1024 * 1024;
+        std::chrono::minutes segment_age{60};
+        // Frames waiting for the writer beyond this are dropped instead of growing without bound
+        size_t max_pending_frames = 100000;
+    };
+
+    explicit DetectionJournal(std::filesystem::path directory, const std::vector<std::string> &class_names = {});
+    DetectionJournal(std::filesystem::path directory, const std::vector<std::string> &class_names, Options options);
+    // Writes out everything pending and syncs the segment
+    ~DetectionJournal();
+
+    DetectionJournal(const DetectionJournal &) = delete;
+    DetectionJournal &operator=(const DetectionJournal &) = delete;
+
+    // Cheap and non-blocking for the caller, the encoding and I/O happen on the writer thread
+    void Append(uint64_t frame_id, const std::vector<Detection> &detections, uint8_t source_id = 0, int64_t timestamp_ns = DJ::NowNs());
+    // Blocks until everything appended so far is written and synced
+    void Flush();
+
+    const std::filesystem::path &Directory() const { return this->directory; }
+    uint64_t DroppedFrames() const;
+
+private:
+    struct PendingFrame
+    {
+        int64_t timestamp_ns;
+        uint64_t frame_id;
+        uint8_t source_id;
+        uint16_t detection_count;
+    };
+
+    const std::filesystem::path directory;
+    const Options options;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    std::vector<PendingFrame> pending_frames;
+    std::vector<Detection> pending_detections;
+    uint64_t appended = 0;
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    bool flush_requested = false;
+    bool stop = false;
+
+    // Writer thread state
+    std::FILE *segment = nullptr;
+    DJ::SegmentHeader segment_header{};
+    std::chrono::steady_clock::time_point segment_opened;
+    std::chrono::steady_clock::time_point last_sync;
+    uint32_t segment_index = 0;
+    std::vector<uint8_t> block;
+
+    std::thread writer;
+
+    void Run();
+    void WriteBlock(const std::vector<PendingFrame> &frames, const std::vector<Detection> &detections);
+    void OpenSegment();
+    void CloseSegment();
+    // After a failed write: closes the segment without trusting anything past its last good header
+    void AbandonSegment();
+    void Sync();
+};
+
+// Reads a journal directory through read-only memory maps. Segments still being written can be
+// queried, only the blocks their header already accounts for are visible.
+class JournalReader
+{
+public:
+    explicit JournalReader(std::filesystem::path directory);
+
+    // Segments in time order, with the header each carried when listed
+    const std::vector<DJ::SegmentInfo> &Segments() const { return this->segments; }
+    const std::vector<std::string> &ClassNames() const { return this->class_names; }
+
+    // Calls fn for each matching frame, segment by segment in the order they were written; returning
+    // false stops the scan.
+    // Segments and blocks whose time range misses the query are skipped without being touched.
+    void ForEachFrame(const DJ::Query &query, const std::function<bool(const DJ::Frame &)> &fn) const;
+
+private:
+    std::filesystem::path directory;
+    std::vector<DJ::SegmentInfo> segments;
+    std::vector<std::string> class_names;
+};
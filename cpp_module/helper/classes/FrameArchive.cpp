@@ -0,0 +1,489 @@
+#include "FrameArchive.hpp"
+#include "FramePool.hpp"
+#include "ImageHash.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+#include "opencv2/imgproc.hpp"
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(FA::PackHeader) == 16);
+static_assert(sizeof(FA::IndexHeader) == 16);
+static_assert(sizeof(FA::IndexEntry) == 40);
+
+namespace
+{
+    // Creates the file exclusively; null when it already exists
+    std::FILE *OpenForAppend(const std::filesystem::path &path)
+    {
+#if defined(_WIN32)
+        std::FILE *file = _wfopen(path.c_str(), L"wbx");
+#else
+        std::FILE *file = std::fopen(path.c_str(), "wbx");
+#endif
+        if (!file && errno != EEXIST)
+            throw std::runtime_error(std::format("Unable to create archive file {}", path.generic_string()));
+        return file;
+    }
+
+    void SyncFile(std::FILE *file)
+    {
+        std::fflush(file);
+#if defined(_WIN32)
+        _commit(_fileno(file));
+#else
+        fsync(fileno(file));
+#endif
+    }
+
+    std::vector<FA::IndexEntry> ReadIndex(const std::filesystem::path &path)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        FA::IndexHeader header{};
+        if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != FA::INDEX_MAGIC ||
+            header.version != FA::VERSION || header.entry_bytes != sizeof(FA::IndexEntry))
+            throw std::runtime_error(std::format("Unreadable archive index {}", path.generic_string()));
+
+        // A partially written last entry is ignored
+        const uint64_t size = std::filesystem::file_size(path);
+        std::vector<FA::IndexEntry> entries((size - sizeof(header)) / sizeof(FA::IndexEntry));
+        ifs.read(reinterpret_cast<char *>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(FA::IndexEntry)));
+        return entries;
+    }
+}
+
+int64_t FrameArchive::NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+FrameArchive::FrameArchive(std::filesystem::path directory) : FrameArchive(std::move(directory), Options{}) {}
+
+FrameArchive::FrameArchive(std::filesystem::path directory, Options options)
+    : directory(std::move(directory)), options(std::move(options))
+{
+    if (this->options.encoding.empty() || this->options.encoding.size() >= sizeof(FA::PackHeader::encoding))
+        throw std::runtime_error(std::format("Unsupported archive encoding '{}'", this->options.encoding));
+    std::filesystem::create_directories(this->directory);
+    this->EnforceRetention();
+    this->writer = std::thread(&FrameArchive::Run, this);
+}
+
+FrameArchive::~FrameArchive()
+{
+    {
+        std::lock_guard lock(this->mutex);
+        this->stop = true;
+    }
+    this->wake.notify_one();
+    this->writer.join();
+    if (this->dropped > 0)
+        LOG_ERR("Frame archive dropped " << this->dropped << " frames because the writer fell behind");
+}
+
+void FrameArchive::Append(const cv::Mat &frame, uint8_t source_id, int64_t timestamp_ns)
+{
+    if (frame.empty())
+        return;
+    const bool drop_alpha = this->options.drop_alpha && frame.type() == CV_8UC4;
+    const int type = drop_alpha ? CV_8UC3 : frame.type();
+    const size_t bytes = frame.total() * CV_ELEM_SIZE(type);
+    {
+        std::lock_guard lock(this->mutex);
+        if (this->pending_bytes + bytes > this->options.max_pending_bytes)
+        {
+            ++this->dropped;
+            return;
+        }
+    }
+
+    // The caller's buffer may be a view that dies with the next capture
+    cv::Mat copy = FramePool::Instance().Acquire(frame.size(), type);
+    if (drop_alpha)
+        cv::cvtColor(frame, copy, cv::COLOR_BGRA2BGR);
+    else
+        frame.copyTo(copy);
+
+    // Reserved only once the copy exists, as a throwing copy would never give it back
+    {
+        std::lock_guard lock(this->mutex);
+        if (this->pending_bytes + bytes > this->options.max_pending_bytes)
+        {
+            ++this->dropped;
+            return;
+        }
+        this->pending_bytes += bytes;
+        this->pending.push_back({timestamp_ns, source_id, std::move(copy)});
+        ++this->appended;
+    }
+    this->wake.notify_one();
+}
+
+void FrameArchive::Flush()
+{
+    std::unique_lock lock(this->mutex);
+    const uint64_t target = this->appended;
+    this->flush_requested = true;
+    this->wake.notify_one();
+    this->flushed.wait(lock, [this, target] { return this->written >= target; });
+}
+
+uint64_t FrameArchive::DroppedFrames() const
+{
+    std::lock_guard lock(this->mutex);
+    return this->dropped;
+}
+
+uint64_t FrameArchive::DuplicateFrames() const
+{
+    std::lock_guard lock(this->mutex);
+    return this->duplicates;
+}
+
+void FrameArchive::Run()
+{
+    std::vector<PendingFrame> frames;
+
+    std::unique_lock lock(this->mutex);
+    while (true)
+    {
+        this->wake.wait_for(lock, this->options.fsync_interval, [this] { return this->stop || this->flush_requested || !this->pending.empty(); });
+        frames.swap(this->pending);
+        for (const PendingFrame &frame : frames)
+            this->pending_bytes -= frame.pixels.total() * frame.pixels.elemSize();
+        const bool sync_now = this->flush_requested || this->stop;
+        const bool stopping = this->stop;
+        const uint64_t target = this->appended;
+        this->flush_requested = false;
+        lock.unlock();
+
+        try
+        {
+            if (!frames.empty())
+                this->WriteBatch(frames);
+
+            const auto now = std::chrono::steady_clock::now();
+            if (this->pack && (sync_now || now - this->last_sync >= this->options.fsync_interval))
+                this->Sync();
+            if (this->pack && (stopping || now - this->segment_opened >= this->options.segment_age))
+                this->CloseSegment();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERR("Frame archive write failed: " << e.what());
+        }
+        frames.clear();
+
+        lock.lock();
+        this->written = target;
+        this->flushed.notify_all();
+        if (stopping)
+            break;
+    }
+}
+
+void FrameArchive::WriteBatch(std::vector<PendingFrame> &frames)
+{
+    const int count = static_cast<int>(frames.size());
+    std::vector<uint64_t> hashes(count);
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i)
+            hashes[i] = HashPixels(frames[i].pixels);
+    });
+
+    // A frame matching the previous one of its source is stored once, everything else is encoded in parallel
+    std::vector<bool> duplicate(count, false);
+    std::map<uint8_t, uint64_t> previous;
+    for (const auto &[source_id, stored] : this->last_stored)
+        previous[source_id] = stored.hash;
+    for (int i = 0; i < count; ++i)
+    {
+        const auto it = previous.find(frames[i].source_id);
+        duplicate[i] = it != previous.end() && it->second == hashes[i];
+        previous[frames[i].source_id] = hashes[i];
+    }
+
+    // A failed encode leaves the buffer empty and is retried below, where the error can be raised
+    std::vector<std::vector<uchar>> encoded(count);
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            if (!duplicate[i] && !cv::imencode(this->options.encoding, frames[i].pixels, encoded[i], this->options.encode_params))
+                encoded[i].clear();
+        }
+    });
+
+    std::vector<FA::IndexEntry> entries;
+    entries.reserve(count);
+    auto write_entries = [this, &entries] {
+        if (entries.empty())
+            return;
+        // The images reach the file before the entries that point at them
+        std::fflush(this->pack);
+        if (std::fwrite(entries.data(), sizeof(FA::IndexEntry), entries.size(), this->index) != entries.size())
+        {
+            this->AbandonSegment();
+            throw std::runtime_error("Unable to append to archive index");
+        }
+        std::fflush(this->index);
+        entries.clear();
+    };
+
+    uint64_t new_duplicates = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (!this->pack)
+            this->OpenSegment();
+
+        const PendingFrame &frame = frames[i];
+        FA::IndexEntry entry{};
+        entry.timestamp_ns = frame.timestamp_ns;
+        entry.hash = hashes[i];
+        entry.width = static_cast<uint16_t>(std::min(frame.pixels.cols, static_cast<int>(UINT16_MAX)));
+        entry.height = static_cast<uint16_t>(std::min(frame.pixels.rows, static_cast<int>(UINT16_MAX)));
+        entry.source_id = frame.source_id;
+
+        const auto stored = this->last_stored.find(frame.source_id);
+        if (duplicate[i] && stored != this->last_stored.end() && stored->second.hash == hashes[i])
+        {
+            entry.offset = stored->second.offset;
+            entry.bytes = stored->second.bytes;
+            entry.flags = FA::FLAG_DUPLICATE;
+            ++new_duplicates;
+        }
+        else
+        {
+            // Not encoded yet when it duplicates an image left behind in the previous segment
+            if (encoded[i].empty() && !cv::imencode(this->options.encoding, frame.pixels, encoded[i], this->options.encode_params))
+                throw std::runtime_error(std::format("Unable to encode frame as {}", this->options.encoding));
+            if (std::fwrite(encoded[i].data(), 1, encoded[i].size(), this->pack) != encoded[i].size())
+            {
+                // Entries not yet in the index are lost with it, the next frame opens a new segment
+                entries.clear();
+                this->AbandonSegment();
+                throw std::runtime_error("Unable to append to archive pack");
+            }
+            entry.offset = this->pack_offset;
+            entry.bytes = static_cast<uint32_t>(encoded[i].size());
+            this->pack_offset += encoded[i].size();
+            this->last_stored[frame.source_id] = {hashes[i], entry.offset, entry.bytes};
+        }
+        entries.push_back(entry);
+
+        if (this->pack_offset >= this->options.segment_bytes)
+        {
+            write_entries();
+            this->CloseSegment();
+        }
+    }
+    write_entries();
+
+    std::lock_guard lock(this->mutex);
+    this->duplicates += new_duplicates;
+}
+
+void FrameArchive::OpenSegment()
+{
+    // Names only have second resolution and the index restarts with the process, so a name may be
+    // taken by a segment of an earlier run; it is skipped instead of truncated
+    while (!this->pack)
+    {
+        this->segment_base = this->directory / std::format("{}_{:04}", GetTimestampString(), this->segment_index++);
+        const std::filesystem::path pack_path = std::filesystem::path(this->segment_base).concat(FA::PACK_EXTENSION);
+        this->pack = OpenForAppend(pack_path);
+        if (!this->pack)
+            continue;
+        this->index = OpenForAppend(std::filesystem::path(this->segment_base).concat(FA::INDEX_EXTENSION));
+        if (!this->index)
+        {
+            std::fclose(this->pack);
+            this->pack = nullptr;
+            std::filesystem::remove(pack_path);
+        }
+    }
+
+    FA::PackHeader pack_header{FA::PACK_MAGIC, FA::VERSION, {}};
+    std::memcpy(pack_header.encoding, this->options.encoding.data(), this->options.encoding.size());
+    std::fwrite(&pack_header, sizeof(pack_header), 1, this->pack);
+    const FA::IndexHeader index_header{FA::INDEX_MAGIC, FA::VERSION, sizeof(FA::IndexEntry), 0};
+    std::fwrite(&index_header, sizeof(index_header), 1, this->index);
+    std::fflush(this->pack);
+    std::fflush(this->index);
+
+    this->pack_offset = sizeof(pack_header);
+    this->last_stored.clear();
+    this->segment_opened = std::chrono::steady_clock::now();
+    this->last_sync = this->segment_opened;
+    DEV_LOG("Archive segment opened: " << this->segment_base.generic_string());
+}
+
+void FrameArchive::CloseSegment()
+{
+    if (!this->pack)
+        return;
+    this->Sync();
+    std::fclose(this->pack);
+    std::fclose(this->index);
+    this->pack = nullptr;
+    this->index = nullptr;
+    this->segment_base.clear();
+    this->EnforceRetention();
+}
+
+void FrameArchive::AbandonSegment()
+{
+    std::fclose(this->pack);
+    std::fclose(this->index);
+    this->pack = nullptr;
+    this->index = nullptr;
+    this->segment_base.clear();
+    this->last_stored.clear();
+}
+
+void FrameArchive::Sync()
+{
+    SyncFile(this->pack);
+    SyncFile(this->index);
+    this->last_sync = std::chrono::steady_clock::now();
+}
+
+void FrameArchive::EnforceRetention() const
+{
+    // Segment names start with their creation time, so name order is age order
+    std::vector<std::filesystem::path> bases;
+    for (const auto &entry : std::filesystem::directory_iterator(this->directory))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == FA::INDEX_EXTENSION)
+            bases.push_back(std::filesystem::path(entry.path()).replace_extension());
+    }
+    std::sort(bases.begin(), bases.end());
+
+    auto segment_bytes = [](const std::filesystem::path &base) {
+        std::error_code ec;
+        uint64_t bytes = 0;
+        for (const char *extension : {FA::PACK_EXTENSION, FA::INDEX_EXTENSION})
+        {
+            const uint64_t size = std::filesystem::file_size(std::filesystem::path(base).concat(extension), ec);
+            bytes += ec ? 0 : size;
+        }
+        return bytes;
+    };
+
+    uint64_t total = 0;
+    for (const std::filesystem::path &base : bases)
+        total += segment_bytes(base);
+
+    const auto oldest_allowed = std::filesystem::file_time_type::clock::now() - this->options.max_age;
+    for (const std::filesystem::path &base : bases)
+    {
+        if (base == this->segment_base)
+            break;
+        std::error_code ec;
+        const auto modified = std::filesystem::last_write_time(std::filesystem::path(base).concat(FA::INDEX_EXTENSION), ec);
+        if (total <= this->options.max_total_bytes && !ec && modified >= oldest_allowed)
+            break;
+
+        const uint64_t bytes = segment_bytes(base);
+        std::filesystem::remove(std::filesystem::path(base).concat(FA::PACK_EXTENSION), ec);
+        std::filesystem::remove(std::filesystem::path(base).concat(FA::INDEX_EXTENSION), ec);
+        total -= bytes;
+        LOG("Archive segment rotated out: " << base.filename().generic_string());
+    }
+}
+
+ArchiveReader::ArchiveReader(std::filesystem::path directory) : directory(std::move(directory))
+{
+    if (!std::filesystem::is_directory(this->directory))
+        throw std::runtime_error(std::format("Archive directory not found: {}", this->directory.generic_string()));
+
+    for (const auto &entry : std::filesystem::directory_iterator(this->directory))
+    {
+        if (!entry.is_regular_file() || entry.path().extension() != FA::INDEX_EXTENSION)
+            continue;
+
+        FA::SegmentInfo info;
+        info.index = entry.path();
+        info.pack = std::filesystem::path(entry.path()).replace_extension(FA::PACK_EXTENSION);
+        try
+        {
+            std::ifstream ifs(info.pack, std::ios::binary);
+            FA::PackHeader pack_header{};
+            if (!ifs.read(reinterpret_cast<char *>(&pack_header), sizeof(pack_header)) || pack_header.magic != FA::PACK_MAGIC || pack_header.version != FA::VERSION)
+                throw std::runtime_error(std::format("Unreadable archive pack {}", info.pack.generic_string()));
+            info.encoding.assign(pack_header.encoding, strnlen(pack_header.encoding, sizeof(pack_header.encoding)));
+            info.pack_bytes = std::filesystem::file_size(info.pack);
+
+            for (const FA::IndexEntry &e : ReadIndex(info.index))
+            {
+                ++info.frame_count;
+                info.min_ts_ns = std::min(info.min_ts_ns, e.timestamp_ns);
+                info.max_ts_ns = std::max(info.max_ts_ns, e.timestamp_ns);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERR("Skipping archive segment: " << e.what());
+            continue;
+        }
+        this->segments.push_back(std::move(info));
+    }
+    std::sort(this->segments.begin(), this->segments.end(), [](const FA::SegmentInfo &a, const FA::SegmentInfo &b) { return a.index < b.index; });
+}
+
+void ArchiveReader::ForEachFrame(int64_t from_ns, int64_t to_ns, std::optional<uint8_t> source_id, const std::function<bool(const FA::Frame &)> &fn) const
+{
+    FA::Frame frame;
+    for (const FA::SegmentInfo &info : this->segments)
+    {
+        // Only the newest segment can still be growing, the others are skipped on their listed range
+        const bool newest = &info == &this->segments.back();
+        if (!newest && (info.frame_count == 0 || info.max_ts_ns < from_ns || info.min_ts_ns > to_ns))
+            continue;
+
+        std::error_code ec;
+        const uint64_t pack_bytes = std::filesystem::file_size(info.pack, ec);
+        if (ec)
+            continue;
+        frame.pack = info.pack;
+        frame.encoding = info.encoding;
+        for (const FA::IndexEntry &entry : ReadIndex(info.index))
+        {
+            if (entry.timestamp_ns < from_ns || entry.timestamp_ns > to_ns || (source_id && *source_id != entry.source_id))
+                continue;
+            if (entry.offset + entry.bytes > pack_bytes)
+                break;
+            frame.entry = entry;
+            if (!fn(frame))
+                return;
+        }
+    }
+}
+
+std::vector<uchar> ArchiveReader::ReadEncoded(const FA::Frame &frame) const
+{
+    std::ifstream ifs(frame.pack, std::ios::binary);
+    std::vector<uchar> bytes(frame.entry.bytes);
+    if (!ifs.seekg(static_cast<std::streamoff>(frame.entry.offset)) || !ifs.read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(bytes.size())))
+        throw std::runtime_error(std::format("Unable to read frame at offset {} of {}", frame.entry.offset, frame.pack.generic_string()));
+    return bytes;
+}
+
+cv::Mat ArchiveReader::Load(const FA::Frame &frame) const
+{
+    const std::vector<uchar> bytes = this->ReadEncoded(frame);
+    cv::Mat image = cv::imdecode(bytes, cv::IMREAD_UNCHANGED);
+    if (image.empty())
+        throw std::runtime_error(std::format("Unable to decode frame at offset {} of {}", frame.entry.offset, frame.pack.generic_string()));
+    return image;
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+// Keeps captured frames in a few large pack files instead of one image file per capture. Agents call
+// Append(); a background thread hashes the pixels, stores a frame identical to the previous one of
+// the same source only once, encodes the rest in parallel and appends them to the current pack.
+// Packs roll over by size or age and the oldest are deleted once the archive exceeds its age or
+// byte budget.
+//
+// Each segment is a pair of files named <directory>/<yyyymmdd_hhmmss>_<nnnn>:
+//   .fpk  PackHeader, then the encoded images back to back
+//   .fpx  IndexHeader, then one IndexEntry per frame, appended only after its image is in the pack,
+//         so an entry never points at a torn image
+namespace FA
+{
+    struct PackHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        char encoding[8]; // image extension, e.g. ".png"
+    };
+
+    struct IndexHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entry_bytes;
+        uint32_t reserved;
+    };
+
+    struct IndexEntry
+    {
+        int64_t timestamp_ns; // unix epoch
+        uint64_t offset;      // of the encoded image in the pack
+        uint64_t hash;        // of the raw pixels
+        uint32_t bytes;
+        uint16_t width;
+        uint16_t height;
+        uint8_t source_id;
+        uint8_t flags;
+        uint8_t reserved[6];
+    };
+
+    constexpr uint32_t PACK_MAGIC = 0x4B504146;  // "FAPK"
+    constexpr uint32_t INDEX_MAGIC = 0x58494146; // "FAIX"
+    constexpr uint32_t VERSION = 1;
+    constexpr uint8_t FLAG_DUPLICATE = 1; // same pixels as an earlier frame, shares its image
+    constexpr const char *PACK_EXTENSION = ".fpk";
+    constexpr const char *INDEX_EXTENSION = ".fpx";
+
+    struct Frame
+    {
+        IndexEntry entry{};
+        std::filesystem::path pack;
+        std::string encoding;
+    };
+
+    struct SegmentInfo
+    {
+        std::filesystem::path index;
+        std::filesystem::path pack;
+        std::string encoding;
+        size_t frame_count = 0;
+        int64_t min_ts_ns = std::numeric_limits<int64_t>::max();
+        int64_t max_ts_ns = std::numeric_limits<int64_t>::min();
+        uint64_t pack_bytes = 0;
+    };
+}
+
+class FrameArchive
+{
+public:
+    struct Options
+    {
+        std::string encoding = ".png";
+        // Screen content compresses well even at the fastest zlib level, which keeps up on slow CPUs
+        std::vector<int> encode_params{cv::IMWRITE_PNG_COMPRESSION, 1};
+        // X11 and DXGI captures leave the alpha byte undefined, storing it would only defeat deduplication
+        bool drop_alpha = true;
+        uint64_t segment_bytes = 256ull * 1024 * 1024;
+        std::chrono::minutes segment_age{60};
+        std::chrono::milliseconds fsync_interval{5000};
+        // Retention, applied whenever a segment closes and at startup
+        std::chrono::hours max_age{24 * 7};
+        uint64_t max_total_bytes = 20ull * 1024 * 1024 * 1024;
+        // Frames waiting for the writer beyond this are dropped instead of stalling capture
+        size_t max_pending_bytes = 512ull * 1024 * 1024;
+    };
+
+    explicit FrameArchive(std::filesystem::path directory);
+    FrameArchive(std::filesystem::path directory, Options options);
+    // Writes out everything pending
+    ~FrameArchive();
+
+    FrameArchive(const FrameArchive &) = delete;
+    FrameArchive &operator=(const FrameArchive &) = delete;
+
+    // Copies the frame and returns; hashing, encoding and I/O happen on the writer thread
+    void Append(const cv::Mat &frame, uint8_t source_id = 0, int64_t timestamp_ns = NowNs());
+    // Blocks until everything appended so far is written and synced
+    void Flush();
+
+    const std::filesystem::path &Directory() const { return this->directory; }
+    uint64_t DroppedFrames() const;
+    uint64_t DuplicateFrames() const;
+
+    static int64_t NowNs();
+
+private:
+    struct PendingFrame
+    {
+        int64_t timestamp_ns;
+        uint8_t source_id;
+        cv::Mat pixels;
+    };
+
+    struct StoredImage
+    {
+        uint64_t hash;
+        uint64_t offset;
+        uint32_t bytes;
+    };
+
+    const std::filesystem::path directory;
+    const Options options;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    std::vector<PendingFrame> pending;
+    size_t pending_bytes = 0;
+    uint64_t appended = 0;
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    uint64_t duplicates = 0;
+    bool flush_requested = false;
+    bool stop = false;
+
+    // Writer thread state
+    std::FILE *pack = nullptr;
+    std::FILE *index = nullptr;
+    std::filesystem::path segment_base;
+    uint64_t pack_offset = 0;
+    std::chrono::steady_clock::time_point segment_opened;
+    std::chrono::steady_clock::time_point last_sync;
+    uint32_t segment_index = 0;
+    // Last image stored in the current segment, per source
+    std::map<uint8_t, StoredImage> last_stored;
+
+    std::thread writer;
+
+    void Run();
+    void WriteBatch(std::vector<PendingFrame> &frames);
+    void OpenSegment();
+    void CloseSegment();
+    // After a failed write: closes the segment without trusting anything past its last good index flush
+    void AbandonSegment();
+    void Sync();
+    void EnforceRetention() const;
+};
+
+// Reads an archive directory. Segments still being written are visible up to their last complete entry.
+class ArchiveReader
+{
+public:
+    explicit ArchiveReader(std::filesystem::path directory);
+
+    // Segments in time order
+    const std::vector<FA::SegmentInfo> &Segments() const { return this->segments; }
+
+    // Calls fn for each frame in [from_ns, to_ns] in the order written; returning false stops the scan
+    void ForEachFrame(int64_t from_ns, int64_t to_ns, std::optional<uint8_t> source_id, const std::function<bool(const FA::Frame &)> &fn) const;
+    // The encoded image exactly as stored, ready to be written out as a file with frame.encoding
+    std::vector<uchar> ReadEncoded(const FA::Frame &frame) const;
+    cv::Mat Load(const FA::Frame &frame) const;
+
+private:
+    std::filesystem::path directory;
+    std::vector<FA::SegmentInfo> segments;
+};
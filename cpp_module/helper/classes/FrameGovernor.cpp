@@ -0,0 +1,192 @@
+#include "FrameGovernor.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <thread>
+
+#include "Utils.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+namespace
+{
+    // Small enough to be free, large enough that a changed alarm label still moves some pixels
+    const cv::Size THUMBNAIL_SIZE(96, 54);
+    constexpr int PIXEL_CHANGE_THRESHOLD = 12;
+    constexpr double IDLE_BACKOFF = 0.5;
+    constexpr auto CPU_SAMPLE_PERIOD = std::chrono::seconds(1);
+
+    double ProcessCpuSeconds()
+    {
+#if defined(_WIN32)
+        FILETIME created, exited, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+            return 0.0;
+        const auto ticks = [](const FILETIME &ft) { return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+        return static_cast<double>(ticks(kernel) + ticks(user)) * 1e-7;
+#else
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+#endif
+    }
+
+    std::optional<double> EnvironmentFps(const char *name)
+    {
+        const char *value = std::getenv(name);
+        if (!value)
+            return std::nullopt;
+        const double fps = std::atof(value);
+        if (fps <= 0.0)
+            throw std::runtime_error(std::format("{} must be a positive frame rate, got '{}'", name, value));
+        return fps;
+    }
+}
+
+FrameGovernor::Options FrameGovernor::Options::FromEnvironment() const
+{
+    Options options = *this;
+    options.min_fps = EnvironmentFps("POF_MIN_FPS").value_or(options.min_fps);
+    options.max_fps = EnvironmentFps("POF_MAX_FPS").value_or(options.max_fps);
+    if (options.min_fps > options.max_fps)
+        throw std::runtime_error(std::format("Minimum frame rate {} is above the maximum {}", options.min_fps, options.max_fps));
+    return options;
+}
+
+FrameGovernor::FrameGovernor() : FrameGovernor(Options{}) {}
+
+FrameGovernor::FrameGovernor(Options options)
+    : options(options),
+      last_change(std::chrono::steady_clock::now()),
+      fps(options.max_fps),
+      effective_fps(options.max_fps),
+      cpu_sampled_at(last_change),
+      cpu_seconds_at(ProcessCpuSeconds())
+{
+}
+
+double FrameGovernor::Observe(const cv::Mat &frame, uint32_t source_id)
+{
+    if (frame.empty())
+        return 0.0;
+
+    std::lock_guard lock(this->mutex);
+    cv::resize(frame, this->thumbnail, THUMBNAIL_SIZE, 0, 0, cv::INTER_AREA);
+    if (this->thumbnail.channels() == 4)
+        cv::cvtColor(this->thumbnail, this->thumbnail, cv::COLOR_BGRA2GRAY);
+    else if (this->thumbnail.channels() == 3)
+        cv::cvtColor(this->thumbnail, this->thumbnail, cv::COLOR_BGR2GRAY);
+
+    cv::Mat &previous = this->previous_thumbnails[source_id];
+    double changed = 1.0;
+    if (previous.size() == this->thumbnail.size() && previous.type() == this->thumbnail.type())
+    {
+        cv::Mat diff;
+        cv::absdiff(this->thumbnail, previous, diff);
+        cv::threshold(diff, diff, PIXEL_CHANGE_THRESHOLD, 255, cv::THRESH_BINARY);
+        changed = cv::countNonZero(diff) / static_cast<double>(diff.total());
+    }
+    std::swap(this->thumbnail, previous);
+
+    if (changed >= this->options.activity_threshold)
+    {
+        this->last_change = std::chrono::steady_clock::now();
+        this->fps = this->options.max_fps;
+        this->idle = false;
+    }
+    return changed;
+}
+
+void FrameGovernor::MarkActivity(bool changed)
+{
+    if (!changed)
+        return;
+    std::lock_guard lock(this->mutex);
+    this->last_change = std::chrono::steady_clock::now();
+    this->fps = this->options.max_fps;
+    this->idle = false;
+}
+
+void FrameGovernor::Record(Stage stage, std::chrono::steady_clock::duration latency)
+{
+    const double ms = std::chrono::duration<double, std::milli>(latency).count();
+    std::lock_guard lock(this->mutex);
+    double &average = this->latency_ms[static_cast<size_t>(stage)];
+    average = average == 0.0 ? ms : average + this->options.smoothing * (ms - average);
+}
+
+void FrameGovernor::SampleCpu(std::chrono::steady_clock::time_point now)
+{
+    if (now - this->cpu_sampled_at < CPU_SAMPLE_PERIOD)
+        return;
+    const double cpu_seconds = ProcessCpuSeconds();
+    const double wall_seconds = std::chrono::duration<double>(now - this->cpu_sampled_at).count();
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    this->cpu_utilization = (cpu_seconds - this->cpu_seconds_at) / (wall_seconds * cores);
+
+    // Scaled from the rate the loop actually ran at over this window, once per sample; the cap then
+    // follows the load back up as it falls and is dropped when it no longer binds
+    if (this->options.cpu_budget < 1.0 && this->cpu_utilization > 0.0 && (this->cpu_cap_fps || this->cpu_utilization > this->options.cpu_budget))
+    {
+        const double window_fps = static_cast<double>(this->frames_since_sample) / wall_seconds;
+        const double cap = window_fps * this->options.cpu_budget / this->cpu_utilization;
+        this->cpu_cap_fps = cap < this->options.max_fps ? std::optional<double>(cap) : std::nullopt;
+    }
+
+    this->cpu_sampled_at = now;
+    this->cpu_seconds_at = cpu_seconds;
+    this->frames_since_sample = 0;
+}
+
+std::chrono::steady_clock::duration FrameGovernor::Interval()
+{
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard lock(this->mutex);
+    ++this->frames_since_sample;
+    this->SampleCpu(now);
+
+    if (now - this->last_change >= this->options.idle_after)
+    {
+        if (!this->idle)
+            DEV_LOG("Screen static for " << this->options.idle_after.count() << " ms, backing off");
+        this->idle = true;
+        this->fps = std::max(this->options.min_fps, this->fps * IDLE_BACKOFF);
+    }
+
+    double target = this->fps;
+    double work_ms = 0.0;
+    for (const double ms : this->latency_ms)
+        work_ms += ms;
+    if (work_ms > 0.0)
+        target = std::min(target, this->options.max_busy_fraction * 1000.0 / work_ms);
+    if (this->cpu_cap_fps)
+        target = std::min(target, *this->cpu_cap_fps);
+
+    this->effective_fps = std::clamp(target, this->options.min_fps, this->options.max_fps);
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / this->effective_fps));
+}
+
+void FrameGovernor::Pace(std::chrono::steady_clock::time_point start)
+{
+    std::this_thread::sleep_until(start + this->Interval());
+}
+
+double FrameGovernor::CurrentFps() const
+{
+    std::lock_guard lock(this->mutex);
+    return this->effective_fps;
+}
+
+std::string FrameGovernor::Summary() const
+{
+    std::lock_guard lock(this->mutex);
+    return std::format("{:.1f} fps ({}), capture {:.1f} ms, inference {:.1f} ms, display {:.1f} ms, cpu {:.0f}%",
+                       this->effective_fps, this->idle ? "idle" : "active",
+                       this->latency_ms[static_cast<size_t>(Stage::Capture)], this->latency_ms[static_cast<size_t>(Stage::Inference)],
+                       this->latency_ms[static_cast<size_t>(Stage::Display)], this->cpu_utilization * 100.0);
+}
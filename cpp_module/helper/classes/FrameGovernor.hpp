@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "opencv2/core.hpp"
+
+// Picks the capture cadence of an agent loop instead of a fixed frame delay. The rate jumps to
+// max_fps as soon as the scene changes, holds while it keeps changing and halves towards min_fps
+// once the screen has been static for idle_after. Whatever the scene does, the rate is capped so
+// the measured per-frame work (moving average of the stage latencies) stays under
+// max_busy_fraction of the interval and the process stays under cpu_budget of the machine.
+//
+// Observe() and Record() may be called from the inference thread while the loop thread paces.
+class FrameGovernor
+{
+public:
+    enum class Stage
+    {
+        Capture,
+        Inference,
+        Display,
+        Count
+    };
+
+    struct Options
+    {
+        double min_fps = 1.0;
+        double max_fps = 30.0;
+        // Static screen time before backing off
+        std::chrono::milliseconds idle_after{3000};
+        // Share of thumbnail pixels that must change for the scene to count as active
+        double activity_threshold = 0.002;
+        // Weight of the newest latency sample in the moving averages
+        double smoothing = 0.2;
+        double max_busy_fraction = 0.8;
+        // Share of all cores the process may use, 1.0 disables the check
+        double cpu_budget = 0.5;
+
+        // Overrides min_fps and max_fps with POF_MIN_FPS and POF_MAX_FPS when set
+        Options FromEnvironment() const;
+    };
+
+    FrameGovernor();
+    explicit FrameGovernor(Options options);
+
+    // Compares the frame against the previous one from the same source on a small gray thumbnail
+    // and returns the share of pixels that changed. Any source changing counts as activity.
+    double Observe(const cv::Mat &frame, uint32_t source_id = 0);
+    // For capture paths that already know whether the screen changed (desktop duplication)
+    void MarkActivity(bool changed);
+    void Record(Stage stage, std::chrono::steady_clock::duration latency);
+
+    std::chrono::steady_clock::duration Interval();
+    // Sleeps out the rest of the interval that began at start
+    void Pace(std::chrono::steady_clock::time_point start);
+
+    double CurrentFps() const;
+    std::string Summary() const;
+
+private:
+    const Options options;
+
+    mutable std::mutex mutex;
+    std::map<uint32_t, cv::Mat> previous_thumbnails;
+    cv::Mat thumbnail;
+    std::chrono::steady_clock::time_point last_change;
+    std::array<double, static_cast<size_t>(Stage::Count)> latency_ms{};
+    double fps;           // what the scene asks for
+    double effective_fps; // after the latency and CPU caps
+    double cpu_utilization = 0.0;
+    // The rate that would have used exactly cpu_budget over the last sample, unset while under budget
+    std::optional<double> cpu_cap_fps;
+    bool idle = false;
+
+    std::chrono::steady_clock::time_point cpu_sampled_at;
+    double cpu_seconds_at = 0.0;
+    uint64_t frames_since_sample = 0;
+
+    void SampleCpu(std::chrono::steady_clock::time_point now);
+};
@@ -0,0 +1,162 @@
+#include "FramePool.hpp"
+
+#include <format>
+
+namespace
+{
+    size_t RoundToClass(size_t bytes)
+    {
+        return (bytes + FramePool::SIZE_CLASS - 1) / FramePool::SIZE_CLASS * FramePool::SIZE_CLASS;
+    }
+}
+
+FramePool::FramePool(size_t max_cached_bytes) : max_cached_bytes(max_cached_bytes) {}
+
+FramePool::~FramePool()
+{
+    this->Trim();
+}
+
+FramePool &FramePool::Instance()
+{
+    static FramePool *instance = new FramePool();
+    return *instance;
+}
+
+cv::Mat FramePool::Acquire(int rows, int cols, int type)
+{
+    cv::Mat frame;
+    frame.allocator = this;
+    frame.create(rows, cols, type);
+    return frame;
+}
+
+void FramePool::Preallocate(const cv::Size &size, int type, int count)
+{
+    std::vector<cv::Mat> frames;
+    frames.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        // Touch the pages so they are placed on the calling thread's NUMA node now
+        frames.push_back(this->Acquire(size, type));
+        frames.back().setTo(cv::Scalar::all(0));
+    }
+    // Dropping the Mats parks every buffer in the free list
+}
+
+void FramePool::Trim()
+{
+    std::lock_guard lock(this->mutex);
+    for (auto &[size_class, buffers] : this->free_lists)
+    {
+        for (uchar *buffer : buffers)
+            cv::fastFree(buffer);
+    }
+    this->free_lists.clear();
+    this->cached_bytes = 0;
+}
+
+FramePool::Stats FramePool::GetStats() const
+{
+    Stats stats;
+    stats.hits = this->hits.load(std::memory_order_relaxed);
+    stats.misses = this->misses.load(std::memory_order_relaxed);
+    stats.bytes_reused = this->bytes_reused.load(std::memory_order_relaxed);
+    stats.outstanding = this->outstanding.load(std::memory_order_relaxed);
+    std::lock_guard lock(this->mutex);
+    stats.cached_bytes = this->cached_bytes;
+    return stats;
+}
+
+std::string FramePool::Summary() const
+{
+    const Stats stats = this->GetStats();
+    const uint64_t total = stats.hits + stats.misses;
+    return std::format("Frame pool: {} of {} allocations avoided ({:.1f}%), {:.1f} MB reused, {:.1f} MB cached, {} buffers in use",
+                       stats.hits, total, total ? 100.0 * stats.hits / total : 0.0,
+                       stats.bytes_reused / (1024.0 * 1024.0), stats.cached_bytes / (1024.0 * 1024.0), stats.outstanding);
+}
+
+uchar *FramePool::TakeBuffer(size_t size_class) const
+{
+    {
+        std::lock_guard lock(this->mutex);
+        if (auto it = this->free_lists.find(size_class); it != this->free_lists.end() && !it->second.empty())
+        {
+            uchar *buffer = it->second.back();
+            it->second.pop_back();
+            this->cached_bytes -= size_class;
+            this->hits.fetch_add(1, std::memory_order_relaxed);
+            this->bytes_reused.fetch_add(size_class, std::memory_order_relaxed);
+            return buffer;
+        }
+    }
+    this->misses.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<uchar *>(cv::fastMalloc(size_class));
+}
+
+void FramePool::ReturnBuffer(uchar *buffer, size_t size_class) const
+{
+    {
+        std::lock_guard lock(this->mutex);
+        if (this->cached_bytes + size_class <= this->max_cached_bytes)
+        {
+            this->free_lists[size_class].push_back(buffer);
+            this->cached_bytes += size_class;
+            return;
+        }
+    }
+    cv::fastFree(buffer);
+}
+
+cv::UMatData *FramePool::allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    // Same step computation as OpenCV's StdMatAllocator
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--)
+    {
+        if (step)
+        {
+            if (data && step[i] != CV_AUTOSTEP)
+                total = step[i];
+            else
+                step[i] = total;
+        }
+        total *= sizes[i];
+    }
+
+    auto *u = new cv::UMatData(this);
+    if (data)
+    {
+        u->data = u->origdata = static_cast<uchar *>(data);
+        u->size = total;
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+        return u;
+    }
+
+    u->data = u->origdata = this->TakeBuffer(RoundToClass(total));
+    u->size = total;
+    this->outstanding.fetch_add(1, std::memory_order_relaxed);
+    return u;
+}
+
+bool FramePool::allocate(cv::UMatData *data, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    return data != nullptr;
+}
+
+void FramePool::deallocate(cv::UMatData *data) const
+{
+    if (!data)
+        return;
+
+    CV_Assert(data->urefcount == 0);
+    CV_Assert(data->refcount == 0);
+    if (!(data->flags & cv::UMatData::USER_ALLOCATED))
+    {
+        this->ReturnBuffer(data->origdata, RoundToClass(data->size));
+        data->origdata = nullptr;
+        this->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+    delete data;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+// Recycling allocator for frame sized buffers. Mats created through Acquire() (or any Mat whose
+// allocator is set to the pool) hand their storage back to a size-classed free list when the last
+// reference is dropped, so steady-state capture, inference and display do not touch the heap.
+class FramePool : public cv::MatAllocator
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;         // buffers served from the free list
+        uint64_t misses = 0;       // buffers that had to be allocated
+        uint64_t bytes_reused = 0; // bytes served from the free list
+        size_t cached_bytes = 0;   // bytes currently parked in the free list
+        size_t outstanding = 0;    // buffers currently referenced by Mats
+    };
+
+    // Buffer sizes are rounded up to this granularity so near-identical sizes share a class
+    static constexpr size_t SIZE_CLASS = 64 * 1024;
+
+    explicit FramePool(size_t max_cached_bytes = 512ull * 1024 * 1024);
+    ~FramePool() override;
+
+    // Process wide pool. It is never destroyed so Mats released during static destruction are safe.
+    static FramePool &Instance();
+
+    cv::Mat Acquire(int rows, int cols, int type);
+    cv::Mat Acquire(const cv::Size &size, int type) { return this->Acquire(size.height, size.width, type); }
+    // Fills the free list up front so the first frames do not pay for allocation. The pages are
+    // touched by the calling thread, which places them on its NUMA node
+    void Preallocate(const cv::Size &size, int type, int count);
+    // Frees every cached buffer
+    void Trim();
+
+    Stats GetStats() const;
+    std::string Summary() const;
+
+    // cv::MatAllocator
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessflags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData *data) const override;
+
+private:
+    const size_t max_cached_bytes;
+    mutable std::mutex mutex;
+    mutable std::map<size_t, std::vector<uchar *>> free_lists;
+    mutable size_t cached_bytes = 0;
+    mutable std::atomic<uint64_t> hits{0};
+    mutable std::atomic<uint64_t> misses{0};
+    mutable std::atomic<uint64_t> bytes_reused{0};
+    mutable std::atomic<size_t> outstanding{0};
+
+    uchar *TakeBuffer(size_t size_class) const;
+    void ReturnBuffer(uchar *buffer, size_t size_class) const;
+};
@@ -0,0 +1,194 @@
+#include "FrameRing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <random>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(FrameRing::RingHeader) == FrameRing::HEADER_BYTES);
+static_assert(sizeof(FrameRing::SlotHeader) == FrameRing::SLOT_HEADER_BYTES);
+static_assert(sizeof(FrameRing::PackedDetection) == 24);
+static_assert(std::atomic_ref<uint64_t>::required_alignment <= alignof(uint64_t));
+
+namespace
+{
+    size_t AlignUp(size_t bytes, size_t alignment)
+    {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+}
+
+FrameRing::FrameRing(std::string name, uint32_t slot_count, size_t frame_capacity, uint32_t max_detections)
+    : name(std::move(name)), slot_count(slot_count), max_detections(max_detections), frame_capacity(frame_capacity)
+{
+    if (this->name.empty() || this->name.find('/') != std::string::npos)
+        throw std::runtime_error(std::format("Invalid shared memory ring name '{}'", this->name));
+    if (slot_count == 0 || frame_capacity == 0)
+        throw std::runtime_error("Shared memory ring needs at least one slot and a non-zero frame capacity");
+
+    this->frame_offset = AlignUp(SLOT_HEADER_BYTES + sizeof(PackedDetection) * max_detections, 64);
+    // Page aligned slots keep one frame's pages from being shared with the next slot's header
+    this->slot_stride = AlignUp(this->frame_offset + frame_capacity, 4096);
+    this->mapped_bytes = HEADER_BYTES + this->slot_stride * slot_count;
+
+    this->Map();
+
+    // A stale segment left by a crashed producer may still hold data: reset every slot, and write the
+    // magic last so readers attaching meanwhile refuse the segment instead of reading half a header
+    std::atomic_ref<uint32_t>(this->Header()->magic).store(0, std::memory_order_relaxed);
+    RingHeader *header = this->Header();
+    header->version = VERSION;
+    header->slot_count = slot_count;
+    header->max_detections = max_detections;
+    header->frame_capacity = frame_capacity;
+    header->slot_stride = this->slot_stride;
+    header->frame_offset = this->frame_offset;
+    header->write_seq = 0;
+    std::random_device random;
+    header->producer_id = (static_cast<uint64_t>(random()) << 32 | random()) | 1;
+    for (uint32_t i = 0; i < slot_count; ++i)
+        std::memset(this->base + HEADER_BYTES + i * this->slot_stride, 0, SLOT_HEADER_BYTES);
+    std::atomic_ref<uint32_t>(header->magic).store(MAGIC, std::memory_order_release);
+}
+
+FrameRing::~FrameRing()
+{
+    // Readers still mapping this segment see it retired, the name may soon belong to another one
+    if (this->base)
+        std::atomic_ref<uint32_t>(this->Header()->magic).store(0, std::memory_order_release);
+    this->Unmap();
+}
+
+void FrameRing::Map()
+{
+#if defined(_WIN32)
+    // The mapping lives as long as any process holds a handle, so there is nothing to unlink later
+    const uint64_t size = this->mapped_bytes;
+    HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                       static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xFFFFFFFF), this->name.c_str());
+    if (!handle)
+        throw std::runtime_error(std::format("CreateFileMapping failed for '{}': {}", this->name, GetLastError()));
+    void *view = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, this->mapped_bytes);
+    if (!view)
+    {
+        const DWORD error = GetLastError();
+        CloseHandle(handle);
+        throw std::runtime_error(std::format("MapViewOfFile failed for '{}': {}", this->name, error));
+    }
+    this->mapping = handle;
+    this->base = static_cast<uint8_t *>(view);
+#else
+    const std::string shm_name = "/" + this->name;
+    this->fd = shm_open(shm_name.c_str(), O_CREAT | O_RDWR, 0660);
+    if (this->fd < 0)
+        throw std::runtime_error(std::format("shm_open failed for '{}': {}", shm_name, std::strerror(errno)));
+    if (ftruncate(this->fd, static_cast<off_t>(this->mapped_bytes)) != 0)
+    {
+        const int error = errno;
+        this->Unmap();
+        throw std::runtime_error(std::format("Unable to size shared memory ring '{}': {}", shm_name, std::strerror(error)));
+    }
+    void *view = mmap(nullptr, this->mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (view == MAP_FAILED)
+    {
+        const int error = errno;
+        this->Unmap();
+        throw std::runtime_error(std::format("Unable to map shared memory ring '{}': {}", shm_name, std::strerror(error)));
+    }
+    this->base = static_cast<uint8_t *>(view);
+#endif
+}
+
+void FrameRing::Unmap()
+{
+#if defined(_WIN32)
+    if (this->base)
+        UnmapViewOfFile(this->base);
+    if (this->mapping)
+        CloseHandle(static_cast<HANDLE>(this->mapping));
+    this->mapping = nullptr;
+#else
+    if (this->base)
+        munmap(this->base, this->mapped_bytes);
+    if (this->fd >= 0)
+    {
+        close(this->fd);
+        // Readers that are still attached keep their mapping, new ones can no longer find the segment
+        shm_unlink(("/" + this->name).c_str());
+    }
+    this->fd = -1;
+#endif
+    this->base = nullptr;
+}
+
+uint8_t *FrameRing::Slot(uint64_t seq) const
+{
+    return this->base + HEADER_BYTES + ((seq - 1) % this->slot_count) * this->slot_stride;
+}
+
+uint64_t FrameRing::LastSequence() const
+{
+    return std::atomic_ref<uint64_t>(this->Header()->write_seq).load(std::memory_order_acquire);
+}
+
+uint64_t FrameRing::Publish(const cv::Mat &frame, const std::vector<Detection> &detections, uint32_t source_id)
+{
+    if (frame.empty() || frame.depth() != CV_8U || frame.dims != 2)
+        throw std::runtime_error("Shared memory ring only carries non-empty 2D 8-bit frames");
+
+    const size_t row_bytes = frame.cols * frame.elemSize();
+    if (row_bytes * frame.rows > this->frame_capacity)
+        throw std::runtime_error(std::format("Frame of {} bytes exceeds the ring's slot capacity of {} bytes", row_bytes * frame.rows, this->frame_capacity));
+
+    std::atomic_ref<uint64_t> write_seq(this->Header()->write_seq);
+    const uint64_t seq = write_seq.load(std::memory_order_relaxed) + 1;
+    uint8_t *slot = this->Slot(seq);
+    auto *slot_header = reinterpret_cast<SlotHeader *>(slot);
+    std::atomic_ref<uint64_t> slot_seq(slot_header->seq);
+
+    // Invalidate the slot before touching its payload, readers still holding the old frame see the change
+    slot_seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const uint32_t count = static_cast<uint32_t>(std::min<size_t>(detections.size(), this->max_detections));
+    auto *packed = reinterpret_cast<PackedDetection *>(slot + SLOT_HEADER_BYTES);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const Detection &d = detections[i];
+        packed[i] = {d.class_id, d.confidence, d.box.x, d.box.y, d.box.width, d.box.height};
+    }
+
+    uint8_t *pixels = slot + this->frame_offset;
+    if (frame.isContinuous())
+    {
+        std::memcpy(pixels, frame.data, row_bytes * frame.rows);
+    }
+    else
+    {
+        for (int y = 0; y < frame.rows; ++y)
+            std::memcpy(pixels + y * row_bytes, frame.ptr(y), row_bytes);
+    }
+
+    slot_header->timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    slot_header->width = static_cast<uint32_t>(frame.cols);
+    slot_header->height = static_cast<uint32_t>(frame.rows);
+    slot_header->channels = static_cast<uint32_t>(frame.channels());
+    slot_header->step = static_cast<uint32_t>(row_bytes);
+    slot_header->detection_count = count;
+    slot_header->source_id = source_id;
+
+    slot_seq.store(seq, std::memory_order_release);
+    write_seq.store(seq, std::memory_order_release);
+    return seq;
+}
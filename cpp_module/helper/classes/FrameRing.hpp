@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Detection.hpp"
+#include "opencv2/core.hpp"
+
+// Ring of raw frames and their detections in named shared memory (POSIX shm on Linux, a named file
+// mapping on Windows), written by one producer and read by any number of consumers. The producer
+// never waits: every Publish() overwrites the oldest slot. A slot's sequence number is cleared while
+// it is rewritten, so a reader knows a frame is intact if the slot still carries the same sequence
+// after the read. python_module/core/utils/shm_ring.py maps the same layout as NumPy arrays.
+//
+// Layout, little endian, every section 64 byte aligned:
+//   RingHeader                                           at 0
+//   slot i                                               at HEADER_BYTES + i * slot_stride
+//     SlotHeader                                         at +0
+//     PackedDetection[max_detections]                    at +SLOT_HEADER_BYTES
+//     frame rows, width * channels bytes each, no gaps   at +frame_offset
+class FrameRing
+{
+public:
+    struct RingHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slot_count;
+        uint32_t max_detections;
+        uint64_t frame_capacity;
+        uint64_t slot_stride;
+        uint64_t frame_offset;
+        uint64_t write_seq; // sequence of the last published frame, 0 before the first
+        uint64_t producer_id; // random per FrameRing; a reader finding another one under the name reattaches
+        uint8_t reserved[8];
+    };
+
+    struct SlotHeader
+    {
+        uint64_t seq; // 0 while the slot is being written
+        int64_t timestamp_ns; // unix epoch
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t step;
+        uint32_t detection_count;
+        uint32_t source_id;
+        uint8_t reserved[24];
+    };
+
+    struct PackedDetection
+    {
+        int32_t class_id;
+        float confidence;
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    static constexpr uint32_t MAGIC = 0x52464F50; // "POFR"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_BYTES = 64;
+    static constexpr size_t SLOT_HEADER_BYTES = 64;
+
+    // Creates (or takes over a stale) segment sized for slot_count frames of up to frame_capacity bytes
+    FrameRing(std::string name, uint32_t slot_count, size_t frame_capacity, uint32_t max_detections = 256);
+    ~FrameRing();
+
+    FrameRing(const FrameRing &) = delete;
+    FrameRing &operator=(const FrameRing &) = delete;
+
+    // Copies an 8-bit frame and its detections into the next slot and returns the sequence number
+    // assigned to it, starting at 1. Detections beyond max_detections are dropped.
+    uint64_t Publish(const cv::Mat &frame, const std::vector<Detection> &detections, uint32_t source_id = 0);
+
+    const std::string &Name() const { return this->name; }
+    size_t FrameCapacity() const { return this->frame_capacity; }
+    uint64_t LastSequence() const;
+
+private:
+    const std::string name;
+    const uint32_t slot_count;
+    const uint32_t max_detections;
+    const size_t frame_capacity;
+    size_t frame_offset = 0;
+    size_t slot_stride = 0;
+    size_t mapped_bytes = 0;
+    uint8_t *base = nullptr;
+#if defined(_WIN32)
+    void *mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    void Map();
+    void Unmap();
+    RingHeader *Header() const { return reinterpret_cast<RingHeader *>(this->base); }
+    uint8_t *Slot(uint64_t seq) const;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "opencv2/core.hpp"
+
+// Fast non-cryptographic 64-bit hash of a frame's pixels, stride aware and including the geometry
+// and type, so identical frames can be recognised without encoding or comparing them byte by byte.
+// Four independent lanes keep it close to memory bandwidth (several GB/s). The fourth byte of an
+// 8-bit 4-channel frame is left out: X11 and DXGI captures leave their alpha undefined, so identical
+// screens would otherwise hash differently.
+inline uint64_t HashPixels(const cv::Mat &frame)
+{
+    constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+    const auto round = [](uint64_t acc, uint64_t value) {
+        acc += value * PRIME_2;
+        acc = (acc << 31) | (acc >> 33);
+        return acc * PRIME_1;
+    };
+
+    // Words start on pixel boundaries, so in BGRA bytes 3 and 7 of every word are alpha (little endian)
+    const uint64_t mask = frame.type() == CV_8UC4 ? 0x00FFFFFF00FFFFFFull : ~0ull;
+    uint64_t lanes[4] = {PRIME_1 + PRIME_2, PRIME_2, 0, 0 - PRIME_1};
+    const size_t row_bytes = frame.cols * frame.elemSize();
+    for (int y = 0; y < frame.rows; ++y)
+    {
+        const uchar *row = frame.ptr<uchar>(y);
+        size_t at = 0;
+        for (; at + 32 <= row_bytes; at += 32)
+        {
+            uint64_t words[4];
+            std::memcpy(words, row + at, sizeof(words));
+            for (int lane = 0; lane < 4; ++lane)
+                lanes[lane] = round(lanes[lane], words[lane] & mask);
+        }
+        for (; at < row_bytes; at += 8)
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, row + at, std::min<size_t>(8, row_bytes - at));
+            lanes[0] = round(lanes[0], word & mask);
+        }
+    }
+
+    uint64_t hash = ((lanes[0] << 1) | (lanes[0] >> 63)) + ((lanes[1] << 7) | (lanes[1] >> 57)) +
+                    ((lanes[2] << 12) | (lanes[2] >> 52)) + ((lanes[3] << 18) | (lanes[3] >> 46));
+    hash ^= (static_cast<uint64_t>(frame.cols) << 32 | static_cast<uint32_t>(frame.rows)) * PRIME_2;
+    hash ^= static_cast<uint64_t>(frame.type()) * PRIME_1;
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_1;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,281 @@
+#include "InferenceScheduler.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+#include "Yolo.hpp"
+
+InferenceScheduler::InferenceScheduler(YOLO &model) : InferenceScheduler(model, Options{}) {}
+
+InferenceScheduler::InferenceScheduler(YOLO &model, Options options)
+    : model(model), options(std::move(options)), thread(&InferenceScheduler::Run, this)
+{
+}
+
+InferenceScheduler::~InferenceScheduler()
+{
+    this->Stop();
+}
+
+uint8_t InferenceScheduler::AddSource(std::string name, ResultFn on_result)
+{
+    return this->AddSource(std::move(name), std::move(on_result), SourceOptions{});
+}
+
+uint8_t InferenceScheduler::AddSource(std::string name, ResultFn on_result, SourceOptions options)
+{
+    std::lock_guard lock(this->mutex);
+    if (this->sources.size() > UINT8_MAX)
+        throw std::length_error("InferenceScheduler takes at most 256 sources");
+    auto source = std::make_unique<Source>();
+    source->name = std::move(name);
+    source->on_result = std::move(on_result);
+    options.queue_depth = std::max<size_t>(options.queue_depth, 1);
+    source->options = options;
+    this->sources.push_back(std::move(source));
+    return static_cast<uint8_t>(this->sources.size() - 1);
+}
+
+bool InferenceScheduler::Submit(uint8_t source, const cv::Mat &frame, uint64_t frame_id)
+{
+    std::unique_lock lock(this->mutex);
+    if (source >= this->sources.size())
+        throw std::out_of_range(std::format("Unknown source {}", source));
+    Source &s = *this->sources[source];
+    if (!s.open || this->stopping || this->Failed())
+        return false;
+
+    const Clock::time_point now = Clock::now();
+    if (s.submitted++ == 0)
+        s.first_submit = now;
+    if (this->first_frame == Clock::time_point{})
+        this->first_frame = now;
+
+    bool kept_all = true;
+    if (s.queue.size() >= s.options.queue_depth)
+    {
+        switch (s.options.drop)
+        {
+        case DropPolicy::DropOldest:
+            s.queue.pop_front();
+            --this->queued;
+            ++s.dropped;
+            kept_all = false;
+            break;
+        case DropPolicy::DropNewest:
+            ++s.dropped;
+            return false;
+        case DropPolicy::Block:
+            this->space.wait(lock, [&] { return s.queue.size() < s.options.queue_depth || this->stopping || this->Failed(); });
+            if (this->stopping || this->Failed())
+            {
+                ++s.dropped;
+                return false;
+            }
+            break;
+        }
+    }
+
+    s.queue.push_back({frame, frame_id, now});
+    ++this->queued;
+    lock.unlock();
+    this->work.notify_one();
+    return kept_all;
+}
+
+void InferenceScheduler::CloseSource(uint8_t source)
+{
+    {
+        std::lock_guard lock(this->mutex);
+        if (source < this->sources.size())
+            this->sources[source]->open = false;
+    }
+    // A lingering batch stops waiting for it
+    this->work.notify_one();
+}
+
+bool InferenceScheduler::Idle() const
+{
+    std::lock_guard lock(this->mutex);
+    return this->queued == 0 && !this->running_batch &&
+           std::none_of(this->sources.begin(), this->sources.end(), [](const std::unique_ptr<Source> &s) { return s->open; });
+}
+
+std::string InferenceScheduler::Error() const
+{
+    std::lock_guard lock(this->mutex);
+    return this->error;
+}
+
+void InferenceScheduler::Stop()
+{
+    {
+        std::lock_guard lock(this->mutex);
+        this->stopping = true;
+    }
+    this->work.notify_all();
+    this->space.notify_all();
+    if (this->thread.joinable())
+        this->thread.join();
+}
+
+std::vector<std::pair<InferenceScheduler::Source *, InferenceScheduler::Item>> InferenceScheduler::TakeBatch()
+{
+    std::vector<std::pair<Source *, Item>> batch;
+    const size_t max_batch = std::max<size_t>(this->options.max_batch, 1);
+    const size_t count = this->sources.size();
+    size_t last = count;
+    while (batch.size() < max_batch)
+    {
+        bool took = false;
+        for (size_t k = 0; k < count && batch.size() < max_batch; ++k)
+        {
+            const size_t i = (this->next_source + k) % count;
+            Source &s = *this->sources[i];
+            if (s.queue.empty())
+                continue;
+            batch.emplace_back(&s, std::move(s.queue.front()));
+            s.queue.pop_front();
+            --this->queued;
+            took = true;
+            last = i;
+        }
+        if (!took)
+            break;
+    }
+    // The next batch starts with the source after the last one served
+    if (last < count)
+        this->next_source = (last + 1) % count;
+    return batch;
+}
+
+void InferenceScheduler::Run()
+{
+    if (this->options.thread_init)
+        this->options.thread_init();
+
+    while (true)
+    {
+        std::vector<std::pair<Source *, Item>> batch;
+        {
+            std::unique_lock lock(this->mutex);
+            this->work.wait(lock, [this] { return this->queued > 0 || this->stopping; });
+            if (this->queued == 0)
+                break;
+
+            // Wait a moment for open sources that have nothing queued yet, so their frames share
+            // this batch instead of waiting for the next one
+            const auto batch_full = [this] {
+                if (this->stopping || this->queued >= this->options.max_batch)
+                    return true;
+                return std::none_of(this->sources.begin(), this->sources.end(), [](const std::unique_ptr<Source> &s) { return s->open && s->queue.empty(); });
+            };
+            if (this->options.linger.count() > 0)
+                this->work.wait_for(lock, this->options.linger, batch_full);
+
+            batch = this->TakeBatch();
+            this->running_batch = true;
+        }
+        this->space.notify_all();
+
+        try
+        {
+            // DetectBatch mirrors all of its frames or none
+            for (const bool mirror : {false, true})
+            {
+                std::vector<cv::Mat> frames;
+                std::vector<size_t> index;
+                for (size_t i = 0; i < batch.size(); ++i)
+                {
+                    if (batch[i].first->options.mirror == mirror)
+                    {
+                        frames.push_back(batch[i].second.frame);
+                        index.push_back(i);
+                    }
+                }
+                if (frames.empty())
+                    continue;
+
+                const std::vector<std::vector<Detection>> detections = this->model.DetectBatch(frames, mirror);
+                for (size_t k = 0; k < index.size(); ++k)
+                {
+                    auto &[source, item] = batch[index[k]];
+                    if (source->on_result)
+                        source->on_result(item.frame, item.frame_id, detections[k]);
+                }
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERR("Inference failed, scheduler stopped: " << e.what());
+            std::lock_guard lock(this->mutex);
+            this->error = e.what();
+            this->failed.store(true, std::memory_order_relaxed);
+            for (const std::unique_ptr<Source> &s : this->sources)
+            {
+                s->dropped += s->queue.size();
+                s->queue.clear();
+            }
+            this->queued = 0;
+            this->running_batch = false;
+            this->space.notify_all();
+            break;
+        }
+
+        std::lock_guard lock(this->mutex);
+        const Clock::time_point now = Clock::now();
+        for (const auto &[source, item] : batch)
+        {
+            ++source->processed;
+            source->latency += now - item.submitted;
+            source->last_result = now;
+        }
+        this->last_frame = now;
+        ++this->batches;
+        this->frames += batch.size();
+        this->running_batch = false;
+    }
+}
+
+InferenceScheduler::Stats InferenceScheduler::GetStats() const
+{
+    const auto seconds_between = [](Clock::time_point start, Clock::time_point end) {
+        return start == Clock::time_point{} || end == Clock::time_point{} ? 0.0 : std::chrono::duration<double>(end - start).count();
+    };
+
+    std::lock_guard lock(this->mutex);
+    Stats stats;
+    stats.batches = this->batches;
+    stats.frames = this->frames;
+    if (const double elapsed = seconds_between(this->first_frame, this->last_frame); elapsed > 0)
+        stats.fps = this->frames / elapsed;
+    for (const std::unique_ptr<Source> &s : this->sources)
+    {
+        SourceStats source;
+        source.name = s->name;
+        source.submitted = s->submitted;
+        source.dropped = s->dropped;
+        source.processed = s->processed;
+        source.open = s->open;
+        if (s->processed > 0)
+            source.mean_latency_ms = std::chrono::duration<double, std::milli>(s->latency).count() / s->processed;
+        if (const double elapsed = seconds_between(s->first_submit, s->last_result); elapsed > 0)
+            source.fps = s->processed / elapsed;
+        stats.sources.push_back(std::move(source));
+    }
+    return stats;
+}
+
+std::string InferenceScheduler::Summary() const
+{
+    const Stats stats = this->GetStats();
+    std::string summary = std::format("Inference: {:.1f} fps over {} sources, {} frames in {} batches ({:.2f} per batch)", stats.fps, stats.sources.size(),
+                                      stats.frames, stats.batches, stats.batches ? static_cast<double>(stats.frames) / stats.batches : 0.0);
+    for (const SourceStats &s : stats.sources)
+    {
+        summary += std::format("\n  {:<24} {:6.1f} fps, {} of {} frames dropped, {:.1f} ms submit to result{}", s.name, s.fps, s.dropped, s.submitted,
+                               s.mean_latency_ms, s.open ? "" : " (closed)");
+    }
+    return summary;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Detection.hpp"
+
+class YOLO;
+
+// Shares one model between several frame sources. Each source submits from its own capture thread
+// into a short queue of its own. The scheduler thread takes up to max_batch frames round-robin, one
+// per source per turn and starting after the source served last, so a fast camera cannot starve a
+// slow one. It runs them through YOLO::DetectBatch and hands every source its detections through
+// the callback the source registered. A full queue drops a frame by the source's policy instead of
+// letting latency grow.
+//
+//   InferenceScheduler scheduler(model);
+//   const uint8_t cam = scheduler.AddSource("cam0", [](const cv::Mat &frame, uint64_t id, const std::vector<Detection> &d) { ... });
+//   scheduler.Submit(cam, frame, frame_id);   // from the capture thread, frame must not be written to afterwards
+class InferenceScheduler
+{
+public:
+    enum class DropPolicy
+    {
+        DropOldest, // live sources: the newest frame is the one worth detecting
+        DropNewest, // keeps a backlog in order, new frames wait for room
+        Block       // Submit waits for room, files processed frame by frame
+    };
+
+    // Runs on the scheduler thread between batches, keep it short
+    using ResultFn = std::function<void(const cv::Mat &frame, uint64_t frame_id, const std::vector<Detection> &detections)>;
+
+    struct SourceOptions
+    {
+        size_t queue_depth = 2;
+        DropPolicy drop = DropPolicy::DropOldest;
+        // See YOLO::Detect; frames of mirrored and plain sources go through the network separately
+        bool mirror = false;
+    };
+
+    struct Options
+    {
+        size_t max_batch = 4;
+        // How long a partial batch waits for frames of the other open sources
+        std::chrono::microseconds linger{std::chrono::milliseconds(3)};
+        // Runs first on the scheduler thread, to pin it for example
+        std::function<void()> thread_init;
+    };
+
+    struct SourceStats
+    {
+        std::string name;
+        uint64_t submitted = 0;
+        uint64_t dropped = 0;
+        uint64_t processed = 0;
+        double mean_latency_ms = 0.0; // submit to result
+        double fps = 0.0;             // processed frames per second, first submit to last result
+        bool open = true;
+    };
+
+    struct Stats
+    {
+        uint64_t batches = 0;
+        uint64_t frames = 0;
+        double fps = 0.0; // all sources together
+        std::vector<SourceStats> sources;
+    };
+
+    explicit InferenceScheduler(YOLO &model);
+    InferenceScheduler(YOLO &model, Options options);
+    // Runs what is queued, then stops
+    ~InferenceScheduler();
+
+    InferenceScheduler(const InferenceScheduler &) = delete;
+    InferenceScheduler &operator=(const InferenceScheduler &) = delete;
+
+    // Source ids are handed out in order and double as the journal's source id
+    uint8_t AddSource(std::string name, ResultFn on_result);
+    uint8_t AddSource(std::string name, ResultFn on_result, SourceOptions options);
+    // False when a frame was dropped, this one or an older one. The Mat is kept by reference
+    // until its result is delivered, so the capture thread has to read the next frame into a new buffer.
+    bool Submit(uint8_t source, const cv::Mat &frame, uint64_t frame_id);
+    // The source submits no more frames; what it queued is still processed
+    void CloseSource(uint8_t source);
+    // Every source is closed and nothing is queued or running
+    bool Idle() const;
+    // DetectBatch threw; the scheduler stops taking frames and Error() says why
+    bool Failed() const { return this->failed.load(std::memory_order_relaxed); }
+    std::string Error() const;
+    void Stop();
+
+    Stats GetStats() const;
+    std::string Summary() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Item
+    {
+        cv::Mat frame;
+        uint64_t frame_id;
+        Clock::time_point submitted;
+    };
+
+    struct Source
+    {
+        std::string name;
+        ResultFn on_result;
+        SourceOptions options;
+        std::deque<Item> queue;
+        bool open = true;
+        uint64_t submitted = 0;
+        uint64_t dropped = 0;
+        uint64_t processed = 0;
+        Clock::duration latency{};
+        Clock::time_point first_submit{};
+        Clock::time_point last_result{};
+    };
+
+    YOLO &model;
+    const Options options;
+
+    mutable std::mutex mutex;
+    std::condition_variable work;  // frames queued, or stopping
+    std::condition_variable space; // a Block source's queue has room
+    // Stable addresses, sources are only ever added
+    std::vector<std::unique_ptr<Source>> sources;
+    size_t next_source = 0;
+    size_t queued = 0;
+    bool running_batch = false;
+    bool stopping = false;
+    uint64_t batches = 0;
+    uint64_t frames = 0;
+    Clock::time_point first_frame{};
+    Clock::time_point last_frame{};
+    std::atomic<bool> failed{false};
+    std::string error;
+
+    std::thread thread;
+
+    void Run();
+    // Round-robin pick under the lock
+    std::vector<std::pair<Source *, Item>> TakeBatch();
+};
@@ -0,0 +1,78 @@
+#include "MappedFile.hpp"
+
+#include <format>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::filesystem::path &path)
+{
+#if defined(_WIN32)
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error(std::format("Unable to open {}", path.generic_string()));
+    this->file = handle;
+    LARGE_INTEGER size{};
+    GetFileSizeEx(handle, &size);
+    this->size = static_cast<size_t>(size.QuadPart);
+    if (this->size == 0)
+        return;
+    this->mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (this->mapping)
+        this->data = static_cast<const uint8_t *>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, this->size));
+#else
+    this->fd = open(path.c_str(), O_RDONLY);
+    if (this->fd < 0)
+        throw std::runtime_error(std::format("Unable to open {}", path.generic_string()));
+    struct stat st{};
+    fstat(this->fd, &st);
+    this->size = static_cast<size_t>(st.st_size);
+    if (this->size == 0)
+        return;
+    void *view = mmap(nullptr, this->size, PROT_READ, MAP_SHARED, this->fd, 0);
+    if (view != MAP_FAILED)
+    {
+        this->data = static_cast<const uint8_t *>(view);
+        // Journal queries and model parsers both read front to back
+        madvise(view, this->size, MADV_SEQUENTIAL);
+    }
+#endif
+    if (!this->data)
+    {
+        this->Close();
+        throw std::runtime_error(std::format("Unable to map {}", path.generic_string()));
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    this->Close();
+}
+
+void MappedFile::Close()
+{
+#if defined(_WIN32)
+    if (this->data)
+        UnmapViewOfFile(this->data);
+    if (this->mapping)
+        CloseHandle(this->mapping);
+    if (this->file)
+        CloseHandle(this->file);
+    this->mapping = nullptr;
+    this->file = nullptr;
+#else
+    if (this->data)
+        munmap(const_cast<uint8_t *>(this->data), this->size);
+    if (this->fd >= 0)
+        close(this->fd);
+    this->fd = -1;
+#endif
+    this->data = nullptr;
+}
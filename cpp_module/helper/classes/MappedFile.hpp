@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Read-only view of a whole file. The pages come straight from the page cache, so every process
+// mapping the same file shares them and nothing is copied into a private buffer.
+class MappedFile
+{
+public:
+    // Throws std::runtime_error when the file cannot be opened or mapped
+    explicit MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Null for an empty file
+    const uint8_t *Data() const { return this->data; }
+    size_t Size() const { return this->size; }
+
+private:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    void *file = nullptr;
+    void *mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    void Close();
+};
@@ -0,0 +1,275 @@
+#include "Nms.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <stdexcept>
+
+NMS::NMS(NmsConfig config) : config(config) {}
+
+float NMS::IoU(const cv::Rect &a, const cv::Rect &b)
+{
+    const int x1 = std::max(a.x, b.x);
+    const int y1 = std::max(a.y, b.y);
+    const int x2 = std::min(a.x + a.width, b.x + b.width);
+    const int y2 = std::min(a.y + a.height, b.y + b.height);
+    if (x2 <= x1 || y2 <= y1)
+        return 0.0f;
+
+    const float inter = static_cast<float>(x2 - x1) * static_cast<float>(y2 - y1);
+    const float area_union = static_cast<float>(a.width) * a.height + static_cast<float>(b.width) * b.height - inter;
+    return area_union > 0.0f ? inter / area_union : 0.0f;
+}
+
+void NMS::BuildGrid(const std::vector<Detection> &candidates, const int *group, int count)
+{
+    int min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+    double extent_sum = 0.0;
+    for (int g = 0; g < count; ++g)
+    {
+        const cv::Rect &box = candidates[group[g]].box;
+        min_x = std::min(min_x, box.x);
+        min_y = std::min(min_y, box.y);
+        max_x = std::max(max_x, box.x + std::max(box.width, 0));
+        max_y = std::max(max_y, box.y + std::max(box.height, 0));
+        extent_sum += std::max(box.width, box.height);
+    }
+
+    this->grid_x = min_x;
+    this->grid_y = min_y;
+    this->grid_cols = 1;
+    this->grid_rows = 1;
+    this->cell_size = std::max(1, max_x - min_x + 1) + std::max(1, max_y - min_y + 1);
+
+    // Small groups are cheaper to scan linearly, so they get a single cell
+    if (count >= GRID_MIN_BOXES)
+    {
+        // Cells about the size of an average box keep the number of boxes per cell small, but
+        // sparse candidates spread over a large area must not produce a huge, mostly empty grid
+        this->cell_size = std::max(1, static_cast<int>(std::ceil(extent_sum / count)));
+        const int64_t max_cells = 4LL * count;
+        while (true)
+        {
+            this->grid_cols = (max_x - min_x) / this->cell_size + 1;
+            this->grid_rows = (max_y - min_y) / this->cell_size + 1;
+            if (static_cast<int64_t>(this->grid_cols) * this->grid_rows <= max_cells)
+                break;
+            this->cell_size *= 2;
+        }
+    }
+
+    const size_t total_cells = static_cast<size_t>(this->grid_cols) * this->grid_rows;
+    if (this->cells.size() < total_cells)
+        this->cells.resize(total_cells);
+    for (size_t c = 0; c < total_cells; ++c)
+        this->cells[c].clear();
+
+    this->visit_stamp.assign(count, -1);
+}
+
+void NMS::CellSpan(const cv::Rect &box, int &col0, int &col1, int &row0, int &row1) const
+{
+    col0 = std::clamp((box.x - this->grid_x) / this->cell_size, 0, this->grid_cols - 1);
+    row0 = std::clamp((box.y - this->grid_y) / this->cell_size, 0, this->grid_rows - 1);
+    col1 = std::clamp((box.x + std::max(box.width, 0) - this->grid_x) / this->cell_size, 0, this->grid_cols - 1);
+    row1 = std::clamp((box.y + std::max(box.height, 0) - this->grid_y) / this->cell_size, 0, this->grid_rows - 1);
+}
+
+void NMS::HardGroup(const std::vector<Detection> &candidates, const int *group, int count)
+{
+    this->BuildGrid(candidates, group, count);
+
+    // Cells hold positions in `group` of boxes that have been kept
+    for (int g = 0; g < count; ++g)
+    {
+        const cv::Rect &box = candidates[group[g]].box;
+        int col0, col1, row0, row1;
+        this->CellSpan(box, col0, col1, row0, row1);
+
+        bool suppressed = false;
+        for (int row = row0; row <= row1 && !suppressed; ++row)
+        {
+            for (int col = col0; col <= col1 && !suppressed; ++col)
+            {
+                for (const int k : this->cells[row * this->grid_cols + col])
+                {
+                    // A kept box spanning several cells is only tested once per candidate
+                    if (this->visit_stamp[k] == g)
+                        continue;
+                    this->visit_stamp[k] = g;
+                    if (IoU(box, candidates[group[k]].box) > this->config.iou_threshold)
+                    {
+                        suppressed = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (suppressed)
+            continue;
+
+        this->kept.push_back(group[g]);
+        this->scores[group[g]] = candidates[group[g]].confidence;
+        for (int row = row0; row <= row1; ++row)
+            for (int col = col0; col <= col1; ++col)
+                this->cells[row * this->grid_cols + col].push_back(g);
+    }
+}
+
+void NMS::SoftGroup(const std::vector<Detection> &candidates, const int *group, int count)
+{
+    this->BuildGrid(candidates, group, count);
+
+    // Every candidate is bucketed up front because any of them may need its score decayed
+    std::vector<char> alive(count, 1);
+    using Entry = std::pair<float, int>;
+    std::priority_queue<Entry> heap;
+    for (int g = 0; g < count; ++g)
+    {
+        int col0, col1, row0, row1;
+        this->CellSpan(candidates[group[g]].box, col0, col1, row0, row1);
+        for (int row = row0; row <= row1; ++row)
+            for (int col = col0; col <= col1; ++col)
+                this->cells[row * this->grid_cols + col].push_back(g);
+
+        this->scores[group[g]] = candidates[group[g]].confidence;
+        heap.emplace(candidates[group[g]].confidence, g);
+    }
+
+    const float inv_sigma = 1.0f / std::max(this->config.soft_sigma, 1e-6f);
+    while (!heap.empty())
+    {
+        const auto [score, g] = heap.top();
+        heap.pop();
+        // Entries are pushed again every time a score decays, so skip the stale ones
+        if (!alive[g] || score != this->scores[group[g]])
+            continue;
+
+        alive[g] = 0;
+        this->kept.push_back(group[g]);
+
+        const cv::Rect &box = candidates[group[g]].box;
+        int col0, col1, row0, row1;
+        this->CellSpan(box, col0, col1, row0, row1);
+        for (int row = row0; row <= row1; ++row)
+        {
+            for (int col = col0; col <= col1; ++col)
+            {
+                for (const int k : this->cells[row * this->grid_cols + col])
+                {
+                    if (!alive[k] || this->visit_stamp[k] == g)
+                        continue;
+                    this->visit_stamp[k] = g;
+
+                    const float iou = IoU(box, candidates[group[k]].box);
+                    if (iou <= 0.0f)
+                        continue;
+
+                    float &decayed = this->scores[group[k]];
+                    decayed *= std::exp(-(iou * iou) * inv_sigma);
+                    if (decayed <= this->config.score_threshold)
+                        alive[k] = 0;
+                    else
+                        heap.emplace(decayed, k);
+                }
+            }
+        }
+    }
+}
+
+std::vector<int> NMS::Run(const std::vector<Detection> &candidates, std::vector<float> *soft_scores)
+{
+    this->order.clear();
+    this->kept.clear();
+    this->scores.assign(candidates.size(), 0.0f);
+
+    for (int i = 0; i < static_cast<int>(candidates.size()); ++i)
+    {
+        if (candidates[i].confidence > this->config.score_threshold)
+            this->order.push_back(i);
+    }
+
+    // Sorting by class first turns class-aware suppression into independent runs over each group
+    const bool class_aware = this->config.class_aware;
+    std::sort(this->order.begin(), this->order.end(), [&candidates, class_aware](int a, int b) {
+        if (class_aware && candidates[a].class_id != candidates[b].class_id)
+            return candidates[a].class_id < candidates[b].class_id;
+        if (candidates[a].confidence != candidates[b].confidence)
+            return candidates[a].confidence > candidates[b].confidence;
+        return a < b;
+    });
+
+    size_t begin = 0;
+    while (begin < this->order.size())
+    {
+        size_t end = begin + 1;
+        if (class_aware)
+        {
+            while (end < this->order.size() && candidates[this->order[end]].class_id == candidates[this->order[begin]].class_id)
+                ++end;
+        }
+        else
+        {
+            end = this->order.size();
+        }
+
+        if (this->config.soft)
+            this->SoftGroup(candidates, this->order.data() + begin, static_cast<int>(end - begin));
+        else
+            this->HardGroup(candidates, this->order.data() + begin, static_cast<int>(end - begin));
+        begin = end;
+    }
+
+    std::vector<int> result = this->kept;
+    std::stable_sort(result.begin(), result.end(), [this](int a, int b) { return this->scores[a] > this->scores[b]; });
+    if (this->config.top_k > 0 && static_cast<int>(result.size()) > this->config.top_k)
+        result.resize(this->config.top_k);
+
+    if (soft_scores)
+        *soft_scores = this->scores;
+    return result;
+}
+
+std::vector<Detection> NMS::Apply(const std::vector<Detection> &candidates)
+{
+    const std::vector<int> indices = this->Run(candidates);
+
+    std::vector<Detection> result;
+    result.reserve(indices.size());
+    for (const int idx : indices)
+    {
+        result.push_back(candidates[idx]);
+        result.back().confidence = this->scores[idx];
+    }
+    return result;
+}
+
+std::vector<std::vector<Detection>> NMS::ApplyBatch(const std::vector<std::vector<Detection>> &images) const
+{
+    std::vector<std::vector<Detection>> results(images.size());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(images.size())), [&](const cv::Range &range) {
+        NMS local(this->config);
+        for (int i = range.start; i < range.end; ++i)
+            results[i] = local.Apply(images[i]);
+    });
+    return results;
+}
+
+std::vector<Detection> NMS::ApplyTiles(const std::vector<std::vector<Detection>> &tiles, const std::vector<cv::Point> &origins)
+{
+    if (tiles.size() != origins.size())
+        throw std::invalid_argument("ApplyTiles needs one origin per tile");
+
+    std::vector<Detection> merged;
+    for (size_t t = 0; t < tiles.size(); ++t)
+    {
+        for (Detection detection : tiles[t])
+        {
+            detection.box.x += origins[t].x;
+            detection.box.y += origins[t].y;
+            merged.push_back(detection);
+        }
+    }
+    return this->Apply(merged);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "Detection.hpp"
+
+struct NmsConfig
+{
+    float score_threshold = 0.5f;
+    float iou_threshold = 0.4f;
+    // Boxes only suppress boxes of the same class
+    bool class_aware = true;
+    // Gaussian Soft-NMS: overlapping boxes have their score decayed instead of being removed
+    bool soft = false;
+    float soft_sigma = 0.5f;
+    // Keep at most this many boxes per image (0 = unlimited)
+    int top_k = 0;
+};
+
+// Greedy non-maximum suppression. Candidates are processed in descending score order; once a
+// class group is larger than GRID_MIN_BOXES the kept boxes are bucketed into a uniform grid so
+// each candidate is only compared with kept boxes that can actually overlap it.
+class NMS
+{
+private:
+    NmsConfig config;
+
+    // Scratch storage reused between calls to avoid per-frame allocations
+    std::vector<int> order;
+    std::vector<int> kept;
+    std::vector<float> scores;
+    std::vector<std::vector<int>> cells;
+    std::vector<int> visit_stamp;
+    int grid_x = 0;
+    int grid_y = 0;
+    int grid_cols = 1;
+    int grid_rows = 1;
+    int cell_size = 1;
+
+    void BuildGrid(const std::vector<Detection> &candidates, const int *group, int count);
+    void CellSpan(const cv::Rect &box, int &col0, int &col1, int &row0, int &row1) const;
+    void HardGroup(const std::vector<Detection> &candidates, const int *group, int count);
+    void SoftGroup(const std::vector<Detection> &candidates, const int *group, int count);
+
+public:
+    static constexpr int GRID_MIN_BOXES = 64;
+
+    explicit NMS(NmsConfig config = {});
+
+    const NmsConfig &Config() const { return this->config; }
+
+    // Returns indices into `candidates` of the boxes that survive, best score first. In soft mode
+    // the decayed scores are written to `soft_scores` (indexed like `candidates`) when provided.
+    std::vector<int> Run(const std::vector<Detection> &candidates, std::vector<float> *soft_scores = nullptr);
+
+    // Convenience wrapper returning the surviving detections, with decayed scores in soft mode
+    std::vector<Detection> Apply(const std::vector<Detection> &candidates);
+
+    // Independent suppression for several images, run in parallel
+    std::vector<std::vector<Detection>> ApplyBatch(const std::vector<std::vector<Detection>> &images) const;
+
+    // Tiles of one image: boxes are shifted by their tile origin and suppressed together, so
+    // duplicates along tile seams are removed
+    std::vector<Detection> ApplyTiles(const std::vector<std::vector<Detection>> &tiles, const std::vector<cv::Point> &origins);
+
+    static float IoU(const cv::Rect &a, const cv::Rect &b);
+};
@@ -0,0 +1,124 @@
+#include "Renderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "FramePool.hpp"
+#include "Utils.hpp"
+
+Renderer::Renderer(std::vector<std::string> class_names) : Renderer(std::move(class_names), Options{}) {}
+
+Renderer::Renderer(std::vector<std::string> class_names, Options options)
+    : class_names(std::move(class_names)), options(options), thread(&Renderer::Run, this)
+{
+}
+
+Renderer::~Renderer()
+{
+    {
+        std::lock_guard lock(this->mutex);
+        this->stop = true;
+    }
+    this->wake.notify_one();
+    if (this->thread.joinable())
+        this->thread.join();
+}
+
+void Renderer::Submit(const std::string &window, const cv::Mat &frame, const std::vector<Detection> &detections, bool mirror)
+{
+    if (frame.empty())
+        return;
+
+    const double scale = std::min({1.0, this->options.window_size.width / static_cast<double>(frame.cols),
+                                   this->options.window_size.height / static_cast<double>(frame.rows)});
+    const cv::Size preview_size(std::max(1, static_cast<int>(std::lround(frame.cols * scale))),
+                                std::max(1, static_cast<int>(std::lround(frame.rows * scale))));
+
+    cv::Mat preview = FramePool::Instance().Acquire(preview_size, frame.type());
+    if (preview_size == frame.size() && mirror)
+        cv::flip(frame, preview, 1);
+    else if (preview_size == frame.size())
+        frame.copyTo(preview);
+    else
+    {
+        cv::resize(frame, preview, preview_size, 0, 0, cv::INTER_AREA);
+        if (mirror)
+            cv::flip(preview, preview, 1);
+    }
+
+    std::vector<Detection> scaled(detections);
+    for (Detection &d : scaled)
+        d.box = cv::Rect(static_cast<int>(d.box.x * scale), static_cast<int>(d.box.y * scale),
+                         static_cast<int>(d.box.width * scale), static_cast<int>(d.box.height * scale));
+
+    {
+        std::lock_guard lock(this->mutex);
+        Pending &slot = this->pending[window];
+        slot.preview = std::move(preview);
+        slot.detections = std::move(scaled);
+        slot.fresh = true;
+    }
+    this->wake.notify_one();
+}
+
+void Renderer::Draw(cv::Mat &preview, const std::vector<Detection> &detections) const
+{
+    for (const Detection &detection : detections)
+    {
+        cv::rectangle(preview, detection.box, cv::Scalar(0, 255, 0), 1);
+        std::string label = (detection.class_id >= 0 && detection.class_id < static_cast<int>(this->class_names.size())) ? this->class_names[detection.class_id] : "Unknown";
+        label += cv::format(": %.2f", detection.confidence);
+        cv::putText(preview, label, cv::Point(detection.box.x, std::max(12, detection.box.y - 4)), cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar(0, 255, 0), 1);
+    }
+}
+
+void Renderer::Run()
+{
+    const auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<double>(1.0 / this->options.max_fps));
+    std::vector<std::pair<std::string, Pending>> frames;
+
+    while (true)
+    {
+        const auto tick_end = std::chrono::steady_clock::now() + period;
+        {
+            std::unique_lock lock(this->mutex);
+            // No window to pump yet, waitKey would return straight away
+            if (this->windows.empty())
+                this->wake.wait(lock, [this] { return this->stop || std::any_of(this->pending.begin(), this->pending.end(), [](const auto &p) { return p.second.fresh; }); });
+            if (this->stop)
+                break;
+
+            frames.clear();
+            for (auto &[window, slot] : this->pending)
+            {
+                if (!slot.fresh)
+                    continue;
+                frames.emplace_back(window, std::move(slot));
+                slot.fresh = false;
+            }
+        }
+
+        for (auto &[window, frame] : frames)
+        {
+            if (this->windows.insert(window).second)
+            {
+                cv::namedWindow(window, cv::WINDOW_NORMAL);
+                cv::resizeWindow(window, frame.preview.cols, frame.preview.rows);
+            }
+            this->Draw(frame.preview, frame.detections);
+            cv::imshow(window, frame.preview);
+        }
+
+        // Pumps the GUI events for the rest of the tick, which is also what caps the frame rate
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(tick_end - std::chrono::steady_clock::now());
+        if (cv::waitKey(static_cast<int>(std::max<int64_t>(1, remaining.count()))) == 27)
+            this->quit_requested = true;
+        for (const std::string &window : this->windows)
+        {
+            if (cv::getWindowProperty(window, cv::WND_PROP_VISIBLE) < 1)
+                this->quit_requested = true;
+        }
+    }
+
+    cv::destroyAllWindows();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Detection.hpp"
+
+// Owns the preview windows on a thread of its own, so capture and inference never block on the GUI.
+// Submit() downscales the frame to the window size right away (the caller's buffer may be reused as
+// soon as it returns) and hands it over with its detections; the render thread shows the newest
+// frame of each window at most max_fps times a second, drawing the boxes at preview resolution.
+// Every HighGUI call happens on the render thread, windows are created once on their first frame.
+class Renderer
+{
+public:
+    struct Options
+    {
+        cv::Size window_size{1280, 720};
+        double max_fps = 30.0;
+    };
+
+    explicit Renderer(std::vector<std::string> class_names = {});
+    Renderer(std::vector<std::string> class_names, Options options);
+    // Closes the windows
+    ~Renderer();
+
+    Renderer(const Renderer &) = delete;
+    Renderer &operator=(const Renderer &) = delete;
+
+    // Replaces whatever the window had not shown yet. With mirror set the preview is flipped
+    // horizontally, the detections are expected in flipped coordinates already (YOLO::Detect(frame, true)).
+    void Submit(const std::string &window, const cv::Mat &frame, const std::vector<Detection> &detections = {}, bool mirror = false);
+    // ESC was pressed or a window was closed
+    bool QuitRequested() const { return this->quit_requested.load(std::memory_order_relaxed); }
+
+private:
+    struct Pending
+    {
+        cv::Mat preview;
+        std::vector<Detection> detections;
+        bool fresh = false;
+    };
+
+    const std::vector<std::string> class_names;
+    const Options options;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::map<std::string, Pending> pending;
+    bool stop = false;
+    std::atomic<bool> quit_requested{false};
+
+    // Render thread state
+    std::set<std::string> windows;
+
+    std::thread thread;
+
+    void Run();
+    void Draw(cv::Mat &preview, const std::vector<Detection> &detections) const;
+};
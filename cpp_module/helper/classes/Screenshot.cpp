@@ -2,7 +2,11 @@
 #if defined(__linux__)
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/Xinerama.h>
+#include <X11/extensions/Xrandr.h>
 #endif
+#include <algorithm>
+#include <tuple>
 
 Screenshot::Screenshot(const std::string &imagePath)
     : _path(imagePath)
@@ -25,6 +29,14 @@ void Screenshot::DisplayDeleter::operator()(Display *d) const
         XCloseDisplay(d);
     }
 }
+
+void Screenshot::ImageDeleter::operator()(XImage *img) const
+{
+    if (img)
+    {
+        XDestroyImage(img);
+    }
+}
 #endif
 
 void Screenshot::Init()
@@ -65,7 +77,7 @@ void Screenshot::Init()
 void Screenshot::capture()
 {
 #if defined(_WIN32)
-    HRESULT hr = DG::CaptureScreenshot(this->_ctx, this->_path, this->_screenshot);
+    HRESULT hr = DG::CaptureScreenshot(this->_ctx, this->_saveFiles ? this->_path : std::string(), this->_screenshot);
     if (FAILED(hr))
     {
         if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET || hr == DXGI_ERROR_DEVICE_HUNG)
@@ -96,6 +108,8 @@ void Screenshot::capture()
             throw std::runtime_error("Failed to capture screenshot");
         }
     }
+    this->_outputs.assign(1, ScreenOutput{0, "primary", cv::Rect(0, 0, this->_screenshot.cols, this->_screenshot.rows)});
+    this->_frames.assign(1, this->_screenshot);
 
 #elif defined(__linux__)
 
@@ -104,41 +118,144 @@ void Screenshot::capture()
         throw std::runtime_error("X display is not open for capture");
     }
     Display *display = this->_display.get();
+    const Window root = DefaultRootWindow(display);
+
+    // Release the previous images before asking the server for the next ones
+    this->_frames.clear();
+    this->_images.clear();
+    this->_outputs = this->EnumerateOutputs();
+
+    const std::string timestamp = GetTimestampString();
+    for (const ScreenOutput &output : this->_outputs)
+    {
+        const cv::Rect &b = output.bounds;
+        std::unique_ptr<XImage, ImageDeleter> image(XGetImage(display, root, b.x, b.y, b.width, b.height, AllPlanes, ZPixmap));
+        if (!image)
+        {
+            throw std::runtime_error("Unable to get Image for output " + output.name);
+        }
+        const XImage *img = image.get();
+
+        // Wrap the XImage data (assuming 32bpp BGRA) instead of copying it, inference takes BGRA as is
+        this->_frames.emplace_back(img->height, img->width, CV_8UC4, img->data, img->bytes_per_line);
+        this->_images.push_back(std::move(image));
+
+        if (!this->_saveFiles)
+        {
+            continue;
+        }
+        std::string fileName = "screenshot_" + timestamp;
+        if (this->_outputs.size() > 1)
+        {
+            fileName += "_" + output.name;
+        }
+        const std::filesystem::path fullPath = this->_path + "/" + fileName + ".png";
+
+        // X leaves the alpha byte undefined, so only the PNG gets a BGR copy
+        cv::cvtColor(this->_frames.back(), this->_bgr, cv::COLOR_BGRA2BGR);
+
+        // Save to file
+        if (!cv::imwrite(fullPath.generic_string(), this->_bgr))
+        {
+            throw std::runtime_error("Unable to save screenshot");
+        }
+        LOG("Saved to: " << fullPath.generic_string());
+    }
+#endif
+}
+
+void Screenshot::setSaveFiles(bool saveFiles)
+{
+    this->_saveFiles = saveFiles;
+}
+
+const std::vector<cv::Mat> &Screenshot::getImages() const
+{
+    return this->_frames;
+}
 
+const std::vector<ScreenOutput> &Screenshot::getOutputs() const
+{
+    return this->_outputs;
+}
+
+const cv::Mat &Screenshot::getImage() const
+{
+    static const cv::Mat empty;
+    return this->_frames.empty() ? empty : this->_frames.front();
+}
+
+#if defined(__linux__)
+std::vector<ScreenOutput> Screenshot::EnumerateOutputs() const
+{
+    Display *display = this->_display.get();
     const Window root = DefaultRootWindow(display);
 
     XWindowAttributes gwa;
     XGetWindowAttributes(display, root, &gwa);
+    const cv::Rect screen(0, 0, gwa.width, gwa.height);
 
-    auto image_deleter = [](XImage *img)
-    { if (img) XDestroyImage(img); };
-    std::unique_ptr<XImage, decltype(image_deleter)> img(
-        XGetImage(display, root, 0, 0, gwa.width, gwa.height, AllPlanes, ZPixmap),
-        image_deleter);
-
-    if (!img)
+    std::vector<ScreenOutput> randr;
+    int event_base = 0;
+    int error_base = 0;
+    int major = 0;
+    int minor = 0;
+    if (XRRQueryExtension(display, &event_base, &error_base) && XRRQueryVersion(display, &major, &minor) &&
+        (major > 1 || (major == 1 && minor >= 5)))
     {
-        throw std::runtime_error("Unable to get Image");
+        int count = 0;
+        if (XRRMonitorInfo *monitors = XRRGetMonitors(display, root, True, &count))
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                char *atom_name = XGetAtomName(display, monitors[i].name);
+                randr.push_back({0, atom_name ? atom_name : "monitor" + std::to_string(i),
+                                 cv::Rect(monitors[i].x, monitors[i].y, monitors[i].width, monitors[i].height)});
+                if (atom_name)
+                {
+                    XFree(atom_name);
+                }
+            }
+            XRRFreeMonitors(monitors);
+        }
     }
-    std::string fileName = "screenshot_" + GetTimestampString() + ".png";
-    const std::filesystem::path fullPath = this->_path + "/" + fileName;
 
-    // Create cv::Mat from XImage data (assuming 32bpp)
-    const cv::Mat mat(img->height, img->width, CV_8UC4, img->data, img->bytes_per_line);
+    std::vector<ScreenOutput> xinerama;
+    if (XineramaIsActive(display))
+    {
+        int count = 0;
+        if (XineramaScreenInfo *screens = XineramaQueryScreens(display, &count))
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                xinerama.push_back({0, "screen" + std::to_string(screens[i].screen_number),
+                                    cv::Rect(screens[i].x_org, screens[i].y_org, screens[i].width, screens[i].height)});
+            }
+            XFree(screens);
+        }
+    }
 
-    // Convert BGRA to BGR if needed
-    cv::cvtColor(mat, this->_screenshot, cv::COLOR_BGRA2BGR);
+    // Xvfb's RandR reports a single monitor spanning every Xinerama screen, so take whichever sees more
+    std::vector<ScreenOutput> outputs = xinerama.size() > randr.size() ? std::move(xinerama) : std::move(randr);
 
-    // Save to file
-    if (!cv::imwrite(fullPath.generic_string(), this->_screenshot))
+    // Clip to the root window, XGetImage fails on anything outside it
+    for (ScreenOutput &output : outputs)
     {
-        throw std::runtime_error("Unable to save screenshot");
+        output.bounds &= screen;
+    }
+    std::erase_if(outputs, [](const ScreenOutput &output) { return output.bounds.empty(); });
+    if (outputs.empty())
+    {
+        outputs.push_back({0, "root", screen});
     }
-    LOG("Saved to: " << fullPath.generic_string());
-#endif
-}
 
-const cv::Mat &Screenshot::getImage() const
-{
-    return this->_screenshot;
+    std::sort(outputs.begin(), outputs.end(), [](const ScreenOutput &a, const ScreenOutput &b) {
+        return std::tie(a.bounds.y, a.bounds.x) < std::tie(b.bounds.y, b.bounds.x);
+    });
+    for (size_t i = 0; i < outputs.size(); ++i)
+    {
+        outputs[i].id = static_cast<uint32_t>(i);
+    }
+    return outputs;
 }
+#endif
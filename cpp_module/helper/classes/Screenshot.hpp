@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Utils.hpp"
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 #if defined(_WIN32)
 #include "dxdiag.hpp"
@@ -9,27 +11,61 @@
 // Forward declare Display to avoid including X11 headers in a public header.
 struct _XDisplay;
 using Display = struct _XDisplay;
+struct _XImage;
+using XImage = struct _XImage;
 #endif
 
+// One monitor of the desktop. Ids are positions in top-to-bottom, left-to-right order, so they stay
+// the same across runs as long as the monitor layout does.
+struct ScreenOutput
+{
+    uint32_t id = 0;
+    std::string name;
+    cv::Rect bounds; // in root window coordinates
+};
+
+// Captures every monitor as its own frame. On Linux the monitors come from RandR 1.5, then Xinerama,
+// falling back to the whole root window. A multi-head Xvfb exercises the Xinerama path:
+//   Xvfb :99 +xinerama -screen 0 1280x720x24 -screen 1 1920x1080x24
+// On Windows only the primary output is captured here; agent_live duplicates every output.
 class Screenshot
 {
 private:
 #if defined(_WIN32)
     DG::DXGIContext _ctx;
+    cv::Mat _screenshot;
 #elif defined(__linux__)
     struct DisplayDeleter
     {
         void operator()(Display *d) const;
     };
+    struct ImageDeleter
+    {
+        void operator()(XImage *img) const;
+    };
     std::unique_ptr<Display, DisplayDeleter> _display;
+    // Back _frames until the next capture, one per output
+    std::vector<std::unique_ptr<XImage, ImageDeleter>> _images;
+    cv::Mat _bgr;
+    std::vector<ScreenOutput> EnumerateOutputs() const;
 #endif
     std::string _path;
-    cv::Mat _screenshot;
+    bool _saveFiles = true;
+    std::vector<ScreenOutput> _outputs;
+    std::vector<cv::Mat> _frames;
     void Init();
 
 public:
     Screenshot(const std::string &imagePath);
     ~Screenshot();
+    // Grabs every output and saves one PNG per output. Monitors are enumerated again on every call,
+    // so hotplugged or rearranged screens are picked up.
     void capture();
+    // Off when the caller archives the frames itself; capture() then only grabs them
+    void setSaveFiles(bool saveFiles);
+    // BGRA frames of the last capture in getOutputs() order, valid until the next call to capture()
+    const std::vector<cv::Mat> &getImages() const;
+    const std::vector<ScreenOutput> &getOutputs() const;
+    // First output's frame
     const cv::Mat &getImage() const;
 };
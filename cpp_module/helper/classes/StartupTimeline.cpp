@@ -0,0 +1,50 @@
+#include "StartupTimeline.hpp"
+
+#include <algorithm>
+#include <format>
+
+namespace
+{
+    double Milliseconds(StartupTimeline::Clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+}
+
+StartupTimeline::Phase::Phase(StartupTimeline &timeline, std::string name) : timeline(timeline), name(std::move(name)), start(Clock::now()) {}
+
+StartupTimeline::Phase::~Phase()
+{
+    this->timeline.Record(std::move(this->name), this->start, Clock::now());
+}
+
+StartupTimeline::StartupTimeline() : origin(Clock::now()) {}
+
+void StartupTimeline::Record(std::string name, Clock::time_point start, Clock::time_point end)
+{
+    std::lock_guard lock(this->mutex);
+    this->entries.push_back({std::move(name), start, end});
+}
+
+std::string StartupTimeline::Summary() const
+{
+    std::vector<Entry> sorted;
+    {
+        std::lock_guard lock(this->mutex);
+        sorted = this->entries;
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Entry &a, const Entry &b) { return a.start < b.start; });
+
+    std::string out = "Startup timeline";
+    Clock::time_point last = this->origin;
+    Clock::duration summed{};
+    for (const Entry &e : sorted)
+    {
+        out += std::format("\n  {:<20} {:>8.1f} ms -> {:>8.1f} ms  ({:.1f} ms)", e.name, Milliseconds(e.start - this->origin),
+                           Milliseconds(e.end - this->origin), Milliseconds(e.end - e.start));
+        last = std::max(last, e.end);
+        summed += e.end - e.start;
+    }
+    out += std::format("\n  ready after {:.1f} ms, {:.1f} ms of phases", Milliseconds(last - this->origin), Milliseconds(summed));
+    return out;
+}
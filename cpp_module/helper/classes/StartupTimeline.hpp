@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Start and end of each startup phase, relative to construction. Phases may run on several threads
+// at once; Summary() shows where they overlapped and what the overlap saved.
+//
+//   StartupTimeline timeline;
+//   {
+//       auto phase = timeline.Begin("model load");
+//       model.Init();
+//   }
+//   LOG(timeline.Summary());
+class StartupTimeline
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Records its phase when it goes out of scope
+    class Phase
+    {
+    public:
+        Phase(StartupTimeline &timeline, std::string name);
+        ~Phase();
+        Phase(const Phase &) = delete;
+        Phase &operator=(const Phase &) = delete;
+
+    private:
+        StartupTimeline &timeline;
+        std::string name;
+        Clock::time_point start;
+    };
+
+    StartupTimeline();
+
+    [[nodiscard]] Phase Begin(std::string name) { return Phase(*this, std::move(name)); }
+    void Record(std::string name, Clock::time_point start, Clock::time_point end);
+    // One line per phase in start order, then the wall time against the summed phase time
+    std::string Summary() const;
+
+private:
+    struct Entry
+    {
+        std::string name;
+        Clock::time_point start;
+        Clock::time_point end;
+    };
+
+    const Clock::time_point origin;
+    mutable std::mutex mutex;
+    std::vector<Entry> entries;
+};
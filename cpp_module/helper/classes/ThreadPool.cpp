@@ -0,0 +1,42 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    if (threads == 0)
+        threads = 1;
+
+    this->workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+        this->workers.emplace_back([this] { this->WorkerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(this->mutex);
+        this->stopping = true;
+    }
+    this->c_var.notify_all();
+    for (std::thread &worker : this->workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(this->mutex);
+            this->c_var.wait(lock, [this] { return this->stopping || !this->tasks.empty(); });
+            if (this->stopping && this->tasks.empty())
+                return;
+            task = std::move(this->tasks.front());
+            this->tasks.pop();
+        }
+        task();
+    }
+}
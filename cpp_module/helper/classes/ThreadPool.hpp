@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable c_var;
+    bool stopping = false;
+    void WorkerLoop();
+
+public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t Size() const { return this->workers.size(); }
+
+    template <class F>
+    auto Submit(F &&task) -> std::future<std::invoke_result_t<F>>
+    {
+        using Result = std::invoke_result_t<F>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard lock(this->mutex);
+            if (this->stopping)
+                throw std::runtime_error("Submit called on a stopped ThreadPool");
+            this->tasks.emplace([packaged] { (*packaged)(); });
+        }
+        this->c_var.notify_one();
+        return result;
+    }
+};
+
+// Fixed capacity multi-producer/multi-consumer queue. Push blocks while full so a fast
+// producer stage cannot run arbitrarily far ahead of a slow consumer stage.
+template <class T>
+class BoundedQueue
+{
+private:
+    std::queue<T> items;
+    const size_t capacity;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity == 0 ? 1 : capacity) {}
+
+    bool Push(T item)
+    {
+        std::unique_lock lock(this->mutex);
+        this->not_full.wait(lock, [this] { return this->closed || this->items.size() < this->capacity; });
+        if (this->closed)
+            return false;
+        this->items.push(std::move(item));
+        lock.unlock();
+        this->not_empty.notify_one();
+        return true;
+    }
+
+    // Returns std::nullopt once the queue is closed and drained
+    std::optional<T> Pop()
+    {
+        std::unique_lock lock(this->mutex);
+        this->not_empty.wait(lock, [this] { return this->closed || !this->items.empty(); });
+        if (this->items.empty())
+            return std::nullopt;
+        T item = std::move(this->items.front());
+        this->items.pop();
+        lock.unlock();
+        this->not_full.notify_one();
+        return item;
+    }
+
+    void Close()
+    {
+        {
+            std::lock_guard lock(this->mutex);
+            this->closed = true;
+        }
+        this->not_empty.notify_all();
+        this->not_full.notify_all();
+    }
+};
@@ -0,0 +1,248 @@
+#include "TopologyDiff.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <tuple>
+
+namespace
+{
+    std::string EscapeJson(const std::string &text)
+    {
+        std::string out;
+        out.reserve(text.size());
+        for (const char c : text)
+        {
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    out += std::format("\\u{:04x}", static_cast<int>(c));
+                else
+                    out += c;
+            }
+        }
+        return out;
+    }
+
+    double IoU(const cv::Rect &a, const cv::Rect &b)
+    {
+        const double overlap = (a & b).area();
+        const double united = a.area() + b.area() - overlap;
+        return united > 0 ? overlap / united : 0.0;
+    }
+
+    double CenterShift(const cv::Rect &a, const cv::Rect &b)
+    {
+        const double dx = (a.x + a.width / 2.0) - (b.x + b.width / 2.0);
+        const double dy = (a.y + a.height / 2.0) - (b.y + b.height / 2.0);
+        return std::sqrt(dx * dx + dy * dy);
+    }
+}
+
+const char *TD::ToString(ChangeKind kind)
+{
+    switch (kind)
+    {
+    case ChangeKind::Added:
+        return "added";
+    case ChangeKind::Removed:
+        return "removed";
+    case ChangeKind::StatusChanged:
+        return "status";
+    case ChangeKind::Moved:
+        return "moved";
+    }
+    return "unknown";
+}
+
+const char *TD::ToString(ElementKind kind)
+{
+    return kind == ElementKind::Link ? "link" : "node";
+}
+
+std::string TD::ChangeEvent::ToJson() const
+{
+    std::string json = std::format("{{\"frame\":{},\"ts_ns\":{},\"source\":{},\"new_view\":{},\"unchanged\":{},\"ocr_runs\":{},\"changes\":[",
+                                   this->frame_id, this->timestamp_ns, static_cast<int>(this->source_id), this->new_view ? "true" : "false",
+                                   this->unchanged, this->ocr_runs);
+    for (size_t i = 0; i < this->changes.size(); ++i)
+    {
+        const Change &c = this->changes[i];
+        json += std::format("{}{{\"change\":\"{}\",\"id\":{},\"element\":\"{}\",\"type\":\"{}\",\"label\":\"{}\",\"from\":\"{}\",\"to\":\"{}\",\"box\":[{},{},{},{}]}}",
+                            i == 0 ? "" : ",", ToString(c.kind), c.element_id, ToString(c.element), EscapeJson(c.type), EscapeJson(c.label),
+                            EscapeJson(c.from_status), EscapeJson(c.to_status), c.box.x, c.box.y, c.box.width, c.box.height);
+    }
+    json += "]}";
+    return json;
+}
+
+TopologyDiff::TopologyDiff(std::vector<std::string> class_names, OcrFn ocr) : TopologyDiff(std::move(class_names), std::move(ocr), Options{}) {}
+
+TopologyDiff::TopologyDiff(std::vector<std::string> class_names, OcrFn ocr, Options options) : ocr(std::move(ocr)), options(options)
+{
+    // <Type>_<Color>; a name without a color is a type with no status
+    for (const std::string &name : class_names)
+    {
+        const size_t split = name.rfind('_');
+        ClassInfo info;
+        info.type = split == std::string::npos ? name : name.substr(0, split);
+        info.status = split == std::string::npos ? std::string() : name.substr(split + 1);
+        info.kind = info.type.starts_with("Link") ? TD::ElementKind::Link : TD::ElementKind::Node;
+        this->classes.push_back(std::move(info));
+    }
+}
+
+bool TopologyDiff::IsTopologyClassList(const std::vector<std::string> &class_names)
+{
+    return !class_names.empty() && std::all_of(class_names.begin(), class_names.end(), [](const std::string &name) {
+        const size_t split = name.rfind('_');
+        return split != std::string::npos && split > 0 && split + 1 < name.size();
+    });
+}
+
+void TopologyDiff::Reset()
+{
+    this->elements.clear();
+}
+
+const TopologyDiff::ClassInfo &TopologyDiff::Classify(int class_id) const
+{
+    static const ClassInfo unknown{TD::ElementKind::Node, "Unknown", ""};
+    return class_id >= 0 && class_id < static_cast<int>(this->classes.size()) ? this->classes[class_id] : unknown;
+}
+
+std::string TopologyDiff::Read(const cv::Mat &frame, const cv::Rect &box, size_t &ocr_runs) const
+{
+    if (!this->ocr || frame.empty())
+        return {};
+    const cv::Rect clipped = box & cv::Rect(0, 0, frame.cols, frame.rows);
+    if (clipped.empty())
+        return {};
+    ++ocr_runs;
+    return this->ocr(frame, clipped);
+}
+
+TD::ChangeEvent TopologyDiff::Update(const cv::Mat &frame, const std::vector<Detection> &detections, uint64_t frame_id, int64_t timestamp_ns, uint8_t source_id)
+{
+    TD::ChangeEvent event;
+    event.frame_id = frame_id;
+    event.timestamp_ns = timestamp_ns;
+    event.source_id = source_id;
+
+    // Candidate pairs of the same type, best overlap first, matched greedily
+    std::vector<std::tuple<double, size_t, size_t>> pairs;
+    for (size_t i = 0; i < this->elements.size(); ++i)
+    {
+        const TD::Element &element = this->elements[i];
+        for (size_t j = 0; j < detections.size(); ++j)
+        {
+            const ClassInfo &info = this->Classify(detections[j].class_id);
+            if (info.kind != element.kind || info.type != element.type)
+                continue;
+            if (const double iou = IoU(element.box, detections[j].box); iou >= this->options.match_iou)
+                pairs.emplace_back(iou, i, j);
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const auto &a, const auto &b) { return std::get<0>(a) > std::get<0>(b); });
+
+    std::vector<int> match_of_element(this->elements.size(), -1);
+    std::vector<bool> detection_matched(detections.size(), false);
+    size_t matched = 0;
+    for (const auto &[iou, i, j] : pairs)
+    {
+        if (match_of_element[i] >= 0 || detection_matched[j])
+            continue;
+        match_of_element[i] = static_cast<int>(j);
+        detection_matched[j] = true;
+        ++matched;
+    }
+
+    // First capture, or another view on screen: start over instead of reporting every element as
+    // removed and added
+    const size_t tracked = std::count_if(this->elements.begin(), this->elements.end(), [](const TD::Element &e) { return e.missed == 0; });
+    if ((this->elements.empty() && !detections.empty()) || (tracked >= 4 && matched < this->options.new_view_fraction * tracked))
+    {
+        this->elements.clear();
+        match_of_element.clear();
+        std::fill(detection_matched.begin(), detection_matched.end(), false);
+        event.new_view = true;
+    }
+
+    std::vector<TD::Element> next;
+    next.reserve(this->elements.size() + detections.size());
+    for (size_t i = 0; i < this->elements.size(); ++i)
+    {
+        TD::Element element = std::move(this->elements[i]);
+        if (match_of_element[i] < 0)
+        {
+            if (++element.missed > this->options.max_missed)
+            {
+                event.changes.push_back({TD::ChangeKind::Removed, element.id, element.kind, element.type, element.label, element.status, {}, element.box});
+                continue;
+            }
+            next.push_back(std::move(element));
+            continue;
+        }
+
+        const Detection &detection = detections[match_of_element[i]];
+        const ClassInfo &info = this->Classify(detection.class_id);
+        bool changed = false;
+        element.missed = 0;
+        if (CenterShift(element.box, detection.box) > this->options.moved_pixels)
+        {
+            element.box = detection.box;
+            if (element.kind == TD::ElementKind::Node)
+            {
+                if (std::string label = this->Read(frame, element.box, event.ocr_runs); !label.empty())
+                    element.label = std::move(label);
+            }
+            event.changes.push_back({TD::ChangeKind::Moved, element.id, element.kind, element.type, element.label, element.status, element.status, element.box});
+            changed = true;
+        }
+        if (info.status != element.status)
+        {
+            event.changes.push_back({TD::ChangeKind::StatusChanged, element.id, element.kind, element.type, element.label, element.status, info.status, detection.box});
+            element.status = info.status;
+            changed = true;
+        }
+        // Follows small jitter too, so it cannot add up to a move
+        element.box = detection.box;
+        element.class_id = detection.class_id;
+        if (!changed)
+            ++event.unchanged;
+        next.push_back(std::move(element));
+    }
+
+    for (size_t j = 0; j < detections.size(); ++j)
+    {
+        if (detection_matched[j])
+            continue;
+        const ClassInfo &info = this->Classify(detections[j].class_id);
+        TD::Element element;
+        element.id = this->next_id++;
+        element.kind = info.kind;
+        element.type = info.type;
+        element.status = info.status;
+        element.class_id = detections[j].class_id;
+        element.box = detections[j].box;
+        if (element.kind == TD::ElementKind::Node)
+            element.label = this->Read(frame, element.box, event.ocr_runs);
+        // A new view is summarised by the flag, not by one Added per element
+        if (!event.new_view)
+            event.changes.push_back({TD::ChangeKind::Added, element.id, element.kind, element.type, element.label, {}, element.status, element.box});
+        next.push_back(std::move(element));
+    }
+
+    this->elements = std::move(next);
+    return event;
+}
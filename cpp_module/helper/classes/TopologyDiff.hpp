@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Detection.hpp"
+
+// Tracks the nodes and links of one topology view across captures and reports what changed. The
+// topology models name their classes <Type>_<Color> (Router_Red, Link_Green); the type identifies
+// an element together with its position, the color is its status. A recapture of the same view
+// usually only recolors a few elements, so OCR runs only for nodes that are new or have moved and
+// the rest keep the label read earlier.
+namespace TD
+{
+    enum class ElementKind : uint8_t
+    {
+        Node,
+        Link
+    };
+
+    enum class ChangeKind : uint8_t
+    {
+        Added,
+        Removed,
+        StatusChanged,
+        Moved
+    };
+
+    struct Element
+    {
+        uint32_t id = 0; // stable for as long as the element is tracked
+        ElementKind kind = ElementKind::Node;
+        std::string type;
+        std::string status;
+        std::string label; // OCR'd site id, nodes only
+        int class_id = -1;
+        cv::Rect box;
+        uint32_t missed = 0; // consecutive captures without a match
+    };
+
+    struct Change
+    {
+        ChangeKind kind;
+        uint32_t element_id;
+        ElementKind element;
+        std::string type;
+        std::string label;
+        std::string from_status; // empty for Added
+        std::string to_status;   // empty for Removed
+        cv::Rect box;
+    };
+
+    struct ChangeEvent
+    {
+        uint64_t frame_id = 0;
+        int64_t timestamp_ns = 0;
+        uint8_t source_id = 0;
+        // Too little of the previous graph matched, the screen shows another view
+        bool new_view = false;
+        size_t unchanged = 0;
+        size_t ocr_runs = 0;
+        std::vector<Change> changes;
+
+        bool Empty() const { return this->changes.empty() && !this->new_view; }
+        // One line, for a JSON lines log or a POST body
+        std::string ToJson() const;
+    };
+
+    const char *ToString(ChangeKind kind);
+    const char *ToString(ElementKind kind);
+}
+
+class TopologyDiff
+{
+public:
+    // Reads the site id inside box; an empty result leaves the node unlabelled
+    using OcrFn = std::function<std::string(const cv::Mat &frame, const cv::Rect &box)>;
+
+    struct Options
+    {
+        // Same type, overlapping at least this much: the same element
+        double match_iou = 0.3;
+        // Center shifts beyond this are reported as Moved and the node is read again
+        int moved_pixels = 6;
+        // Captures an element may go undetected before it is reported Removed, detections flicker
+        uint32_t max_missed = 2;
+        // Below this fraction of the previous elements matched, the capture is treated as a new view
+        double new_view_fraction = 0.4;
+    };
+
+    TopologyDiff(std::vector<std::string> class_names, OcrFn ocr = nullptr);
+    TopologyDiff(std::vector<std::string> class_names, OcrFn ocr, Options options);
+
+    // Whether class_names is a topology class list, every name of the <Type>_<Color> form; the
+    // elements of any other model (COCO) do not make a topology
+    static bool IsTopologyClassList(const std::vector<std::string> &class_names);
+
+    TD::ChangeEvent Update(const cv::Mat &frame, const std::vector<Detection> &detections, uint64_t frame_id, int64_t timestamp_ns, uint8_t source_id = 0);
+
+    const std::vector<TD::Element> &Elements() const { return this->elements; }
+    void Reset();
+
+private:
+    struct ClassInfo
+    {
+        TD::ElementKind kind;
+        std::string type;
+        std::string status;
+    };
+
+    std::vector<ClassInfo> classes;
+    OcrFn ocr;
+    Options options;
+    std::vector<TD::Element> elements;
+    uint32_t next_id = 1;
+
+    const ClassInfo &Classify(int class_id) const;
+    std::string Read(const cv::Mat &frame, const cv::Rect &box, size_t &ocr_runs) const;
+};
@@ -0,0 +1,267 @@
+#include "TopologyGraph.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <tuple>
+
+TopologyGraph::TopologyGraph(const std::vector<TG::Node> &nodes, const std::vector<TG::Link> &links) : TopologyGraph(nodes, links, Options{}) {}
+
+TopologyGraph::TopologyGraph(const std::vector<TG::Node> &nodes, const std::vector<TG::Link> &links, const Options &options)
+{
+    const auto contains = [](const std::vector<std::string> &names, const std::string &name) {
+        return std::find(names.begin(), names.end(), name) != names.end();
+    };
+
+    const uint32_t n = static_cast<uint32_t>(nodes.size());
+    this->failed.reserve(n);
+    this->root.reserve(n);
+    for (const TG::Node &node : nodes)
+    {
+        this->failed.push_back(contains(options.failed_statuses, node.status));
+        this->root.push_back(contains(options.root_types, node.type));
+    }
+
+    // Normalised and deduplicated; a link reported twice is failed if either report says so
+    struct Edge
+    {
+        uint32_t a, b;
+        bool failed;
+    };
+    std::vector<Edge> edges;
+    edges.reserve(links.size());
+    for (const TG::Link &link : links)
+    {
+        if (link.a >= n || link.b >= n)
+            throw std::out_of_range(std::format("Link {}-{} refers to a node outside the {} nodes", link.a, link.b, n));
+        if (link.a != link.b)
+            edges.push_back({std::min(link.a, link.b), std::max(link.a, link.b), contains(options.failed_statuses, link.status)});
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge &x, const Edge &y) { return std::tie(x.a, x.b) < std::tie(y.a, y.b); });
+    for (const Edge &edge : edges)
+    {
+        if (!this->link_ends.empty() && this->link_ends.back() == std::pair(edge.a, edge.b))
+        {
+            this->link_failed.back() |= edge.failed;
+            continue;
+        }
+        this->link_ends.emplace_back(edge.a, edge.b);
+        this->link_failed.push_back(edge.failed);
+    }
+
+    this->offsets.assign(n + 1, 0);
+    for (const auto &[a, b] : this->link_ends)
+    {
+        ++this->offsets[a + 1];
+        ++this->offsets[b + 1];
+    }
+    for (uint32_t v = 0; v < n; ++v)
+        this->offsets[v + 1] += this->offsets[v];
+    this->adjacent_node.resize(this->offsets[n]);
+    this->adjacent_link.resize(this->offsets[n]);
+    std::vector<uint32_t> fill(this->offsets.begin(), this->offsets.end() - 1);
+    for (uint32_t link = 0; link < this->link_ends.size(); ++link)
+    {
+        const auto [a, b] = this->link_ends[link];
+        this->adjacent_node[fill[a]] = b;
+        this->adjacent_link[fill[a]++] = link;
+        this->adjacent_node[fill[b]] = a;
+        this->adjacent_link[fill[b]++] = link;
+    }
+
+    this->FindCuts();
+}
+
+template <typename Finished>
+void TopologyGraph::Dfs(uint32_t start, Lowpoints &lp, Finished finished) const
+{
+    // Iterative so a long chain of sites cannot overflow the stack. The parent is skipped by link
+    // rather than by node, which keeps parallel links from hiding a cut.
+    std::vector<std::pair<uint32_t, uint32_t>> stack; // node, next adjacency entry
+    lp.disc[start] = lp.low[start] = lp.timer++;
+    stack.emplace_back(start, this->offsets[start]);
+
+    while (!stack.empty())
+    {
+        const uint32_t v = stack.back().first;
+        if (uint32_t &next = stack.back().second; next < this->offsets[v + 1])
+        {
+            const uint32_t to = this->adjacent_node[next];
+            const uint32_t link = this->adjacent_link[next];
+            ++next;
+            if (link == lp.parent_link[v])
+                continue;
+            if (lp.disc[to] == NONE)
+            {
+                lp.parent_link[to] = link;
+                lp.disc[to] = lp.low[to] = lp.timer++;
+                stack.emplace_back(to, this->offsets[to]);
+            }
+            else
+            {
+                lp.low[v] = std::min(lp.low[v], lp.disc[to]);
+            }
+            continue;
+        }
+
+        stack.pop_back();
+        if (stack.empty())
+            break;
+        const uint32_t parent = stack.back().first;
+        lp.low[parent] = std::min(lp.low[parent], lp.low[v]);
+        finished(parent, v);
+    }
+}
+
+void TopologyGraph::FindCuts()
+{
+    const uint32_t n = static_cast<uint32_t>(this->NodeCount());
+    Lowpoints lp{std::vector<uint32_t>(n, NONE), std::vector<uint32_t>(n, 0), std::vector<uint32_t>(n, NONE)};
+    std::vector<uint8_t> cut(n, 0);
+
+    for (uint32_t start = 0; start < n; ++start)
+    {
+        if (lp.disc[start] != NONE)
+            continue;
+        uint32_t start_children = 0;
+        this->Dfs(start, lp, [&](uint32_t parent, uint32_t child) {
+            if (lp.low[child] > lp.disc[parent])
+                this->bridges.push_back(lp.parent_link[child]);
+            if (parent == start)
+                ++start_children;
+            else if (lp.low[child] >= lp.disc[parent])
+                cut[parent] = 1;
+        });
+        if (start_children > 1)
+            cut[start] = 1;
+    }
+
+    for (uint32_t v = 0; v < n; ++v)
+    {
+        if (cut[v])
+            this->articulation_points.push_back(v);
+    }
+    std::sort(this->bridges.begin(), this->bridges.end());
+}
+
+template <typename Pass>
+std::vector<uint32_t> TopologyGraph::Distances(const std::vector<uint32_t> &sources, Pass pass) const
+{
+    std::vector<uint32_t> distance(this->NodeCount(), TG::UNREACHABLE);
+    std::vector<uint32_t> queue;
+    queue.reserve(this->NodeCount());
+    for (const uint32_t s : sources)
+    {
+        if (distance[s] == TG::UNREACHABLE)
+        {
+            distance[s] = 0;
+            queue.push_back(s);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head)
+    {
+        const uint32_t v = queue[head];
+        for (uint32_t i = this->offsets[v]; i < this->offsets[v + 1]; ++i)
+        {
+            const uint32_t to = this->adjacent_node[i];
+            if (distance[to] == TG::UNREACHABLE && pass(this->adjacent_link[i], to))
+            {
+                distance[to] = distance[v] + 1;
+                queue.push_back(to);
+            }
+        }
+    }
+    return distance;
+}
+
+std::vector<uint32_t> TopologyGraph::RootDistances(bool healthy_only) const
+{
+    std::vector<uint32_t> roots;
+    for (uint32_t v = 0; v < this->NodeCount(); ++v)
+    {
+        if (this->root[v] && !(healthy_only && this->failed[v]))
+            roots.push_back(v);
+    }
+    return this->Distances(roots, [&](uint32_t link, uint32_t to) { return !healthy_only || (!this->link_failed[link] && !this->failed[to]); });
+}
+
+TG::Prior TopologyGraph::RankPofCandidates(uint32_t down) const
+{
+    if (down >= this->NodeCount())
+        throw std::out_of_range(std::format("Down site {} is outside the {} nodes", down, this->NodeCount()));
+
+    TG::Prior prior;
+    // Healthy paths may end at the down site itself, it is red by definition
+    std::vector<uint32_t> roots;
+    for (uint32_t v = 0; v < this->NodeCount(); ++v)
+    {
+        if (this->root[v] && !this->failed[v] && v != down)
+            roots.push_back(v);
+    }
+    const std::vector<uint32_t> healthy = this->Distances(roots, [&](uint32_t link, uint32_t to) {
+        return !this->link_failed[link] && (!this->failed[to] || to == down);
+    });
+    prior.reachable = healthy[down] != TG::UNREACHABLE;
+
+    // A DFS rooted at the down site: a child subtree whose lowpoint does not climb above v hangs off
+    // v alone, so v separates the site from every root when the roots outside those subtrees are
+    // at most v itself. A bridge separates it when the subtree below the bridge holds all of them.
+    const uint32_t n = static_cast<uint32_t>(this->NodeCount());
+    Lowpoints lp{std::vector<uint32_t>(n, NONE), std::vector<uint32_t>(n, 0), std::vector<uint32_t>(n, NONE)};
+    std::vector<uint32_t> roots_below(n, 0), roots_cut_off(n, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> tree_bridges; // link, node below it
+    for (uint32_t v = 0; v < n; ++v)
+        roots_below[v] = this->root[v] && v != down;
+    this->Dfs(down, lp, [&](uint32_t parent, uint32_t child) {
+        roots_below[parent] += roots_below[child];
+        if (lp.low[child] >= lp.disc[parent])
+            roots_cut_off[parent] += roots_below[child];
+        if (lp.low[child] > lp.disc[parent])
+            tree_bridges.emplace_back(lp.parent_link[child], child);
+    });
+
+    // Without any path to a root the screenshot does not show what the site hangs off
+    const uint32_t total_roots = roots_below[down];
+    if (total_roots == 0)
+        return prior;
+
+    const std::vector<uint32_t> from_down = this->Distances({down}, [](uint32_t, uint32_t) { return true; });
+    std::vector<uint8_t> separating(n, 0);
+    for (uint32_t v = 0; v < n; ++v)
+    {
+        if (v != down && lp.disc[v] != NONE && roots_cut_off[v] + (this->root[v] ? 1u : 0u) == total_roots)
+            separating[v] = 1;
+    }
+
+    // A failed bridge the down site depends on counts against its end away from the site
+    std::vector<double> link_evidence(n, 0.0);
+    for (const auto &[link, below] : tree_bridges)
+    {
+        if (this->link_failed[link] && roots_below[below] == total_roots)
+            link_evidence[below] += 0.5;
+    }
+    // Failed links around a node are weaker evidence of the node failing
+    for (uint32_t link = 0; link < this->LinkCount(); ++link)
+    {
+        if (!this->link_failed[link])
+            continue;
+        link_evidence[this->link_ends[link].first] += 0.25;
+        link_evidence[this->link_ends[link].second] += 0.25;
+    }
+
+    size_t failed_separators = 0;
+    for (uint32_t v = 0; v < n; ++v)
+    {
+        if (v == down || from_down[v] == TG::UNREACHABLE || !(separating[v] || this->failed[v] || link_evidence[v] >= 0.5))
+            continue;
+        // A failed node the site cannot route around outranks everything else
+        const double score = 2.0 * this->failed[v] + 1.0 * separating[v] + link_evidence[v];
+        prior.candidates.push_back({v, score, this->failed[v] != 0, separating[v] != 0, from_down[v]});
+        failed_separators += this->failed[v] && separating[v];
+    }
+    std::sort(prior.candidates.begin(), prior.candidates.end(), [](const TG::Candidate &x, const TG::Candidate &y) {
+        return x.score != y.score ? x.score > y.score : x.distance < y.distance;
+    });
+    prior.decisive = !prior.reachable && failed_separators == 1;
+    return prior;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Structural analysis of one topology graph: articulation points, bridges, reachability from the
+// core and a ranking of point of failure candidates for a down site. It is a deterministic prior
+// next to the GNN. When a down site's only way to the core runs through one failed node, that node
+// is the answer without a model; otherwise the ranking is a cheap cross-check on the prediction.
+//
+// Nodes and links carry the status color the detector read (Router_Red, Link_Green). Links are
+// undirected; duplicates and self loops are dropped. The adjacency is kept as CSR and everything
+// runs in linear time, microseconds for the graphs a topology screenshot holds.
+namespace TG
+{
+    constexpr uint32_t UNREACHABLE = std::numeric_limits<uint32_t>::max();
+
+    struct Node
+    {
+        std::string type;
+        std::string status;
+    };
+
+    struct Link
+    {
+        uint32_t a;
+        uint32_t b;
+        std::string status;
+    };
+
+    struct Candidate
+    {
+        uint32_t node;
+        double score;
+        bool failed;
+        // Removing the node leaves the down site without a path to any root
+        bool separating;
+        // Hops from the down site
+        uint32_t distance;
+    };
+
+    struct Prior
+    {
+        // The down site still reaches a root over healthy nodes and links, nothing upstream explains it
+        bool reachable = false;
+        // Exactly one failed node separates the down site from every root
+        bool decisive = false;
+        // Best first
+        std::vector<Candidate> candidates;
+    };
+}
+
+class TopologyGraph
+{
+public:
+    struct Options
+    {
+        // Where traffic from the sites terminates
+        std::vector<std::string> root_types{"HubSite", "Router"};
+        std::vector<std::string> failed_statuses{"Red"};
+    };
+
+    TopologyGraph(const std::vector<TG::Node> &nodes, const std::vector<TG::Link> &links);
+    TopologyGraph(const std::vector<TG::Node> &nodes, const std::vector<TG::Link> &links, const Options &options);
+
+    size_t NodeCount() const { return this->failed.size(); }
+    size_t LinkCount() const { return this->link_ends.size(); }
+    // Link indices refer to the deduplicated links, each as {a, b} with a < b
+    const std::pair<uint32_t, uint32_t> &LinkEnds(uint32_t link) const { return this->link_ends[link]; }
+
+    // Nodes whose removal disconnects their component, ascending
+    const std::vector<uint32_t> &ArticulationPoints() const { return this->articulation_points; }
+    // Links whose removal disconnects their component, ascending
+    const std::vector<uint32_t> &Bridges() const { return this->bridges; }
+    // Hop count from the nearest root to every node, TG::UNREACHABLE where none leads. With
+    // healthy_only failed nodes and links are not crossed, failed roots are not sources.
+    std::vector<uint32_t> RootDistances(bool healthy_only) const;
+    TG::Prior RankPofCandidates(uint32_t down) const;
+
+private:
+    static constexpr uint32_t NONE = TG::UNREACHABLE;
+
+    std::vector<uint8_t> failed;
+    std::vector<uint8_t> root;
+    std::vector<uint8_t> link_failed;
+    std::vector<std::pair<uint32_t, uint32_t>> link_ends;
+    // CSR: the neighbours of v are adjacent_node[offsets[v] .. offsets[v + 1]), reached over adjacent_link
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> adjacent_node;
+    std::vector<uint32_t> adjacent_link;
+    std::vector<uint32_t> articulation_points;
+    std::vector<uint32_t> bridges;
+
+    struct Lowpoints
+    {
+        std::vector<uint32_t> disc;
+        std::vector<uint32_t> low;
+        std::vector<uint32_t> parent_link;
+        uint32_t timer = 0;
+    };
+
+    void FindCuts();
+    // Tarjan's lowpoint DFS from start over what it has not visited yet; finished(parent, child) runs
+    // once per tree link, after the child's subtree
+    template <typename Finished>
+    void Dfs(uint32_t start, Lowpoints &lp, Finished finished) const;
+    // Hop counts from sources, crossing only links for which pass(link, to) holds
+    template <typename Pass>
+    std::vector<uint32_t> Distances(const std::vector<uint32_t> &sources, Pass pass) const;
+};
@@ -0,0 +1,623 @@
+#include "V4l2Capture.hpp"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <format>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+
+#include "FramePool.hpp"
+#include "Utils.hpp"
+
+namespace
+{
+    // Restarts on EINTR, as the V4L2 examples do
+    int Ioctl(int fd, unsigned long request, void *arg)
+    {
+        int result;
+        do
+            result = ioctl(fd, request, arg);
+        while (result == -1 && errno == EINTR);
+        return result;
+    }
+
+    std::string FourCC(uint32_t code)
+    {
+        return {static_cast<char>(code & 0xFF), static_cast<char>((code >> 8) & 0xFF), static_cast<char>((code >> 16) & 0xFF), static_cast<char>((code >> 24) & 0xFF)};
+    }
+
+    const char *FormatName(V4l2Capture::Format format)
+    {
+        switch (format)
+        {
+        case V4l2Capture::Format::Mjpeg:
+            return "MJPEG";
+        case V4l2Capture::Format::Yuyv:
+            return "YUYV";
+        default:
+            return "auto";
+        }
+    }
+
+    std::optional<long> EnvironmentCount(const char *name)
+    {
+        const char *value = std::getenv(name);
+        if (!value)
+            return std::nullopt;
+        const long count = std::atol(value);
+        if (count <= 0)
+            throw std::runtime_error(std::format("{} must be a positive number, got '{}'", name, value));
+        return count;
+    }
+
+    // Byte range of the first complete JPEG at or after offset, walking the marker segments so an
+    // EOI inside an EXIF thumbnail does not end the frame. {size, size} when none is left.
+    std::pair<size_t, size_t> NextJpeg(const uint8_t *data, size_t size, size_t offset)
+    {
+        size_t start = offset;
+        while (start + 1 < size && !(data[start] == 0xFF && data[start + 1] == 0xD8))
+            ++start;
+        if (start + 1 >= size)
+            return {size, size};
+
+        size_t pos = start + 2;
+        while (pos + 1 < size)
+        {
+            // Entropy coded data
+            if (data[pos] != 0xFF)
+            {
+                ++pos;
+                continue;
+            }
+            const uint8_t marker = data[pos + 1];
+            if (marker == 0xD9)
+                return {start, pos + 2};
+            if (marker == 0xFF)
+            {
+                ++pos;
+                continue;
+            }
+            // Stuffed 0xFF, restart markers and TEM carry no length
+            if (marker == 0x00 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+            {
+                pos += 2;
+                continue;
+            }
+            if (pos + 3 >= size)
+                break;
+            pos += 2 + ((static_cast<size_t>(data[pos + 2]) << 8) | data[pos + 3]);
+        }
+        return {size, size};
+    }
+}
+
+V4l2Capture::Options V4l2Capture::Options::FromEnvironment() const
+{
+    Options options = *this;
+    if (const char *value = std::getenv("POF_V4L2_FORMAT"))
+    {
+        const std::string name = value;
+        if (name == "mjpeg")
+            options.format = Format::Mjpeg;
+        else if (name == "yuyv")
+            options.format = Format::Yuyv;
+        else if (name == "auto")
+            options.format = Format::Auto;
+        else
+            throw std::runtime_error(std::format("POF_V4L2_FORMAT must be mjpeg, yuyv or auto, got '{}'", name));
+    }
+    if (const char *value = std::getenv("POF_V4L2_SIZE"))
+    {
+        if (std::sscanf(value, "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+            throw std::runtime_error(std::format("POF_V4L2_SIZE must look like 1280x720, got '{}'", value));
+    }
+    if (const char *value = std::getenv("POF_V4L2_FPS"))
+    {
+        options.fps = std::atof(value);
+        if (options.fps < 0.0)
+            throw std::runtime_error(std::format("POF_V4L2_FPS must not be negative, got '{}'", value));
+    }
+    options.buffers = static_cast<uint32_t>(EnvironmentCount("POF_V4L2_BUFFERS").value_or(options.buffers));
+    options.decode_threads = static_cast<uint32_t>(EnvironmentCount("POF_V4L2_DECODE_THREADS").value_or(options.decode_threads));
+    return options;
+}
+
+V4l2Capture::V4l2Capture(Options options) : options(std::move(options))
+{
+    timespec monotonic{};
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    this->monotonic_offset = Clock::now().time_since_epoch() - std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(monotonic.tv_sec) + std::chrono::nanoseconds(monotonic.tv_nsec));
+
+    struct stat info{};
+    if (stat(this->options.device.c_str(), &info) != 0)
+        throw std::runtime_error(std::format("Cannot open {}: {}", this->options.device, std::strerror(errno)));
+
+    try
+    {
+        if (S_ISCHR(info.st_mode))
+            this->OpenDevice();
+        else
+            this->OpenRecording();
+    }
+    catch (...)
+    {
+        this->Release();
+        throw;
+    }
+
+    // The queue, a frame per decoder and the one the reader holds
+    FramePool::Instance().Preallocate(this->size, CV_8UC3, static_cast<int>(this->options.queue_depth + this->options.decode_threads + 1));
+
+    const uint32_t decode_threads = std::max<uint32_t>(this->options.decode_threads, 1);
+    for (uint32_t i = 0; i < decode_threads; ++i)
+        this->decoders.emplace_back(&V4l2Capture::Decode, this);
+    if (this->Live())
+        this->capture_thread = std::thread(&V4l2Capture::CaptureDevice, this);
+    else
+        this->capture_thread = std::thread(&V4l2Capture::CaptureRecording, this);
+}
+
+V4l2Capture::~V4l2Capture()
+{
+    this->Stop();
+}
+
+void V4l2Capture::OpenDevice()
+{
+    const std::string &device = this->options.device;
+    this->fd = open(device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (this->fd < 0)
+        throw std::runtime_error(std::format("Cannot open {}: {}", device, std::strerror(errno)));
+
+    v4l2_capability capability{};
+    if (Ioctl(this->fd, VIDIOC_QUERYCAP, &capability) != 0)
+        throw std::runtime_error(std::format("{} is not a V4L2 device: {}", device, std::strerror(errno)));
+    const uint32_t caps = capability.capabilities & V4L2_CAP_DEVICE_CAPS ? capability.device_caps : capability.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING))
+        throw std::runtime_error(std::format("{} ({}) cannot stream video capture", device, reinterpret_cast<const char *>(capability.card)));
+
+    bool has_mjpeg = false;
+    bool has_yuyv = false;
+    v4l2_fmtdesc description{};
+    description.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for (description.index = 0; Ioctl(this->fd, VIDIOC_ENUM_FMT, &description) == 0; ++description.index)
+    {
+        has_mjpeg |= description.pixelformat == V4L2_PIX_FMT_MJPEG;
+        has_yuyv |= description.pixelformat == V4L2_PIX_FMT_YUYV;
+    }
+
+    Format wanted = this->options.format;
+    if (wanted == Format::Auto)
+        wanted = has_mjpeg ? Format::Mjpeg : Format::Yuyv;
+    if ((wanted == Format::Mjpeg && !has_mjpeg) || (wanted == Format::Yuyv && !has_yuyv))
+        throw std::runtime_error(std::format("{} does not offer {}", device, FormatName(wanted)));
+    const uint32_t pixel_format = wanted == Format::Mjpeg ? V4L2_PIX_FMT_MJPEG : V4L2_PIX_FMT_YUYV;
+
+    v4l2_format format{};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width = static_cast<uint32_t>(this->options.width);
+    format.fmt.pix.height = static_cast<uint32_t>(this->options.height);
+    format.fmt.pix.pixelformat = pixel_format;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    if (Ioctl(this->fd, VIDIOC_S_FMT, &format) != 0)
+        throw std::runtime_error(std::format("{} rejected {} {}x{}: {}", device, FormatName(wanted), this->options.width, this->options.height, std::strerror(errno)));
+    if (format.fmt.pix.pixelformat != pixel_format)
+        throw std::runtime_error(std::format("{} switched {} to {}", device, FormatName(wanted), FourCC(format.fmt.pix.pixelformat)));
+    this->format = wanted;
+    this->size = cv::Size(static_cast<int>(format.fmt.pix.width), static_cast<int>(format.fmt.pix.height));
+    this->bytes_per_line = format.fmt.pix.bytesperline;
+    if (this->size != cv::Size(this->options.width, this->options.height))
+    {
+        LOG(device << " does not do " << this->options.width << "x" << this->options.height << ", using " << this->size.width << "x" << this->size.height);
+    }
+
+    // Not every driver lets the rate be set, the one it runs at is read back either way
+    v4l2_streamparm parameters{};
+    parameters.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (this->options.fps > 0.0)
+    {
+        parameters.parm.capture.timeperframe.numerator = 1000;
+        parameters.parm.capture.timeperframe.denominator = static_cast<uint32_t>(this->options.fps * 1000.0);
+        Ioctl(this->fd, VIDIOC_S_PARM, &parameters);
+    }
+    if (Ioctl(this->fd, VIDIOC_G_PARM, &parameters) == 0 && parameters.parm.capture.timeperframe.numerator > 0)
+        this->fps = static_cast<double>(parameters.parm.capture.timeperframe.denominator) / parameters.parm.capture.timeperframe.numerator;
+
+    v4l2_requestbuffers request{};
+    request.count = std::max(this->options.buffers, std::max<uint32_t>(this->options.decode_threads, 1) + 2);
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    if (Ioctl(this->fd, VIDIOC_REQBUFS, &request) != 0)
+        throw std::runtime_error(std::format("{} has no mmap streaming: {}", device, std::strerror(errno)));
+    if (request.count < 2)
+        throw std::runtime_error(std::format("{} granted {} buffers, it needs at least 2", device, request.count));
+
+    for (uint32_t i = 0; i < request.count; ++i)
+    {
+        v4l2_buffer buffer{};
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+        if (Ioctl(this->fd, VIDIOC_QUERYBUF, &buffer) != 0)
+            throw std::runtime_error(std::format("{} buffer {}: {}", device, i, std::strerror(errno)));
+        Mapping mapping;
+        mapping.length = buffer.length;
+        mapping.start = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, buffer.m.offset);
+        if (mapping.start == MAP_FAILED)
+            throw std::runtime_error(std::format("{} buffer {} cannot be mapped: {}", device, i, std::strerror(errno)));
+        this->mappings.push_back(mapping);
+        if (Ioctl(this->fd, VIDIOC_QBUF, &buffer) != 0)
+            throw std::runtime_error(std::format("{} buffer {} cannot be queued: {}", device, i, std::strerror(errno)));
+        this->hardware_timestamps = (buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (Ioctl(this->fd, VIDIOC_STREAMON, &type) != 0)
+        throw std::runtime_error(std::format("{} does not start streaming: {}", device, std::strerror(errno)));
+
+    LOG("V4L2 " << device << " (" << reinterpret_cast<const char *>(capability.card) << "): " << FormatName(this->format) << " " << this->size.width << "x"
+                << this->size.height << " at " << this->fps << " fps, " << this->mappings.size() << " buffers, " << std::max<uint32_t>(this->options.decode_threads, 1)
+                << " decode threads" << (this->hardware_timestamps ? "" : ", no monotonic timestamps"));
+}
+
+void V4l2Capture::OpenRecording()
+{
+    const std::string &path = this->options.device;
+    const int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+        throw std::runtime_error(std::format("Cannot open {}: {}", path, std::strerror(errno)));
+    struct stat info{};
+    fstat(file, &info);
+    this->recording.length = static_cast<size_t>(info.st_size);
+    this->recording.start = this->recording.length > 0 ? mmap(nullptr, this->recording.length, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    close(file);
+    if (this->recording.start == MAP_FAILED)
+    {
+        this->recording = {};
+        throw std::runtime_error(std::format("Cannot map {}: {}", path, std::strerror(errno)));
+    }
+    madvise(this->recording.start, this->recording.length, MADV_SEQUENTIAL);
+
+    const auto *data = static_cast<const uint8_t *>(this->recording.start);
+    const auto [start, end] = NextJpeg(data, this->recording.length, 0);
+    if (start == end)
+        throw std::runtime_error(std::format("{} holds no complete JPEG frame", path));
+    const cv::Mat first = cv::imdecode(cv::Mat(1, static_cast<int>(end - start), CV_8U, const_cast<uint8_t *>(data + start)), cv::IMREAD_COLOR);
+    if (first.empty())
+        throw std::runtime_error(std::format("The first frame of {} does not decode", path));
+
+    this->format = Format::Mjpeg;
+    this->size = first.size();
+    this->fps = this->options.fps;
+    LOG("Replaying " << path << ": MJPEG " << this->size.width << "x" << this->size.height << (this->fps > 0 ? std::format(" at {} fps", this->fps) : " unpaced"));
+}
+
+void V4l2Capture::CaptureDevice()
+{
+    std::optional<uint32_t> last_sequence;
+    uint64_t serial = 0;
+    while (true)
+    {
+        {
+            std::lock_guard lock(this->mutex);
+            if (this->stopping)
+                break;
+        }
+
+        pollfd descriptor{this->fd, POLLIN, 0};
+        const int polled = poll(&descriptor, 1, 200);
+        if (polled < 0 && errno != EINTR)
+        {
+            std::lock_guard lock(this->mutex);
+            this->error = std::format("poll on {}: {}", this->options.device, std::strerror(errno));
+            break;
+        }
+        if (polled <= 0)
+            continue;
+
+        v4l2_buffer buffer{};
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        if (Ioctl(this->fd, VIDIOC_DQBUF, &buffer) != 0)
+        {
+            if (errno == EAGAIN)
+                continue;
+            // ENODEV when the camera is unplugged
+            std::lock_guard lock(this->mutex);
+            this->error = std::format("{} stopped delivering frames: {}", this->options.device, std::strerror(errno));
+            break;
+        }
+
+        if (buffer.flags & V4L2_BUF_FLAG_ERROR)
+        {
+            this->Requeue(static_cast<int>(buffer.index));
+            std::lock_guard lock(this->mutex);
+            ++this->decode_errors;
+            continue;
+        }
+
+        Clock::time_point captured = Clock::now();
+        if ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+            captured = Clock::time_point(this->monotonic_offset + std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(buffer.timestamp.tv_sec) + std::chrono::microseconds(buffer.timestamp.tv_usec)));
+
+        std::lock_guard lock(this->mutex);
+        if (last_sequence && buffer.sequence > *last_sequence + 1)
+            this->driver_dropped += buffer.sequence - *last_sequence - 1;
+        last_sequence = buffer.sequence;
+
+        // Every decoder is busy and a frame is already waiting: the new one is worth more
+        while (!this->jobs.empty())
+        {
+            const Job stale = this->jobs.front();
+            this->jobs.pop_front();
+            this->Requeue(stale.buffer);
+            this->finished.emplace(stale.serial, std::nullopt);
+            ++this->replaced;
+        }
+        this->Deliver();
+
+        const Mapping &mapping = this->mappings[buffer.index];
+        const size_t used = this->format == Format::Mjpeg ? buffer.bytesused : mapping.length;
+        this->jobs.push_back({serial++, buffer.sequence, static_cast<int>(buffer.index), static_cast<const uint8_t *>(mapping.start), used, captured});
+        this->work.notify_one();
+    }
+
+    std::lock_guard lock(this->mutex);
+    this->capture_done = true;
+    this->work.notify_all();
+    this->delivered.notify_all();
+}
+
+void V4l2Capture::CaptureRecording()
+{
+    const auto *data = static_cast<const uint8_t *>(this->recording.start);
+    const size_t length = this->recording.length;
+    const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(this->fps > 0 ? 1.0 / this->fps : 0.0));
+    const size_t max_in_flight = std::max<size_t>(this->options.buffers, 1);
+
+    uint64_t serial = 0;
+    size_t offset = 0;
+    Clock::time_point next = Clock::now();
+    while (true)
+    {
+        const auto [start, end] = NextJpeg(data, length, offset);
+        if (start == end)
+            break;
+        offset = end;
+
+        if (period > Clock::duration::zero())
+        {
+            std::this_thread::sleep_until(next);
+            next += period;
+        }
+
+        std::unique_lock lock(this->mutex);
+        // A recording is processed frame by frame, it waits instead of dropping
+        this->room.wait(lock, [&] { return this->stopping || this->InFlight() < max_in_flight; });
+        if (this->stopping)
+            break;
+        this->jobs.push_back({serial, serial, -1, data + start, end - start, Clock::now()});
+        ++serial;
+        this->work.notify_one();
+    }
+
+    std::lock_guard lock(this->mutex);
+    this->capture_done = true;
+    this->work.notify_all();
+    this->delivered.notify_all();
+}
+
+void V4l2Capture::Decode()
+{
+    FramePool &pool = FramePool::Instance();
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock lock(this->mutex);
+            this->work.wait(lock, [this] { return !this->jobs.empty() || this->capture_done || this->stopping; });
+            if (this->stopping || this->jobs.empty())
+                break;
+            job = this->jobs.front();
+            this->jobs.pop_front();
+            ++this->decoding;
+        }
+
+        const Clock::time_point decode_start = Clock::now();
+        Frame frame;
+        frame.sequence = job.sequence;
+        frame.captured = job.captured;
+        frame.image = pool.Acquire(this->size, CV_8UC3);
+        bool ok = false;
+        try
+        {
+            if (this->format == Format::Mjpeg)
+            {
+                // Decodes into the pooled frame when the sizes match, which they do for every frame
+                cv::imdecode(cv::Mat(1, static_cast<int>(job.size), CV_8U, const_cast<uint8_t *>(job.data)), cv::IMREAD_COLOR, &frame.image);
+                ok = !frame.image.empty() && frame.image.size() == this->size;
+            }
+            else
+            {
+                const cv::Mat yuyv(this->size, CV_8UC2, const_cast<uint8_t *>(job.data), this->bytes_per_line);
+                cv::cvtColor(yuyv, frame.image, cv::COLOR_YUV2BGR_YUYV);
+                ok = true;
+            }
+        }
+        catch (const cv::Exception &e)
+        {
+            LOG_EVERY_MS(5000, "Frame " << job.sequence << " from " << this->options.device << " does not decode: " << e.what());
+        }
+        if (job.buffer >= 0)
+            this->Requeue(job.buffer);
+        frame.decoded = Clock::now();
+
+        std::lock_guard lock(this->mutex);
+        --this->decoding;
+        if (ok)
+        {
+            ++this->decoded;
+            this->decode_time += frame.decoded - decode_start;
+            this->latency += frame.decoded - frame.captured;
+            this->finished.emplace(job.serial, std::move(frame));
+        }
+        else
+        {
+            ++this->decode_errors;
+            this->finished.emplace(job.serial, std::nullopt);
+        }
+        this->Deliver();
+    }
+
+    std::lock_guard lock(this->mutex);
+    this->delivered.notify_all();
+}
+
+void V4l2Capture::Deliver()
+{
+    bool any = false;
+    bool retired = false;
+    for (auto it = this->finished.begin(); it != this->finished.end() && it->first == this->next_serial; it = this->finished.erase(it))
+    {
+        ++this->next_serial;
+        retired = true;
+        if (!it->second)
+            continue;
+        // Live frames are dropped oldest first, a recording's frames are held back in CaptureRecording
+        if (this->Live() && this->ready.size() >= std::max<size_t>(this->options.queue_depth, 1))
+        {
+            this->ready.pop_front();
+            ++this->queue_dropped;
+        }
+        this->ready.push_back(std::move(*it->second));
+        any = true;
+    }
+    if (any)
+        this->delivered.notify_one();
+    // A frame that failed to decode leaves nothing for Read() to take, so the recording has to learn
+    // here that it is out of flight, and a reader waiting for the end has to recheck
+    if (retired)
+    {
+        this->room.notify_one();
+        if (!any)
+            this->delivered.notify_all();
+    }
+}
+
+bool V4l2Capture::Read(Frame &frame)
+{
+    std::unique_lock lock(this->mutex);
+    this->delivered.wait(lock, [this] {
+        return !this->ready.empty() || this->stopping || (this->capture_done && this->jobs.empty() && this->decoding == 0 && this->finished.empty());
+    });
+    if (this->stopping || this->ready.empty())
+        return false;
+    frame = std::move(this->ready.front());
+    this->ready.pop_front();
+    ++this->frames;
+    this->room.notify_one();
+    return true;
+}
+
+void V4l2Capture::Requeue(int buffer)
+{
+    v4l2_buffer request{};
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    request.index = static_cast<uint32_t>(buffer);
+    // Fails once the device is gone, DQBUF reports that
+    Ioctl(this->fd, VIDIOC_QBUF, &request);
+}
+
+size_t V4l2Capture::InFlight() const
+{
+    return this->jobs.size() + this->decoding + this->finished.size() + this->ready.size();
+}
+
+void V4l2Capture::Stop()
+{
+    {
+        std::lock_guard lock(this->mutex);
+        this->stopping = true;
+    }
+    this->work.notify_all();
+    this->room.notify_all();
+    this->delivered.notify_all();
+    if (this->capture_thread.joinable())
+        this->capture_thread.join();
+    for (std::thread &decoder : this->decoders)
+    {
+        if (decoder.joinable())
+            decoder.join();
+    }
+    this->Release();
+}
+
+void V4l2Capture::Release()
+{
+    if (this->fd >= 0)
+    {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        Ioctl(this->fd, VIDIOC_STREAMOFF, &type);
+    }
+    for (const Mapping &mapping : this->mappings)
+        munmap(mapping.start, mapping.length);
+    this->mappings.clear();
+    if (this->recording.start)
+        munmap(this->recording.start, this->recording.length);
+    this->recording = {};
+    if (this->fd >= 0)
+        close(this->fd);
+    this->fd = -1;
+}
+
+std::string V4l2Capture::Error() const
+{
+    std::lock_guard lock(this->mutex);
+    return this->error;
+}
+
+V4l2Capture::Stats V4l2Capture::GetStats() const
+{
+    std::lock_guard lock(this->mutex);
+    Stats stats;
+    stats.frames = this->frames;
+    stats.driver_dropped = this->driver_dropped;
+    stats.replaced = this->replaced;
+    stats.queue_dropped = this->queue_dropped;
+    stats.decode_errors = this->decode_errors;
+    stats.hardware_timestamps = this->hardware_timestamps;
+    if (this->decoded > 0)
+    {
+        stats.mean_decode_ms = std::chrono::duration<double, std::milli>(this->decode_time).count() / this->decoded;
+        stats.mean_latency_ms = std::chrono::duration<double, std::milli>(this->latency).count() / this->decoded;
+    }
+    return stats;
+}
+
+std::string V4l2Capture::Summary() const
+{
+    const Stats stats = this->GetStats();
+    return std::format("{} {} frames, {} dropped by the driver, {} replaced, {} dropped from the queue, {} decode errors, "
+                       "decode {:.2f} ms, {} to decoded {:.2f} ms",
+                       this->options.device, stats.frames, stats.driver_dropped, stats.replaced, stats.queue_dropped, stats.decode_errors, stats.mean_decode_ms,
+                       stats.hardware_timestamps ? "sensor" : "dequeue", stats.mean_latency_ms);
+}
+
+#endif
@@ -0,0 +1,178 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+// Webcam capture straight from V4L2, for what cv::VideoCapture leaves to the backend. Pixel format,
+// resolution and frame rate are negotiated when the device opens instead of after the first frame.
+// The driver fills a fixed set of mmap'd buffers. A capture thread dequeues them and decode threads
+// turn them into BGR frames from the FramePool: MJPEG through imdecode, YUYV through one color
+// conversion. Each buffer goes back to the driver once decoded. Frames come out of Read() in capture
+// order, stamped with the driver's monotonic timestamp, so latency is measured from the sensor.
+//
+// A live device never waits for the reader. A frame still waiting for a decoder is replaced by the
+// newer one, and a full output queue drops its oldest frame. The sequence gaps the driver reports
+// are counted too.
+//
+// device may also name a recorded MJPEG stream, which has no hardware behind it:
+//   ffmpeg -f v4l2 -input_format mjpeg -video_size 1280x720 -i /dev/video0 -c copy -f mjpeg cam.mjpeg
+// Its frames go through the same decode path at options.fps, or as fast as they decode when fps is 0.
+// Nothing is dropped, the recording waits for the reader. The vivid driver (modprobe vivid) gives a
+// YUYV device without a camera.
+class V4l2Capture
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Format
+    {
+        Auto, // MJPEG when the device offers it, YUYV otherwise
+        Mjpeg,
+        Yuyv
+    };
+
+    struct Options
+    {
+        std::string device = "/dev/video0";
+        // Requested, the driver picks the nearest size it supports
+        int width = 1280;
+        int height = 720;
+        double fps = 30.0;
+        Format format = Format::Auto;
+        // Driver buffers mapped into the process, at least decode_threads + 2
+        uint32_t buffers = 4;
+        uint32_t decode_threads = 2;
+        // Decoded frames waiting for Read(), 1 hands a reader that paces itself the newest frame
+        size_t queue_depth = 1;
+
+        // Overrides with POF_V4L2_FORMAT (mjpeg or yuyv), POF_V4L2_SIZE (1920x1080), POF_V4L2_FPS,
+        // POF_V4L2_BUFFERS and POF_V4L2_DECODE_THREADS when set
+        Options FromEnvironment() const;
+    };
+
+    struct Frame
+    {
+        // BGR, from the frame pool
+        cv::Mat image;
+        // The driver's frame counter, or the frame index of a recording
+        uint64_t sequence = 0;
+        // Driver timestamp when it has a monotonic one, the dequeue time otherwise
+        Clock::time_point captured;
+        Clock::time_point decoded;
+    };
+
+    struct Stats
+    {
+        uint64_t frames = 0;         // returned by Read()
+        uint64_t driver_dropped = 0; // sequence gaps, frames the driver had no free buffer for
+        uint64_t replaced = 0;       // waited for a decoder and were replaced by a newer frame
+        uint64_t queue_dropped = 0;  // decoded, dropped from a full output queue
+        uint64_t decode_errors = 0;
+        double mean_decode_ms = 0.0;
+        double mean_latency_ms = 0.0; // capture to decoded
+        bool hardware_timestamps = false;
+    };
+
+    // Throws std::runtime_error when the device cannot be opened or has no usable format
+    explicit V4l2Capture(Options options);
+    ~V4l2Capture();
+
+    V4l2Capture(const V4l2Capture &) = delete;
+    V4l2Capture &operator=(const V4l2Capture &) = delete;
+
+    // Blocks for the next frame. False once the stream ended: a recording ran out, the device
+    // failed (Error() says why) or Stop() was called.
+    bool Read(Frame &frame);
+    void Stop();
+
+    cv::Size FrameSize() const { return this->size; }
+    Format PixelFormat() const { return this->format; }
+    double Fps() const { return this->fps; }
+    bool Live() const { return this->fd >= 0; }
+    std::string Error() const;
+
+    Stats GetStats() const;
+    std::string Summary() const;
+
+private:
+    struct Job
+    {
+        uint64_t serial;
+        uint64_t sequence;
+        // Driver buffer to hand back, -1 for recordings
+        int buffer;
+        const uint8_t *data;
+        size_t size;
+        Clock::time_point captured;
+    };
+
+    struct Mapping
+    {
+        void *start = nullptr;
+        size_t length = 0;
+    };
+
+    const Options options;
+    int fd = -1;
+    std::vector<Mapping> mappings;
+    // A recording is mapped whole
+    Mapping recording;
+    Format format = Format::Auto;
+    cv::Size size;
+    size_t bytes_per_line = 0;
+    double fps = 0.0;
+    bool hardware_timestamps = false;
+    // steady_clock minus CLOCK_MONOTONIC, zero with libstdc++ and libc++
+    Clock::duration monotonic_offset{};
+
+    mutable std::mutex mutex;
+    std::condition_variable work;      // jobs queued, or capture done
+    std::condition_variable delivered; // frames ready, or the stream ended
+    std::condition_variable room;      // a recording may read its next frame
+    std::deque<Job> jobs;
+    // Finished frames by serial until every earlier one is finished too, nullopt for skipped ones
+    std::map<uint64_t, std::optional<Frame>> finished;
+    std::deque<Frame> ready;
+    uint64_t next_serial = 0;
+    size_t decoding = 0;
+    bool capture_done = false;
+    bool stopping = false;
+    std::string error;
+
+    uint64_t frames = 0;
+    uint64_t driver_dropped = 0;
+    uint64_t replaced = 0;
+    uint64_t queue_dropped = 0;
+    uint64_t decode_errors = 0;
+    uint64_t decoded = 0;
+    Clock::duration decode_time{};
+    Clock::duration latency{};
+
+    std::thread capture_thread;
+    std::vector<std::thread> decoders;
+
+    void OpenDevice();
+    void OpenRecording();
+    void CaptureDevice();
+    void CaptureRecording();
+    void Decode();
+    // Under the lock: moves finished frames to the output queue in serial order
+    void Deliver();
+    void Requeue(int buffer);
+    size_t InFlight() const;
+    void Release();
+};
+
+#endif
@@ -1,38 +1,120 @@
 #include "Yolo.hpp"
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+    // Model files are parsed from a read-only mapping unless POF_MODEL_MMAP=0
+    bool MapModelFiles()
+    {
+        const char *map = std::getenv("POF_MODEL_MMAP");
+        return map == nullptr || std::string(map) != "0";
+    }
+}
+
+YOLO::YOLO(std::string modelName) : MODEL_NAME(std::move(modelName)) {}
 
-YOLO::YOLO(){this->CheckGPU();}
+YOLO::YOLO(std::string modelName, const std::filesystem::path &modelDir, const std::filesystem::path &classNamesPath)
+    : MODEL_PATH(modelDir), MODEL_NAME(std::move(modelName)), class_names_path(classNamesPath.generic_string()) {}
 
-void YOLO::LoadOnnx() {
-    const std::filesystem::path onnx_path = this->MODEL_PATH / "yolov8l.onnx";
+YOLO::~YOLO()
+{
+    {
+        std::lock_guard lock(this->swap_mutex);
+        this->stopping = true;
+    }
+    this->swap_event.notify_all();
+    if (this->watch_thread.joinable())
+        this->watch_thread.join();
+    if (this->reload_thread.joinable())
+        this->reload_thread.join();
+}
+
+void YOLO::LoadOnnx(Network &network) const {
+    const std::filesystem::path onnx_path = this->MODEL_PATH / (this->MODEL_NAME + ".onnx");
 
     if (!std::filesystem::exists(onnx_path)) {
         throw std::runtime_error(std::format("Ensure models are in {}", this->MODEL_PATH.generic_string()));
     }
 
     LOG(std::format("Loading model from: {}", onnx_path.generic_string()));
-    try{this->model = cv::dnn::readNetFromONNX(onnx_path.generic_string());}
+    const auto start = std::chrono::steady_clock::now();
+    try{
+        if (MapModelFiles()) {
+            // The importer copies the initializers into its own blobs, so the mapping can go right away
+            const MappedFile file(onnx_path);
+            network.net = cv::dnn::readNetFromONNX(reinterpret_cast<const char *>(file.Data()), file.Size());
+            network.file_bytes = file.Size();
+            network.mapped = true;
+        }
+        else {
+            network.net = cv::dnn::readNetFromONNX(onnx_path.generic_string());
+            network.file_bytes = std::filesystem::file_size(onnx_path);
+        }
+    }
     catch (const cv::Exception& e) {
         throw std::runtime_error(std::format("Failed to load model: {}", e.msg));
     }
+    network.read_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
-void YOLO::LoadVino() {
-    const std::filesystem::path bin = this->MODEL_PATH / "yolov8l.bin";
-    const std::filesystem::path bin_xml = this->MODEL_PATH / "yolov8l.xml";
+void YOLO::LoadVino(Network &network) const {
+    const std::filesystem::path bin = this->MODEL_PATH / (this->MODEL_NAME + ".bin");
+    const std::filesystem::path bin_xml = this->MODEL_PATH / (this->MODEL_NAME + ".xml");
 
-    if (!std::filesystem::exists(bin) && !std::filesystem::exists(bin_xml)){
+    if (!std::filesystem::exists(bin) || !std::filesystem::exists(bin_xml)){
         throw std::runtime_error(std::format("Ensure models are in {}", this->MODEL_PATH.generic_string()));
     }
 
     LOG(std::format("Loading model from: {}", bin.generic_string()));
     LOG(std::format("Loading model config from: {}", bin_xml.generic_string()));
+    const auto start = std::chrono::steady_clock::now();
     try {
-        this->model = cv::dnn::readNet( bin_xml.generic_string(), bin.generic_string());
+        if (MapModelFiles()) {
+            // OpenVINO may keep constants pointing into the weights buffer, so the mapping lives as long as the network
+            const MappedFile config(bin_xml);
+            auto weights = std::make_shared<const MappedFile>(bin);
+            network.net = cv::dnn::readNetFromModelOptimizer(config.Data(), config.Size(), weights->Data(), weights->Size());
+            network.file_bytes = config.Size() + weights->Size();
+            network.weights = std::move(weights);
+            network.mapped = true;
+        }
+        else {
+            network.net = cv::dnn::readNet( bin_xml.generic_string(), bin.generic_string());
+            network.file_bytes = std::filesystem::file_size(bin_xml) + std::filesystem::file_size(bin);
+        }
     }catch (const cv::Exception& e) {
         throw std::runtime_error(std::format("Failed to load model: {} \n \t Reason: {}", bin_xml.string() ,e.msg));
     }catch(const std::exception& e){
         throw std::runtime_error(std::format("Failed to load model: {}", e.what()));
     }
+    network.read_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<std::filesystem::path> YOLO::ModelFiles() const
+{
+    const std::filesystem::path xml = this->MODEL_PATH / (this->MODEL_NAME + ".xml");
+    const std::filesystem::path bin = this->MODEL_PATH / (this->MODEL_NAME + ".bin");
+    if (std::filesystem::exists(xml) && std::filesystem::exists(bin))
+        return {xml, bin};
+    return {this->MODEL_PATH / (this->MODEL_NAME + ".onnx")};
+}
+
+void YOLO::LoadModel(Network &network) const
+{
+    if (this->ModelFiles().size() == 2)
+    {
+        this->LoadVino(network);
+        network.ir = true;
+    }
+    else
+        this->LoadOnnx(network);
 }
 
 void YOLO::LoadClassNames()
@@ -50,80 +132,476 @@ void YOLO::LoadClassNames()
     ifs.close();
 }
 
-void YOLO::SetupYoloNetwork()
+void YOLO::SetupYoloNetwork(bool cpu_only, StartupTimeline *timeline)
 {
-    if (this->hw_info.has_cuda)
+    // Parsing the model does not depend on the backend, so it overlaps the probe
+    auto loaded = std::make_shared<Network>();
+    std::future<HINFO> probe = std::async(std::launch::async, [timeline] {
+        const auto start = StartupTimeline::Clock::now();
+        HINFO info = ProbeHardware(std::filesystem::current_path() / "kernel_cache" / "hw_probe.txt");
+        if (timeline)
+            timeline->Record(info.cached ? "hardware probe (cached)" : "hardware probe", start, StartupTimeline::Clock::now());
+        return info;
+    });
     {
-        this->LoadOnnx();
-        this->model.setPreferableBackend(cv::dnn::DNN_BACKEND_CUDA);
-        this->model.setPreferableTarget(cv::dnn::DNN_TARGET_CUDA);
+        const auto start = StartupTimeline::Clock::now();
+        this->LoadModel(*loaded);
+        this->LoadClassNames();
+        if (timeline)
+            timeline->Record("model read", start, StartupTimeline::Clock::now());
     }
-    else if (this->hw_info.has_amd && this->hw_info.has_opencl)
+    this->hw_info = probe.get();
+
+    if (loaded->net.empty())
+        throw std::runtime_error(std::format("Ensure models are in {}", this->MODEL_PATH.generic_string()));
+
+    if (this->hw_info.has_cuda && !cpu_only)
+    {
+        this->backend = cv::dnn::DNN_BACKEND_CUDA;
+        this->target = cv::dnn::DNN_TARGET_CUDA;
+    }
+    else if (this->hw_info.has_amd && this->hw_info.has_opencl && !cpu_only)
     {
-        this->LoadOnnx();
         cv::ocl::setUseOpenCL(true);
-        this->model.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-        this->model.setPreferableTarget(cv::dnn::DNN_TARGET_OPENCL);
+        this->backend = cv::dnn::DNN_BACKEND_OPENCV;
+        this->target = cv::dnn::DNN_TARGET_OPENCL;
     }
     else
     {
-        this->LoadOnnx();
-        this->model.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-        this->model.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+        this->backend = cv::dnn::DNN_BACKEND_OPENCV;
+        this->target = cv::dnn::DNN_TARGET_CPU;
+    }
+    // An IR network only runs on the OpenVINO backend, which has no CUDA target
+    if (loaded->ir)
+    {
+        this->backend = cv::dnn::DNN_BACKEND_INFERENCE_ENGINE;
+        if (this->target == cv::dnn::DNN_TARGET_CUDA)
+            this->target = cv::dnn::DNN_TARGET_CPU;
     }
+    this->Configure(loaded->net);
 
-    if (this->model.empty())
-        throw std::runtime_error(std::format("Ensure models are in {}", this->MODEL_PATH.generic_string()));
+    loaded->generation = 1;
+    loaded->proven = true;
+    this->network.store(loaded);
+    {
+        std::lock_guard lock(this->swap_mutex);
+        this->swap_stats.generation = 1;
+    }
+
+    const char *use_profile = std::getenv("POF_TUNE_PROFILE");
+    if (!cpu_only && (use_profile == nullptr || std::string(use_profile) != "0"))
+    {
+        if (const std::optional<TuneProfile> tuned = this->LoadTuneProfile())
+        {
+            this->ApplyProfile(*tuned);
+            LOG(std::format("Using tuned profile: backend {} target {}, {} threads, input {}, batch {} ({:.1f} fps at {:.1f} ms)", tuned->backend, tuned->target,
+                            tuned->threads, tuned->input_size, tuned->batch, tuned->fps, tuned->latency_ms));
+        }
+    }
+}
+
+void YOLO::ApplyProfile(const TuneProfile &profile)
+{
+    if (profile.input_size <= 0 || profile.input_size % 32 != 0)
+        throw std::runtime_error(std::format("Input size {} is not a positive multiple of 32", profile.input_size));
+    if (profile.target == cv::dnn::DNN_TARGET_OPENCL || profile.target == cv::dnn::DNN_TARGET_OPENCL_FP16)
+        cv::ocl::setUseOpenCL(true);
+    this->backend = profile.backend;
+    this->target = profile.target;
+    if (const std::shared_ptr<Network> current = this->network.load())
+        this->Configure(current->net);
+    // Process wide. The layout's pool (POF_OPENCV_THREADS, or one thread per inference core) is a ceiling
+    // a tuned count may only lower, more threads would just compete for the cores inference is pinned to
+    if (profile.threads > 0)
+        cv::setNumThreads(this->pool_threads > 0 ? std::min(profile.threads, this->pool_threads) : profile.threads);
+    this->input_size = cv::Size(profile.input_size, profile.input_size);
+    this->profile = profile;
+}
+
+void YOLO::SetConfidenceThreshold(float threshold)
+{
+    if (threshold < 0.0f || threshold > 1.0f)
+        throw std::runtime_error(std::format("Confidence threshold {} is outside [0, 1]", threshold));
+    this->confidence_threshold = threshold;
+}
+
+void YOLO::SetInputSize(int size)
+{
+    if (size <= 0 || size % 32 != 0)
+        throw std::runtime_error(std::format("Input size {} is not a positive multiple of 32", size));
+    this->input_size = cv::Size(size, size);
+}
+
+void YOLO::Configure(cv::dnn::Net &net) const
+{
+    net.setPreferableBackend(this->backend);
+    net.setPreferableTarget(this->target);
+    net.enableFusion(true);
+}
+
+std::optional<bool> YOLO::BatchSupported() const
+{
+    const std::shared_ptr<Network> current = this->network.load();
+    return current ? current->batch_supported : std::nullopt;
+}
 
-    this->model.enableFusion(true);
-    this->LoadClassNames();
+void YOLO::SmokeTest(cv::dnn::Net &net) const
+{
+    // Doubles as the warm-up: backend setup and kernel compilation happen here instead of on the first live frame
+    const cv::Mat blank(this->input_size, CV_8UC3, cv::Scalar::all(0));
+    cv::Mat blob;
+    CreateBlob(blank, blob, this->input_size);
+    std::vector<cv::Mat> outs;
+    net.setInput(blob);
+    net.forward(outs, net.getUnconnectedOutLayersNames());
+
+    if (outs.empty() || outs[0].dims != 3 || outs[0].size[1] <= 4)
+        throw std::runtime_error("The smoke inference gave no detection output");
+    const int classes = outs[0].size[1] - 4;
+    if (!this->class_names.empty() && classes != static_cast<int>(this->class_names.size()))
+        throw std::runtime_error(std::format("The model has {} classes and the class list {}, a new class list needs a restart", classes, this->class_names.size()));
+    if (!cv::checkRange(outs[0]))
+        throw std::runtime_error("The smoke inference gave NaN or infinite scores");
+}
+
+bool YOLO::Reload()
+{
+    std::lock_guard lock(this->swap_mutex);
+    if (this->reloading || this->stopping)
+        return false;
+    if (!this->network.load())
+        throw std::runtime_error("Reload before Init");
+    // Finished, it cleared reloading as its last step
+    if (this->reload_thread.joinable())
+        this->reload_thread.join();
+    this->reloading = true;
+    this->reload_thread = std::thread(&YOLO::ReloadNetwork, this);
+    return true;
 }
 
-void YOLO::CheckGPU()
+void YOLO::ReloadNetwork()
 {
+    // How long the old network is kept for a rollback when no frame comes to prove the new one
+    constexpr std::chrono::seconds ROLLBACK_WINDOW{60};
+
+    const auto start = std::chrono::steady_clock::now();
+    auto candidate = std::make_shared<Network>();
+    std::string error;
     try
     {
-        if (cv::cuda::getCudaEnabledDeviceCount() > 0)
+        this->LoadModel(*candidate);
+        if (candidate->ir != this->network.load()->ir)
+            throw std::runtime_error("The model changed between ONNX and OpenVINO IR, which needs a restart to pick its backend");
+        if (candidate->net.empty())
+            throw std::runtime_error("The model file holds no network");
+        this->Configure(candidate->net);
+        this->SmokeTest(candidate->net);
+    }
+    catch (const cv::Exception &e)
+    {
+        error = e.msg;
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+    }
+    const double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::unique_lock lock(this->swap_mutex);
+    this->swap_stats.last_load_ms = load_ms;
+    if (!error.empty())
+    {
+        ++this->swap_stats.rejected;
+        this->swap_stats.last_error = error;
+        LOG_ERR(std::format("New model rejected, generation {} stays: {}", this->swap_stats.generation, error));
+        this->reloading = false;
+        return;
+    }
+
+    candidate->generation = this->swap_stats.generation + 1;
+    this->previous = this->network.exchange(candidate);
+    this->swap_stats.generation = candidate->generation;
+    ++this->swap_stats.swaps;
+    LOG(std::format("Swapped in model generation {} ({:.0f} ms to load and warm up)", candidate->generation, load_ms));
+
+    this->swap_event.wait_for(lock, ROLLBACK_WINDOW, [&] { return this->stopping || candidate->proven || this->network.load() != candidate; });
+    // Released here rather than on an inference thread
+    std::shared_ptr<Network> retired;
+    if (candidate->proven)
+        retired = std::move(this->previous);
+    this->reloading = false;
+    lock.unlock();
+    retired.reset();
+}
+
+void YOLO::WatchModel(std::chrono::milliseconds interval)
+{
+    std::lock_guard lock(this->swap_mutex);
+    if (this->watch_thread.joinable() || this->stopping)
+        return;
+    this->watch_thread = std::thread(&YOLO::Watch, this, interval);
+}
+
+void YOLO::Watch(std::chrono::milliseconds interval)
+{
+    const std::vector<std::filesystem::path> files = this->ModelFiles();
+    // Latest modification and total size over the model files
+    using Stamp = std::pair<std::filesystem::file_time_type, uintmax_t>;
+    const auto stamp = [&files]() -> std::optional<Stamp> {
+        Stamp combined{};
+        for (const std::filesystem::path &file : files)
+        {
+            std::error_code ec;
+            const auto modified = std::filesystem::last_write_time(file, ec);
+            const uintmax_t size = ec ? 0 : std::filesystem::file_size(file, ec);
+            if (ec)
+                return std::nullopt;
+            combined = Stamp(std::max(combined.first, modified), combined.second + size);
+        }
+        return combined;
+    };
+
+    // What the running network was read from, and what the previous poll saw
+    std::optional<Stamp> loaded = stamp();
+    std::optional<Stamp> seen = loaded;
+    std::unique_lock lock(this->swap_mutex);
+    while (!this->swap_event.wait_for(lock, interval, [this] { return this->stopping; }))
+    {
+        lock.unlock();
+        const std::optional<Stamp> current = stamp();
+        // A file still being written changes between polls; a busy reload is retried on the next one
+        if (current && current != loaded && current == seen && this->Reload())
+        {
+            LOG("Model file changed, reloading " << files.back().generic_string());
+            loaded = current;
+        }
+        seen = current;
+        lock.lock();
+    }
+}
+
+bool YOLO::RollBack(const std::shared_ptr<Network> &failed, const std::string &reason)
+{
+    std::lock_guard lock(this->swap_mutex);
+    // Replaced meanwhile, the frame goes to the current network
+    if (this->network.load() != failed)
+        return true;
+    if (failed->proven || !this->previous)
+        return false;
+
+    this->network.store(this->previous);
+    this->swap_stats.generation = this->previous->generation;
+    this->previous.reset();
+    ++this->swap_stats.rollbacks;
+    this->swap_stats.last_error = reason;
+    LOG_ERR(std::format("Model generation {} failed a live inference, rolled back to generation {}: {}", failed->generation, this->swap_stats.generation, reason));
+    this->swap_event.notify_all();
+    return true;
+}
+
+void YOLO::MarkProven(Network &network)
+{
+    if (network.proven.load(std::memory_order_relaxed) || network.proven.exchange(true))
+        return;
+    std::lock_guard lock(this->swap_mutex);
+    this->swap_event.notify_all();
+}
+
+std::string YOLO::LoadSummary() const
+{
+    const std::shared_ptr<Network> current = this->network.load();
+    if (!current)
+        return "Model not loaded";
+    const char *how = current->weights ? "mapped, weights used in place" : current->mapped ? "parsed from a mapping" : "read";
+    return std::format("Model {} ({}, {:.0f} MB, {}) in {:.0f} ms; process {}", this->MODEL_NAME, current->ir ? "OpenVINO IR" : "ONNX",
+                       current->file_bytes / (1024.0 * 1024.0), how, current->read_ms, CurrentProcessMemory().Summary());
+}
+
+YOLO::SwapStats YOLO::GetSwapStats() const
+{
+    std::lock_guard lock(this->swap_mutex);
+    return this->swap_stats;
+}
+
+namespace
+{
+    constexpr int PROBE_CACHE_VERSION = 1;
+    constexpr auto PROBE_CACHE_MAX_AGE = std::chrono::hours(24 * 7);
+    constexpr int TUNE_PROFILE_VERSION = 1;
+
+    std::unordered_map<std::string, std::string> ReadKeyValues(const std::filesystem::path &file)
+    {
+        std::ifstream ifs(file);
+        std::unordered_map<std::string, std::string> values;
+        std::string line;
+        while (std::getline(ifs, line))
+        {
+            if (const size_t split = line.find('='); split != std::string::npos)
+                values[line.substr(0, split)] = line.substr(split + 1);
+        }
+        return values;
+    }
+
+    // Written aside and renamed, so a model starting at the same time never reads half a file
+    void WriteKeyValues(const std::filesystem::path &file, const std::string &content)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(file.parent_path(), ec);
+        const std::filesystem::path tmp = file.string() + std::format(".{:x}.tmp", std::random_device{}());
+        {
+            std::ofstream ofs(tmp, std::ios::trunc);
+            if (!ofs)
+                return;
+            ofs << content;
+        }
+        std::filesystem::rename(tmp, file, ec);
+        if (ec)
         {
-            this->hw_info.has_cuda = true;
-            this->hw_info.has_nvidia = true;
+            DEV_LOG("Failed to store " << file.generic_string() << ": " << ec.message());
+            std::filesystem::remove(tmp, ec);
         }
     }
+
+    void ClassifyVendor(HINFO &info)
+    {
+        if (info.gpu_vendor.find("AMD") != std::string::npos)
+            info.has_amd = true;
+        else if (info.gpu_vendor.find("Intel") != std::string::npos)
+            info.has_intel = true;
+        else if (info.gpu_vendor.find("NVIDIA") != std::string::npos)
+            info.has_nvidia = true;
+    }
+
+    // key=value lines; anything missing or from another OpenCV build or CUDA setup is a miss
+    std::optional<HINFO> LoadProbeCache(const std::filesystem::path &cache_file, int cuda_devices)
+    {
+        std::error_code ec;
+        const auto modified = std::filesystem::last_write_time(cache_file, ec);
+        if (ec || std::filesystem::file_time_type::clock::now() - modified > PROBE_CACHE_MAX_AGE)
+            return std::nullopt;
+
+        std::unordered_map<std::string, std::string> values = ReadKeyValues(cache_file);
+        if (values["version"] != std::to_string(PROBE_CACHE_VERSION) || values["opencv"] != CV_VERSION ||
+            values["cuda_devices"] != std::to_string(cuda_devices) || !values.contains("opencl"))
+            return std::nullopt;
+
+        HINFO info;
+        info.has_cuda = info.has_nvidia = cuda_devices > 0;
+        info.has_opencl = values["opencl"] == "1";
+        info.gpu_name = values["gpu_name"];
+        info.gpu_vendor = values["gpu_vendor"];
+        ClassifyVendor(info);
+        info.cached = true;
+        return info;
+    }
+
+    void StoreProbeCache(const std::filesystem::path &cache_file, int cuda_devices, const HINFO &info)
+    {
+        WriteKeyValues(cache_file, std::format("version={}\nopencv={}\ncuda_devices={}\nopencl={}\ngpu_name={}\ngpu_vendor={}\n", PROBE_CACHE_VERSION, CV_VERSION,
+                                               cuda_devices, info.has_opencl ? 1 : 0, info.gpu_name, info.gpu_vendor));
+    }
+}
+
+std::filesystem::path YOLO::TuneProfilePath() const
+{
+    return std::filesystem::current_path() / "kernel_cache" / std::format("tune_{}.txt", this->MODEL_NAME);
+}
+
+std::string YOLO::TuneKey() const
+{
+    // Size and modification time stand in for a hash of a file that can be hundreds of megabytes
+    uintmax_t size = 0;
+    std::filesystem::file_time_type::rep modified = 0;
+    for (const std::filesystem::path &file : this->ModelFiles())
+    {
+        std::error_code ec;
+        if (const uintmax_t bytes = std::filesystem::file_size(file, ec); !ec)
+            size += bytes;
+        modified = std::max(modified, std::filesystem::last_write_time(file, ec).time_since_epoch().count());
+    }
+    return std::format("opencv {}; model {}:{}; gpu {}; cuda {}; opencl {}; cpus {}", CV_VERSION, size, modified, this->hw_info.gpu_name,
+                       this->hw_info.has_cuda ? 1 : 0, this->hw_info.has_opencl ? 1 : 0, std::thread::hardware_concurrency());
+}
+
+std::optional<TuneProfile> YOLO::LoadTuneProfile() const
+{
+    std::unordered_map<std::string, std::string> values = ReadKeyValues(this->TuneProfilePath());
+    if (values["version"] != std::to_string(TUNE_PROFILE_VERSION) || values["key"] != this->TuneKey())
+        return std::nullopt;
+    try
+    {
+        TuneProfile profile;
+        profile.backend = std::stoi(values.at("backend"));
+        profile.target = std::stoi(values.at("target"));
+        profile.threads = std::stoi(values.at("threads"));
+        profile.batch = std::stoi(values.at("batch"));
+        profile.input_size = std::stoi(values.at("input_size"));
+        profile.budget_ms = std::stod(values.at("budget_ms"));
+        profile.latency_ms = std::stod(values.at("latency_ms"));
+        profile.fps = std::stod(values.at("fps"));
+        profile.meets_budget = values.at("meets_budget") == "1";
+        if (profile.input_size <= 0 || profile.input_size % 32 != 0 || profile.batch <= 0)
+            return std::nullopt;
+        return profile;
+    }
+    catch (const std::exception &)
+    {
+        DEV_LOG("Ignoring malformed tune profile " << this->TuneProfilePath().generic_string());
+        return std::nullopt;
+    }
+}
+
+void YOLO::StoreTuneProfile(const TuneProfile &profile) const
+{
+    WriteKeyValues(this->TuneProfilePath(), std::format("version={}\nkey={}\nbackend={}\ntarget={}\nthreads={}\nbatch={}\ninput_size={}\nbudget_ms={}\n"
+                                                        "latency_ms={}\nfps={}\nmeets_budget={}\n",
+                                                        TUNE_PROFILE_VERSION, this->TuneKey(), profile.backend, profile.target, profile.threads, profile.batch,
+                                                        profile.input_size, profile.budget_ms, profile.latency_ms, profile.fps, profile.meets_budget ? 1 : 0));
+}
+
+HINFO YOLO::ProbeHardware(const std::filesystem::path &cache_file)
+{
+    // Cheap, and part of the cache key so a driver that starts or stops exposing CUDA is noticed
+    int cuda_devices = 0;
+    try
+    {
+        cuda_devices = cv::cuda::getCudaEnabledDeviceCount();
+    }
     catch (const cv::Exception& e)
     {
         throw std::runtime_error(std::format("Failed to get CUDA devices: {}", e.msg));
     }
 
+    const char *reprobe = std::getenv("POF_REPROBE");
+    if (reprobe == nullptr || std::string(reprobe) != "1")
+    {
+        if (std::optional<HINFO> cached = LoadProbeCache(cache_file, cuda_devices))
+            return *cached;
+    }
+
+    HINFO info;
+    info.has_cuda = info.has_nvidia = cuda_devices > 0;
     if (cv::ocl::haveOpenCL())
     {
         cv::ocl::Context context;
         context.create(cv::ocl::Device::TYPE_ALL);
         if (!context.empty())
         {
-            this->hw_info.has_opencl = true;
+            info.has_opencl = true;
             const cv::ocl::Device& device = context.device(0);
-            this->hw_info.gpu_name = device.name();
-            this->hw_info.gpu_vendor = device.vendorName();
-
-            if (this->hw_info.gpu_vendor.find("AMD") != std::string::npos)
-            {
-                this->hw_info.has_amd = true;
-            }
-            else if (this->hw_info.gpu_vendor.find("Intel") != std::string::npos)
-            {
-                this->hw_info.has_intel = true;
-            }
-            else if (this->hw_info.gpu_vendor.find("NVIDIA") != std::string::npos)
-            {
-                this->hw_info.has_nvidia = true;
-            }
+            info.gpu_name = device.name();
+            info.gpu_vendor = device.vendorName();
+            ClassifyVendor(info);
         }
     }
+
+    StoreProbeCache(cache_file, cuda_devices, info);
+    return info;
 }
 
 void YOLO::HardwareSummary() const {
     LOG("Hardware Detection Summary");
-    LOG("GPU Name: " << (this->hw_info.gpu_name.empty() ? "N/A" : this->hw_info.gpu_name));
+    LOG("GPU Name: " << (this->hw_info.gpu_name.empty() ? "N/A" : this->hw_info.gpu_name) << (this->hw_info.cached ? " (cached probe)" : ""));
 
     if (this->hw_info.has_cuda)
     {
@@ -134,11 +612,13 @@ void YOLO::HardwareSummary() const {
     }
 }
 
-void YOLO::Init()
+void YOLO::Init(bool cpu_only, StartupTimeline *timeline)
 {
+    // What CT::ApplyLayout sized the pool to, or OpenCV's default without a layout
+    this->pool_threads = cv::getNumThreads();
     try
     {
-        this->SetupYoloNetwork();
+        this->SetupYoloNetwork(cpu_only, timeline);
     }
     catch (const cv::Exception&)
     {
@@ -149,53 +629,101 @@ void YOLO::Init()
     }
 }
 
-void YOLO::ProcessFrame(cv::Mat &frame)
+void YOLO::Warmup()
 {
-    if (frame.empty() || this->model.empty())
-    throw std::runtime_error("Model or Frame is invalid");
+    const cv::Mat blank(this->input_size, CV_8UC3, cv::Scalar::all(0));
+    this->Detect(blank);
+}
 
-    try
-    {
-        cv::Mat blob;
-        cv::dnn::blobFromImage(frame, blob, 1.0 / 255.0, cv::Size(this->YOLO_INPUT_WIDTH, this->YOLO_INPUT_HEIGHT), cv::Scalar(), true, false, CV_32F);
-        this->model.setInput(blob);
-    }
-    catch (const cv::Exception &e)
+namespace
+{
+    // What CreateBlob takes; checked before inference so a bad frame is not taken for a failing network
+    bool ValidFrame(const cv::Mat &frame)
     {
-        throw std::runtime_error(e.what());
+        const int channels = frame.channels();
+        return !frame.empty() && frame.depth() == CV_8U && (channels == 1 || channels == 3 || channels == 4);
     }
 
-    std::vector<cv::Mat> outs;
-    try
+    // Writes one row of an 8-bit frame into the R, G and B planes of an NCHW blob, scaling to [0, 1]
+    template <int CN>
+    void PackRow(const uchar *src, int width, bool mirror, float *r, float *g, float *b)
     {
-        this->model.forward(outs, this->model.getUnconnectedOutLayersNames());
-    }
-    catch (const cv::Exception &e)
-    {
-        throw std::runtime_error(e.what());
+        constexpr float scale = 1.0f / 255.0f;
+        for (int x = 0; x < width; ++x)
+        {
+            const uchar *px = src + (mirror ? width - 1 - x : x) * CN;
+            if constexpr (CN == 1)
+            {
+                r[x] = g[x] = b[x] = px[0] * scale;
+            }
+            else
+            {
+                b[x] = px[0] * scale;
+                g[x] = px[1] * scale;
+                r[x] = px[2] * scale;
+            }
+        }
     }
+}
 
-    // --- REVISED & IMPROVED POST-PROCESSING ---
+void YOLO::CreateBlob(const cv::Mat &frame, cv::Mat &blob, const cv::Size &inputSize, bool mirror)
+{
+    const int channels = frame.channels();
+    if (frame.depth() != CV_8U || (channels != 1 && channels != 3 && channels != 4))
+        throw std::runtime_error("Frame must be 8-bit gray, BGR or BGRA");
+
+    // Resize first, at the source channel count, so channel drop, swizzle, mirroring and
+    // normalisation happen in one pass over input-sized data instead of over the full frame.
+    // This is what blobFromImage(1/255, inputSize, swapRB = true, crop = false) produces.
+    thread_local cv::Mat resized;
+    cv::resize(frame, resized, inputSize, 0, 0, cv::INTER_LINEAR);
+    // The workers below have thread_locals of their own, they read this thread's buffer through the reference
+    const cv::Mat &resized_frame = resized;
+
+    const int sizes[] = {1, 3, inputSize.height, inputSize.width};
+    blob.create(4, sizes, CV_32F);
+    float *r_plane = blob.ptr<float>();
+    float *g_plane = r_plane + inputSize.area();
+    float *b_plane = g_plane + inputSize.area();
+
+    cv::parallel_for_(cv::Range(0, inputSize.height), [&](const cv::Range &rows) {
+        for (int y = rows.start; y < rows.end; ++y)
+        {
+            const uchar *src = resized_frame.ptr<uchar>(y);
+            const size_t offset = static_cast<size_t>(y) * inputSize.width;
+            switch (channels)
+            {
+            case 1:
+                PackRow<1>(src, inputSize.width, mirror, r_plane + offset, g_plane + offset, b_plane + offset);
+                break;
+            case 3:
+                PackRow<3>(src, inputSize.width, mirror, r_plane + offset, g_plane + offset, b_plane + offset);
+                break;
+            default:
+                PackRow<4>(src, inputSize.width, mirror, r_plane + offset, g_plane + offset, b_plane + offset);
+                break;
+            }
+        }
+    });
+}
 
-    // The output 'outs[0]' is a Mat with 3 dimensions: [batch_size, num_channels, num_proposals]
+void YOLO::DecodeOutput(const cv::Mat &output, const cv::Size &frameSize, const cv::Size &inputSize, float confThreshold, std::vector<Detection> &candidates)
+{
+    // The output is a Mat with 3 dimensions: [batch_size, num_channels, num_proposals]
     // For a YOLOv8-style model, this is [1, 84, 8400] where 84 = 4 (box) + 80 (classes)
-    if (outs.empty() || outs[0].dims != 3)
+    if (output.dims != 3)
         throw std::runtime_error("Empty detection: check if model is loaded");
 
-    cv::Mat detections = outs[0];
+    const int num_classes = output.size[1] - 4;
 
     // Reshape the [1, 84, 8400] output to a 2D matrix of [84, 8400]
-    cv::Mat detection_matrix_transposed(detections.size[1], detections.size[2], CV_32F, detections.ptr<float>());
+    const cv::Mat detection_matrix_transposed(output.size[1], output.size[2], CV_32F, const_cast<float *>(output.ptr<float>()));
 
     // Transpose the matrix to have proposals as rows for easier iteration: [8400, 84]
-    cv::Mat detection_matrix = detection_matrix_transposed.t();
+    const cv::Mat detection_matrix = detection_matrix_transposed.t();
 
-    std::vector<int> class_ids;
-    std::vector<float> confidences;
-    std::vector<cv::Rect> boxes;
-
-    const float x_factor = frame.cols / static_cast<float>(this->YOLO_INPUT_WIDTH);
-    const float y_factor = frame.rows / static_cast<float>(this->YOLO_INPUT_HEIGHT);
+    const float x_factor = frameSize.width / static_cast<float>(inputSize.width);
+    const float y_factor = frameSize.height / static_cast<float>(inputSize.height);
 
     // Iterate over each row (each detection proposal)
     for (int i = 0; i < detection_matrix.rows; ++i)
@@ -204,17 +732,14 @@ void YOLO::ProcessFrame(cv::Mat &frame)
         const float *proposal = detection_matrix.ptr<float>(i);
 
         // The class scores start after the 4 box coordinates
-        cv::Mat scores(1, class_names.size(), CV_32F, (void *)(proposal + 4));
+        const cv::Mat scores(1, num_classes, CV_32F, const_cast<float *>(proposal + 4));
 
         cv::Point class_id_point;
         double max_score;
         cv::minMaxLoc(scores, nullptr, &max_score, nullptr, &class_id_point);
 
-        if (max_score > this->CONFIDENCE_THRESHOLD)
+        if (max_score > confThreshold)
         {
-            confidences.push_back(static_cast<float>(max_score));
-            class_ids.push_back(class_id_point.x);
-
             // Extract box coordinates
             const float cx = proposal[0];
             const float cy = proposal[1];
@@ -222,26 +747,177 @@ void YOLO::ProcessFrame(cv::Mat &frame)
             const float h = proposal[3];
 
             // Scale box coordinates back to the original frame size
-            int left = static_cast<int>((cx - w / 2) * x_factor);
-            int top = static_cast<int>((cy - h / 2) * y_factor);
-            int width = static_cast<int>(w * x_factor);
-            int height = static_cast<int>(h * y_factor);
+            const int left = static_cast<int>((cx - w / 2) * x_factor);
+            const int top = static_cast<int>((cy - h / 2) * y_factor);
+            const int width = static_cast<int>(w * x_factor);
+            const int height = static_cast<int>(h * y_factor);
 
-            boxes.push_back(cv::Rect(left, top, width, height));
+            candidates.push_back({class_id_point.x, static_cast<float>(max_score), cv::Rect(left, top, width, height)});
         }
     }
+}
+
+std::vector<Detection> YOLO::Suppress(const std::vector<Detection> &candidates, float confThreshold, float nmsThreshold)
+{
+    NmsConfig config;
+    config.score_threshold = confThreshold;
+    config.iou_threshold = nmsThreshold;
+    thread_local NMS nms;
+    if (nms.Config().score_threshold != confThreshold || nms.Config().iou_threshold != nmsThreshold)
+        nms = NMS(config);
+    return nms.Apply(candidates);
+}
+
+std::vector<Detection> YOLO::Detect(const cv::Mat &frame, bool mirror)
+{
+    const std::shared_ptr<Network> current = this->network.load();
+    if (!ValidFrame(frame) || !current || current->net.empty())
+        throw std::runtime_error("Model or Frame is invalid");
+
+    std::vector<Detection> detections;
+    try
+    {
+        detections = this->Forward(*current, frame, mirror);
+    }
+    catch (const std::exception &e)
+    {
+        if (!this->RollBack(current, e.what()))
+            throw;
+        return this->Detect(frame, mirror);
+    }
+    this->MarkProven(*current);
+    return detections;
+}
+
+std::vector<Detection> YOLO::Forward(Network &network, const cv::Mat &frame, bool mirror)
+{
+    const cv::Size input_size = this->input_size;
+
+    try
+    {
+        cv::Mat blob;
+        CreateBlob(frame, blob, input_size, mirror);
+        network.net.setInput(blob);
+    }
+    catch (const cv::Exception &e)
+    {
+        throw std::runtime_error(e.what());
+    }
+
+    std::vector<cv::Mat> outs;
+    try
+    {
+        network.net.forward(outs, network.net.getUnconnectedOutLayersNames());
+    }
+    catch (const cv::Exception &e)
+    {
+        throw std::runtime_error(e.what());
+    }
+
+    if (outs.empty())
+        throw std::runtime_error("Empty detection: check if model is loaded");
+
+    std::vector<Detection> candidates;
+    DecodeOutput(outs[0], frame.size(), input_size, this->confidence_threshold, candidates);
+    return Suppress(candidates, this->confidence_threshold, this->NMS_THRESHOLD);
+}
+
+std::vector<std::vector<Detection>> YOLO::DetectBatch(const std::vector<cv::Mat> &frames, bool mirror)
+{
+    const std::shared_ptr<Network> current = this->network.load();
+    if (frames.size() <= 1 || (current && current->batch_supported == false))
+    {
+        std::vector<std::vector<Detection>> results(frames.size());
+        for (size_t i = 0; i < frames.size(); ++i)
+            results[i] = this->Detect(frames[i], mirror);
+        return results;
+    }
+
+    if (!current || current->net.empty() || !std::all_of(frames.begin(), frames.end(), ValidFrame))
+        throw std::runtime_error("Model or Frame is invalid");
+
+    std::vector<std::vector<Detection>> results;
+    try
+    {
+        results = this->ForwardBatch(*current, frames, mirror);
+    }
+    catch (const std::exception &e)
+    {
+        if (!this->RollBack(current, e.what()))
+            throw;
+        return this->DetectBatch(frames, mirror);
+    }
+    this->MarkProven(*current);
+    return results;
+}
+
+std::vector<std::vector<Detection>> YOLO::ForwardBatch(Network &network, const std::vector<cv::Mat> &frames, bool mirror)
+{
+    std::vector<std::vector<Detection>> results(frames.size());
+    const cv::Size input_size = this->input_size;
+    const int batch = static_cast<int>(frames.size());
+
+    // Each frame's planes are written straight into its slice of the [N, 3, H, W] blob
+    const int sizes[] = {batch, 3, input_size.height, input_size.width};
+    cv::Mat blob(4, sizes, CV_32F);
+    const int slice_sizes[] = {1, 3, input_size.height, input_size.width};
+    for (int i = 0; i < batch; ++i)
+    {
+        cv::Mat slice(4, slice_sizes, CV_32F, blob.ptr<float>(i));
+        CreateBlob(frames[i], slice, input_size, mirror);
+    }
 
-    std::vector<int> nms_indices;
-    cv::dnn::NMSBoxes(boxes, confidences, this->CONFIDENCE_THRESHOLD, this->NMS_THRESHOLD, nms_indices);
+    std::vector<cv::Mat> outs;
+    try
+    {
+        network.net.setInput(blob);
+        network.net.forward(outs, network.net.getUnconnectedOutLayersNames());
+    }
+    catch (const cv::Exception &e)
+    {
+        if (network.batch_supported == true)
+            throw std::runtime_error(e.what());
+        outs.clear();
+    }
 
-    for (int idx : nms_indices)
+    if (outs.empty() || outs[0].dims != 3 || outs[0].size[0] != batch)
     {
-        cv::Rect box = boxes[idx];
-        int class_id = class_ids[idx];
+        // Models exported with a fixed batch of 1 either reject the blob or only answer for the first image
+        network.batch_supported = false;
+        LOG("Model does not take batched input, running " << batch << " frames one at a time");
+        for (int i = 0; i < batch; ++i)
+            results[i] = this->Forward(network, frames[i], mirror);
+        return results;
+    }
+    network.batch_supported = true;
+
+    const cv::Mat &output = outs[0];
+    const int output_sizes[] = {1, output.size[1], output.size[2]};
+    cv::parallel_for_(cv::Range(0, batch), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            const cv::Mat slice(3, output_sizes, CV_32F, const_cast<float *>(output.ptr<float>(i)));
+            std::vector<Detection> candidates;
+            DecodeOutput(slice, frames[i].size(), input_size, this->confidence_threshold, candidates);
+            results[i] = Suppress(candidates, this->confidence_threshold, this->NMS_THRESHOLD);
+        }
+    });
+    return results;
+}
 
-        cv::rectangle(frame, box, cv::Scalar(0, 255, 0), 2);
-        std::string label = (class_id < this->class_names.size()) ? this->class_names[class_id] : "Unknown";
-        label += cv::format(": %.2f", confidences[idx]);
-        cv::putText(frame, label, cv::Point(box.x, box.y - 10), cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
+void YOLO::DrawDetections(cv::Mat &frame, const std::vector<Detection> &detections) const
+{
+    for (const Detection &detection : detections)
+    {
+        cv::rectangle(frame, detection.box, cv::Scalar(0, 255, 0), 2);
+        std::string label = (detection.class_id >= 0 && detection.class_id < static_cast<int>(this->class_names.size())) ? this->class_names[detection.class_id] : "Unknown";
+        label += cv::format(": %.2f", detection.confidence);
+        cv::putText(frame, label, cv::Point(detection.box.x, detection.box.y - 10), cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
     }
-}
\ No newline at end of file
+}
+
+void YOLO::ProcessFrame(cv::Mat &frame)
+{
+    const std::vector<Detection> detections = this->Detect(frame);
+    this->DrawDetections(frame, detections);
+}
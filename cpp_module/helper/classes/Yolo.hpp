@@ -1,16 +1,28 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <stdexcept>
 #include <string>
 #include <format>
+#include <optional>
 
 #include "Utils.hpp"
+#include "Detection.hpp"
+#include "Nms.hpp"
+#include "StartupTimeline.hpp"
 #include "opencv2/dnn.hpp"
 #include "opencv2/core/utils/logger.hpp"
 
+class MappedFile;
+
 struct HINFO
 {
     bool has_cuda = false;
@@ -20,29 +32,177 @@ struct HINFO
     bool has_nvidia = false;
     std::string gpu_name;
     std::string gpu_vendor;
+    // Read from the probe cache instead of enumerating devices
+    bool cached = false;
+};
+
+// A measured configuration for one model on one host, written by Autotuner and applied by
+// YOLO::Init on later starts
+struct TuneProfile
+{
+    int backend = cv::dnn::DNN_BACKEND_OPENCV;
+    int target = cv::dnn::DNN_TARGET_CPU;
+    // cv::setNumThreads up to the pool size Init found, 0 leaves the thread count alone
+    int threads = 0;
+    // Frames per forward pass, for callers that batch (InferenceScheduler)
+    int batch = 1;
+    int input_size = 640;
+    // What the search was asked for and what the picked configuration measured
+    double budget_ms = 0.0;
+    double latency_ms = 0.0; // 90th percentile of one forward pass of batch frames
+    double fps = 0.0;
+    bool meets_budget = false;
 };
 
+// The network can be replaced while the detector runs. Reload() reads the model files again on a
+// background thread and warms the new network up with a smoke inference. Only then does it swap the
+// network in, with one atomic store. An inference holds the network it started on, so in-flight frames
+// finish on the old one; it is freed once the new one has run a live frame. A model that fails to load,
+// gives no usable output or has another class count than the class list is never swapped in. A swapped-in
+// network whose first live inferences fail is rolled back to the previous one and the frame is retried.
 class YOLO
 {
+public:
+    struct SwapStats
+    {
+        uint64_t generation = 0; // 1 for the network Init loaded
+        uint64_t swaps = 0;
+        uint64_t rejected = 0;     // failed to load or the smoke inference, never swapped in
+        uint64_t rollbacks = 0;    // swapped in, then failed a live inference
+        double last_load_ms = 0.0; // read, configure and smoke inference of the latest reload
+        std::string last_error;
+    };
+
 private:
-    const  float CONFIDENCE_THRESHOLD = 0.5f;
+    // One loaded network with what was learned while running it
+    struct Network
+    {
+        cv::dnn::Net net;
+        // Whether it takes a batch dimension above 1, learned on the first DetectBatch
+        std::optional<bool> batch_supported;
+        uint64_t generation = 0;
+        // The weights for backends that read them in place (OpenVINO); null when the importer copied
+        // them, as OpenCV's ONNX importer does
+        std::shared_ptr<const MappedFile> weights;
+        uintmax_t file_bytes = 0;
+        double read_ms = 0.0;
+        bool mapped = false;
+        // Read from <model>.xml/.bin rather than <model>.onnx
+        bool ir = false;
+        // Set by the first successful inference; until then a failure rolls back to the previous network
+        std::atomic<bool> proven{false};
+    };
+
+    float confidence_threshold = 0.5f;
     const float NMS_THRESHOLD = 0.4f;
-    const int YOLO_INPUT_WIDTH = 640;
-    const int YOLO_INPUT_HEIGHT = 640;
-    cv::dnn::Net model;
+    // Square, a multiple of 32; a tuned profile may lower it
+    cv::Size input_size{640, 640};
+    int backend = cv::dnn::DNN_BACKEND_OPENCV;
+    int target = cv::dnn::DNN_TARGET_CPU;
+    std::atomic<std::shared_ptr<Network>> network;
     const std::filesystem::path MODEL_PATH = std::filesystem::current_path() / "models/yolo";
+    const std::string MODEL_NAME;
     std::vector<std::string> class_names;
     const std::string class_names_path = (std::filesystem::current_path() / "models/yolo/coco.names.txt").generic_string();
     HINFO hw_info;
+    std::optional<TuneProfile> profile;
+    // cv::getNumThreads() when Init ran
+    int pool_threads = 0;
+
+    mutable std::mutex swap_mutex;
+    // Reload finished, a swapped-in network proved itself or the detector is shutting down
+    std::condition_variable swap_event;
+    // Kept for a rollback until the current network has run a live frame
+    std::shared_ptr<Network> previous;
+    SwapStats swap_stats;
+    bool reloading = false;
+    bool stopping = false;
+    std::thread reload_thread;
+    std::thread watch_thread;
+
     void LoadClassNames();
-    void SetupYoloNetwork();
-    void CheckGPU();
-    void LoadOnnx();
-    void LoadVino();
+    void SetupYoloNetwork(bool cpu_only, StartupTimeline *timeline);
+    // The OpenVINO IR when <model>.xml and <model>.bin both exist, as only it runs on weights shared
+    // between processes; <model>.onnx otherwise
+    void LoadModel(Network &network) const;
+    std::vector<std::filesystem::path> ModelFiles() const;
+    // Parse the model files from a read-only mapping, see MappedFile; POF_MODEL_MMAP=0 reads them instead
+    void LoadOnnx(Network &network) const;
+    void LoadVino(Network &network) const;
+    void Configure(cv::dnn::Net &net) const;
+    // Throws when the network does not run or its output does not fit the class list
+    void SmokeTest(cv::dnn::Net &net) const;
+    void ReloadNetwork();
+    void Watch(std::chrono::milliseconds interval);
+    // After a failed inference on failed: true when the caller should retry on the current network
+    bool RollBack(const std::shared_ptr<Network> &failed, const std::string &reason);
+    void MarkProven(Network &network);
+    std::vector<Detection> Forward(Network &network, const cv::Mat &frame, bool mirror);
+    std::vector<std::vector<Detection>> ForwardBatch(Network &network, const std::vector<cv::Mat> &frames, bool mirror);
 
 public:
-    YOLO();
-    void Init();
+    explicit YOLO(std::string modelName = "yolov8l");
+    // Model files from modelDir and the class list from classNamesPath instead of ./models/yolo
+    YOLO(std::string modelName, const std::filesystem::path &modelDir, const std::filesystem::path &classNamesPath);
+    // Waits for a running reload to finish
+    ~YOLO();
+
+    YOLO(const YOLO &) = delete;
+    YOLO &operator=(const YOLO &) = delete;
+    // Reads the model while the hardware is probed, then picks the backend from the probe. Both
+    // phases go to timeline when one is given. A tuned profile for this model and host replaces the
+    // pick unless cpu_only is set or POF_TUNE_PROFILE=0.
+    void Init(bool cpu_only = false, StartupTimeline *timeline = nullptr);
+    // Backend, target, thread count and input size; before the first inference or between them
+    void ApplyProfile(const TuneProfile &profile);
+    // Boxes scoring below are dropped before NMS, 0.5 unless set
+    void SetConfidenceThreshold(float threshold);
+    // Square input size, a multiple of 32, replacing 640 or the tuned size. A model with fixed input
+    // axes only runs at the size it was exported for. Like ApplyProfile, not while inferences run.
+    void SetInputSize(int size);
+    // Starts loading the model files again on a background thread, see the class comment. False when a
+    // reload is still running, which includes the wait for the last swapped-in network to run a frame.
+    bool Reload();
+    // Reloads whenever the model files (<model>.onnx, or the IR) change. The file is polled every interval and read once it stayed
+    // the same for a whole interval; copying the new model next to it and renaming it over is safest.
+    void WatchModel(std::chrono::milliseconds interval = std::chrono::seconds(2));
+    SwapStats GetSwapStats() const;
+    // One inference on a blank frame, so backend setup and kernel compilation happen before the first real frame
+    void Warmup();
+    // Valid after Init
     void HardwareSummary() const;
+    // Model file size, how it was read and how long that took, with the process memory at the time of the call
+    std::string LoadSummary() const;
+    // CUDA and OpenCL devices. Creating an OpenCL context for every device is the slow part of startup,
+    // so the result is kept in cache_file and reused while the OpenCV build and the CUDA device count
+    // match and the file is less than a week old. POF_REPROBE=1 forces a fresh probe.
+    static HINFO ProbeHardware(const std::filesystem::path &cache_file);
+    // kernel_cache/tune_<model>.txt
+    std::filesystem::path TuneProfilePath() const;
+    // Identifies what a profile was measured on: OpenCV build, model file, devices and core count.
+    // A profile with another key is not loaded. Valid after Init.
+    std::string TuneKey() const;
+    std::optional<TuneProfile> LoadTuneProfile() const;
+    void StoreTuneProfile(const TuneProfile &profile) const;
+    // The profile Init or ApplyProfile put in place
+    const std::optional<TuneProfile> &Profile() const { return this->profile; }
+    const HINFO &Hardware() const { return this->hw_info; }
+    std::optional<bool> BatchSupported() const;
+    const std::string &ModelName() const { return this->MODEL_NAME; }
+    const std::filesystem::path &ModelDir() const { return this->MODEL_PATH; }
+    std::filesystem::path ClassNamesPath() const { return this->class_names_path; }
+    const std::vector<std::string> &ClassNames() const { return this->class_names; }
     void ProcessFrame(cv::Mat &frame);
+    // Accepts gray, BGR or BGRA frames. With mirror set the network sees the horizontally flipped
+    // frame and the boxes are in flipped coordinates, without the frame itself being flipped.
+    std::vector<Detection> Detect(const cv::Mat &frame, bool mirror = false);
+    // Detections for each frame, in order. The frames go through the network as one batch when the
+    // model allows it (exported with a dynamic batch axis), otherwise one after another.
+    std::vector<std::vector<Detection>> DetectBatch(const std::vector<cv::Mat> &frames, bool mirror = false);
+    void DrawDetections(cv::Mat &frame, const std::vector<Detection> &detections) const;
+
+    // Individual pipeline stages, kept static so they can be benchmarked without a loaded model
+    static void CreateBlob(const cv::Mat &frame, cv::Mat &blob, const cv::Size &inputSize, bool mirror = false);
+    static void DecodeOutput(const cv::Mat &output, const cv::Size &frameSize, const cv::Size &inputSize, float confThreshold, std::vector<Detection> &candidates);
+    static std::vector<Detection> Suppress(const std::vector<Detection> &candidates, float confThreshold, float nmsThreshold);
 };
\ No newline at end of file
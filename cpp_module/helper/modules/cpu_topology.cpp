@@ -0,0 +1,275 @@
+#include "cpu_topology.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <map>
+#include <set>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace CT
+{
+    namespace
+    {
+        int ReadInt(const std::filesystem::path &path, int fallback)
+        {
+            std::ifstream ifs(path);
+            int value = fallback;
+            if (ifs.is_open())
+                ifs >> value;
+            return ifs.fail() ? fallback : value;
+        }
+
+        std::string ReadLine(const std::filesystem::path &path)
+        {
+            std::ifstream ifs(path);
+            std::string line;
+            std::getline(ifs, line);
+            return line;
+        }
+
+        const char *Env(const char *name)
+        {
+            const char *value = std::getenv(name);
+            return (value && *value) ? value : nullptr;
+        }
+    }
+
+    int CpuTopology::PhysicalCores() const
+    {
+        std::set<std::pair<int, int>> cores;
+        for (const LogicalCpu &cpu : this->cpus)
+            cores.emplace(cpu.package_id, cpu.core_id);
+        return static_cast<int>(cores.size());
+    }
+
+    std::vector<int> CpuTopology::CpusOnNode(int node) const
+    {
+        std::vector<int> ids;
+        for (const LogicalCpu &cpu : this->cpus)
+        {
+            if (cpu.numa_node == node)
+                ids.push_back(cpu.id);
+        }
+        return ids;
+    }
+
+    std::vector<int> ParseCpuList(const std::string &list)
+    {
+        std::vector<int> cpus;
+        std::stringstream ss(list);
+        std::string range;
+        while (std::getline(ss, range, ','))
+        {
+            if (range.empty())
+                continue;
+            try
+            {
+                const size_t dash = range.find('-');
+                const int first = std::stoi(range.substr(0, dash));
+                const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu)
+                    cpus.push_back(cpu);
+            }
+            catch (const std::exception &)
+            {
+                LOG_ERR("Ignoring malformed cpu range: " << range);
+            }
+        }
+        std::sort(cpus.begin(), cpus.end());
+        cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+        return cpus;
+    }
+
+    std::string FormatCpuList(const std::vector<int> &cpus)
+    {
+        std::string out;
+        for (size_t i = 0; i < cpus.size();)
+        {
+            size_t j = i;
+            while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+                ++j;
+            if (!out.empty())
+                out += ',';
+            out += j == i ? std::to_string(cpus[i]) : std::format("{}-{}", cpus[i], cpus[j]);
+            i = j + 1;
+        }
+        return out.empty() ? "none" : out;
+    }
+
+    CpuTopology DiscoverTopology()
+    {
+        CpuTopology topology;
+
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        const bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        // Node membership comes from the node directories since the per-cpu node links are optional
+        std::map<int, int> node_of_cpu;
+        const std::filesystem::path node_root = "/sys/devices/system/node";
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(node_root, ec))
+        {
+            const std::string name = entry.path().filename().string();
+            if (!name.starts_with("node") || name.size() == 4 || !std::isdigit(static_cast<unsigned char>(name[4])))
+                continue;
+            const int node = std::stoi(name.substr(4));
+            for (const int cpu : ParseCpuList(ReadLine(entry.path() / "cpulist")))
+                node_of_cpu[cpu] = node;
+            topology.num_nodes = std::max(topology.num_nodes, node + 1);
+        }
+
+        const std::filesystem::path cpu_root = "/sys/devices/system/cpu";
+        for (const int id : ParseCpuList(ReadLine(cpu_root / "online")))
+        {
+            if (have_mask && !CPU_ISSET(id, &allowed))
+                continue;
+            const std::filesystem::path topo = cpu_root / std::format("cpu{}", id) / "topology";
+            LogicalCpu cpu;
+            cpu.id = id;
+            cpu.core_id = ReadInt(topo / "core_id", id);
+            cpu.package_id = ReadInt(topo / "physical_package_id", 0);
+            cpu.numa_node = node_of_cpu.contains(id) ? node_of_cpu[id] : 0;
+            topology.cpus.push_back(cpu);
+        }
+#endif
+
+        if (topology.cpus.empty())
+        {
+            const int count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+            for (int id = 0; id < count; ++id)
+                topology.cpus.push_back({id, id, 0, 0});
+            topology.num_nodes = 1;
+        }
+        return topology;
+    }
+
+    ThreadLayout PlanLayout(const CpuTopology &topology)
+    {
+        ThreadLayout layout;
+
+        // Default to the node with the most usable CPUs
+        size_t best = 0;
+        for (int node = 0; node < topology.num_nodes; ++node)
+        {
+            if (const size_t count = topology.CpusOnNode(node).size(); count > best)
+            {
+                best = count;
+                layout.numa_node = node;
+            }
+        }
+        if (const char *node = Env("POF_NUMA_NODE"))
+            layout.numa_node = std::clamp(std::atoi(node), 0, topology.num_nodes - 1);
+
+        // One hardware thread per physical core on the chosen node: inference is compute bound,
+        // so SMT siblings mostly compete for the same execution units
+        std::vector<int> primaries;
+        std::set<std::pair<int, int>> seen_cores;
+        for (const LogicalCpu &cpu : topology.cpus)
+        {
+            if (cpu.numa_node == layout.numa_node && seen_cores.emplace(cpu.package_id, cpu.core_id).second)
+                primaries.push_back(cpu.id);
+        }
+        if (primaries.empty())
+        {
+            for (const LogicalCpu &cpu : topology.cpus)
+                primaries.push_back(cpu.id);
+        }
+
+        // Capture gets the first core (and its sibling, where it has one) to itself when there are
+        // enough cores to spare; otherwise every stage shares the node
+        if (primaries.size() > 2)
+        {
+            const auto first = std::find_if(topology.cpus.begin(), topology.cpus.end(), [&](const LogicalCpu &cpu) { return cpu.id == primaries.front(); });
+            for (const LogicalCpu &cpu : topology.cpus)
+            {
+                if (cpu.package_id == first->package_id && cpu.core_id == first->core_id)
+                    layout.capture_cpus.push_back(cpu.id);
+            }
+            layout.inference_cpus.assign(primaries.begin() + 1, primaries.end());
+        }
+        else
+        {
+            layout.capture_cpus = primaries;
+            layout.inference_cpus = primaries;
+        }
+
+        if (const char *cpus = Env("POF_CAPTURE_CPUS"))
+            layout.capture_cpus = ParseCpuList(cpus);
+        if (const char *cpus = Env("POF_INFERENCE_CPUS"))
+            layout.inference_cpus = ParseCpuList(cpus);
+
+        layout.opencv_threads = std::max(1, static_cast<int>(layout.inference_cpus.size()));
+        if (const char *threads = Env("POF_OPENCV_THREADS"))
+            layout.opencv_threads = std::max(1, std::atoi(threads));
+
+        return layout;
+    }
+
+    bool PinCurrentThread(const std::vector<int> &cpus)
+    {
+#if defined(__linux__)
+        if (cpus.empty())
+            return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const int cpu : cpus)
+        {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpus;
+        return false;
+#endif
+    }
+
+    bool PreferNode(int node)
+    {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+        // MPOL_PREFERRED from <numaif.h>, called directly to avoid a libnuma dependency
+        constexpr int MPOL_PREFERRED_MODE = 1;
+        if (node < 0 || node >= static_cast<int>(sizeof(unsigned long) * 8))
+            return false;
+        const unsigned long mask = 1UL << node;
+        return syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, &mask, sizeof(mask) * 8) == 0;
+#else
+        (void)node;
+        return false;
+#endif
+    }
+
+    void ApplyLayout(const ThreadLayout &layout)
+    {
+        PreferNode(layout.numa_node);
+
+        // OpenCV's worker threads inherit the affinity of the thread that spawns them, so bring the
+        // pool up while this thread sits on the inference cpus and only then move it to capture
+        PinCurrentThread(layout.inference_cpus);
+        cv::setNumThreads(layout.opencv_threads);
+        cv::parallel_for_(cv::Range(0, layout.opencv_threads), [](const cv::Range &) {});
+        PinCurrentThread(layout.capture_cpus);
+    }
+
+    void StartupReport(const CpuTopology &topology, const ThreadLayout &layout)
+    {
+        LOG("CPU Topology Summary");
+        LOG(std::format("Usable logical CPUs: {}, physical cores: {}, NUMA nodes: {}",
+                        topology.cpus.size(), topology.PhysicalCores(), topology.num_nodes));
+        for (int node = 0; node < topology.num_nodes; ++node)
+            LOG(std::format("  node {}: cpus {}", node, FormatCpuList(topology.CpusOnNode(node))));
+        LOG(std::format("Layout: node {}, capture on [{}], inference on [{}], OpenCV threads {}",
+                        layout.numa_node, FormatCpuList(layout.capture_cpus), FormatCpuList(layout.inference_cpus), layout.opencv_threads));
+    }
+}
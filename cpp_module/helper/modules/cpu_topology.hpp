@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Utils.hpp"
+
+namespace CT
+{
+    struct LogicalCpu
+    {
+        int id = 0;
+        int core_id = 0;
+        int package_id = 0;
+        int numa_node = 0;
+    };
+
+    struct CpuTopology
+    {
+        std::vector<LogicalCpu> cpus; // only CPUs this process is allowed to run on
+        int num_nodes = 1;
+        int PhysicalCores() const;
+        std::vector<int> CpusOnNode(int node) const;
+    };
+
+    // Where each pipeline stage runs. Filled from the topology and overridden by:
+    //   POF_NUMA_NODE       node to keep capture, inference and frame buffers on
+    //   POF_CAPTURE_CPUS    cpu list for the capture thread, e.g. "2" or "0-1"
+    //   POF_INFERENCE_CPUS  cpu list for inference threads, e.g. "4-11,16-23"
+    //   POF_OPENCV_THREADS  size of OpenCV's internal pool
+    struct ThreadLayout
+    {
+        int numa_node = 0;
+        std::vector<int> capture_cpus;
+        std::vector<int> inference_cpus;
+        int opencv_threads = 1;
+    };
+
+    CpuTopology DiscoverTopology();
+    ThreadLayout PlanLayout(const CpuTopology &topology);
+
+    // Call from the capture thread before any other OpenCV work. Sizes and places OpenCV's pool,
+    // prefers the layout's node for memory touched from now on and pins the caller to capture_cpus
+    void ApplyLayout(const ThreadLayout &layout);
+    // Restricts the calling thread to `cpus`; returns false if the OS refused
+    bool PinCurrentThread(const std::vector<int> &cpus);
+    // Makes new pages touched by the calling thread prefer `node`
+    bool PreferNode(int node);
+
+    std::vector<int> ParseCpuList(const std::string &list);
+    std::string FormatCpuList(const std::vector<int> &cpus);
+    void StartupReport(const CpuTopology &topology, const ThreadLayout &layout);
+}
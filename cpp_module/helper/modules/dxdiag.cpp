@@ -1,5 +1,7 @@
 #include "dxdiag.hpp"
 #include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <tuple>
 
 namespace DG
 {
@@ -16,9 +18,7 @@ namespace DG
         IDXGIOutputDuplication *pDuplication,
         ID3D11Device *pDevice,
         ID3D11DeviceContext *pImmediateContext,
-        int &width,
-        int &height,
-        std::vector<BYTE> &pixel_data_out)
+        cv::Mat &frame_out)
     {
         static const int MAX_RETRIES = 3;
         static const int RETRY_DELAY_MS = 10;
@@ -118,20 +118,16 @@ namespace DG
                 return false;
             }
 
-            // Update the output dimensions
-            width = desc.Width;
-            height = desc.Height;
-
-            // Calculate the total size needed for the pixel data
-            size_t totalSize = width * height * 4; // 4 bytes per pixel (BGRA)
-            pixel_data_out.resize(totalSize);
+            // Hand out a recycled BGRA buffer; the previous frame's buffer goes back to the pool
+            const int width = static_cast<int>(desc.Width);
+            const int height = static_cast<int>(desc.Height);
+            frame_out = FramePool::Instance().Acquire(height, width, CV_8UC4);
 
             // Copy the pixel data row by row
-            BYTE *pSrcData = static_cast<BYTE *>(mappedResource.pData);
-            BYTE *pDstData = pixel_data_out.data();
+            const BYTE *pSrcData = static_cast<const BYTE *>(mappedResource.pData);
             for (int row = 0; row < height; row++)
             {
-                memcpy(pDstData + row * width * 4,
+                memcpy(frame_out.ptr(row),
                        pSrcData + row * mappedResource.RowPitch,
                        width * 4);
             }
@@ -159,8 +155,71 @@ namespace DG
         return false;
     }
 
+    namespace
+    {
+        // Duplicates the remaining desktop outputs of the adapter InitializeDXGI settled on, so every
+        // monitor of the wall is captured. Outputs that cannot be duplicated are logged and skipped.
+        void DuplicateAdapterOutputs(DXGIContext &ctx)
+        {
+            DXGI_OUTPUT_DESC primaryDesc;
+            ctx.pOutput1->GetDesc(&primaryDesc);
+
+            UINT outputIndex = 0;
+            ComPtr<IDXGIOutput> pOutput;
+            while (ctx.pAdapter->EnumOutputs(outputIndex++, &pOutput) != DXGI_ERROR_NOT_FOUND)
+            {
+                DXGI_OUTPUT_DESC outputDesc;
+                pOutput->GetDesc(&outputDesc);
+                if (!outputDesc.AttachedToDesktop)
+                {
+                    pOutput.Reset();
+                    continue;
+                }
+
+                OutputDuplication output;
+                output.name = outputDesc.DeviceName;
+                output.bounds = outputDesc.DesktopCoordinates;
+                if (outputDesc.Monitor == primaryDesc.Monitor)
+                {
+                    // Already duplicated, share it
+                    output.pOutput1 = ctx.pOutput1;
+                    output.pOutput1->AddRef();
+                    output.pDupl = ctx.pDesktopDupl;
+                    output.pDupl->AddRef();
+                }
+                else
+                {
+                    HRESULT hr = pOutput->QueryInterface(__uuidof(IDXGIOutput1), reinterpret_cast<void **>(&output.pOutput1));
+                    if (SUCCEEDED(hr))
+                        hr = output.pOutput1->DuplicateOutput(ctx.pDevice, &output.pDupl);
+                    if (FAILED(hr))
+                    {
+                        LOG_ERR("Skipping output " << outputIndex - 1 << ", duplication failed. HR: 0x" << std::hex << hr << std::dec);
+                        SafeRelease(&output.pOutput1);
+                        pOutput.Reset();
+                        continue;
+                    }
+                }
+                ctx.outputs.push_back(std::move(output));
+                pOutput.Reset();
+            }
+
+            std::sort(ctx.outputs.begin(), ctx.outputs.end(), [](const OutputDuplication &a, const OutputDuplication &b) {
+                return std::tie(a.bounds.top, a.bounds.left) < std::tie(b.bounds.top, b.bounds.left);
+            });
+            for (size_t i = 0; i < ctx.outputs.size(); ++i)
+                ctx.outputs[i].id = static_cast<uint32_t>(i);
+        }
+    }
+
     void CleanupDXGI(DXGIContext &ctx)
     {
+        for (OutputDuplication &output : ctx.outputs)
+        {
+            SafeRelease(&output.pDupl);
+            SafeRelease(&output.pOutput1);
+        }
+        ctx.outputs.clear();
         SafeRelease(&ctx.pDesktopDupl);
         SafeRelease(&ctx.pOutput1);
         SafeRelease(&ctx.pImmediateContext);
@@ -252,6 +311,8 @@ namespace DG
                                 // We found a working setup, store references and return true
                                 ctx.pAdapter = pAdapter.Detach(); // Detach to keep the reference
                                 // pOutput.Detach() is not needed as ctx.pOutput1 is derived from it
+                                DuplicateAdapterOutputs(ctx);
+                                LOG("Duplicating " << ctx.outputs.size() << " output(s)");
                                 return true;
                             }
                             else
@@ -516,8 +577,8 @@ namespace DG
         if (pStream)
             pStream->Release();
 
-        out_cv_image = cv::Mat(height, width, CV_8UC4, const_cast<BYTE *>(pixels), pitch);
-        cv::cvtColor(out_cv_image, out_cv_image, cv::COLOR_BGRA2BGR);
+        // Keep BGRA: a plain copy out of the mapped texture, the consumers handle the alpha channel
+        cv::Mat(height, width, CV_8UC4, const_cast<BYTE *>(pixels), pitch).copyTo(out_cv_image);
 
         return hr;
     }
@@ -588,8 +649,11 @@ namespace DG
             return S_OK;                      // Not an error, just skipped
         }
 
-        // 6. Save the pixels to a PNG file
-        hr = SavePixelsToPng(ctx, outputPath, pixels, Desc.Width, Desc.Height, pitch, out_cv_image);
+        // 6. Save the pixels to a PNG file, or only copy them out when no path is given
+        if (outputPath.empty())
+            cv::Mat(Desc.Height, Desc.Width, CV_8UC4, pixels, pitch).copyTo(out_cv_image);
+        else
+            hr = SavePixelsToPng(ctx, outputPath, pixels, Desc.Width, Desc.Height, pitch, out_cv_image);
 
         // Unmap the resource before releasing
         ctx.pImmediateContext->Unmap(StagingTexture, 0);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <chrono>
 #include <wrl/client.h>
 #include <filesystem>
@@ -15,6 +16,7 @@
 // OpenCV includes
 #include <opencv2/opencv.hpp>
 #include "Utils.hpp"
+#include "FramePool.hpp"
 
 using Microsoft::WRL::ComPtr;
 
@@ -48,9 +50,17 @@ namespace DG
         IDXGIOutputDuplication *pDuplication,
         ID3D11Device *pDevice,
         ID3D11DeviceContext *pImmediateContext,
-        int &width,
-        int &height,
-        std::vector<BYTE> &pixel_data_out);
+        cv::Mat &frame_out);
+
+    // One duplicated monitor; id is its position in top-to-bottom, left-to-right order
+    struct OutputDuplication
+    {
+        uint32_t id = 0;
+        std::wstring name;
+        RECT bounds{};
+        IDXGIOutput1 *pOutput1 = nullptr;
+        IDXGIOutputDuplication *pDupl = nullptr;
+    };
 
     // Helper struct to hold DXGI/DirectX objects
     struct DXGIContext
@@ -62,6 +72,9 @@ namespace DG
         IDXGIOutput1 *pOutput1 = nullptr;
         IDXGIOutputDuplication *pDesktopDupl = nullptr;
         IWICImagingFactory *pWICFactory = nullptr;
+        // Every desktop-attached output of pAdapter, filled by InitializeDXGI. The output behind
+        // pDesktopDupl is included and holds its own references.
+        std::vector<OutputDuplication> outputs;
     };
 
     void enableANSIColors();
@@ -72,5 +85,6 @@ namespace DG
     void Cleanup(DXGIContext &ctx);
     HRESULT SavePixelsToPng(DXGIContext &ctx, const std::string &imageDirectory, const BYTE *pixels, UINT width, UINT height, UINT pitch, cv::Mat &out_cv_image);
     bool IsScreenBlack(const BYTE *pixels, UINT width, UINT height, UINT pitch);
+    // An empty outputPath copies the frame without saving it
     HRESULT CaptureScreenshot(DXGIContext &ctx, const std::string &outputPath, cv::Mat &out_cv_image);
 }
\ No newline at end of file
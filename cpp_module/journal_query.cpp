@@ -0,0 +1,231 @@
+#include "DetectionJournal.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <map>
+#include <thread>
+
+// Queries the detection journal the agents write.
+//
+// usage: journal_query <journal_dir> [--from <time>] [--to <time>] [--class <name|id>]... [--source <n>]
+//                      [--min-score <s>] [--limit <n>] [--count | --segments | --replay [speed]]
+//
+// <time> is local time as "YYYY-MM-DD HH:MM[:SS]" or "HH:MM[:SS]" for today. Without a mode every
+// matching detection is printed; --count prints per class totals, --segments lists the segment files
+// and --replay redraws the matching frames in a window at recorded pace (times speed).
+
+namespace
+{
+    enum class Mode
+    {
+        List,
+        Count,
+        Segments,
+        Replay
+    };
+
+    struct Options
+    {
+        std::filesystem::path journal_dir;
+        std::string from;
+        std::string to;
+        std::vector<std::string> classes;
+        std::optional<int> source_id;
+        float min_score = 0.0f;
+        size_t limit = 0;
+        Mode mode = Mode::List;
+        double replay_speed = 1.0;
+    };
+
+    std::string ClassName(const std::vector<std::string> &names, int class_id)
+    {
+        return class_id >= 0 && class_id < static_cast<int>(names.size()) ? names[class_id] : std::to_string(class_id);
+    }
+
+    bool ParseArgs(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--from" && has_value)
+                options.from = argv[++i];
+            else if (arg == "--to" && has_value)
+                options.to = argv[++i];
+            else if (arg == "--class" && has_value)
+                options.classes.emplace_back(argv[++i]);
+            else if (arg == "--source" && has_value)
+                options.source_id = std::stoi(argv[++i]);
+            else if (arg == "--min-score" && has_value)
+                options.min_score = std::stof(argv[++i]);
+            else if (arg == "--limit" && has_value)
+                options.limit = std::stoul(argv[++i]);
+            else if (arg == "--count")
+                options.mode = Mode::Count;
+            else if (arg == "--segments")
+                options.mode = Mode::Segments;
+            else if (arg == "--replay")
+            {
+                options.mode = Mode::Replay;
+                if (has_value && !std::string(argv[i + 1]).starts_with("--"))
+                    options.replay_speed = std::stod(argv[++i]);
+            }
+            else if (options.journal_dir.empty() && !arg.starts_with("--"))
+                options.journal_dir = arg;
+            else
+                return false;
+        }
+        return !options.journal_dir.empty();
+    }
+
+    DJ::Query BuildQuery(const Options &options, const std::vector<std::string> &class_names)
+    {
+        DJ::Query query;
+        if (!options.from.empty())
+            query.from_ns = ParseLocalTime(options.from);
+        if (!options.to.empty())
+            query.to_ns = ParseLocalTime(options.to);
+        for (const std::string &name : options.classes)
+        {
+            const auto it = std::find(class_names.begin(), class_names.end(), name);
+            if (it != class_names.end())
+                query.class_ids.insert(static_cast<int>(it - class_names.begin()));
+            else if (!name.empty() && std::all_of(name.begin(), name.end(), [](unsigned char c) { return std::isdigit(c); }))
+                query.class_ids.insert(std::stoi(name));
+            else
+                throw std::runtime_error(std::format("Unknown class '{}'", name));
+        }
+        if (options.source_id)
+            query.source_id = static_cast<uint8_t>(*options.source_id);
+        query.min_score = options.min_score;
+        return query;
+    }
+
+    void ListSegments(const JournalReader &reader)
+    {
+        uint64_t total_bytes = 0;
+        uint64_t total_detections = 0;
+        for (const DJ::SegmentInfo &segment : reader.Segments())
+        {
+            const uint64_t bytes = std::filesystem::file_size(segment.path);
+            total_bytes += bytes;
+            total_detections += segment.header.detection_count;
+            if (segment.header.block_count == 0)
+            {
+                std::cout << std::format("{}  (empty)\n", segment.path.filename().string());
+                continue;
+            }
+            std::cout << std::format("{}  {} .. {}  {} frames  {} detections  {} bytes\n", segment.path.filename().string(),
+                                     FormatLocalTime(segment.header.min_ts_ns), FormatLocalTime(segment.header.max_ts_ns),
+                                     segment.header.frame_count, segment.header.detection_count, bytes);
+        }
+        if (total_detections > 0)
+            std::cout << std::format("{} segments, {} detections, {:.1f} bytes per detection\n", reader.Segments().size(),
+                                     total_detections, static_cast<double>(total_bytes) / static_cast<double>(total_detections));
+    }
+
+    void Replay(const JournalReader &reader, const DJ::Query &query, double speed, size_t limit)
+    {
+        // The journal has no pixels, frames are redrawn on a canvas as large as the boxes seen
+        cv::Size canvas_size(1280, 720);
+        reader.ForEachFrame(query, [&canvas_size](const DJ::Frame &frame) {
+            for (const Detection &d : frame.detections)
+                canvas_size = cv::Size(std::max(canvas_size.width, d.box.br().x), std::max(canvas_size.height, d.box.br().y));
+            return true;
+        });
+
+        const std::vector<std::string> &names = reader.ClassNames();
+        cv::Mat canvas(canvas_size, CV_8UC3);
+        bool quit = false;
+        size_t shown = 0;
+        int64_t previous_ts = 0;
+        reader.ForEachFrame(query, [&](const DJ::Frame &frame) {
+            if (previous_ts != 0 && frame.timestamp_ns > previous_ts)
+            {
+                const auto gap = std::chrono::nanoseconds(static_cast<int64_t>((frame.timestamp_ns - previous_ts) / speed));
+                std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(gap, std::chrono::seconds(2)));
+            }
+            previous_ts = frame.timestamp_ns;
+
+            canvas.setTo(cv::Scalar::all(32));
+            for (const Detection &d : frame.detections)
+            {
+                cv::rectangle(canvas, d.box, cv::Scalar(0, 255, 0), 2);
+                cv::putText(canvas, std::format("{} {:.2f}", ClassName(names, d.class_id), d.confidence), cv::Point(d.box.x, d.box.y - 4),
+                            cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 1);
+            }
+            cv::putText(canvas, std::format("{}  frame {}  source {}", FormatLocalTime(frame.timestamp_ns), frame.frame_id, static_cast<int>(frame.source_id)),
+                        cv::Point(10, 24), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(255, 255, 255), 1);
+            handleWindow("Journal Replay", canvas, quit);
+            return !quit && (limit == 0 || ++shown < limit);
+        });
+        cv::destroyAllWindows();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!ParseArgs(argc, argv, options))
+    {
+        std::cerr << "usage: journal_query <journal_dir> [--from <time>] [--to <time>] [--class <name|id>]... [--source <n>]\n"
+                  << "                     [--min-score <s>] [--limit <n>] [--count | --segments | --replay [speed]]\n"
+                  << "  <time>: \"YYYY-MM-DD HH:MM[:SS]\" or \"HH:MM[:SS]\" (today), local time\n";
+        return 2;
+    }
+
+    try
+    {
+        const JournalReader reader(options.journal_dir);
+        const std::vector<std::string> &names = reader.ClassNames();
+        const DJ::Query query = BuildQuery(options, names);
+
+        switch (options.mode)
+        {
+        case Mode::Segments:
+            ListSegments(reader);
+            break;
+        case Mode::Count:
+        {
+            std::map<int, uint64_t> counts;
+            uint64_t frames = 0;
+            reader.ForEachFrame(query, [&](const DJ::Frame &frame) {
+                ++frames;
+                for (const Detection &d : frame.detections)
+                    ++counts[d.class_id];
+                return true;
+            });
+            for (const auto &[class_id, count] : counts)
+                std::cout << std::format("{:<20} {}\n", ClassName(names, class_id), count);
+            std::cout << std::format("{} frames with matching detections\n", frames);
+            break;
+        }
+        case Mode::Replay:
+            Replay(reader, query, options.replay_speed, options.limit);
+            break;
+        case Mode::List:
+        {
+            size_t printed = 0;
+            reader.ForEachFrame(query, [&](const DJ::Frame &frame) {
+                const std::string when = FormatLocalTime(frame.timestamp_ns);
+                for (const Detection &d : frame.detections)
+                {
+                    std::cout << std::format("{}  frame {}  source {}  {} {:.2f}  [{}, {}, {}, {}]\n", when, frame.frame_id, static_cast<int>(frame.source_id),
+                                             ClassName(names, d.class_id), d.confidence, d.box.x, d.box.y, d.box.width, d.box.height);
+                    if (options.limit != 0 && ++printed >= options.limit)
+                        return false;
+                }
+                return true;
+            });
+            break;
+        }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERR(e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "Yolo.hpp"
+#include "Autotuner.hpp"
+#include "Utils.hpp"
+#include "cpu_topology.hpp"
+#include <algorithm>
+#include <iostream>
+
+// Picks the backend, thread count, batch size and input size for a model on this host.
+//
+// usage: yolo_tune [--model <name>] [--budget <ms>] [--samples <dir>] [--retune]
+//
+// The profile is written to kernel_cache/tune_<model>.txt and applied by YOLO::Init from then on.
+// A stored profile measured for the same budget, model file, OpenCV build and devices is kept as
+// it is; --retune searches again regardless. Samples should be frames like the ones the agents
+// see (topology screenshots): only on real frames can a smaller input or an FP16/OpenCL target be
+// checked against the CPU at 640, without them neither is tried.
+
+namespace
+{
+    constexpr size_t MAX_SAMPLES = 16;
+
+    struct Options
+    {
+        std::string model_name = "yolov8l";
+        double budget_ms = 33.0;
+        std::filesystem::path samples_dir;
+        bool retune = false;
+    };
+
+    bool ParseArgs(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--model" && has_value)
+                options.model_name = argv[++i];
+            else if (arg == "--budget" && has_value)
+                options.budget_ms = std::stod(argv[++i]);
+            else if (arg == "--samples" && has_value)
+                options.samples_dir = argv[++i];
+            else if (arg == "--retune")
+                options.retune = true;
+            else
+                return false;
+        }
+        return options.budget_ms > 0.0;
+    }
+
+    std::vector<cv::Mat> LoadSamples(const std::filesystem::path &dir)
+    {
+        std::vector<std::filesystem::path> paths;
+        for (const auto &entry : std::filesystem::directory_iterator(dir))
+        {
+            std::string ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (entry.is_regular_file() && (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp"))
+                paths.push_back(entry.path());
+        }
+        std::sort(paths.begin(), paths.end());
+
+        std::vector<cv::Mat> samples;
+        for (const std::filesystem::path &path : paths)
+        {
+            if (samples.size() == MAX_SAMPLES)
+                break;
+            if (cv::Mat image = cv::imread(path.string(), cv::IMREAD_COLOR); !image.empty())
+                samples.push_back(image);
+        }
+        return samples;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_WARNING);
+
+    Options options;
+    if (!ParseArgs(argc, argv, options))
+    {
+        std::cerr << "usage: yolo_tune [--model <name>] [--budget <ms>] [--samples <dir>] [--retune]" << std::endl;
+        return 2;
+    }
+
+    // Measured on the cores and OpenCV pool the agents run inference with (POF_INFERENCE_CPUS,
+    // POF_OPENCV_THREADS), so a tuned thread count fits them
+    const CT::ThreadLayout layout = CT::PlanLayout(CT::DiscoverTopology());
+    CT::ApplyLayout(layout);
+    CT::PinCurrentThread(layout.inference_cpus);
+
+    try
+    {
+        YOLO model(options.model_name);
+        model.Init(true);
+
+        if (const std::optional<TuneProfile> stored = model.LoadTuneProfile(); stored && !options.retune && stored->budget_ms == options.budget_ms)
+        {
+            LOG(std::format("Keeping the profile in {}: {:.1f} fps at {:.1f} ms, input {}, batch {}. --retune searches again.", model.TuneProfilePath().generic_string(),
+                            stored->fps, stored->latency_ms, stored->input_size, stored->batch));
+            return 0;
+        }
+
+        Autotuner::Options tune_options;
+        tune_options.budget_ms = options.budget_ms;
+        if (!options.samples_dir.empty())
+        {
+            tune_options.samples = LoadSamples(options.samples_dir);
+            if (tune_options.samples.empty())
+                throw std::runtime_error(std::format("No images in {}", options.samples_dir.generic_string()));
+            LOG("Tuning on " << tune_options.samples.size() << " sample frames from " << options.samples_dir.generic_string());
+        }
+
+        Autotuner tuner(model, tune_options);
+        const TuneProfile profile = tuner.Run();
+        LOG(tuner.Report());
+        model.StoreTuneProfile(profile);
+        LOG(std::format("Picked input {}, batch {}, {} threads: {:.1f} fps at {:.1f} ms{}. Written to {}", profile.input_size, profile.batch,
+                        profile.threads > 0 ? std::to_string(profile.threads) : "default", profile.fps, profile.latency_ms,
+                        profile.meets_budget ? "" : std::format(", over the {:.1f} ms budget", profile.budget_ms), model.TuneProfilePath().generic_string()));
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERR("Tuning failed: " << e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -7,18 +7,22 @@ import logging
 logger = logging.getLogger(__name__)
 logger.info('Loading modules...')
 
+import os
 import sys
 import base64
 import binascii
+import cv2
 from fastapi import FastAPI, status, Request
-from core.utils.schema import Request as pofRequest, Response as pofResponse
+from core.utils.schema import Request as pofRequest, Response as pofResponse, FrameRequest
 from fastapi.responses import JSONResponse
 from fastapi.exceptions import RequestValidationError
-from core.utils.pof import pof, prep_models
+from core.utils.pof import pof, prep_models, pof_native
 from pathlib import Path
 from core.pof.GNN.GModel import GNN
 from ultralytics import YOLO
 from core.utils.exception_handler import InvalidImageException, SiteIdNotFoundInImage, NoSiteId
+from core.utils.shm_ring import FrameRingReader
+from core.utils.analysis_cache import AnalysisCache
 
 logger.info('Modules loaded successfully')
 
@@ -38,13 +42,20 @@ try:
 except Exception as e:
     sys.exit(1)
 
-if not isinstance(yolo_model, YOLO) or not isinstance(gnn_model, GNN):
+if not isinstance(yolo_model, (YOLO, pof_native.Detector) if pof_native else YOLO) or not isinstance(gnn_model, GNN):
     logger.error('[ERROR]: Failed to load models')
     sys.exit(1)
 
 save_dir = base_path / 'workspace/received_images'
 save_dir.mkdir(exist_ok=True, parents=True)
 
+# Shared memory rings published by the C++ agents, attached on first use
+frame_rings = {}
+
+# Repeat queries for an image seen before only rerun the GNN, POF_ANALYSIS_CACHE_MB=0 disables the cache
+analysis_cache_mb = int(os.environ.get('POF_ANALYSIS_CACHE_MB', '256'))
+analysis_cache = AnalysisCache(analysis_cache_mb * 1024 * 1024) if analysis_cache_mb > 0 else None
+
 @app.exception_handler(RequestValidationError)
 async def validation_exception_handler(request: Request, exc: RequestValidationError):
     return JSONResponse(
@@ -88,7 +99,7 @@ async def check_pof(request: pofRequest):
         return JSONResponse(status_code=status.HTTP_200_OK, content={"message": "Invalid base64 string"})
 
     try:
-        predicted_pof, accuracy = pof(image_bytes,request.site_id,yolo_model, gnn_model)
+        predicted_pof, accuracy = pof(image_bytes,request.site_id,yolo_model, gnn_model, analysis_cache)
         accuracy = accuracy * 100
         accuracy = round(accuracy, 2)
 
@@ -104,6 +115,56 @@ async def check_pof(request: pofRequest):
 
     return pofResponse(site_id=request.site_id, pof=predicted_pof, certainty=accuracy, order_id=request.order_id)
 
+@app.post('/pof/frame')
+async def check_pof_frame(request: FrameRequest):
+    reader = frame_rings.get(request.ring)
+    # An agent restart, or a ring recreated for a larger monitor, puts a new segment behind the name
+    if reader is not None and not reader.is_current():
+        del frame_rings[request.ring]
+        reader.close()
+        reader = None
+    if reader is None:
+        try:
+            reader = FrameRingReader(request.ring)
+        except (FileNotFoundError, ValueError) as e:
+            logger.error(f'Frame ring "{request.ring}" unavailable for order id: {request.order_id}. Reason: {e}')
+            return JSONResponse(status_code=status.HTTP_200_OK, content={"message": f"Frame ring {request.ring} is not available"})
+        frame_rings[request.ring] = reader
+
+    # Detach from the ring before the models run, the agent keeps publishing meanwhile.
+    # The screen agents publish BGRA, so the copy doubles as the conversion to BGR.
+    image = None
+    frame = reader.read(request.seq)
+    if frame is not None:
+        if frame.image.shape[2] == 4:
+            image = cv2.cvtColor(frame.image, cv2.COLOR_BGRA2BGR)
+        else:
+            image = frame.image.copy()
+        if not frame.is_valid():
+            image = None
+        del frame
+    if image is None:
+        return JSONResponse(status_code=status.HTTP_200_OK, content={"message": f"Frame {request.seq} is no longer in ring {request.ring}"})
+
+    try:
+        predicted_pof, accuracy = pof(image, request.site_id, yolo_model, gnn_model, analysis_cache)
+        accuracy = round(accuracy * 100, 2)
+
+        image_path = save_dir / f'{request.order_id}.png'
+        if not cv2.imwrite(str(image_path), image):
+            logger.error(f'Failed to save image for order id: {request.order_id}')
+    except Exception as e:
+        logger.error(f'Unexpected error occurred while processing order id: {request.order_id}. Reason: {e}')
+        raise e
+
+    return pofResponse(site_id=request.site_id, pof=predicted_pof, certainty=accuracy, order_id=request.order_id)
+
+@app.get('/metrics/cache')
+async def cache_metrics(request: Request):
+    if analysis_cache is None:
+        return JSONResponse(status_code=status.HTTP_200_OK, content={"enabled": False})
+    return JSONResponse(status_code=status.HTTP_200_OK, content={"enabled": True, **analysis_cache.stats()})
+
 @app.get('/health')
 async def health_check(request: Request):
     return JSONResponse(status_code=status.HTTP_200_OK, content={"message": "OK OWS"})
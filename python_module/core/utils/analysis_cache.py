@@ -0,0 +1,156 @@
+"""
+Content addressed cache of the image analysis behind a POF prediction.
+
+YOLO, the per node OCR and the graph construction depend only on the pixels, not on the site that
+is down, so repeat queries for the same topology image (other site_ids, retried order_ids) reuse
+the cached graph and only rebuild the down_id flag and rerun the GNN. Entries are keyed by a hash
+of the decoded image, so a PNG upload and the same frame read from a shared memory ring hit the
+same entry. Oversized JPEGs are keyed by their reduced resolution decode (see image_decode), which
+keeps a hit from ever decoding them at native resolution.
+
+With pof_native on PYTHONPATH the entries live in the agents' C++ AnalysisCache
+(cpp_module/helper/classes/AnalysisCache.hpp), keyed by the same HashPixels. The OrderedDict LRU
+with blake2b keys below is the fallback for a service running without the C++ module, or with
+POF_NATIVE_CACHE=0.
+"""
+import hashlib
+import logging
+import os
+import threading
+from collections import OrderedDict
+from dataclasses import dataclass, field
+from typing import Optional
+
+import numpy as np
+import torch
+
+try:
+    import pof_native
+except ImportError:
+    pof_native = None
+
+logger = logging.getLogger(__name__)
+
+# Mixes the model generation into a 64-bit pixel hash
+GENERATION_PRIME = 0x9E3779B97F4A7C15
+KEY_MASK = (1 << 64) - 1
+
+
+@dataclass(frozen=True)
+class ImageAnalysis:
+    """Everything pof() derives from the pixels alone"""
+    node_ids: list
+    node_centers: np.ndarray
+    # Node features with the down_id flag column left at 0
+    x: torch.Tensor
+    edge_index: torch.Tensor
+    edge_attr: torch.Tensor
+    detection_counts: dict = field(default_factory=dict)
+
+    def nbytes(self) -> int:
+        tensors = (self.x, self.edge_index, self.edge_attr)
+        return (sum(t.element_size() * t.nelement() for t in tensors) + self.node_centers.nbytes
+                + sum(len(i) for i in self.node_ids) + 64 * len(self.node_ids) + 512)
+
+
+@dataclass
+class CacheStats:
+    hits: int = 0
+    misses: int = 0
+    evictions: int = 0
+    entries: int = 0
+    bytes: int = 0
+
+    def hit_rate(self) -> float:
+        lookups = self.hits + self.misses
+        return self.hits / lookups if lookups else 0.0
+
+
+def image_key(image: np.ndarray) -> str:
+    """Hash of the decoded pixels and their shape; blake2b runs at memory speed and releases the GIL"""
+    pixels = np.ascontiguousarray(image)
+    digest = hashlib.blake2b(digest_size=16)
+    digest.update(str((pixels.shape, pixels.dtype.str)).encode())
+    digest.update(memoryview(pixels).cast('B'))
+    return digest.hexdigest()
+
+
+class AnalysisCache:
+    """LRU of ImageAnalysis bounded by their approximate memory footprint, safe to share between threads"""
+
+    def __init__(self, max_bytes: int):
+        self.max_bytes = max_bytes
+        use_native = pof_native is not None and os.environ.get('POF_NATIVE_CACHE') != '0'
+        self._native = pof_native.AnalysisCache(max_bytes) if use_native else None
+        self._entries: 'OrderedDict[str, ImageAnalysis]' = OrderedDict()
+        self._sizes = {}
+        self._lock = threading.Lock()
+        self._stats = CacheStats()
+
+    def key(self, image: np.ndarray, generation: int = 0):
+        """
+        Cache key of a decoded frame for the detector's model generation, so analyses of a swapped out
+        model are never returned. An int (HashPixels) for the C++ cache, a str (image_key) otherwise.
+        """
+        if self._native is not None:
+            return (pof_native.hash_pixels(np.ascontiguousarray(image)) ^ (generation * GENERATION_PRIME)) & KEY_MASK
+        return f'{image_key(image)}:{generation}'
+
+    def get(self, key) -> Optional[ImageAnalysis]:
+        if self._native is not None:
+            return self._native.get(key)
+        with self._lock:
+            analysis = self._entries.get(key)
+            if analysis is None:
+                self._stats.misses += 1
+                return None
+            self._stats.hits += 1
+            self._entries.move_to_end(key)
+            return analysis
+
+    def put(self, key, analysis: ImageAnalysis) -> None:
+        size = analysis.nbytes()
+        if self._native is not None:
+            self._native.put(key, analysis, size)
+            return
+        if size > self.max_bytes:
+            return
+        with self._lock:
+            if key in self._entries:
+                self._stats.bytes -= self._sizes.pop(key)
+                del self._entries[key]
+            self._entries[key] = analysis
+            self._sizes[key] = size
+            self._stats.bytes += size
+            while self._stats.bytes > self.max_bytes:
+                evicted, _ = self._entries.popitem(last=False)
+                self._stats.bytes -= self._sizes.pop(evicted)
+                self._stats.evictions += 1
+            self._stats.entries = len(self._entries)
+
+    def clear(self) -> None:
+        if self._native is not None:
+            self._native.clear()
+            return
+        with self._lock:
+            self._entries.clear()
+            self._sizes.clear()
+            self._stats.bytes = 0
+            self._stats.entries = 0
+
+    def stats(self) -> dict:
+        if self._native is not None:
+            stats = self._native.stats()
+            lookups = stats['hits'] + stats['misses']
+            return {**stats, 'hit_rate': round(stats['hits'] / lookups if lookups else 0.0, 4)}
+        with self._lock:
+            s = self._stats
+            return {
+                'entries': s.entries,
+                'bytes': s.bytes,
+                'max_bytes': self.max_bytes,
+                'hits': s.hits,
+                'misses': s.misses,
+                'evictions': s.evictions,
+                'hit_rate': round(s.hit_rate(), 4),
+            }
@@ -15,6 +15,7 @@ from typing import Union
 from pathlib import Path
 from fuzzywuzzy import fuzz
 from core.utils.exception_handler import InvalidImageException
+from core.utils.image_decode import NativeRegions
 from core.utils.node_type_config import NODE_TYPE, COLOR_MAP
 
 logger = logging.getLogger(__name__)
@@ -103,11 +104,11 @@ def site_id_2_binary(img) -> Union[np.ndarray, None]:
     mask = cv2.resize(mask, None, fx=3, fy=3, interpolation=cv2.INTER_LINEAR)
     return mask
 
-def get_site_id_from_image(image_path: Union[str, Path, np.ndarray], node_bbox) -> Union[None, np.ndarray]:
+def get_site_id_from_image(image_path: Union[str, Path, np.ndarray, NativeRegions], node_bbox) -> Union[None, np.ndarray]:
     """
     Crops the site ID from a node image and performs OCR.
     Args:
-        image_path (str): The path to the full topology image.
+        image_path (str): The path to the full topology image, the image, or a NativeRegions that decodes only the crop.
         node_bbox (list): Bounding box of the detected node in the format [x_min, y_min, x_max, y_max].
 
     Returns:
@@ -118,7 +119,7 @@ def get_site_id_from_image(image_path: Union[str, Path, np.ndarray], node_bbox)
 
     if isinstance(image_path, (str, Path)):
         img = cv2.imread(str(image_path))
-    elif isinstance(image_path, np.ndarray):
+    elif isinstance(image_path, (np.ndarray, NativeRegions)):
         img = image_path
 
     if img is None:
@@ -127,9 +128,7 @@ def get_site_id_from_image(image_path: Union[str, Path, np.ndarray], node_bbox)
 
     x_min, y_min, x_max, y_max = [int(coord) for coord in node_bbox]
 
-    if y_min < y_max and x_min < x_max:
-        detected_image = img[y_min:y_max, x_min:x_max]
-    else:
+    if not (y_min < y_max and x_min < x_max):
         logger.warning("Detected object region is out of bounds or invalid.")
         return None
 
@@ -157,7 +156,7 @@ def get_site_id_from_image(image_path: Union[str, Path, np.ndarray], node_bbox)
 
     return site_id_image
 
-def get_site_id_from_node(image_path: Union[str, Path, np.ndarray], node_bbox) -> str | None:
+def get_site_id_from_node(image_path: Union[str, Path, np.ndarray, NativeRegions], node_bbox) -> str | None:
     """
     Crops the site ID from a node image and performs OCR.
     Args:
@@ -212,13 +211,13 @@ def create_node_tensor(nodes: list, down_id: str = None) -> dict:
     node_ids = []
     for node in nodes:
         feature = TYPE_MAP.get(node['type']) + COLOR_MAP.get(node['color'])
-        is_down = 1 if down_id and fuzz.ratio(down_id, node['id']) >= 70 else 0
-        feature.append(is_down)
+        feature.append(0)
         node_centers.append(node['center'])
         node_ids.append(node['id'])
         node_features.append(feature)
 
     x = torch.tensor(node_features, dtype=torch.float)
+    x[:, -1] = down_id_flags(node_ids, down_id)
     node_centers = np.array(node_centers)
 
     return {
@@ -228,6 +227,19 @@ def create_node_tensor(nodes: list, down_id: str = None) -> dict:
     }
 
 
+def down_id_flags(node_ids: list, down_id: str = None) -> torch.Tensor:
+    """
+    The down_id node feature: 1 for every node whose id fuzzily matches the faulty site, else 0
+
+    Args:
+        node_ids (List): Node ids in node feature order
+        down_id (str): Site Id of the faulty site
+    Returns:
+        torch.Tensor: One flag per node
+    """
+    return torch.tensor([1.0 if down_id and fuzz.ratio(down_id, node_id) >= 70 else 0.0 for node_id in node_ids], dtype=torch.float)
+
+
 def create_edges_tensor(edges: list, node_centers: list) -> dict:
     """
     Creates edges tensors (connective lines in the topology images)
@@ -286,13 +298,14 @@ def create_edges_tensor(edges: list, node_centers: list) -> dict:
         'edge_attr': edge_attr
     }
 
-def extract_data_from_YOLO(result: list, img: Union[str, Path, np.ndarray]) -> list:
+def extract_data_from_YOLO(result: list, img: Union[str, Path, np.ndarray, NativeRegions], scale: float = 1.0) -> list:
     """
     Extracts detection data from YOLO model
 
     Args:
         result (list): Detections result from YOLO model
         img (str | Path | np.ndarray): Path to or binary image
+        scale (float): img pixels per pixel of the image YOLO ran on, when that was a reduced decode
 
     Returns:
          list: List of nodes and edges extracted from the image
@@ -309,12 +322,12 @@ def extract_data_from_YOLO(result: list, img: Union[str, Path, np.ndarray]) -> l
     for key, item in enumerate(boxes.data):
         class_id = item[-1]
         class_name = get_class_name(result=result[0], c_id=class_id)
-        bbox = boxes.data[key][:4]
-        center = boxes.xywh[key][0:2].cpu().detach().numpy().tolist()
+        bbox = boxes.data[key][:4] * scale
+        center = (boxes.xywh[key][0:2] * scale).cpu().detach().numpy().tolist()
         color = class_name.split('_')[-1]
 
         if class_name.startswith('Link'):
-            x_min, y_min, x_max, y_max = boxes.xyxy[key].cpu().detach().numpy().tolist()
+            x_min, y_min, x_max, y_max = (boxes.xyxy[key] * scale).cpu().detach().numpy().tolist()
             edge = {'color': color, 'endpoints': [(x_min, y_min), (x_max, y_max)]}
             edges.append(edge)
         elif any(class_name.startswith(p) for p in NODE_TYPE):
@@ -327,6 +340,42 @@ def extract_data_from_YOLO(result: list, img: Union[str, Path, np.ndarray]) -> l
 
     return [nodes, edges]
 
+def extract_data_from_detections(detections: np.ndarray, class_names: list, img: Union[np.ndarray, NativeRegions], scale: float = 1.0) -> list:
+    """
+    Extracts nodes and edges from the C++ detector's output, the pof_native counterpart of extract_data_from_YOLO
+
+    Args:
+        detections (np.ndarray): Structured array of (class_id, confidence, x, y, width, height)
+        class_names (list): Class names by class id
+        img (np.ndarray): BGR image the detections belong to
+        scale (float): img pixels per pixel of the image the detector ran on, when that was a reduced decode
+
+    Returns:
+         list: List of nodes and edges extracted from the image
+    """
+    nodes = []
+    edges = []
+
+    for d in detections:
+        class_id = int(d['class_id'])
+        if not 0 <= class_id < len(class_names):
+            continue
+        class_name = class_names[class_id]
+        x, y, w, h = (round(int(d[k]) * scale) for k in ('x', 'y', 'width', 'height'))
+        bbox = [x, y, x + w, y + h]
+        center = [x + w / 2, y + h / 2]
+        color = class_name.split('_')[-1]
+
+        if class_name.startswith('Link'):
+            edges.append({'color': color, 'endpoints': [(bbox[0], bbox[1]), (bbox[2], bbox[3])]})
+        elif any(class_name.startswith(p) for p in NODE_TYPE):
+            site_id = get_site_id_from_node(image_path=img, node_bbox=bbox)
+            if site_id == 'invalid' or not site_id:
+                continue
+            nodes.append({'id': site_id, 'type': class_name.split('_')[0], 'color': color, 'center': center})
+
+    return [nodes, edges]
+
 def copy_and_merge(src, dst):
     if not Path.exists(dst):
         shutil.copy2(src, dst)
@@ -0,0 +1,241 @@
+"""
+Resolution aware decoding of request images.
+
+Topology screenshots arrive as 4K or larger images while YOLO runs at IMGSZ, so decoding them at
+native resolution only for the detector to scale them down again wastes most of the decode. The
+size is read from the header first. When the image is at least twice the detection size and the
+codec can scale while decoding, which libjpeg does in the DCT, it is decoded at 1/2, 1/4 or 1/8.
+PNG has no such mode: OpenCV inflates every row whatever the output size, so PNG and other formats
+are decoded at native resolution as before.
+
+The site id crops OCR reads need native resolution. A reduced frame therefore keeps the encoded
+bytes and native() hands OCR a NativeRegions, which decodes only the strip it slices: libjpeg-turbo
+cuts the enclosing MCU blocks out of the stream losslessly (PyTurboJPEG's crop) and only those are
+decoded. A request then never holds the native image, at the cost of one entropy decode pass over
+the stream per crop. Without PyTurboJPEG, or for a JPEG carrying EXIF orientation the crop would not
+apply, native() decodes the whole image instead, started in the background while the detector works
+on the reduced frame; that path costs a full decode on top of the reduced one.
+"""
+import logging
+import os
+import struct
+import threading
+from concurrent.futures import Future, ThreadPoolExecutor
+from typing import Optional, Tuple
+
+import cv2
+import numpy as np
+
+from core.utils.exception_handler import InvalidImageException
+
+try:
+    from turbojpeg import TurboJPEG
+    _turbojpeg = TurboJPEG()
+except (ImportError, OSError, RuntimeError):
+    # Module missing, or it cannot find the libturbojpeg shared library
+    _turbojpeg = None
+
+logger = logging.getLogger(__name__)
+
+REDUCED_COLOR = {2: cv2.IMREAD_REDUCED_COLOR_2, 4: cv2.IMREAD_REDUCED_COLOR_4, 8: cv2.IMREAD_REDUCED_COLOR_8}
+# SOFn markers carry the frame size; C4 (DHT), C8 (JPG) and CC (DAC) share the range but do not
+JPEG_SOF = {0xC0, 0xC1, 0xC2, 0xC3, 0xC5, 0xC6, 0xC7, 0xC9, 0xCA, 0xCB, 0xCD, 0xCE, 0xCF}
+# Largest JPEG MCU edge (4:2:0 subsampling); lossless crops start on an MCU boundary
+JPEG_MCU = 16
+
+# cv2.imdecode releases the GIL, full decodes overlap the detector of the same request
+_full_decoder = ThreadPoolExecutor(max_workers=min(4, os.cpu_count() or 1), thread_name_prefix='pof-decode')
+
+
+def image_size(data: bytes) -> Optional[Tuple[str, int, int]]:
+    """
+    Reads the format and size from the image header without decoding any pixels.
+
+    Args:
+        data (bytes): Encoded image
+
+    Returns:
+        Tuple[str, int, int] | None: ('png' | 'jpeg', width, height), None for other or malformed data
+    """
+    if data[:8] == b'\x89PNG\r\n\x1a\n' and data[12:16] == b'IHDR' and len(data) >= 24:
+        width, height = struct.unpack('>II', data[16:24])
+        return 'png', width, height
+
+    if data[:2] != b'\xff\xd8':
+        return None
+    pos = 2
+    while pos + 4 <= len(data):
+        if data[pos] != 0xFF:
+            return None
+        marker = data[pos + 1]
+        if marker == 0xFF:  # fill byte
+            pos += 1
+            continue
+        if marker == 0x01 or 0xD0 <= marker <= 0xD7:  # no length field
+            pos += 2
+            continue
+        (length,) = struct.unpack('>H', data[pos + 2:pos + 4])
+        if marker in JPEG_SOF:
+            if pos + 9 > len(data):
+                return None
+            height, width = struct.unpack('>HH', data[pos + 5:pos + 9])
+            return 'jpeg', width, height
+        if marker == 0xDA:  # scan data follows, no frame header before it
+            return None
+        pos += 2 + length
+    return None
+
+
+def reduction(data: bytes, target: int) -> int:
+    """
+    The largest decode scale denominator that keeps the longer side at or above target, 1 when the
+    image is small, its format cannot be decoded at reduced size or POF_REDUCED_DECODE=0
+    """
+    if os.environ.get('POF_REDUCED_DECODE') == '0':
+        return 1
+    header = image_size(data)
+    if header is None or header[0] != 'jpeg':
+        return 1
+    longest = max(header[1], header[2])
+    for factor in (8, 4, 2):
+        if longest // factor >= target:
+            return factor
+    return 1
+
+
+def decode_image(image) -> np.ndarray:
+    """
+    Turns a request image into the BGR frame the models expect.
+
+    Args:
+        image (bytes | np.ndarray): Encoded image, or a decoded BGR/BGRA frame
+
+    Returns:
+        np.ndarray: BGR image
+    """
+    if isinstance(image, np.ndarray):
+        # Raw frame from the shared memory ring, the screen capture agents publish BGRA
+        if image.ndim == 3 and image.shape[2] == 4:
+            image = cv2.cvtColor(image, cv2.COLOR_BGRA2BGR)
+    else:
+        image = cv2.imdecode(np.frombuffer(image, np.uint8), cv2.IMREAD_COLOR)
+
+    if image is None or image.size == 0:
+        logger.error('Invalid image')
+        raise InvalidImageException('Image is not valid')
+    return image
+
+
+class NativeRegions:
+    """
+    A JPEG at native resolution that decodes only the regions sliced out of it. Supports what the OCR
+    crops use of an ndarray: shape, and img[rows, cols] with two step 1 slices, which returns a BGR array.
+    """
+
+    def __init__(self, data: bytes, width: int, height: int):
+        self._data = data
+        self.shape = (height, width, 3)
+        self.size = width * height * 3
+
+    def __getitem__(self, key) -> np.ndarray:
+        rows, cols = key
+        height, width = self.shape[:2]
+        y0, y1, _ = rows.indices(height)
+        x0, x1, _ = cols.indices(width)
+        if y1 <= y0 or x1 <= x0:
+            return np.empty((0, 0, 3), np.uint8)
+        # Aligned down to the MCU grid, the tile's origin is then where the crop actually starts
+        ax, ay = x0 - x0 % JPEG_MCU, y0 - y0 % JPEG_MCU
+        tile = cv2.imdecode(np.frombuffer(_turbojpeg.crop(self._data, ax, ay, x1 - ax, y1 - ay), np.uint8), cv2.IMREAD_COLOR)
+        if tile is None:
+            raise InvalidImageException('Image is not valid')
+        return tile[y0 - ay:y1 - ay, x0 - ax:x1 - ax]
+
+
+def has_exif(data: bytes) -> bool:
+    """Whether a JPEG has an APP1 Exif segment, whose orientation decoding applies and a lossless crop does not"""
+    return b'Exif\x00\x00' in data[:65536]
+
+
+class FrameSource:
+    """
+    The frame detection runs on and, on demand, the same image at native resolution.
+
+    Detections on frame are in frame pixels; multiplied by scale they are in native pixels, the
+    coordinates of full() and of the graph construction.
+    """
+
+    def __init__(self, frame: np.ndarray, scale: float = 1.0, data: Optional[bytes] = None):
+        self.frame = frame
+        self.scale = scale
+        self._data = data
+        self._full: Optional[np.ndarray] = frame if data is None else None
+        self._pending: Optional[Future] = None
+        self._lock = threading.Lock()
+
+    @property
+    def reduced(self) -> bool:
+        return self._data is not None
+
+    @property
+    def regional(self) -> bool:
+        """Whether native() decodes per region instead of the whole image"""
+        return self.reduced and _turbojpeg is not None and os.environ.get('POF_REGION_DECODE') != '0' and not has_exif(self._data)
+
+    def prefetch(self):
+        """Starts the native resolution decode in the background, if native() is going to need one"""
+        if self.regional:
+            return
+        with self._lock:
+            if self._full is None and self._pending is None:
+                self._pending = _full_decoder.submit(decode_image, self._data)
+
+    def native(self):
+        """
+        What the OCR crops are cut from, in native pixels: a NativeRegions when the image can be decoded per
+        region, the full() image otherwise
+        """
+        if self.regional:
+            _, width, height = image_size(self._data)
+            return NativeRegions(self._data, width, height)
+        return self.full()
+
+    def full(self) -> np.ndarray:
+        """The image at native resolution, decoded on first use and kept after that"""
+        self.prefetch()
+        with self._lock:
+            pending = self._pending
+        if pending is not None:
+            full = pending.result()
+            with self._lock:
+                self._full, self._pending, self._data = full, None, None
+        return self._full
+
+
+def decode_frame(image, target: int) -> FrameSource:
+    """
+    Decodes a request image for detection at target size.
+
+    Args:
+        image (bytes | np.ndarray): Encoded image, or a decoded BGR/BGRA frame
+        target (int): Detection input size; the decoded frame's longer side stays at or above it
+
+    Returns:
+        FrameSource: The detection frame, and the native image once full() is called
+    """
+    if isinstance(image, np.ndarray):
+        return FrameSource(decode_image(image))
+
+    factor = reduction(image, target)
+    if factor == 1:
+        return FrameSource(decode_image(image))
+
+    frame = cv2.imdecode(np.frombuffer(image, np.uint8), REDUCED_COLOR[factor])
+    if frame is None or frame.size == 0:
+        logger.error('Invalid image')
+        raise InvalidImageException('Image is not valid')
+    # From the longer sides, which EXIF rotation swaps together with the shorter ones
+    _, width, height = image_size(image)
+    scale = max(width, height) / max(frame.shape[:2])
+    logger.debug(f'Decoded {width}x{height} at 1/{factor} for detection')
+    return FrameSource(frame, scale, image)
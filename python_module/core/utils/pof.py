@@ -5,17 +5,29 @@ This contains the business logic of the application. This is where the 3 models
 """
 
 import logging
+import os
 import sys
+import time
 import cv2
 import torch
 import numpy as np
 from fuzzywuzzy import fuzz
-from typing import Tuple
+from contextlib import contextmanager
+from typing import Optional, Tuple
 from ultralytics import YOLO
 from core.utils import helpers as utils
+from core.utils.analysis_cache import AnalysisCache, ImageAnalysis
+from core.utils.image_decode import FrameSource, decode_frame
+from core.utils.node_type_config import NODE_TYPE, COLOR_MAP
 from core.pof.GNN.GModel import GNN
 from core.utils.exception_handler import InvalidImageException, SiteIdNotFoundInImage, NoSiteId
 
+# The C++ detector (cpp_module/bindings), built with -DBUILD_PYTHON_BINDINGS=ON and found on PYTHONPATH
+try:
+    import pof_native
+except ImportError:
+    pof_native = None
+
 # Configure logging
 logger = logging.getLogger(__name__)
 
@@ -24,11 +36,15 @@ CONF_LEVEL = 0.1
 DEVICE = 'cuda' if torch.cuda.is_available() else 'cpu'
 IMGSZ = 1280
 FUZZY_PERCENTAGE = 70
+# Structural prior from pof_native.TopologyGraph: 'check' logs when the GNN contradicts a decisive
+# structural answer, 'answer' returns decisive answers without running the GNN, 'off' skips it
+GRAPH_PRIOR = os.environ.get('POF_GRAPH_PRIOR', 'check')
 
 def prep_models(yolo_model_path, gnn_model_path) -> Tuple[YOLO, GNN]:
     """
     Prepares the YOLO and GNN models and all its necessary configurations.
     Wrap this function call in a try catch block as it will raise exceptions if model does not exist in path
+    With POF_NATIVE_DETECTOR=1 the YOLO model is the C++ detector from pof_native instead of ultralytics
 
     Args:
         yolo_model_path (Path): Path to the YOLO model.
@@ -43,11 +59,14 @@ def prep_models(yolo_model_path, gnn_model_path) -> Tuple[YOLO, GNN]:
 
     # Load models
     try:
-        yolo_model = YOLO(yolo_model_path)
-        yolo_model.to(DEVICE)
-        yolo_model.eval()
+        if os.environ.get('POF_NATIVE_DETECTOR') == '1':
+            yolo_model = load_native_detector(yolo_model_path)
+        else:
+            yolo_model = YOLO(yolo_model_path)
+            yolo_model.to(DEVICE)
+            yolo_model.eval()
 
-        logger.info(f'YOLO model loaded from: {yolo_model_path}')
+            logger.info(f'YOLO model loaded from: {yolo_model_path}')
 
         gnn_model = load_gnn_model( # from .pof.GNN.GModel import GNN
             model_path=gnn_model_path,
@@ -67,6 +86,40 @@ def prep_models(yolo_model_path, gnn_model_path) -> Tuple[YOLO, GNN]:
     return yolo_model, gnn_model
 
 
+def load_native_detector(yolo_model_path):
+    """
+    Loads the C++ detector on the ONNX export of the YOLO model (core/yolo/pt_to_onnx.py writes it next to
+    the .pt), or its OpenVINO IR when one is there, with the class list from classes.txt in the same directory,
+    one name per line in class id order.
+
+    Args:
+        yolo_model_path (Path): Path to the YOLO .pt model
+
+    Returns:
+        pof_native.Detector: The loaded detector
+    """
+    if pof_native is None:
+        raise ImportError('POF_NATIVE_DETECTOR is set but the pof_native module is not on PYTHONPATH')
+
+    onnx_path = yolo_model_path.with_suffix('.onnx')
+    class_names_path = yolo_model_path.parent / 'classes.txt'
+    # An OpenVINO IR (<model>.xml and .bin) next to it is preferred, its weights are shared between processes
+    has_ir = onnx_path.with_suffix('.xml').exists() and onnx_path.with_suffix('.bin').exists()
+    if not (onnx_path.exists() or has_ir) or not class_names_path.exists():
+        raise FileNotFoundError(f'Native detector needs {onnx_path} and {class_names_path}')
+
+    # Same threshold and input size as the ultralytics path; boxes are stretched rather than letterboxed and
+    # NMS uses IoU 0.4 instead of 0.7, so counts can still differ slightly (see cpp_module/bindings/pof_native.cpp)
+    detector = pof_native.Detector(onnx_path.stem, str(onnx_path.parent), str(class_names_path), cpu_only=DEVICE == 'cpu',
+                                   confidence=CONF_LEVEL, input_size=IMGSZ)
+    logger.info(f'Native YOLO detector loaded from: {onnx_path}')
+    logger.info(detector.load_summary)
+    # A new pt_to_onnx.py export replaces the network in place, POF_MODEL_WATCH=0 keeps the loaded one
+    if os.environ.get('POF_MODEL_WATCH') != '0':
+        detector.watch_model()
+    return detector
+
+
 def load_gnn_model(model_path, in_channels, hidden_channels, num_edge_features) -> GNN:
     """
     Loads the trained GNN model and sets it to evaluation mode.
@@ -115,44 +168,81 @@ def interpret_pof_predictions(pof_logits, has_pof_logit, node_ids) -> Tuple[str,
     pred_prob = probs[pred_idx].item()
     return pred_site_id, pred_prob
 
-def pof(image, down_id: str, yolo_model, gnn_model) -> Tuple[str, float]:
+def graph_prior(analysis: ImageAnalysis, down_index: int):
     """
-    Main function to process a network topology image and predict the point of failure.
+    Ranks point of failure candidates from the graph structure alone: which failed nodes the down site
+    cannot route around on its way to a HubSite or Router (see cpp_module/helper/classes/TopologyGraph.hpp).
 
     Args:
-        image (bytes): Image to be processed
-        down_id (str): Site Id down to be processed
-        yolo_model (YOLO): YOLO model
-        gnn_model (GNN): GNN model
+        analysis (ImageAnalysis): Graph of the image
+        down_index (int): Node index of the site down
 
     Returns:
-        Tuple[str, float]: A tuple containing the predicted POF site ID and its probability.
+        pof_native.PofPrior | None: The ranking, None when pof_native is not available
     """
-    # Check if image exists
-    if image is None:
-        logger.error('Invalid image')
-        raise InvalidImageException('Image invalid')
+    if pof_native is None:
+        return None
+    # Type and color come back out of the one-hot node and edge features
+    colors = list(COLOR_MAP)
+    types = [NODE_TYPE[i] for i in analysis.x[:, :len(NODE_TYPE)].argmax(dim=1).tolist()]
+    statuses = [colors[i] for i in analysis.x[:, len(NODE_TYPE):len(NODE_TYPE) + len(colors)].argmax(dim=1).tolist()]
+    src, dst = analysis.edge_index.tolist()
+    link_colors = [colors[i] for i in analysis.edge_attr.argmax(dim=1).tolist()] if src else []
+    # edge_index holds both directions of every link
+    links = [(s, d, c) for s, d, c in zip(src, dst, link_colors) if s < d]
+    graph = pof_native.TopologyGraph(types, statuses, [(s, d) for s, d, _ in links], [c for _, _, c in links])
+    return graph.rank_pof_candidates(down_index)
+
+
+@contextmanager
+def stage(timings: Optional[dict], name: str):
+    """Adds the wall time of the block to timings[name] (seconds) when timings is a dict"""
+    if timings is None:
+        yield
+        return
+    start = time.perf_counter()
+    try:
+        yield
+    finally:
+        timings[name] = timings.get(name, 0.0) + time.perf_counter() - start
 
-    if not down_id:
-        logger.error('Empty or invalid site ID')
-        raise NoSiteId('Empty or invalid site ID')
 
-    image = cv2.imdecode(np.frombuffer(image, np.uint8), cv2.IMREAD_COLOR)
+def analyze_image(image, yolo_model, timings: Optional[dict] = None) -> ImageAnalysis:
+    """
+    Runs YOLO and the per node OCR and builds the graph, everything that does not depend on the site down.
 
-    if image is None or image.size == 0:
-        logger.error('Invalid image')
-        raise InvalidImageException('Image is not valid')
+    Args:
+        image (FrameSource | np.ndarray): BGR image, or the detection frame of a reduced resolution decode
+        yolo_model (YOLO | pof_native.Detector): YOLO model, or the C++ detector
+        timings (dict): When given, receives the seconds spent in the yolo, ocr and graph stages, and in
+            decode the time spent waiting for the native resolution image
 
-    # Run YOLO model on the image
-    yolo_data = yolo_model.predict(source=image, save=False, conf=CONF_LEVEL, verbose=False, imgsz=IMGSZ,device=DEVICE)
-    result = yolo_data[0]
+    Returns:
+        ImageAnalysis: Node ids, centers and features (down_id flag left at 0) and the edge tensors
+    """
+    source = image if isinstance(image, FrameSource) else FrameSource(image)
+    # The OCR crops need native resolution; unless they can be decoded one by one, a reduced decode gets
+    # the whole image while the detector runs
+    source.prefetch()
+
+    native = pof_native is not None and isinstance(yolo_model, pof_native.Detector)
+    with stage(timings, 'yolo'):
+        if native:
+            # The array is read in place and the GIL is released while the network runs
+            detections = yolo_model.detect(source.frame)
+            cls_names = dict(enumerate(yolo_model.class_names))
+            cls_ids = detections['class_id'].tolist()
+        else:
+            # Run YOLO model on the image
+            yolo_data = yolo_model.predict(source=source.frame, save=False, conf=CONF_LEVEL, verbose=False, imgsz=IMGSZ,device=DEVICE)
+            result = yolo_data[0]
+            cls_names = result.names
+            cls_ids   = result.boxes.cls.int().cpu().tolist()
 
     # class-wise counts
-    cls_names = result.names
-    cls_ids   = result.boxes.cls.int().cpu().tolist()
     counts = {}
     for cid in cls_ids:
-        name = cls_names[cid]
+        name = cls_names.get(cid, str(cid))
         counts[name] = counts.get(name, 0) + 1
 
     count_str = ", ".join(f"{v} {k}" for k, v in counts.items())
@@ -160,15 +250,24 @@ def pof(image, down_id: str, yolo_model, gnn_model) -> Tuple[str, float]:
         f"Detections: {count_str}"
     )
     logger.info(log_line)
-    # Process results to extract nodes and edges
-    nodes, edges = utils.extract_data_from_YOLO(yolo_data, image)
+    with stage(timings, 'decode'):
+        native_image = source.native()
+
+    # Process results to extract nodes and edges, boxes scaled to native resolution
+    # Site ids are read per node here, which makes this the OCR stage
+    with stage(timings, 'ocr'):
+        if native:
+            nodes, edges = utils.extract_data_from_detections(detections, yolo_model.class_names, native_image, source.scale)
+        else:
+            nodes, edges = utils.extract_data_from_YOLO(yolo_data, native_image, source.scale)
     if len(nodes) == 0:
         logger.error('No nodes found in image or YOLO failed to process image')
         raise InvalidImageException('No nodes found in image')
 
     # Create graph tensors
-    node_data = utils.create_node_tensor(nodes, down_id)
-    edge_data = utils.create_edges_tensor(edges, node_data['node_centers'])
+    with stage(timings, 'graph'):
+        node_data = utils.create_node_tensor(nodes)
+        edge_data = utils.create_edges_tensor(edges, node_data['node_centers'])
 
     # Validate graph
     if len(node_data['node_ids']) == 0:
@@ -182,9 +281,58 @@ def pof(image, down_id: str, yolo_model, gnn_model) -> Tuple[str, float]:
     if edge_data['edge_index'].size(1) == 0:
         logger.warning('No valid edges detected in the graph, proceeding with isolated nodes.')
 
+    return ImageAnalysis(
+        node_ids=node_data['node_ids'],
+        node_centers=node_data['node_centers'],
+        x=node_data['x'],
+        edge_index=edge_data['edge_index'],
+        edge_attr=edge_data['edge_attr'],
+        detection_counts=counts
+    )
+
+
+def pof(image, down_id: str, yolo_model, gnn_model, cache: Optional[AnalysisCache] = None, timings: Optional[dict] = None) -> Tuple[str, float]:
+    """
+    Main function to process a network topology image and predict the point of failure.
+
+    Args:
+        image (bytes | np.ndarray): Encoded image, or a decoded BGR/BGRA frame
+        down_id (str): Site Id down to be processed
+        yolo_model (YOLO): YOLO model
+        gnn_model (GNN): GNN model
+        cache (AnalysisCache): When given, an image analysed before skips YOLO, OCR and graph
+            construction and only the down_id flag and the GNN are recomputed
+        timings (dict): When given, receives the seconds spent per stage: decode, yolo, ocr, graph, prior and gnn
+
+    Returns:
+        Tuple[str, float]: A tuple containing the predicted POF site ID and its probability.
+    """
+    # Check if image exists
+    if image is None:
+        logger.error('Invalid image')
+        raise InvalidImageException('Image invalid')
+
+    if not down_id:
+        logger.error('Empty or invalid site ID')
+        raise NoSiteId('Empty or invalid site ID')
+
+    # Oversized JPEGs are decoded at reduced resolution, native resolution only once OCR needs it
+    with stage(timings, 'decode'):
+        source = decode_frame(image, IMGSZ)
+
+    # A model the native detector swapped in since gets entries of its own; the old ones age out of the LRU
+    key = cache.key(source.frame, getattr(yolo_model, 'model_generation', 0)) if cache is not None else None
+    analysis = cache.get(key) if cache is not None else None
+    if analysis is None:
+        analysis = analyze_image(source, yolo_model, timings)
+        if cache is not None:
+            cache.put(key, analysis)
+    else:
+        logger.info(f'Analysis cache hit: {len(analysis.node_ids)} nodes, {analysis.edge_index.size(1)} edges')
+
     # Fuzzy matching for down_id
     matches = []
-    for id in node_data['node_ids']:
+    for id in analysis.node_ids:
         score = fuzz.ratio(down_id, id)
         if score >= FUZZY_PERCENTAGE:
             matches.append({'score': score, 'id': id})
@@ -200,12 +348,30 @@ def pof(image, down_id: str, yolo_model, gnn_model) -> Tuple[str, float]:
         logger.error(f'Site down with ID "{down_id}" closest match "{closest_match}" has low similarity ({match["score"]}%)')
         raise SiteIdNotFoundInImage(f'Site down with ID "{down_id}" closest match "{closest_match}" has low similarity ({match["score"]}%)')
 
+    # The cached features are shared between requests, only this request's copy gets its down_id flag
+    x = analysis.x.clone()
+    x[:, -1] = utils.down_id_flags(analysis.node_ids, down_id)
+
+    # A down site that hangs off exactly one failed node needs no model
+    structural = None
+    if GRAPH_PRIOR != 'off':
+        with stage(timings, 'prior'):
+            prior = graph_prior(analysis, analysis.node_ids.index(closest_match))
+        if prior is not None and prior.decisive:
+            structural = analysis.node_ids[next(c.node for c in prior.candidates if c.failed and c.separating)]
+            if GRAPH_PRIOR == 'answer':
+                logger.info(f'POF {structural} from the topology, the only failed node between {closest_match} and the core')
+                return structural, 1.0
+
     # Feed extracted nodes and edges to the GNN
-    with torch.no_grad():
-        pof_logits, has_pof_logit = gnn_model(node_data['x'], edge_data['edge_index'], edge_data['edge_attr'])
+    with stage(timings, 'gnn'), torch.no_grad():
+        pof_logits, has_pof_logit = gnn_model(x, analysis.edge_index, analysis.edge_attr)
 
     # Interpret predictions
-    return interpret_pof_predictions(pof_logits, has_pof_logit, node_data['node_ids'])
+    prediction = interpret_pof_predictions(pof_logits, has_pof_logit, analysis.node_ids)
+    if structural is not None and prediction[0] != structural:
+        logger.warning(f'GNN predicted {prediction[0]} ({prediction[1]:.2f}) but {structural} is the only failed node between {closest_match} and the core')
+    return prediction
 
 if __name__ == "__main__":
     sys.exit(0)
\ No newline at end of file
@@ -0,0 +1,246 @@
+"""
+End to end latency and accuracy regression harness for the POF pipeline.
+
+Replays a corpus of topology images through pof(), the same path /pof takes (decode, YOLO, OCR,
+graph construction, structural prior, GNN), at a fixed concurrency and reports latency percentiles,
+the per stage breakdown, throughput and accuracy. The corpus has the layout prep_data_from_images.py consumes:
+
+    <corpus>/images/<name>.png|jpg
+    <corpus>/pof/<name>.txt        line 1 "<label>: <down site id>", line 2 "<label>: <pof site id>"
+                                   (the pof site id may be empty, the labels are not read)
+
+With --baseline the run is compared against a stored result file and the process exits with 1 when
+p95 latency grows, or accuracy drops, past the tolerances. --write-baseline stores the run instead.
+
+Usage: python -m core.utils.pof_bench <corpus> [--concurrency N] [--repeat N] [--cache]
+                                      [--baseline FILE [--latency-tolerance 0.2] [--accuracy-tolerance 0.02]]
+                                      [--write-baseline FILE]
+"""
+import argparse
+import json
+import logging
+import statistics
+import sys
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+from dataclasses import dataclass, field, asdict
+from pathlib import Path
+from typing import Optional
+
+from fuzzywuzzy import fuzz
+
+from core.utils.analysis_cache import AnalysisCache
+from core.utils.pof import pof, prep_models
+
+logger = logging.getLogger(__name__)
+
+STAGES = ('decode', 'yolo', 'ocr', 'graph', 'prior', 'gnn')
+# prep_data_from_images.py matches labels to node ids at this similarity
+LABEL_MATCH = 80
+
+
+@dataclass
+class Case:
+    name: str
+    image: bytes
+    down_id: str
+    pof_id: Optional[str]
+
+
+@dataclass
+class Result:
+    name: str
+    latency: float
+    stages: dict = field(default_factory=dict)
+    prediction: Optional[str] = None
+    certainty: Optional[float] = None
+    error: Optional[str] = None
+    correct: Optional[bool] = None
+
+
+def label_value(line: str) -> Optional[str]:
+    line = line.strip()
+    return line.split(': ')[1].strip() or None if ': ' in line else None
+
+
+def load_corpus(corpus: Path) -> list[Case]:
+    images_dir, labels_dir = corpus / 'images', corpus / 'pof'
+    cases = []
+    for image_path in sorted(list(images_dir.glob('*.png')) + list(images_dir.glob('*.jpg'))):
+        label_path = labels_dir / f'{image_path.stem}.txt'
+        if not label_path.exists():
+            logger.warning(f'No label file for {image_path.name}, skipping')
+            continue
+        # Same layout prep_data_from_images.py reads: the down id on line 1, the pof id on line 2, each after ': '
+        lines = label_path.read_text().splitlines()
+        down_id, pof_id = (label_value(lines[i]) if len(lines) > i else None for i in (0, 1))
+        if not down_id:
+            logger.warning(f'No down id in {label_path.name}, skipping')
+            continue
+        # Encoded bytes, so decoding is part of the measured path as it is for /pof
+        cases.append(Case(image_path.stem, image_path.read_bytes(), down_id, pof_id))
+    return cases
+
+
+def is_correct(case: Case, prediction: Optional[str]) -> bool:
+    if case.pof_id is None:
+        return prediction == 'indeterminate'
+    return prediction is not None and fuzz.ratio(case.pof_id, prediction) >= LABEL_MATCH
+
+
+def percentile(values: list[float], q: float) -> float:
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, max(0, round(q / 100 * (len(ordered) - 1))))
+    return ordered[index]
+
+
+class Runner:
+    """Each worker thread loads its own models, ultralytics predictors are not safe to share between threads"""
+
+    def __init__(self, yolo_path: Path, gnn_path: Path, cache: Optional[AnalysisCache]):
+        self.yolo_path = yolo_path
+        self.gnn_path = gnn_path
+        self.cache = cache
+        self._local = threading.local()
+
+    def models(self):
+        if not hasattr(self._local, 'models'):
+            self._local.models = prep_models(self.yolo_path, self.gnn_path)
+        return self._local.models
+
+    def warm(self, cases: list[Case], barrier: threading.Barrier):
+        """
+        Loads this thread's models and runs cases on them, then holds the thread until every worker has
+        done the same, so each of the pool's threads gets exactly one warm-up
+        """
+        try:
+            self.models()
+            for case in cases:
+                self.run(case)
+        except BaseException:
+            barrier.abort()
+            raise
+        barrier.wait()
+
+    def run(self, case: Case) -> Result:
+        yolo_model, gnn_model = self.models()
+        timings = {}
+        start = time.perf_counter()
+        try:
+            prediction, certainty = pof(case.image, case.down_id, yolo_model, gnn_model, self.cache, timings)
+            result = Result(case.name, time.perf_counter() - start, timings, prediction, round(certainty, 4))
+        except Exception as e:
+            result = Result(case.name, time.perf_counter() - start, timings, error=f'{type(e).__name__}: {e}')
+        result.correct = is_correct(case, result.prediction)
+        return result
+
+
+def summarize(results: list[Result], wall: float) -> dict:
+    latencies = [r.latency for r in results]
+    stage_summary = {}
+    for name in STAGES:
+        values = [r.stages[name] for r in results if name in r.stages]
+        if values:
+            stage_summary[name] = {'mean_ms': statistics.fmean(values) * 1000, 'p95_ms': percentile(values, 95) * 1000}
+    return {
+        'runs': len(results),
+        'errors': sum(1 for r in results if r.error),
+        'accuracy': sum(1 for r in results if r.correct) / len(results) if results else 0.0,
+        'p50_ms': percentile(latencies, 50) * 1000,
+        'p95_ms': percentile(latencies, 95) * 1000,
+        'p99_ms': percentile(latencies, 99) * 1000,
+        'throughput': len(results) / wall if wall > 0 else 0.0,
+        'stages': stage_summary,
+    }
+
+
+def report(summary: dict, concurrency: int):
+    print(f"{summary['runs']} runs at concurrency {concurrency}, {summary['errors']} errors, accuracy {summary['accuracy'] * 100:.1f}%")
+    print(f"  latency  p50 {summary['p50_ms']:8.1f} ms   p95 {summary['p95_ms']:8.1f} ms   p99 {summary['p99_ms']:8.1f} ms")
+    print(f"  throughput {summary['throughput']:.2f} images/s")
+    for name, s in summary['stages'].items():
+        print(f"  {name:<7} mean {s['mean_ms']:8.1f} ms   p95 {s['p95_ms']:8.1f} ms")
+
+
+def compare(summary: dict, results: list[Result], baseline: dict, latency_tolerance: float, accuracy_tolerance: float) -> list[str]:
+    """Regressions against the baseline, an empty list when the run passes"""
+    failures = []
+    base = baseline['summary']
+    if base['p95_ms'] > 0 and summary['p95_ms'] > base['p95_ms'] * (1 + latency_tolerance):
+        failures.append(f"p95 latency {summary['p95_ms']:.1f} ms exceeds baseline {base['p95_ms']:.1f} ms by more than {latency_tolerance * 100:.0f}%")
+    if summary['accuracy'] < base['accuracy'] - accuracy_tolerance:
+        failures.append(f"accuracy {summary['accuracy'] * 100:.1f}% is below baseline {base['accuracy'] * 100:.1f}% by more than {accuracy_tolerance * 100:.1f} points")
+
+    # Reported, not failed on: a changed prediction only matters when it costs accuracy
+    expected = {r['name']: r['prediction'] for r in baseline['results']}
+    changed = sorted({r.name for r in results if r.name in expected and r.prediction != expected[r.name]})
+    if changed:
+        print(f"  {len(changed)} predictions differ from the baseline: {', '.join(changed[:10])}{' ...' if len(changed) > 10 else ''}")
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('corpus', type=Path)
+    parser.add_argument('--yolo', type=Path, default=Path.cwd() / 'models/YOLO/best.pt')
+    parser.add_argument('--gnn', type=Path, default=Path.cwd() / 'models/GNN/best.pt')
+    parser.add_argument('--concurrency', type=int, default=1)
+    parser.add_argument('--repeat', type=int, default=1, help='passes over the corpus')
+    parser.add_argument('--warmup', type=int, default=1, help='images run per worker before measuring')
+    parser.add_argument('--cache', action='store_true', help='run with the analysis cache, repeat passes then hit it')
+    parser.add_argument('--baseline', type=Path)
+    parser.add_argument('--latency-tolerance', type=float, default=0.2, help='allowed p95 growth, as a fraction')
+    parser.add_argument('--accuracy-tolerance', type=float, default=0.02, help='allowed accuracy drop, as a fraction')
+    parser.add_argument('--write-baseline', type=Path)
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.WARNING, format='[%(levelname)s]: %(message)s')
+    cases = load_corpus(args.corpus)
+    if not cases:
+        print(f'No labelled images in {args.corpus}')
+        return 2
+
+    runner = Runner(args.yolo, args.gnn, AnalysisCache(512 * 1024 * 1024) if args.cache else None)
+    with ThreadPoolExecutor(max_workers=args.concurrency) as pool:
+        # Loads the models and warms them up on every worker, outside the measurement
+        barrier = threading.Barrier(args.concurrency)
+        warmups = [pool.submit(runner.warm, [cases[(w * args.warmup + i) % len(cases)] for i in range(args.warmup)], barrier)
+                   for w in range(args.concurrency)]
+        for warmup in warmups:
+            warmup.result()
+        if runner.cache is not None:
+            runner.cache.clear()
+
+        start = time.perf_counter()
+        results = list(pool.map(runner.run, cases * args.repeat))
+        wall = time.perf_counter() - start
+
+    summary = summarize(results, wall)
+    report(summary, args.concurrency)
+    for r in results:
+        if r.error:
+            logger.warning(f'{r.name}: {r.error}')
+
+    if args.write_baseline:
+        args.write_baseline.write_text(json.dumps({
+            'concurrency': args.concurrency,
+            'summary': summary,
+            'results': [asdict(r) for r in results[:len(cases)]],
+        }, indent=2))
+        print(f'Baseline written to {args.write_baseline}')
+
+    if args.baseline:
+        failures = compare(summary, results, json.loads(args.baseline.read_text()), args.latency_tolerance, args.accuracy_tolerance)
+        for failure in failures:
+            print(f'REGRESSION: {failure}')
+        if failures:
+            return 1
+        print('No regression against the baseline')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -49,6 +49,24 @@ class Request(BaseModel):
             )
         return v
 
+class FrameRequest(BaseModel):
+    """A frame the C++ agents published to a shared memory ring instead of posting it as base64"""
+    site_id: str
+    order_id: str
+    ring: str
+    seq: int | None = None
+
+    @field_validator('site_id', 'order_id', 'ring', mode='after')
+    @classmethod
+    def validate_not_empty(cls, v: str, info) -> str:
+        if not v or not v.strip():
+            raise PydanticCustomError(
+                "empty_value",
+                "{field} must not be empty",
+                {"field": info.field_name}
+            )
+        return v
+
 class Response(BaseModel):
     site_id: str
     order_id: str
@@ -0,0 +1,276 @@
+"""
+Shared memory frame transport between the C++ agents and this service.
+
+The C++ FrameRing (cpp_module/helper/classes/FrameRing.hpp) publishes raw frames and their
+detections into fixed slots of a named shared memory segment. FrameRingReader maps those slots
+as NumPy arrays without copying. One producer writes, any number of readers follow, and the
+producer never waits for them: the oldest slot is overwritten, so a frame is only known to be
+intact if RingFrame.is_valid() still holds after it has been used (or use RingFrame.copy()).
+
+FrameRingWriter writes the same layout from Python, for tests and the transport benchmark.
+"""
+import logging
+import os
+import struct
+import time
+from dataclasses import dataclass
+from multiprocessing import shared_memory, resource_tracker
+from typing import Iterator, Optional
+
+import numpy as np
+
+logger = logging.getLogger(__name__)
+
+MAGIC = 0x52464F50  # "POFR"
+VERSION = 1
+HEADER_BYTES = 64
+SLOT_HEADER_BYTES = 64
+
+# RingHeader: magic, version, slot_count, max_detections, frame_capacity, slot_stride, frame_offset, write_seq
+_RING_HEADER = struct.Struct('<IIIIQQQQ')
+_WRITE_SEQ_OFFSET = 40
+# Random per producer, a restarted agent or a resized ring gets a new one
+_PRODUCER_ID = struct.Struct('<Q')
+_PRODUCER_ID_OFFSET = 48
+# SlotHeader: seq, timestamp_ns, width, height, channels, step, detection_count, source_id
+_SLOT_HEADER = struct.Struct('<QqIIIIII')
+
+DETECTION_DTYPE = np.dtype([
+    ('class_id', '<i4'),
+    ('confidence', '<f4'),
+    ('x', '<i4'),
+    ('y', '<i4'),
+    ('width', '<i4'),
+    ('height', '<i4'),
+])
+
+
+# Segments created by FrameRingWriter in this process, their tracker registration belongs to the writer
+_created = set()
+
+
+def _align(value: int, alignment: int) -> int:
+    return (value + alignment - 1) // alignment * alignment
+
+
+def _attach(name: str) -> shared_memory.SharedMemory:
+    """
+    Opens an existing segment without letting Python's resource tracker unlink it at exit,
+    the producer owns the segment's lifetime.
+    """
+    try:
+        return shared_memory.SharedMemory(name=name, create=False, track=False)
+    except TypeError:
+        # Python < 3.13 has no track argument and registers every attached segment
+        shm = shared_memory.SharedMemory(name=name, create=False)
+        if name not in _created:
+            try:
+                resource_tracker.unregister(shm._name, 'shared_memory')
+            except Exception:
+                pass
+        return shm
+
+
+@dataclass
+class RingFrame:
+    seq: int
+    timestamp_ns: int
+    source_id: int
+    image: np.ndarray       # height x width x channels uint8, a view into shared memory
+    detections: np.ndarray  # DETECTION_DTYPE records, a view into shared memory
+    _reader: Optional['FrameRingReader'] = None
+
+    def is_valid(self) -> bool:
+        """True while the producer has not started overwriting this frame's slot."""
+        if self._reader is None:
+            return True
+        return self._reader._slot_seq(self.seq) == self.seq
+
+    def copy(self) -> Optional['RingFrame']:
+        """Detached copy of the frame, or None if the slot was overwritten while copying."""
+        frame = RingFrame(self.seq, self.timestamp_ns, self.source_id, self.image.copy(), self.detections.copy())
+        return frame if self.is_valid() else None
+
+
+class FrameRingReader:
+    def __init__(self, name: str):
+        self.name = name
+        self.dropped = 0
+        self._shm = _attach(name)
+        buf = self._shm.buf
+        (magic, version, self.slot_count, self.max_detections,
+         self.frame_capacity, self.slot_stride, self.frame_offset, _) = _RING_HEADER.unpack_from(buf, 0)
+        if magic != MAGIC:
+            self.close()
+            raise ValueError(f'Shared memory segment "{name}" is not an initialised frame ring')
+        if version != VERSION:
+            self.close()
+            raise ValueError(f'Frame ring "{name}" has version {version}, expected {VERSION}')
+        self.producer_id, = _PRODUCER_ID.unpack_from(buf, _PRODUCER_ID_OFFSET)
+        # 8-byte aligned views so sequence numbers are read in a single load
+        self._write_seq = np.ndarray((1,), dtype='<u8', buffer=buf, offset=_WRITE_SEQ_OFFSET)
+        self._slot_seqs = np.ndarray((self.slot_count,), dtype='<u8', buffer=buf, offset=HEADER_BYTES,
+                                     strides=(self.slot_stride,))
+
+    def is_current(self) -> bool:
+        """
+        False once this mapping no longer is the ring published under the name: its producer retired
+        it, or a new one (an agent restart, a ring recreated for a larger monitor) replaced the segment.
+        Attaches by name to compare, so call it once per request rather than per frame.
+        """
+        if struct.unpack_from('<I', self._shm.buf, 0)[0] != MAGIC:
+            return False
+        try:
+            shm = _attach(self.name)
+        except FileNotFoundError:
+            return False
+        try:
+            magic, = struct.unpack_from('<I', shm.buf, 0)
+            producer_id, = _PRODUCER_ID.unpack_from(shm.buf, _PRODUCER_ID_OFFSET)
+        finally:
+            shm.close()
+        return magic == MAGIC and producer_id == self.producer_id
+
+    @property
+    def latest_seq(self) -> int:
+        """Sequence of the newest published frame, 0 before the first one."""
+        return int(self._write_seq[0])
+
+    @property
+    def oldest_seq(self) -> int:
+        """Oldest sequence that may still be in the ring."""
+        return max(1, self.latest_seq - self.slot_count + 1)
+
+    def _slot_offset(self, seq: int) -> int:
+        return HEADER_BYTES + ((seq - 1) % self.slot_count) * self.slot_stride
+
+    def _slot_seq(self, seq: int) -> int:
+        return int(self._slot_seqs[(seq - 1) % self.slot_count])
+
+    def read(self, seq: Optional[int] = None) -> Optional[RingFrame]:
+        """
+        Maps frame `seq` (the newest when omitted). Returns None when the frame has not been
+        published yet, has been overwritten, or is being written right now.
+        """
+        if seq is None:
+            seq = self.latest_seq
+        if seq <= 0 or seq > self.latest_seq or self._slot_seq(seq) != seq:
+            return None
+
+        offset = self._slot_offset(seq)
+        buf = self._shm.buf
+        (_, timestamp_ns, width, height, channels, step, detection_count,
+         source_id) = _SLOT_HEADER.unpack_from(buf, offset)
+        image = np.ndarray((height, width, channels), dtype=np.uint8, buffer=buf,
+                           offset=offset + self.frame_offset, strides=(step, channels, 1))
+        detections = np.ndarray((detection_count,), dtype=DETECTION_DTYPE, buffer=buf,
+                                offset=offset + SLOT_HEADER_BYTES)
+        frame = RingFrame(seq, timestamp_ns, source_id, image, detections, self)
+        # The header fields above must belong to the same frame
+        return frame if frame.is_valid() else None
+
+    def follow(self, poll_interval: float = 0.001, start_seq: Optional[int] = None) -> Iterator[RingFrame]:
+        """
+        Yields every frame from `start_seq` (the next one published when omitted) onwards. A reader
+        that falls more than a ring behind skips to the oldest frame still available and counts the
+        skipped frames in `dropped`.
+        """
+        next_seq = self.latest_seq + 1 if start_seq is None else start_seq
+        while True:
+            if next_seq > self.latest_seq:
+                time.sleep(poll_interval)
+                continue
+            if next_seq < self.oldest_seq:
+                self.dropped += self.oldest_seq - next_seq
+                next_seq = self.oldest_seq
+            frame = self.read(next_seq)
+            if frame is None:
+                # Overwritten between the checks, count it and move on
+                self.dropped += 1
+            else:
+                yield frame
+            next_seq += 1
+
+    def close(self):
+        """Frames handed out must be dropped first, NumPy views keep the mapping alive."""
+        self._write_seq = None
+        self._slot_seqs = None
+        try:
+            self._shm.close()
+        except BufferError:
+            logger.warning(f'Frame ring "{self.name}" still has live views, leaving it mapped')
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+class FrameRingWriter:
+    """Python producer for the same layout. The C++ agents use FrameRing instead."""
+
+    def __init__(self, name: str, slot_count: int, frame_capacity: int, max_detections: int = 256):
+        self.name = name
+        self.slot_count = slot_count
+        self.max_detections = max_detections
+        self.frame_capacity = frame_capacity
+        self.frame_offset = _align(SLOT_HEADER_BYTES + DETECTION_DTYPE.itemsize * max_detections, 64)
+        self.slot_stride = _align(self.frame_offset + frame_capacity, 4096)
+        size = HEADER_BYTES + self.slot_stride * slot_count
+        self._shm = shared_memory.SharedMemory(name=name, create=True, size=size)
+        _created.add(name)
+        buf = self._shm.buf
+        buf[:HEADER_BYTES] = bytes(HEADER_BYTES)
+        for i in range(slot_count):
+            start = HEADER_BYTES + i * self.slot_stride
+            buf[start:start + SLOT_HEADER_BYTES] = bytes(SLOT_HEADER_BYTES)
+        self._write_seq = 0
+        self.producer_id = int.from_bytes(os.urandom(8), 'little') | 1
+        # Magic goes in last so readers never see a half initialised header
+        _RING_HEADER.pack_into(buf, 0, 0, VERSION, slot_count, max_detections, frame_capacity,
+                               self.slot_stride, self.frame_offset, 0)
+        _PRODUCER_ID.pack_into(buf, _PRODUCER_ID_OFFSET, self.producer_id)
+        struct.pack_into('<I', buf, 0, MAGIC)
+
+    def publish(self, image: np.ndarray, detections: Optional[np.ndarray] = None, source_id: int = 0) -> int:
+        if image.dtype != np.uint8:
+            raise ValueError('Frame ring only carries uint8 frames')
+        if image.ndim == 2:
+            image = image[:, :, None]
+        height, width, channels = image.shape
+        if image.nbytes > self.frame_capacity:
+            raise ValueError(f'Frame of {image.nbytes} bytes exceeds the slot capacity of {self.frame_capacity} bytes')
+        if detections is None:
+            detections = np.zeros((0,), dtype=DETECTION_DTYPE)
+        detections = detections[:self.max_detections]
+
+        seq = self._write_seq + 1
+        offset = HEADER_BYTES + ((seq - 1) % self.slot_count) * self.slot_stride
+        buf = self._shm.buf
+        struct.pack_into('<Q', buf, offset, 0)
+
+        target = np.ndarray((height, width, channels), dtype=np.uint8, buffer=buf, offset=offset + self.frame_offset)
+        target[...] = image
+        packed = np.ndarray((len(detections),), dtype=DETECTION_DTYPE, buffer=buf, offset=offset + SLOT_HEADER_BYTES)
+        packed[...] = detections
+        del target, packed
+
+        _SLOT_HEADER.pack_into(buf, offset, 0, time.time_ns(), width, height, channels, width * channels,
+                               len(detections), source_id)
+        struct.pack_into('<Q', buf, offset, seq)
+        struct.pack_into('<Q', buf, _WRITE_SEQ_OFFSET, seq)
+        self._write_seq = seq
+        return seq
+
+    def close(self):
+        struct.pack_into('<I', self._shm.buf, 0, 0)
+        self._shm.close()
+        self._shm.unlink()
+        _created.discard(self.name)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
@@ -0,0 +1,97 @@
+"""
+Compares the cost of moving one screen frame from a capture agent into the POF service:
+
+    post: BGRA->BGR, PNG encode, base64, JSON body, then on the service side JSON parse,
+          base64 validation in the schema, base64 decode and PNG decode
+    ring: publish into the shared memory ring, then map it and convert to BGR (what /pof/frame does)
+
+The HTTP round trip itself is not included, so the post numbers are a lower bound.
+
+Usage: python -m core.utils.transport_bench [--iterations N] [--sizes 1280x720 1920x1080 ...]
+"""
+import argparse
+import base64
+import json
+import os
+import statistics
+import time
+
+import cv2
+import numpy as np
+
+from core.utils.shm_ring import FrameRingWriter, FrameRingReader
+
+
+def synthetic_screen(width: int, height: int) -> np.ndarray:
+    """Diagram-like BGRA frame: flat background, boxes, links and labels compress like real screenshots."""
+    rng = np.random.default_rng(0)
+    frame = np.full((height, width, 4), 245, np.uint8)
+    for i in range(200):
+        x, y = int(rng.integers(0, width - 80)), int(rng.integers(0, height - 40))
+        color = tuple(int(c) for c in rng.integers(0, 255, 3)) + (255,)
+        cv2.rectangle(frame, (x, y), (x + 70, y + 30), color, -1)
+        cv2.putText(frame, f'SITE{i:04d}', (x + 2, y + 20), cv2.FONT_HERSHEY_SIMPLEX, 0.4, (0, 0, 0, 255), 1)
+        x2, y2 = int(rng.integers(0, width)), int(rng.integers(0, height))
+        cv2.line(frame, (x + 35, y + 15), (x2, y2), (60, 60, 60, 255), 1)
+    return frame
+
+
+def time_post(frame: np.ndarray) -> tuple[float, float]:
+    start = time.perf_counter()
+    bgr = cv2.cvtColor(frame, cv2.COLOR_BGRA2BGR)
+    ok, png = cv2.imencode('.png', bgr)
+    body = json.dumps({'site_id': 'SITE0001', 'order_id': '1', 'image_base64': base64.b64encode(png).decode('ascii')})
+    produced = time.perf_counter()
+
+    payload = json.loads(body)
+    base64.b64decode(payload['image_base64'], validate=True)
+    image_bytes = base64.b64decode(payload['image_base64'])
+    image = cv2.imdecode(np.frombuffer(image_bytes, np.uint8), cv2.IMREAD_COLOR)
+    consumed = time.perf_counter()
+    assert ok and image is not None
+    return produced - start, consumed - produced
+
+
+def time_ring(writer: FrameRingWriter, reader: FrameRingReader, frame: np.ndarray) -> tuple[float, float]:
+    start = time.perf_counter()
+    seq = writer.publish(frame)
+    produced = time.perf_counter()
+
+    ring_frame = reader.read(seq)
+    image = cv2.cvtColor(ring_frame.image, cv2.COLOR_BGRA2BGR)
+    valid = ring_frame.is_valid()
+    consumed = time.perf_counter()
+    del ring_frame
+    assert valid and image is not None
+    return produced - start, consumed - produced
+
+
+def report(name: str, samples: list[tuple[float, float]]):
+    produce = statistics.median(s[0] for s in samples) * 1000
+    consume = statistics.median(s[1] for s in samples) * 1000
+    print(f'  {name:<5} produce {produce:8.2f} ms   consume {consume:8.2f} ms   total {produce + consume:8.2f} ms')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--iterations', type=int, default=20)
+    parser.add_argument('--sizes', nargs='+', default=['1280x720', '1920x1080', '3840x2160'])
+    args = parser.parse_args()
+
+    for size in args.sizes:
+        width, height = (int(v) for v in size.split('x'))
+        frame = synthetic_screen(width, height)
+        ring_name = f'pof_transport_bench_{os.getpid()}'
+        with FrameRingWriter(ring_name, 4, frame.nbytes, 0) as writer:
+            reader = FrameRingReader(ring_name)
+            post = [time_post(frame) for _ in range(args.iterations)]
+            ring = [time_ring(writer, reader, frame) for _ in range(args.iterations)]
+            reader.close()
+
+        print(f'{width}x{height} BGRA, median of {args.iterations}')
+        report('post', post)
+        report('ring', ring)
+
+
+if __name__ == '__main__':
+    main()
@@ -5,5 +5,6 @@ from pathlib import Path
 model_path = Path.cwd().parents[1] / 'models' / 'YOLO' / 'best.pt'
 model = YOLO(model_path)
     
-# Export the model to ONNX format
-model.export(format='onnx')
+# Export the model to ONNX format at the service's input size (IMGSZ in core/utils/pof.py),
+# OpenCV runs the fixed-size graph only at the size it was exported for
+model.export(format='onnx', imgsz=1280)